@@ -11,9 +11,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "buffer/buffer_pool_manager_instance.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "common/logger.h"
@@ -54,31 +57,183 @@ BufferPoolManagerInstance::~BufferPoolManagerInstance() {
   delete replacer_;
 }
 
+/*
+ * The log is forced without the latch. The page may be evicted meanwhile, which writes it back as well.
+ */
 bool BufferPoolManagerInstance::FlushPgImp(page_id_t page_id) {
   // Make sure you call DiskManager::WritePage!
-  lock_guard lock{latch_};
+  std::unique_lock lock{latch_};
   auto itr = page_table_.find(page_id);
   if (itr == page_table_.end()) {
     return false;
   }
+  lsn_t lsn = UnpersistedLSN(&pages_[itr->second]);
+  if (lsn != INVALID_LSN) {
+    lock.unlock();
+    log_manager_->WaitUntilPersistent(lsn);
+    lock.lock();
+    log_forced_flushes_++;
+    itr = page_table_.find(page_id);
+    if (itr == page_table_.end()) {
+      return true;
+    }
+  }
   frame_id_t frame = itr->second;
   auto page = &pages_[frame];
   // assert valid
   assert(page->GetPageId() != INVALID_PAGE_ID);
 
-  disk_manager_->WritePage(page->GetPageId(), page->GetData());
+  // Only forces the log if the page changed again while we waited.
+  if (ForceLog(page)) {
+    log_forced_flushes_++;
+  }
+  if (!disk_manager_->WritePage(page->GetPageId(), page->GetData())) {
+    // It stays dirty, and a checkpoint keeps its recLSN.
+    return false;
+  }
+  page->is_dirty_ = false;
+  if (page->GetPinCount() == 0) {
+    // Nobody can be changing the page, so the disk copy is current. A pinned page keeps its recLSN.
+    page->rec_lsn_ = INVALID_LSN;
+  }
 
   return true;
 }
 
+/*
+ * The log is forced once, without the latch, up to the newest page LSN. Pages that change meanwhile are forced under
+ * the latch. If the batch fails, part of it may have been written already, but every page stays dirty.
+ */
 void BufferPoolManagerInstance::FlushAllPgsImp() {
   // You can do it!
-  lock_guard lock{latch_};
+  std::unique_lock lock{latch_};
+  lsn_t max_lsn = INVALID_LSN;
+  for (size_t i = 0; i < pool_size_; i++) {
+    if (pages_[i].GetPageId() != INVALID_PAGE_ID) {
+      max_lsn = std::max(max_lsn, UnpersistedLSN(&pages_[i]));
+    }
+  }
+  if (max_lsn != INVALID_LSN) {
+    lock.unlock();
+    log_manager_->WaitUntilPersistent(max_lsn);
+    lock.lock();
+    log_forced_flushes_++;
+  }
+  // One batch, so a double-write buffer is only synced once per DOUBLE_WRITE_BATCH_PAGES pages.
+  std::vector<std::pair<page_id_t, const char *>> batch;
   for (int i = 0; i < static_cast<int>(pool_size_); i++) {
     auto page = &pages_[i];
     if (page->GetPageId() != INVALID_PAGE_ID) {
-      disk_manager_->WritePage(page->GetPageId(), page->GetData());
+      if (ForceLog(page)) {
+        log_forced_flushes_++;
+      }
+      batch.emplace_back(page->GetPageId(), page->GetData());
+    }
+  }
+  if (!disk_manager_->WritePages(batch)) {
+    return;
+  }
+  for (size_t i = 0; i < pool_size_; i++) {
+    auto page = &pages_[i];
+    if (page->GetPageId() != INVALID_PAGE_ID) {
+      page->is_dirty_ = false;
+      if (page->GetPinCount() == 0) {
+        page->rec_lsn_ = INVALID_LSN;
+      }
+    }
+  }
+}
+
+void BufferPoolManagerInstance::GetDirtyPageTableImp(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) {
+  lock_guard lock{latch_};
+  for (size_t i = 0; i < pool_size_; i++) {
+    auto page = &pages_[i];
+    // Pinned pages count even when they are clean, their holders may be changing them right now.
+    if (page->GetPageId() != INVALID_PAGE_ID && page->rec_lsn_ != INVALID_LSN) {
+      (*dirty_page_table)[page->GetPageId()] = page->rec_lsn_;
+    }
+  }
+}
+
+bool BufferPoolManagerInstance::PickVictim(frame_id_t *frame_id) {
+  if (log_manager_ == nullptr || !enable_logging) {
+    return replacer_->Victim(frame_id);
+  }
+  return replacer_->VictimPreferring(
+      frame_id,
+      [&](frame_id_t frame) { return !pages_[frame].IsDirty() || UnpersistedLSN(&pages_[frame]) == INVALID_LSN; },
+      VICTIM_CANDIDATES);
+}
+
+/*
+ * While the log is forced, the victim stays pinned so that nobody else evicts it. If it was fetched again meanwhile, or
+ * changed again after that, another victim is picked. A victim that cannot be written goes back to the replacer, and
+ * no other is tried: they would most likely fail the same way.
+ */
+bool BufferPoolManagerInstance::EvictVictim(std::unique_lock<std::mutex> *lock, frame_id_t *frame_id) {
+  while (PickVictim(frame_id)) {
+    Page *page = &pages_[*frame_id];
+    lsn_t lsn = page->IsDirty() ? UnpersistedLSN(page) : INVALID_LSN;
+    if (lsn != INVALID_LSN) {
+      page->pin_count_++;
+      lock->unlock();
+      log_manager_->WaitUntilPersistent(lsn);
+      lock->lock();
+      log_forced_evictions_++;
+      page->pin_count_--;
+      if (page->GetPinCount() > 0) {
+        // Its new holders hand it back to the replacer when they unpin it.
+        continue;
+      }
+      if (page->IsDirty() && UnpersistedLSN(page) != INVALID_LSN) {
+        replacer_->Unpin(*frame_id);
+        continue;
+      }
+    }
+    if (page->IsDirty()) {
+      ForceLog(page);
+      if (!disk_manager_->WritePage(page->GetPageId(), page->GetData())) {
+        replacer_->Unpin(*frame_id);
+        return false;
+      }
     }
+    page_table_.erase(page->GetPageId());
+    return true;
+  }
+  return false;
+}
+
+bool BufferPoolManagerInstance::ForceLog(Page *page) {
+  lsn_t lsn = UnpersistedLSN(page);
+  if (lsn == INVALID_LSN) {
+    return false;
+  }
+  log_manager_->WaitUntilPersistent(lsn);
+  return true;
+}
+
+/*
+ * The header page keeps no LSN, the bytes where other pages keep theirs belong to its first record. It is written back
+ * after everything logged so far instead.
+ *
+ * Recovery and a standby redo pages from log that was read from disk, before the log manager is told where that log
+ * ends. An LSN the log manager has not handed out yet is such a page's, and is persistent already.
+ */
+lsn_t BufferPoolManagerInstance::UnpersistedLSN(Page *page) {
+  if (log_manager_ == nullptr || !enable_logging) {
+    return INVALID_LSN;
+  }
+  lsn_t next_lsn = log_manager_->GetNextLSN();
+  lsn_t page_lsn = page->GetPageId() == HEADER_PAGE_ID ? next_lsn - 1 : page->GetLSN();
+  if (page_lsn >= next_lsn || page_lsn <= log_manager_->GetPersistentLSN()) {
+    return INVALID_LSN;
+  }
+  return page_lsn;
+}
+
+void BufferPoolManagerInstance::TrackRecLSN(Page *page) {
+  if (log_manager_ != nullptr && page->rec_lsn_ == INVALID_LSN) {
+    page->rec_lsn_ = log_manager_->GetNextLSN();
   }
 }
 
@@ -91,7 +246,7 @@ Page *BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) {
 
   // find page in free list
   assert(page_table_.size() <= pool_size_);
-  lock_guard lock{latch_};
+  std::unique_lock lock{latch_};
   if (!free_list_.empty()) {
     frame_id_t frame = free_list_.back();
     Page *free_page = &pages_[frame];
@@ -100,25 +255,23 @@ Page *BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) {
     free_page->page_id_ = *page_id;
     free_page->pin_count_ = 1;
     free_page->is_dirty_ = false;
+    free_page->rec_lsn_ = INVALID_LSN;
+    TrackRecLSN(free_page);
 
     memset(free_page->data_, 0, PAGE_SIZE);
     page_table_[*page_id] = frame;
     return free_page;
   }
   // find from lru
-  if (replacer_->Size() > 0) {
-    frame_id_t frame;
-    replacer_->Victim(&frame);  // assert not false
+  frame_id_t frame;
+  if (EvictVictim(&lock, &frame)) {
     Page *free_page = &pages_[frame];
-    LOG_INFO("evict page:%d", free_page->GetPageId());
-    page_table_.erase(free_page->GetPageId());
-    if (free_page->IsDirty()) {
-      disk_manager_->WritePage(free_page->GetPageId(), free_page->GetData());
-    }
     *page_id = AllocatePage();
     free_page->page_id_ = *page_id;
     free_page->pin_count_ = 1;
     free_page->is_dirty_ = false;
+    free_page->rec_lsn_ = INVALID_LSN;
+    TrackRecLSN(free_page);
 
     memset(free_page->data_, 0, PAGE_SIZE);
     page_table_[*page_id] = frame;
@@ -137,7 +290,7 @@ Page *BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) {
   // 3.     Delete R from the page table and insert P.
   // 4.     Update P's metadata, read in the page content from disk, and then return a pointer to P.
 
-  lock_guard lock{latch_};
+  std::unique_lock lock{latch_};
   assert(page_table_.size() <= pool_size_);
   // search in free list
   auto itr = page_table_.find(page_id);
@@ -145,6 +298,7 @@ Page *BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) {
     frame_id_t frame = itr->second;
     replacer_->Pin(frame);
     pages_[frame].pin_count_++;
+    TrackRecLSN(&pages_[frame]);
     return &pages_[frame];
   }
   // find from free list
@@ -155,25 +309,35 @@ Page *BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) {
     free_page->page_id_ = page_id;
     free_page->pin_count_ = 1;  // TODO(wind):
     free_page->is_dirty_ = false;
+    free_page->rec_lsn_ = INVALID_LSN;
+    TrackRecLSN(free_page);
     page_table_[page_id] = frame;
     disk_manager_->ReadPage(page_id, free_page->GetData());
     return free_page;
   }
   // find from replacer
-  if (replacer_->Size() > 0) {
-    frame_id_t frame;
-    replacer_->Victim(&frame);  // assert not false
+  frame_id_t frame;
+  if (EvictVictim(&lock, &frame)) {
+    // The page may have been read in by someone else while the latch was released for a log force.
     Page *free_page = &pages_[frame];
-    // check dirty
-    page_table_.erase(free_page->GetPageId());
-    if (free_page->IsDirty()) {
-      disk_manager_->WritePage(free_page->GetPageId(), free_page->GetData());
+    itr = page_table_.find(page_id);
+    if (itr != page_table_.end()) {
+      free_page->page_id_ = INVALID_PAGE_ID;
+      free_page->is_dirty_ = false;
+      free_page->rec_lsn_ = INVALID_LSN;
+      free_list_.push_back(frame);
+      replacer_->Pin(itr->second);
+      pages_[itr->second].pin_count_++;
+      TrackRecLSN(&pages_[itr->second]);
+      return &pages_[itr->second];
     }
 
     // change data for new page
     free_page->page_id_ = page_id;
     free_page->pin_count_ = 1;  // TODO(wind):
     free_page->is_dirty_ = false;
+    free_page->rec_lsn_ = INVALID_LSN;
+    TrackRecLSN(free_page);
     disk_manager_->ReadPage(page_id, free_page->GetData());
     page_table_[page_id] = frame;
     return free_page;
@@ -207,8 +371,11 @@ bool BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) {
   page->page_id_ = INVALID_PAGE_ID;
   page->pin_count_ = 0;
   page->is_dirty_ = false;
+  page->rec_lsn_ = INVALID_LSN;
+  // The frame goes back to the free list only, the replacer must not hand it out as well.
+  replacer_->Pin(frame_id);
   free_list_.emplace_front(frame_id);
-  return false;
+  return true;
 }
 
 bool BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) {
@@ -229,6 +396,10 @@ bool BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) {
   page->pin_count_--;
   if (page->GetPinCount() == 0) {
     replacer_->Unpin(itr->second);
+    if (!page->IsDirty()) {
+      // Nothing was changed while the page was pinned, the disk copy is still current.
+      page->rec_lsn_ = INVALID_LSN;
+    }
   }
 
   return true;
@@ -32,6 +32,30 @@ bool LRUReplacer::Victim(frame_id_t *frame_id) {
   return true;
 }
 
+bool LRUReplacer::VictimPreferring(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &cheap,
+                                   size_t max_candidates) {
+  lock_guard lock{lock_};
+  if (lru_.empty()) {
+    return false;
+  }
+  // walk from the least recently used end, take the first cheap frame or else the least recently used one
+  auto victim = std::prev(lru_.end());
+  auto itr = victim;
+  for (size_t i = 0; i < max_candidates; i++) {
+    if (cheap(*itr)) {
+      victim = itr;
+      break;
+    }
+    if (itr == lru_.begin()) {
+      break;
+    }
+    --itr;
+  }
+  *frame_id = *victim;
+  lru_.erase(victim);
+  return true;
+}
+
 void LRUReplacer::Pin(frame_id_t frame_id) {
   lock_guard lock{lock_};
   lru_.remove(frame_id);
@@ -105,4 +105,11 @@ void ParallelBufferPoolManager::FlushAllPgsImp() {
   }
 }
 
+void ParallelBufferPoolManager::GetDirtyPageTableImp(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) {
+  // every instance owns a disjoint set of page ids, so the tables simply merge
+  for (auto &ptr : managers_) {
+    ptr->GetDirtyPageTable(dirty_page_table);
+  }
+}
+
 }  // namespace bustub
@@ -0,0 +1,130 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager.cpp
+//
+// Identification: src/common/epoch_manager.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/epoch_manager.h"
+
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace bustub {
+
+/** How many guards the thread holds, of any manager. A thread inside a guard never waits for the epoch to move on. */
+static thread_local int guard_depth = 0;
+
+EpochGuard::EpochGuard(EpochManager *epoch_manager) : epoch_manager_(epoch_manager), slot_(epoch_manager->Enter()) {
+  guard_depth++;
+}
+
+EpochGuard::~EpochGuard() {
+  guard_depth--;
+  epoch_manager_->Exit(slot_);
+}
+
+EpochManager::EpochManager(size_t num_slots, size_t garbage_threshold)
+    : num_slots_(num_slots), slots_(new EpochSlot[num_slots]), garbage_threshold_(garbage_threshold) {
+  BUSTUB_ASSERT(num_slots > 0, "An epoch manager needs at least one slot.");
+}
+
+EpochManager::~EpochManager() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    BUSTUB_ASSERT(slots_[i].epoch_ == 0, "No guard may outlive its epoch manager.");
+  }
+  for (const Retired &retired : garbage_) {
+    retired.deleter_(retired.object_);
+  }
+}
+
+/*
+ * The epoch is read before the slot is taken, so the global epoch may have moved on meanwhile. Publishing an older
+ * epoch is harmless: whatever was retired before we published was unlinked before, the guard cannot find it, and an
+ * older epoch in a slot holds back the global one all the same.
+ */
+size_t EpochManager::Enter() {
+  // Threads mostly find the slot they had last time free, and do not touch the cache lines of the others.
+  static thread_local size_t slot_hint = 0;
+  size_t slot = slot_hint % num_slots_;
+  while (true) {
+    for (size_t i = 0; i < num_slots_; i++) {
+      uint64_t free = 0;
+      if (slots_[slot].epoch_.compare_exchange_strong(free, global_epoch_)) {
+        slot_hint = slot;
+        return slot;
+      }
+      slot = (slot + 1) % num_slots_;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void EpochManager::Exit(size_t slot) { slots_[slot].epoch_ = 0; }
+
+bool EpochManager::TryAdvance() {
+  uint64_t epoch = global_epoch_;
+  for (size_t i = 0; i < num_slots_; i++) {
+    uint64_t slot_epoch = slots_[i].epoch_;
+    if (slot_epoch != 0 && slot_epoch != epoch) {
+      return false;
+    }
+  }
+  return global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void EpochManager::Retire(void *object, void (*deleter)(void *)) {
+  size_t garbage_count;
+  {
+    // Reading the epoch under the latch keeps garbage_ in epoch order.
+    std::scoped_lock lock(garbage_latch_);
+    garbage_.push_back(Retired{global_epoch_, object, deleter});
+    garbage_count = garbage_.size();
+  }
+  if (garbage_count <= garbage_threshold_) {
+    return;
+  }
+  Reclaim();
+  // A reader that is not scheduled holds the epoch back for as long as it likes. Past twice the threshold, retiring
+  // threads outside a guard wait for it, which bounds the garbage.
+  while (guard_depth == 0 && GetGarbageCount() > 2 * garbage_threshold_) {
+    std::this_thread::yield();
+    Reclaim();
+  }
+}
+
+/*
+ * An object retired in epoch e may be held by readers that were in e when it was unlinked. The global epoch moves on
+ * to e + 1 while they are still there, but to e + 2 only once all of them left. Deleters run without the latch, they
+ * may retire objects of their own.
+ */
+size_t EpochManager::Reclaim() {
+  if (TryAdvance()) {
+    TryAdvance();
+  }
+  uint64_t epoch = global_epoch_;
+  std::vector<Retired> freeable;
+  {
+    std::scoped_lock lock(garbage_latch_);
+    while (!garbage_.empty() && garbage_.front().epoch_ + 2 <= epoch) {
+      freeable.push_back(garbage_.front());
+      garbage_.pop_front();
+    }
+  }
+  for (const Retired &retired : freeable) {
+    retired.deleter_(retired.object_);
+  }
+  return freeable.size();
+}
+
+size_t EpochManager::GetGarbageCount() {
+  std::scoped_lock lock(garbage_latch_);
+  return garbage_.size();
+}
+
+}  // namespace bustub
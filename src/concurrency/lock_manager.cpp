@@ -14,65 +14,775 @@
 
 #include <algorithm>
 #include <memory>
-#include <mutex>
-#include <utility>
-#include <vector>
-#include "concurrency/transaction.h"
+
+#include "concurrency/transaction_manager.h"
 
 namespace bustub {
 
+LockManager::LockManager(DeadlockMode deadlock_mode, size_t num_shards)
+    : lock_table_(num_shards), deadlock_mode_(deadlock_mode) {
+  if (deadlock_mode_ == DeadlockMode::DETECTION) {
+    enable_cycle_detection_ = true;
+    cycle_detection_thread_ = new std::thread(&LockManager::RunCycleDetection, this);
+  }
+}
+
+LockManager::~LockManager() {
+  if (cycle_detection_thread_ != nullptr) {
+    {
+      std::scoped_lock lock(cycle_detection_latch_);
+      enable_cycle_detection_ = false;
+    }
+    cycle_detection_cv_.notify_one();
+    cycle_detection_thread_->join();
+    delete cycle_detection_thread_;
+  }
+}
+
 bool LockManager::LockShared(Transaction *txn, const RID &rid) {
-  // verify valid
-  if (txn->GetState() == TransactionState::ABORTED || txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED ||
-      txn->IsSharedLocked(rid)) {
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  // READ_UNCOMMITTED never takes shared locks, read-only transactions no locks at all, and nobody locks after
+  // unlocking under 2PL.
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED || txn->IsReadOnly() ||
+      txn->GetState() == TransactionState::SHRINKING) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
-  auto &lque = lock_table_[rid];
-
-  // for that other thread may change the request list,we use iter here
-
-  auto iter = lque.request_queue_.begin();
-
-  while (iter != lque.request_queue_.end()) {
+  if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid)) {
+    return true;
   }
 
+  std::unique_lock<std::mutex> lock;
+  auto queue = LatchQueue(rid, true, &lock);
+  auto request = queue->request_queue_.emplace(queue->request_queue_.end(), txn->GetTransactionId(), LockMode::SHARED);
+  if (!Acquire(txn, queue.get(), request, &lock)) {
+    lock.unlock();
+    RemoveQueueIfEmpty(rid, queue);
+    return false;
+  }
+  txn->GetSharedLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::LockExclusive(Transaction *txn, const RID &rid) {
-  std::unique_lock lock{latch_};
-  txn->GetExclusiveLockSet()->emplace(rid);
-  auto &lque = lock_table_[rid];
   if (txn->GetState() == TransactionState::ABORTED) {
     return false;
   }
-  if (lock_table_.count(rid) == 0) {
-    lock_table_[rid].request_queue_.emplace_back(txn->GetTransactionId(), LockMode::EXCLUSIVE, true);
-  } else {
-    auto &que = lock_table_[rid].request_queue_;
-
-    bool has_lock = std::any_of(que.begin(), que.end(), [](const LockRequest &req) -> bool { return req.granted_; });
-    if (has_lock) {
-      lock_table_[rid].cv_.wait(lock);
-      // get lock now
-      lock_table_[rid].request_queue_.emplace_back(txn->GetTransactionId(), LockMode::EXCLUSIVE, true);
-    }
+  if (txn->GetState() == TransactionState::SHRINKING || txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (txn->IsSharedLocked(rid)) {
+    return LockUpgrade(txn, rid);
   }
 
+  std::unique_lock<std::mutex> lock;
+  auto queue = LatchQueue(rid, true, &lock);
+  auto request =
+      queue->request_queue_.emplace(queue->request_queue_.end(), txn->GetTransactionId(), LockMode::EXCLUSIVE);
+  if (!Acquire(txn, queue.get(), request, &lock)) {
+    lock.unlock();
+    RemoveQueueIfEmpty(rid, queue);
+    return false;
+  }
+  txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::LockUpgrade(Transaction *txn, const RID &rid) {
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING || txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock;
+  auto queue = LatchQueue(rid, false, &lock);
+  if (queue == nullptr) {
+    return false;
+  }
+  // Two transactions waiting to upgrade would wait for each other.
+  if (queue->upgrading_ != INVALID_TXN_ID) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  bool granted = Upgrade(txn, queue.get(), LockMode::EXCLUSIVE, &lock);
   txn->GetSharedLockSet()->erase(rid);
+  if (!granted) {
+    lock.unlock();
+    RemoveQueueIfEmpty(rid, queue);
+    return false;
+  }
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
+/*
+ * Under READ_COMMITTED shared locks are released early, which does not end the growing phase.
+ */
 bool LockManager::Unlock(Transaction *txn, const RID &rid) {
+  LockMode mode;
+  if (!ReleaseRow(txn, rid, &mode)) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::GROWING &&
+      !(mode == LockMode::SHARED && txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED)) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::UnlockInstant(Transaction *txn, const RID &rid) {
+  LockMode mode;
+  return ReleaseRow(txn, rid, &mode);
+}
+
+/*
+ * The table lock covers the rows before their locks go away, so no other transaction can get in between. Escalation
+ * trades concurrency for the memory and the lock manager work of many row locks.
+ */
+bool LockManager::EscalateTableLock(Transaction *txn, table_oid_t oid, const std::vector<RID> &rows) {
+  bool write = std::any_of(rows.begin(), rows.end(), [txn](const RID &rid) { return txn->IsExclusiveLocked(rid); });
+  if (!LockTable(txn, write ? LockMode::EXCLUSIVE : LockMode::SHARED, oid)) {
+    return false;
+  }
+  LockMode mode;
+  for (const RID &rid : rows) {
+    ReleaseRow(txn, rid, &mode);
+  }
+  return true;
+}
+
+bool LockManager::LockTable(Transaction *txn, LockMode mode, table_oid_t oid) {
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  LockMode held;
+  bool holds = GetTableLockMode(txn, oid, &held);
+  if (holds && Covers(held, mode)) {
+    return true;
+  }
+  LockMode target = holds ? Combine(held, mode) : mode;
+  if (txn->GetState() == TransactionState::SHRINKING || txn->IsReadOnly() ||
+      (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED && target != LockMode::INTENTION_EXCLUSIVE &&
+       target != LockMode::EXCLUSIVE)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock;
+  LockRequestQueue *queue = LatchTableQueue(oid, &lock);
+  bool granted;
+  if (holds) {
+    if (queue->upgrading_ != INVALID_TXN_ID) {
+      txn->SetState(TransactionState::ABORTED);
+      return false;
+    }
+    granted = Upgrade(txn, queue, target, &lock);
+    TableLockSet(txn, held)->erase(oid);
+  } else {
+    auto request = queue->request_queue_.emplace(queue->request_queue_.end(), txn->GetTransactionId(), target);
+    granted = Acquire(txn, queue, request, &lock);
+  }
+  if (granted) {
+    TableLockSet(txn, target)->emplace(oid);
+  }
+  return granted;
+}
+
+bool LockManager::UnlockTable(Transaction *txn, table_oid_t oid) {
+  LockMode mode;
+  if (!GetTableLockMode(txn, oid, &mode)) {
+    return false;
+  }
+  TableLockSet(txn, mode)->erase(oid);
+  std::unique_lock<std::mutex> lock;
+  LockRequestQueue *queue = LatchTableQueue(oid, &lock);
+  auto &requests = queue->request_queue_;
+  auto request = std::find_if(requests.begin(), requests.end(), [txn](const LockRequest &req) {
+    return req.txn_id_ == txn->GetTransactionId() && req.granted_;
+  });
+  if (request == requests.end()) {
+    return false;
+  }
+  requests.erase(request);
+  lock.unlock();
+  queue->cv_.notify_all();
+
+  // Intention locks only announce row locks, releasing them does not end the growing phase.
+  bool ends_growing = mode == LockMode::EXCLUSIVE || mode == LockMode::SHARED_INTENTION_EXCLUSIVE ||
+                      (mode == LockMode::SHARED && txn->GetIsolationLevel() != IsolationLevel::READ_COMMITTED);
+  if (txn->GetState() == TransactionState::GROWING && ends_growing) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::GetTableLockMode(Transaction *txn, table_oid_t oid, LockMode *mode) {
+  for (LockMode candidate : {LockMode::EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED,
+                             LockMode::INTENTION_EXCLUSIVE, LockMode::INTENTION_SHARED}) {
+    auto lock_set = TableLockSet(txn, candidate);
+    if (lock_set->find(oid) != lock_set->end()) {
+      *mode = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Compatibility matrix of the hierarchy:
+ *
+ *        IS   IX   S    SIX  X
+ *   IS   yes  yes  yes  yes  no
+ *   IX   yes  yes  no   no   no
+ *   S    yes  no   yes  no   no
+ *   SIX  yes  no   no   no   no
+ *   X    no   no   no   no   no
+ */
+bool LockManager::Compatible(LockMode a, LockMode b) {
+  switch (a) {
+    case LockMode::INTENTION_SHARED:
+      return b != LockMode::EXCLUSIVE;
+    case LockMode::INTENTION_EXCLUSIVE:
+      return b == LockMode::INTENTION_SHARED || b == LockMode::INTENTION_EXCLUSIVE;
+    case LockMode::SHARED:
+      return b == LockMode::INTENTION_SHARED || b == LockMode::SHARED;
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return b == LockMode::INTENTION_SHARED;
+    case LockMode::EXCLUSIVE:
+      return false;
+  }
+  return false;
+}
+
+/*
+ * The modes are ordered IS < IX, IS < S, IX < SIX, S < SIX and SIX < X. The only pair that is not ordered, IX and S,
+ * combines to SIX.
+ */
+LockManager::LockMode LockManager::Combine(LockMode a, LockMode b) {
+  if (a == b) {
+    return a;
+  }
+  if (a == LockMode::EXCLUSIVE || b == LockMode::EXCLUSIVE) {
+    return LockMode::EXCLUSIVE;
+  }
+  if (a == LockMode::INTENTION_SHARED) {
+    return b;
+  }
+  if (b == LockMode::INTENTION_SHARED) {
+    return a;
+  }
+  return LockMode::SHARED_INTENTION_EXCLUSIVE;
+}
+
+std::shared_ptr<std::unordered_set<table_oid_t>> LockManager::TableLockSet(Transaction *txn, LockMode mode) {
+  switch (mode) {
+    case LockMode::SHARED:
+      return txn->GetSharedTableLockSet();
+    case LockMode::EXCLUSIVE:
+      return txn->GetExclusiveTableLockSet();
+    case LockMode::INTENTION_SHARED:
+      return txn->GetIntentionSharedTableLockSet();
+    case LockMode::INTENTION_EXCLUSIVE:
+      return txn->GetIntentionExclusiveTableLockSet();
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return txn->GetSharedIntentionExclusiveTableLockSet();
+  }
+  return nullptr;
+}
+
+bool LockManager::ReleaseRow(Transaction *txn, const RID &rid, LockMode *mode) {
   txn->GetSharedLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->erase(rid);
+  std::unique_lock<std::mutex> lock;
+  auto queue = LatchQueue(rid, false, &lock);
+  if (queue == nullptr) {
+    return false;
+  }
+  auto &requests = queue->request_queue_;
+  auto request = std::find_if(requests.begin(), requests.end(), [txn](const LockRequest &req) {
+    return req.txn_id_ == txn->GetTransactionId() && req.granted_;
+  });
+  if (request == requests.end()) {
+    return false;
+  }
+  *mode = request->lock_mode_;
+  requests.erase(request);
+  bool empty = requests.empty();
+  lock.unlock();
+  queue->cv_.notify_all();
+  if (empty) {
+    RemoveQueueIfEmpty(rid, queue);
+  }
   return true;
 }
 
+/*
+ * The queue is latched only after the shard latch is dropped, so a queue may be removed in between. A removed queue
+ * is never used again; the lookup is simply repeated.
+ */
+std::shared_ptr<LockManager::LockRequestQueue> LockManager::LatchQueue(const RID &rid, bool create,
+                                                                        std::unique_lock<std::mutex> *lock) {
+  LockTableShard &shard = ShardOf(rid);
+  while (true) {
+    std::shared_ptr<LockRequestQueue> queue;
+    {
+      std::scoped_lock shard_lock(shard.latch_);
+      auto it = shard.queues_.find(rid);
+      if (it != shard.queues_.end()) {
+        queue = it->second;
+      } else if (create) {
+        queue = std::make_shared<LockRequestQueue>();
+        queue->rid_ = rid;
+        shard.queues_.emplace(rid, queue);
+      } else {
+        return nullptr;
+      }
+    }
+    *lock = std::unique_lock(queue->latch_);
+    if (!queue->removed_) {
+      return queue;
+    }
+    lock->unlock();
+  }
+}
+
+void LockManager::RemoveQueueIfEmpty(const RID &rid, const std::shared_ptr<LockRequestQueue> &queue) {
+  LockTableShard &shard = ShardOf(rid);
+  std::scoped_lock shard_lock(shard.latch_);
+  auto it = shard.queues_.find(rid);
+  if (it == shard.queues_.end() || it->second != queue) {
+    return;
+  }
+  std::scoped_lock queue_lock(queue->latch_);
+  if (queue->request_queue_.empty()) {
+    queue->removed_ = true;
+    shard.queues_.erase(it);
+  }
+}
+
+LockManager::LockRequestQueue *LockManager::LatchTableQueue(table_oid_t oid, std::unique_lock<std::mutex> *lock) {
+  LockRequestQueue *queue;
+  {
+    std::scoped_lock table_lock(table_lock_table_latch_);
+    auto &entry = table_lock_table_[oid];
+    if (entry == nullptr) {
+      entry = std::make_unique<LockRequestQueue>();
+      entry->oid_ = oid;
+    }
+    queue = entry.get();
+  }
+  *lock = std::unique_lock(queue->latch_);
+  return queue;
+}
+
+/*
+ * The new request goes to the head of the waiting requests, so the upgrade only waits for the other holders of the
+ * lock.
+ */
+bool LockManager::Upgrade(Transaction *txn, LockRequestQueue *queue, LockMode mode,
+                          std::unique_lock<std::mutex> *lock) {
+  auto &requests = queue->request_queue_;
+  auto held = std::find_if(requests.begin(), requests.end(), [txn](const LockRequest &req) {
+    return req.txn_id_ == txn->GetTransactionId() && req.granted_;
+  });
+  if (held == requests.end()) {
+    return false;
+  }
+  requests.erase(held);
+  auto waiting = std::find_if(requests.begin(), requests.end(), [](const LockRequest &req) { return !req.granted_; });
+  auto request = requests.emplace(waiting, txn->GetTransactionId(), mode);
+  queue->upgrading_ = txn->GetTransactionId();
+  // Older waiters now wait for us as well, under wound-wait they wake up to wound us.
+  queue->cv_.notify_all();
+  bool granted = Acquire(txn, queue, request, lock);
+  queue->upgrading_ = INVALID_TXN_ID;
+  return granted;
+}
+
+bool LockManager::Acquire(Transaction *txn, LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                          std::unique_lock<std::mutex> *lock) {
+  auto ready = [&] { return txn->GetState() == TransactionState::ABORTED || Grantable(*queue, request); };
+  // Only sampled requests that cannot be granted right away read the clock.
+  bool timed = SampleRequest() && !ready();
+  auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+  size_t queue_length = queue->request_queue_.size();
+  if (deadlock_mode_ == DeadlockMode::PREVENTION && !ready()) {
+    // Whoever wounds us while we wait looks up the queue to wake us up in. Registering takes the latch of the lookup
+    // table, which is never taken under a queue latch.
+    lock->unlock();
+    SetWaitingIn(txn->GetTransactionId(), queue);
+    lock->lock();
+    // Every change to the queue wakes us up, a younger holder that upgraded ahead of us meanwhile is wounded then.
+    while (!ready()) {
+      std::vector<txn_id_t> wounded = Wound(txn, request->lock_mode_, queue);
+      if (wounded.empty()) {
+        queue->cv_.wait(*lock);
+        continue;
+      }
+      lock->unlock();
+      NotifyWounded(wounded);
+      lock->lock();
+    }
+    lock->unlock();
+    SetWaitingIn(txn->GetTransactionId(), nullptr);
+    lock->lock();
+  } else {
+    queue->cv_.wait(*lock, ready);
+  }
+  if (timed) {
+    RecordWait(*queue,
+               std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start),
+               queue_length);
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    queue->request_queue_.erase(request);
+    queue->cv_.notify_all();
+    return false;
+  }
+  request->granted_ = true;
+  return true;
+}
+
+bool LockManager::Grantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request) {
+  bool before = true;
+  for (auto it = queue.request_queue_.begin(); it != queue.request_queue_.end(); ++it) {
+    if (it == request) {
+      before = false;
+      continue;
+    }
+    if ((before || it->granted_) && !Compatible(it->lock_mode_, request->lock_mode_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * A wounded transaction that holds the lock keeps it until it rolls back; one that waits in this queue wakes up and
+ * gives up its request.
+ */
+std::vector<txn_id_t> LockManager::Wound(Transaction *txn, LockMode mode, LockRequestQueue *queue) {
+  bool wounded = false;
+  std::vector<txn_id_t> holders;
+  for (const auto &request : queue->request_queue_) {
+    if (request.txn_id_ <= txn->GetTransactionId() || Compatible(request.lock_mode_, mode)) {
+      continue;
+    }
+    Transaction *victim = TransactionManager::GetTransaction(request.txn_id_);
+    if (victim->GetState() == TransactionState::GROWING || victim->GetState() == TransactionState::SHRINKING) {
+      victim->SetState(TransactionState::ABORTED);
+      wounded = true;
+      if (request.granted_) {
+        holders.push_back(request.txn_id_);
+      }
+    }
+  }
+  if (wounded) {
+    queue->cv_.notify_all();
+  }
+  return holders;
+}
+
+void LockManager::SetWaitingIn(txn_id_t txn_id, LockRequestQueue *queue) {
+  std::scoped_lock lock(waiting_latch_);
+  if (queue == nullptr) {
+    waiting_in_.erase(txn_id);
+  } else {
+    waiting_in_[txn_id] = queue;
+  }
+}
+
+/*
+ * The victims were aborted before their queues are looked up. A victim that registers afterwards finds its state
+ * when it checks it under its queue latch, and one that checked before is waiting once we got the latch.
+ */
+void LockManager::NotifyWounded(const std::vector<txn_id_t> &wounded) {
+  std::scoped_lock lock(waiting_latch_);
+  for (txn_id_t txn_id : wounded) {
+    auto it = waiting_in_.find(txn_id);
+    if (it == waiting_in_.end()) {
+      continue;
+    }
+    LockRequestQueue *queue = it->second;
+    {
+      std::scoped_lock queue_lock(queue->latch_);
+    }
+    queue->cv_.notify_all();
+  }
+}
+
+/*
+ * The counter is per thread, so unsampled requests touch no shared cache line.
+ */
+bool LockManager::SampleRequest() {
+  static thread_local uint32_t request_count = 0;
+  uint32_t sample_every = contention_sample_every_.load(std::memory_order_relaxed);
+  if (sample_every == 0 || ++request_count % sample_every != 0) {
+    return false;
+  }
+  sampled_requests_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void LockManager::RecordWait(const LockRequestQueue &queue, std::chrono::microseconds wait, size_t queue_length) {
+  std::scoped_lock lock(contention_latch_);
+  all_waits_.Record(wait, queue_length);
+  if (queue.oid_ != INVALID_TABLE_OID) {
+    hot_tables_[queue.oid_].Record(wait, queue_length);
+    return;
+  }
+  auto it = hot_rows_.find(queue.rid_);
+  if (it == hot_rows_.end()) {
+    if (hot_row_capacity_ == 0) {
+      return;
+    }
+    LockContention counters;
+    if (hot_rows_.size() == hot_row_capacity_) {
+      // Space-Saving: the row takes the place of the least waited for one. Its count may include all of the
+      // evicted row's waits, which are not its own.
+      auto coldest = std::min_element(hot_rows_.begin(), hot_rows_.end(), [](const auto &a, const auto &b) {
+        return a.second.waits_ < b.second.waits_;
+      });
+      counters.waits_ = coldest->second.waits_;
+      counters.error_ = coldest->second.waits_;
+      hot_rows_.erase(coldest);
+    }
+    it = hot_rows_.emplace(queue.rid_, counters).first;
+  }
+  it->second.Record(wait, queue_length);
+}
+
+void LockManager::SetContentionSampling(uint32_t sample_every, size_t hot_rows) {
+  {
+    std::scoped_lock lock(contention_latch_);
+    contention_sample_every_ = sample_every;
+    hot_row_capacity_ = hot_rows;
+  }
+  ResetContentionStats();
+}
+
+LockContentionStats LockManager::GetContentionStats() {
+  LockContentionStats stats;
+  {
+    std::scoped_lock lock(contention_latch_);
+    stats.sample_every_ = contention_sample_every_;
+    stats.requests_ = sampled_requests_;
+    stats.all_ = all_waits_;
+    stats.hot_rows_.assign(hot_rows_.begin(), hot_rows_.end());
+    stats.hot_tables_.assign(hot_tables_.begin(), hot_tables_.end());
+  }
+  auto most_waits_first = [](const auto &a, const auto &b) {
+    return a.second.waits_ != b.second.waits_ ? a.second.waits_ > b.second.waits_
+                                              : a.second.total_wait_ > b.second.total_wait_;
+  };
+  std::sort(stats.hot_rows_.begin(), stats.hot_rows_.end(), most_waits_first);
+  std::sort(stats.hot_tables_.begin(), stats.hot_tables_.end(), most_waits_first);
+  return stats;
+}
+
+void LockManager::ResetContentionStats() {
+  std::scoped_lock lock(contention_latch_);
+  sampled_requests_ = 0;
+  all_waits_ = LockContention{};
+  hot_rows_.clear();
+  hot_tables_.clear();
+}
+
+void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock lock(waits_for_latch_);
+  auto &edges = waits_for_[t1];
+  if (std::find(edges.begin(), edges.end(), t2) == edges.end()) {
+    edges.push_back(t2);
+  }
+}
+
+void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock lock(waits_for_latch_);
+  auto it = waits_for_.find(t1);
+  if (it == waits_for_.end()) {
+    return;
+  }
+  it->second.erase(std::remove(it->second.begin(), it->second.end(), t2), it->second.end());
+  if (it->second.empty()) {
+    waits_for_.erase(it);
+  }
+}
+
+bool LockManager::HasCycle(txn_id_t *txn_id) {
+  std::scoped_lock lock(waits_for_latch_);
+  std::vector<txn_id_t> vertices;
+  for (auto &[t, edges] : waits_for_) {
+    vertices.push_back(t);
+    std::sort(edges.begin(), edges.end());
+  }
+  std::sort(vertices.begin(), vertices.end());
+  std::unordered_set<txn_id_t> visited;
+  for (txn_id_t t : vertices) {
+    std::vector<txn_id_t> path;
+    std::unordered_set<txn_id_t> on_path;
+    if (visited.count(t) == 0 && FindCycle(t, &path, &on_path, &visited, txn_id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * A vertex that was fully explored without finding a cycle cannot be on one found later, so it is not searched again.
+ */
+bool LockManager::FindCycle(txn_id_t t, std::vector<txn_id_t> *path, std::unordered_set<txn_id_t> *on_path,
+                            std::unordered_set<txn_id_t> *visited, txn_id_t *victim) {
+  visited->insert(t);
+  path->push_back(t);
+  on_path->insert(t);
+  auto it = waits_for_.find(t);
+  if (it != waits_for_.end()) {
+    for (txn_id_t next : it->second) {
+      if (on_path->count(next) != 0) {
+        auto start = std::find(path->begin(), path->end(), next);
+        *victim = *std::max_element(start, path->end());
+        return true;
+      }
+      if (visited->count(next) == 0 && FindCycle(next, path, on_path, visited, victim)) {
+        return true;
+      }
+    }
+  }
+  path->pop_back();
+  on_path->erase(t);
+  return false;
+}
+
+std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() {
+  std::scoped_lock lock(waits_for_latch_);
+  std::vector<std::pair<txn_id_t, txn_id_t>> edges;
+  for (const auto &[t1, waits_for] : waits_for_) {
+    for (txn_id_t t2 : waits_for) {
+      edges.emplace_back(t1, t2);
+    }
+  }
+  return edges;
+}
+
+void LockManager::RemoveVertex(txn_id_t t) {
+  std::scoped_lock lock(waits_for_latch_);
+  waits_for_.erase(t);
+  for (auto it = waits_for_.begin(); it != waits_for_.end();) {
+    auto &edges = it->second;
+    edges.erase(std::remove(edges.begin(), edges.end(), t), edges.end());
+    it = edges.empty() ? waits_for_.erase(it) : std::next(it);
+  }
+}
+
+/*
+ * The queues are latched one at a time, so the graph is not an atomic snapshot: a transaction granted its lock after
+ * its queue was read may still show up in a cycle. Real deadlocks do not go away by themselves and are always found;
+ * the price of a stale edge is an unneeded abort, which is why the whole pass runs without stopping lock requests.
+ */
+size_t LockManager::DetectDeadlocks() {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<LockRequestQueue>> row_queues;
+  for (auto &shard : lock_table_) {
+    std::scoped_lock shard_lock(shard.latch_);
+    for (const auto &[rid, queue] : shard.queues_) {
+      row_queues.push_back(queue);
+    }
+  }
+  std::vector<LockRequestQueue *> queues;
+  {
+    std::scoped_lock table_lock(table_lock_table_latch_);
+    for (const auto &[oid, queue] : table_lock_table_) {
+      queues.push_back(queue.get());
+    }
+  }
+  for (const auto &queue : row_queues) {
+    queues.push_back(queue.get());
+  }
+
+  {
+    std::scoped_lock lock(waits_for_latch_);
+    waits_for_.clear();
+  }
+  std::unordered_map<txn_id_t, LockRequestQueue *> waiting_in;
+  for (LockRequestQueue *queue : queues) {
+    AddQueueEdges(queue, &waiting_in);
+  }
+  size_t deadlocks = 0;
+  txn_id_t victim;
+  while (HasCycle(&victim)) {
+    RemoveVertex(victim);
+    LockRequestQueue *queue = waiting_in[victim];
+    {
+      // Only a transaction that still waits is sure to be alive. Aborting it under the queue latch orders the wake-up
+      // after its last check of its state.
+      std::scoped_lock queue_lock(queue->latch_);
+      const auto &requests = queue->request_queue_;
+      if (std::none_of(requests.begin(), requests.end(),
+                       [victim](const LockRequest &req) { return req.txn_id_ == victim && !req.granted_; })) {
+        continue;
+      }
+      TransactionManager::GetTransaction(victim)->SetState(TransactionState::ABORTED);
+    }
+    queue->cv_.notify_all();
+    deadlocks++;
+  }
+
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  std::scoped_lock stats_lock(stats_latch_);
+  deadlock_stats_.passes_++;
+  deadlock_stats_.deadlocks_ += deadlocks;
+  deadlock_stats_.last_pass_duration_ = duration;
+  deadlock_stats_.max_pass_duration_ = std::max(deadlock_stats_.max_pass_duration_, duration);
+  return deadlocks;
+}
+
+void LockManager::AddQueueEdges(LockRequestQueue *queue,
+                                std::unordered_map<txn_id_t, LockRequestQueue *> *waiting_in) {
+  std::scoped_lock lock(queue->latch_);
+  const auto &requests = queue->request_queue_;
+  for (auto waiting = requests.begin(); waiting != requests.end(); ++waiting) {
+    if (waiting->granted_) {
+      continue;
+    }
+    (*waiting_in)[waiting->txn_id_] = queue;
+    bool before = true;
+    for (auto it = requests.begin(); it != requests.end(); ++it) {
+      if (it == waiting) {
+        before = false;
+        continue;
+      }
+      if ((before || it->granted_) && it->txn_id_ != waiting->txn_id_ &&
+          !Compatible(it->lock_mode_, waiting->lock_mode_)) {
+        AddEdge(waiting->txn_id_, it->txn_id_);
+      }
+    }
+  }
+}
+
+DeadlockStats LockManager::GetDeadlockStats() {
+  std::scoped_lock lock(stats_latch_);
+  return deadlock_stats_;
+}
+
+void LockManager::RunCycleDetection() {
+  std::unique_lock lock(cycle_detection_latch_);
+  while (!cycle_detection_cv_.wait_for(lock, cycle_detection_interval, [this] { return !enable_cycle_detection_; })) {
+    lock.unlock();
+    DetectDeadlocks();
+    lock.lock();
+  }
+}
+
 }  // namespace bustub
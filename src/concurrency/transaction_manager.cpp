@@ -12,6 +12,7 @@
 
 #include "concurrency/transaction_manager.h"
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -20,27 +21,76 @@
 
 namespace bustub {
 
-std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
-std::shared_mutex TransactionManager::txn_map_mutex = {};
+TransactionRegistry TransactionManager::txn_registry;
 
 Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level) {
   // Acquire the global transaction latch in shared mode.
   global_txn_latch_.RLock();
 
+  // Getting the id and registering are one step for GetOldestActiveTransaction.
   if (txn == nullptr) {
-    txn = new Transaction(next_txn_id_++, isolation_level);
+    txn = txn_registry.RegisterNew([&] {
+      auto *new_txn = new Transaction(next_txn_id_++, isolation_level);
+      new_txn->SetAsyncCommit(async_commit_);
+      new_txn->SetOptimistic(optimistic_);
+      return new_txn;
+    });
+  } else {
+    txn_registry.Register(txn);
   }
-  txn_map_mutex.lock();
-  txn_map[txn->GetTransactionId()] = txn;
-  txn_map_mutex.unlock();
+  if (enable_logging) {
+    std::scoped_lock lock(active_txns_latch_);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+    active_txns_[txn->GetTransactionId()] = txn->GetPrevLSN();
+  }
+
+  if (txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION) {
+    BeginSnapshot(txn);
+  }
+  return txn;
+}
+
+/*
+ * Nobody looks up a transaction that takes no locks, and a checkpoint has nothing to wait for from one that writes
+ * nothing, so the registry and the global transaction latch are left alone. Its snapshot takes a slot, no latch.
+ */
+Transaction *TransactionManager::BeginReadOnly() {
+  auto *txn = new Transaction(next_txn_id_++, IsolationLevel::SNAPSHOT_ISOLATION, true);
+  BeginSnapshot(txn);
   return txn;
 }
 
-void TransactionManager::Commit(Transaction *txn) {
+bool TransactionManager::Commit(Transaction *txn) {
+  // A read-only transaction leaves the versions it held back to the next writing commit to collect.
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::COMMITTED);
+    EndSnapshot(txn);
+    return true;
+  }
+  if (txn->IsOptimistic() && !InstallAndValidate(txn)) {
+    Abort(txn);
+    return false;
+  }
   txn->SetState(TransactionState::COMMITTED);
 
-  // Perform all deletes before we commit.
+  // Stamp the versions we wrote before the deletes free their slots for other inserts.
   auto write_set = txn->GetWriteSet();
+  if (!write_set->empty()) {
+    std::scoped_lock commit_lock(commit_latch_);
+    timestamp_t commit_ts = last_commit_ts_ + 1;
+    std::vector<std::pair<TableHeap *, RID>> written;
+    for (const auto &item : *write_set) {
+      item.table_->CommitVersion(item.rid_, txn, commit_ts);
+      written.emplace_back(item.table_, item.rid_);
+    }
+    txn->SetCommitTs(commit_ts);
+    last_commit_ts_ = commit_ts;
+    std::scoped_lock gc_lock(gc_latch_);
+    committed_writes_.emplace_back(commit_ts, std::move(written));
+  }
+
+  // Perform all deletes before we commit.
   while (!write_set->empty()) {
     auto &item = write_set->back();
     auto table = item.table_;
@@ -52,16 +102,49 @@ void TransactionManager::Commit(Transaction *txn) {
   }
   write_set->clear();
 
-  // Release all the locks.
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT);
+    lsn_t commit_lsn;
+    {
+      std::scoped_lock lock(active_txns_latch_);
+      commit_lsn = log_manager_->AppendLogRecord(&log_record);
+      active_txns_.erase(txn->GetTransactionId());
+    }
+    txn->SetPrevLSN(commit_lsn);
+    if (txn->IsAsyncCommit()) {
+      // The flush thread makes the record durable within its commit lag; we do not wait for it.
+      log_manager_->ScheduleFlush(commit_lsn);
+    } else {
+      // Group commit: only wait for the batch holding our COMMIT record, not for a dedicated flush.
+      log_manager_->WaitUntilPersistent(commit_lsn);
+    }
+  }
+
+  // Release all the locks. Nobody looks the transaction up without a lock request of it, it can be forgotten now.
   ReleaseLocks(txn);
+  txn_registry.Unregister(txn);
+  EndSnapshot(txn);
+  GarbageCollect();
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
+  return true;
 }
 
 void TransactionManager::Abort(Transaction *txn) {
   txn->SetState(TransactionState::ABORTED);
+  if (txn->IsReadOnly()) {
+    EndSnapshot(txn);
+    return;
+  }
+  // Buffered writes never reached the tables.
+  txn->GetBufferedWriteSet()->clear();
+  txn->GetReadSet()->clear();
   // Rollback before releasing the lock.
   auto table_write_set = txn->GetWriteSet();
+  std::vector<std::pair<TableHeap *, RID>> written;
+  for (const auto &item : *table_write_set) {
+    written.emplace_back(item.table_, item.rid_);
+  }
   while (!table_write_set->empty()) {
     auto &item = table_write_set->back();
     auto table = item.table_;
@@ -76,6 +159,10 @@ void TransactionManager::Abort(Transaction *txn) {
     table_write_set->pop_back();
   }
   table_write_set->clear();
+  // The pages hold the versions from before the transaction again; until now snapshots read the saved ones.
+  for (const auto &[table, rid] : written) {
+    table->AbortVersion(rid, txn);
+  }
   // Rollback index updates
   auto index_write_set = txn->GetIndexWriteSet();
   while (!index_write_set->empty()) {
@@ -102,12 +189,129 @@ void TransactionManager::Abort(Transaction *txn) {
   table_write_set->clear();
   index_write_set->clear();
 
-  // Release all the locks.
+  if (enable_logging) {
+    std::scoped_lock lock(active_txns_latch_);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+    active_txns_.erase(txn->GetTransactionId());
+  }
+
+  // Release all the locks. Nobody looks the transaction up without a lock request of it, it can be forgotten now.
   ReleaseLocks(txn);
+  txn_registry.Unregister(txn);
+  EndSnapshot(txn);
+  GarbageCollect();
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
 }
 
+bool TransactionManager::InstallAndValidate(Transaction *txn) {
+  std::vector<TableWriteRecord> writes;
+  for (const auto &[rid, record] : *txn->GetBufferedWriteSet()) {
+    writes.push_back(record);
+  }
+  txn->GetBufferedWriteSet()->clear();
+  std::sort(writes.begin(), writes.end(),
+            [](const TableWriteRecord &a, const TableWriteRecord &b) { return a.rid_.Get() < b.rid_.Get(); });
+  txn->SetWritePhase(true);
+  for (const auto &record : writes) {
+    bool written = record.wtype_ == WType::DELETE ? record.table_->MarkDelete(record.rid_, txn)
+                                                  : record.table_->UpdateTuple(record.tuple_, record.rid_, txn);
+    if (!written || txn->GetState() == TransactionState::ABORTED) {
+      return false;
+    }
+  }
+  auto read_set = txn->GetReadSet();
+  bool valid = std::all_of(read_set->begin(), read_set->end(),
+                           [txn](const auto &read) { return read.second.table_->ValidateRead(read.second, txn); });
+  read_set->clear();
+  return valid;
+}
+
+/*
+ * A collection that misses the slot we are taking uses a watermark read before it, which is no newer than the last
+ * commit we read afterwards. If that one moved on meanwhile, the collection may have dropped what our timestamp
+ * needs, so we publish the newer one and check again.
+ */
+void TransactionManager::BeginSnapshot(Transaction *txn) {
+  timestamp_t read_ts = last_commit_ts_;
+  // Threads mostly find the slot they had last time free, and do not touch the cache lines of the others.
+  static thread_local size_t slot_hint = 0;
+  size_t slot = slot_hint % num_snapshot_slots_;
+  bool found = false;
+  for (size_t i = 0; i < num_snapshot_slots_ && !found; i++) {
+    timestamp_t free = SnapshotSlot::NO_SNAPSHOT;
+    found = snapshot_slots_[slot].read_ts_.compare_exchange_strong(free, read_ts);
+    if (!found) {
+      slot = (slot + 1) % num_snapshot_slots_;
+    }
+  }
+  if (!found) {
+    // No slot was free, the overflow set is read under its latch.
+    std::scoped_lock lock(timestamp_latch_);
+    read_ts = last_commit_ts_;
+    snapshots_.insert(read_ts);
+    txn->SetReadTs(read_ts);
+    txn->SetSnapshotSlot(num_snapshot_slots_);
+    return;
+  }
+  slot_hint = slot;
+  for (timestamp_t now = last_commit_ts_; now != read_ts; now = last_commit_ts_) {
+    read_ts = now;
+    snapshot_slots_[slot].read_ts_ = read_ts;
+  }
+  txn->SetReadTs(read_ts);
+  txn->SetSnapshotSlot(slot);
+}
+
+void TransactionManager::EndSnapshot(Transaction *txn) {
+  if (txn->GetIsolationLevel() != IsolationLevel::SNAPSHOT_ISOLATION) {
+    return;
+  }
+  if (txn->GetSnapshotSlot() < num_snapshot_slots_) {
+    snapshot_slots_[txn->GetSnapshotSlot()].read_ts_ = SnapshotSlot::NO_SNAPSHOT;
+    return;
+  }
+  std::scoped_lock lock(timestamp_latch_);
+  snapshots_.erase(snapshots_.find(txn->GetReadTs()));
+}
+
+/*
+ * A version replaced by the commit at ts is read by snapshots older than ts only. Once the oldest snapshot is at or
+ * past ts, every version that ended there can go; later commits wait for the watermark to move on.
+ */
+size_t TransactionManager::GarbageCollect() {
+  timestamp_t watermark = GetWatermark();
+  size_t pruned = 0;
+  std::scoped_lock lock(gc_latch_);
+  while (!committed_writes_.empty() && committed_writes_.front().first <= watermark) {
+    for (const auto &[table, rid] : committed_writes_.front().second) {
+      pruned += table->PruneVersions(rid, watermark);
+    }
+    committed_writes_.pop_front();
+  }
+  return pruned;
+}
+
+/*
+ * The last commit is read before the slots, see BeginSnapshot.
+ */
+timestamp_t TransactionManager::GetWatermark() {
+  timestamp_t watermark = last_commit_ts_;
+  for (size_t i = 0; i < num_snapshot_slots_; i++) {
+    watermark = std::min<timestamp_t>(watermark, snapshot_slots_[i].read_ts_);
+  }
+  std::scoped_lock lock(timestamp_latch_);
+  return snapshots_.empty() ? watermark : std::min(watermark, *snapshots_.begin());
+}
+
+timestamp_t TransactionManager::GetLastCommitTs() { return last_commit_ts_; }
+
+std::vector<std::pair<txn_id_t, lsn_t>> TransactionManager::GetActiveTransactionTable() {
+  std::scoped_lock lock(active_txns_latch_);
+  return {active_txns_.begin(), active_txns_.end()};
+}
+
 void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
 
 void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
@@ -0,0 +1,67 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.cpp
+//
+// Identification: src/concurrency/transaction_registry.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/transaction_registry.h"
+
+#include <mutex>  // NOLINT
+
+namespace bustub {
+
+void TransactionRegistry::Register(Transaction *txn) {
+  Shard &shard = ShardOf(txn->GetTransactionId());
+  std::unique_lock lock(shard.latch_);
+  shard.txns_[txn->GetTransactionId()] = txn;
+}
+
+void TransactionRegistry::Unregister(Transaction *txn) {
+  Shard &shard = ShardOf(txn->GetTransactionId());
+  std::unique_lock lock(shard.latch_);
+  auto it = shard.txns_.find(txn->GetTransactionId());
+  if (it != shard.txns_.end() && it->second == txn) {
+    shard.txns_.erase(it);
+  }
+}
+
+Transaction *TransactionRegistry::Find(txn_id_t txn_id) {
+  Shard &shard = ShardOf(txn_id);
+  std::shared_lock lock(shard.latch_);
+  auto it = shard.txns_.find(txn_id);
+  return it == shard.txns_.end() ? nullptr : it->second;
+}
+
+/*
+ * The shards are looked at one after the other, so a transaction that begins meanwhile may be missed. No transaction
+ * is between getting its id and being registered while we look, so one that is missed got its id afterwards and is
+ * younger than every transaction found.
+ */
+txn_id_t TransactionRegistry::GetOldestActive() {
+  std::unique_lock begin_lock(begin_latch_);
+  txn_id_t oldest = INVALID_TXN_ID;
+  for (Shard &shard : shards_) {
+    std::shared_lock lock(shard.latch_);
+    if (!shard.txns_.empty() && (oldest == INVALID_TXN_ID || shard.txns_.begin()->first < oldest)) {
+      oldest = shard.txns_.begin()->first;
+    }
+  }
+  return oldest;
+}
+
+size_t TransactionRegistry::Size() {
+  size_t size = 0;
+  for (Shard &shard : shards_) {
+    std::shared_lock lock(shard.latch_);
+    size += shard.txns_.size();
+  }
+  return size;
+}
+
+}  // namespace bustub
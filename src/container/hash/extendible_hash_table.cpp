@@ -31,12 +31,13 @@ namespace bustub {
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 HASH_TABLE_TYPE::ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager,
-                                     const KeyComparator &comparator, HashFunction<KeyType> hash_fn)
-    : buffer_pool_manager_(buffer_pool_manager), comparator_(comparator), hash_fn_(std::move(hash_fn)) {
-  //  implement me!
-
-  directory_page_id_ = INVALID_PAGE_ID;
-}
+                                     const KeyComparator &comparator, HashFunction<KeyType> hash_fn,
+                                     LogManager *log_manager, page_id_t directory_page_id)
+    : directory_page_id_(directory_page_id),
+      buffer_pool_manager_(buffer_pool_manager),
+      log_manager_(log_manager),
+      comparator_(comparator),
+      hash_fn_(std::move(hash_fn)) {}
 
 /*****************************************************************************
  * HELPERS
@@ -75,9 +76,12 @@ HashTableDirectoryPage *HASH_TABLE_TYPE::FetchDirectoryPage() {
     page_id_t new_bu_pg_id;
     auto new_bucket_pg = buffer_pool_manager_->NewPage(&new_bu_pg_id);
     assert(new_bucket_pg != nullptr);
+    reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(new_bucket_pg->GetData())->SetPageId(new_bu_pg_id);
 
     result->SetBucketPageId(0, new_bu_pg_id);
-    buffer_pool_manager_->UnpinPage(new_bu_pg_id, false);
+    // An empty bucket is all zeroes, so only the directory needs to be logged.
+    LogDirectoryUpdate(nullptr, result);
+    buffer_pool_manager_->UnpinPage(new_bu_pg_id, true);
     buffer_pool_manager_->UnpinPage(directory_page_id_, true);
   }
 
@@ -120,84 +124,78 @@ bool HASH_TABLE_TYPE::Insert(Transaction *transaction, const KeyType &key, const
 
   // check not full
   if (!bucket->IsFull()) {
-    bool success = bucket->Insert(key, value, comparator_);
+    uint32_t bucket_idx;
+    bool success = bucket->Insert(key, value, comparator_, &bucket_idx);
+    if (success) {
+      LogBucketChange(transaction, LogRecordType::HASH_BUCKET_INSERT, bucket, bucket_idx, key, value);
+    }
     buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    buffer_pool_manager_->UnpinPage(bucket_pgid, true);
+    buffer_pool_manager_->UnpinPage(bucket_pgid, success);
     return success;
   }
 
   // bucket full split bucket
   buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-  buffer_pool_manager_->UnpinPage(bucket_pgid, true);
+  buffer_pool_manager_->UnpinPage(bucket_pgid, false);
   return SplitInsert(transaction, key, value);
 }
 
+/*
+ * Directory slots that point at the full bucket all have its local depth. The ones whose next hash bit is set move to
+ * the new bucket, and so do the entries whose hash has that bit set.
+ */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 bool HASH_TABLE_TYPE::SplitInsert(Transaction *transaction, const KeyType &key, const ValueType &value) {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();  // rel
-  frame_id_t bucket_pgid = KeyToPageId(key, dir_page);
+  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
+  page_id_t bucket_pgid = KeyToPageId(key, dir_page);
   auto bucket_idx = KeyToDirectoryIndex(key, dir_page);
   auto bucket_depth = dir_page->GetLocalDepth(bucket_idx);
-  HASH_TABLE_BUCKET_TYPE *bucket = FetchBucketPage(bucket_pgid);
-  auto dir_depth = dir_page->GetGlobalDepth();
 
   // if can not split any more
-  if ((1 << (bucket_depth + 1)) > DIRECTORY_ARRAY_SIZE) {
+  if ((1U << (bucket_depth + 1)) > DIRECTORY_ARRAY_SIZE) {
     buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    buffer_pool_manager_->UnpinPage(bucket_pgid, false);
     return false;
   }
 
   // if need to grow directory
-
-  if (bucket_depth == dir_depth) {
+  if (bucket_depth == dir_page->GetGlobalDepth()) {
     dir_page->IncrGlobalDepth();
   }
 
-  // get all old data from  old bucket
-  auto old_bucket_data = bucket->GetAll();
-  dir_page->IncrLocalDepth(bucket_idx);
   // create new image bucket
   page_id_t new_bucket_pgid;
   auto new_bk_pg = buffer_pool_manager_->NewPage(&new_bucket_pgid);
   assert(new_bk_pg != nullptr);
   HASH_TABLE_BUCKET_TYPE *new_bucket = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(new_bk_pg->GetData());
-  auto new_bk_idx = dir_page->GetSplitImageIndex(bucket_idx);
-  dir_page->SetBucketPageId(new_bk_idx, new_bucket_pgid);
-  dir_page->SetLocalDepth(new_bk_idx, bucket_depth + 1);
+  new_bucket->SetPageId(new_bucket_pgid);
 
-  // insert data into two buckets
+  // update links
+  uint32_t image_bit = 1U << bucket_depth;
+  for (uint32_t i = 0; i < dir_page->Size(); i++) {
+    if (dir_page->GetBucketPageId(i) == bucket_pgid) {
+      dir_page->SetLocalDepth(i, bucket_depth + 1);
+      if ((i & image_bit) != 0) {
+        dir_page->SetBucketPageId(i, new_bucket_pgid);
+      }
+    }
+  }
 
+  // move the data of the image out of the old bucket
+  HASH_TABLE_BUCKET_TYPE *bucket = FetchBucketPage(bucket_pgid);
+  auto old_bucket_data = bucket->GetAll();
+  bucket->Bzero();
   for (const auto &data : old_bucket_data) {
-    uint32_t tg_idx = Hash(data.first) & (dir_page->GetLocalDepthMask(new_bk_idx));
-    if (tg_idx == new_bk_idx) {
+    if ((Hash(data.first) & image_bit) != 0) {
       new_bucket->Insert(data.first, data.second, comparator_);
     } else {
       bucket->Insert(data.first, data.second, comparator_);
     }
   }
-  //
-  // update links
-  size_t distance = 1 << dir_page->GetLocalDepth(new_bk_idx);
-  for (size_t i = bucket_idx; i < dir_page->Size(); i += distance) {
-    dir_page->SetBucketPageId(i, bucket_idx);
-    dir_page->SetLocalDepth(bucket_idx, dir_page->GetLocalDepth(bucket_idx));
-  }
-  for (size_t i = bucket_idx; i >= distance; i -= distance) {
-    dir_page->SetBucketPageId(i, bucket_idx);
-    dir_page->SetLocalDepth(bucket_idx, dir_page->GetLocalDepth(bucket_idx));
-  }
-  for (size_t i = new_bk_idx; i < dir_page->Size(); i += distance) {
-    dir_page->SetBucketPageId(i, new_bk_idx);
-    dir_page->SetLocalDepth(new_bk_idx, dir_page->GetLocalDepth(new_bk_idx));
-  }
-  for (size_t i = new_bk_idx; i >= distance; i -= distance) {
-    dir_page->SetBucketPageId(i, new_bk_idx);
-    dir_page->SetLocalDepth(new_bk_idx, dir_page->GetLocalDepth(new_bk_idx));
-  }
+  LogBucketSplit(transaction, new_bucket);
+  LogDirectoryUpdate(transaction, dir_page);
+  LogBucketSplit(transaction, bucket);
 
   // unpin page
-
   buffer_pool_manager_->UnpinPage(directory_page_id_, true);
   buffer_pool_manager_->UnpinPage(bucket_pgid, true);
   buffer_pool_manager_->UnpinPage(new_bucket_pgid, true);
@@ -213,11 +211,16 @@ bool HASH_TABLE_TYPE::Remove(Transaction *transaction, const KeyType &key, const
   auto bucket_pgid = KeyToPageId(key, dir_page);
   HASH_TABLE_BUCKET_TYPE *bucket = FetchBucketPage(bucket_pgid);
 
-  bool success = bucket->Remove(key, value, comparator_);
+  uint32_t bucket_idx;
+  bool success = bucket->Remove(key, value, comparator_, &bucket_idx);
+  if (success) {
+    LogBucketChange(transaction, LogRecordType::HASH_BUCKET_REMOVE, bucket, bucket_idx, key, value);
+  }
+  bool empty = bucket->IsEmpty();
 
-  buffer_pool_manager_->UnpinPage(directory_page_id_, true);
+  buffer_pool_manager_->UnpinPage(directory_page_id_, false);
   buffer_pool_manager_->UnpinPage(bucket_pgid, success);
-  if (bucket->IsEmpty()) {
+  if (success && empty) {
     Merge(transaction, key, value);
   }
   return success;
@@ -230,44 +233,106 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 void HASH_TABLE_TYPE::Merge(Transaction *transaction, const KeyType &key, const ValueType &value) {
   HashTableDirectoryPage *dir_page = FetchDirectoryPage();  // rel
 
-  auto bucket_pgid = KeyToPageId(key, dir_page);
   auto bucket_idx = KeyToDirectoryIndex(key, dir_page);
-  auto image_idx = dir_page->GetSplitImageIndex(bucket_idx);
+  page_id_t bucket_pgid = dir_page->GetBucketPageId(bucket_idx);
+  auto local_depth = dir_page->GetLocalDepth(bucket_idx);
   // check valid
-
-  if (dir_page->GetLocalDepth(bucket_idx) == 0) {
+  if (local_depth == 0) {
     buffer_pool_manager_->UnpinPage(directory_page_id_, false);
     return;
   }
-  if (dir_page->GetLocalDepth(bucket_idx) != dir_page->GetLocalDepth(image_idx)) {
+  auto image_idx = dir_page->GetSplitImageIndex(bucket_idx);
+  if (dir_page->GetLocalDepth(image_idx) != local_depth) {
     buffer_pool_manager_->UnpinPage(directory_page_id_, false);
     return;
   }
-  // delete bucket
+  HASH_TABLE_BUCKET_TYPE *bucket = FetchBucketPage(bucket_pgid);
+  bool empty = bucket->IsEmpty();
   buffer_pool_manager_->UnpinPage(bucket_pgid, false);
-  buffer_pool_manager_->DeletePage(bucket_pgid);
+  if (!empty) {
+    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
+    return;
+  }
 
   // update links
-
-  auto image_pgid = dir_page->GetBucketPageId(image_idx);
-
-  dir_page->IncrLocalDepth(bucket_idx);
-  dir_page->IncrLocalDepth(image_idx);
-
-  for (size_t i = 0; i < dir_page->Size(); i++) {
-    if (dir_page->GetBucketPageId(i) == static_cast<page_id_t>(bucket_pgid)) {
+  page_id_t image_pgid = dir_page->GetBucketPageId(image_idx);
+  for (uint32_t i = 0; i < dir_page->Size(); i++) {
+    page_id_t page_id = dir_page->GetBucketPageId(i);
+    if (page_id == bucket_pgid || page_id == image_pgid) {
       dir_page->SetBucketPageId(i, image_pgid);
-      dir_page->SetLocalDepth(i, dir_page->GetLocalDepth(image_idx));
+      dir_page->SetLocalDepth(i, local_depth - 1);
     }
   }
 
   while (dir_page->CanShrink()) {
     dir_page->DecrGlobalDepth();
   }
+  // The bucket is empty, so the directory update is all that has to be logged.
+  LogDirectoryUpdate(transaction, dir_page);
 
+  // delete bucket
+  buffer_pool_manager_->DeletePage(bucket_pgid);
   buffer_pool_manager_->UnpinPage(directory_page_id_, true);
 }
 
+/*****************************************************************************
+ * LOGGING
+ *****************************************************************************/
+template <typename KeyType, typename ValueType, typename KeyComparator>
+lsn_t HASH_TABLE_TYPE::AppendLogRecord(Transaction *transaction, LogRecord *log_record) {
+  lsn_t lsn = log_manager_->AppendLogRecord(log_record);
+  if (transaction != nullptr) {
+    transaction->SetPrevLSN(lsn);
+  }
+  return lsn;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::LogBucketChange(Transaction *transaction, LogRecordType type, HASH_TABLE_BUCKET_TYPE *bucket,
+                                      uint32_t bucket_idx, const KeyType &key, const ValueType &value) {
+  if (!IsLogging()) {
+    return;
+  }
+  MappingType entry(key, value);
+  std::vector<char> entry_data(reinterpret_cast<const char *>(&entry),
+                               reinterpret_cast<const char *>(&entry) + sizeof(MappingType));
+  LogRecord log_record(transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                       transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(), type, directory_page_id_,
+                       bucket->GetPageId(), bucket_idx, Hash(key), sizeof(MappingType), std::move(entry_data));
+  bucket->SetLSN(AppendLogRecord(transaction, &log_record));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::LogBucketSplit(Transaction *transaction, HASH_TABLE_BUCKET_TYPE *bucket) {
+  if (!IsLogging()) {
+    return;
+  }
+  // Split buckets are packed from the first slot, which is where redo puts the entries back.
+  auto entries = bucket->GetAll();
+  std::vector<char> entry_data(reinterpret_cast<const char *>(entries.data()),
+                               reinterpret_cast<const char *>(entries.data() + entries.size()));
+  LogRecord log_record(transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                       transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(), bucket->GetPageId(),
+                       sizeof(MappingType), std::move(entry_data));
+  bucket->SetLSN(AppendLogRecord(transaction, &log_record));
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::LogDirectoryUpdate(Transaction *transaction, HashTableDirectoryPage *dir_page) {
+  if (!IsLogging()) {
+    return;
+  }
+  std::vector<std::pair<page_id_t, uint32_t>> buckets;
+  buckets.reserve(dir_page->Size());
+  for (uint32_t i = 0; i < dir_page->Size(); i++) {
+    buckets.emplace_back(dir_page->GetBucketPageId(i), dir_page->GetLocalDepth(i));
+  }
+  LogRecord log_record(transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                       transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(), dir_page->GetPageId(),
+                       dir_page->GetGlobalDepth(), std::move(buckets));
+  dir_page->SetLSN(AppendLogRecord(transaction, &log_record));
+}
+
 /*****************************************************************************
  * GETGLOBALDEPTH - DO NOT TOUCH
  *****************************************************************************/
@@ -16,6 +16,7 @@
 
 #include "common/exception.h"
 #include "execution/executors/delete_executor.h"
+#include "execution/plans/seq_scan_plan.h"
 #include "storage/table/tuple.h"
 
 namespace bustub {
@@ -35,20 +36,35 @@ void DeleteExecutor::Init() {
     throw Exception("table not exist");
   }
   indexs_ = catalog->GetTableIndexes(table_info_->name_);
+
+  // A child scan without a predicate hands over every row of the table, one exclusive lock on the table covers them
+  // all. Otherwise the rows are locked one by one under an intention lock.
+  auto child_plan = plan_->GetChildPlan();
+  if (child_plan->GetType() == PlanType::SeqScan) {
+    auto scan_plan = static_cast<const SeqScanPlanNode *>(child_plan);
+    if (scan_plan->GetTableOid() == plan_->TableOid() && scan_plan->GetPredicate() == nullptr &&
+        !table_info_->table_->LockTable(exec_ctx_->GetTransaction(), LockManager::LockMode::EXCLUSIVE)) {
+      throw Exception("lock table error");
+    }
+  }
   assert(child_executor_);
   child_executor_->Init();
 }
 
 bool DeleteExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) {
   Tuple tmp_tuple;
+  Transaction *txn = exec_ctx_->GetTransaction();
   while (child_executor_->Next(&tmp_tuple, rid)) {
-    auto success = table_info_->table_->MarkDelete(*rid, exec_ctx_->GetTransaction());
-    for (auto index : indexs_) {
-      index->index_->DeleteEntry(tmp_tuple, *rid, exec_ctx_->GetTransaction());
-    }
-    if (!success) {
+    // A row that was not deleted keeps its index entries, and its key range stays unlocked.
+    if (!table_info_->table_->MarkDelete(*rid, txn)) {
       throw Exception("delete error");
     }
+    for (auto index : indexs_) {
+      auto key = tmp_tuple.KeyFromTuple(table_info_->schema_, index->key_schema_, index->index_->GetKeyAttrs());
+      index->index_->DeleteEntry(key, *rid, txn);
+      txn->GetIndexWriteSet()->emplace_back(*rid, table_info_->oid_, WType::DELETE, tmp_tuple, index->index_oid_,
+                                            exec_ctx_->GetCatalog());
+    }
   }
 
   return false;
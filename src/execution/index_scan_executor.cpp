@@ -11,12 +11,72 @@
 //===----------------------------------------------------------------------===//
 #include "execution/executors/index_scan_executor.h"
 
+#include <optional>
+
+#include "common/exception.h"
+
 namespace bustub {
 IndexScanExecutor::IndexScanExecutor(ExecutorContext *exec_ctx, const IndexScanPlanNode *plan)
-    : AbstractExecutor(exec_ctx) {}
+    : AbstractExecutor(exec_ctx), plan_(plan) {}
+
+/*
+ * The index locks the range under REPEATABLE_READ, and the rows found in it, so the rows are only read in Next.
+ */
+void IndexScanExecutor::Init() {
+  Catalog *catalog = exec_ctx_->GetCatalog();
+  if (catalog == nullptr) {
+    throw Exception("get catalog error");
+  }
+  index_info_ = catalog->GetIndex(plan_->GetIndexOid());
+  if (index_info_ == Catalog::NULL_INDEX_INFO) {
+    throw Exception("index not exist");
+  }
+  table_info_ = catalog->GetTable(index_info_->table_name_);
+  if (table_info_ == Catalog::NULL_TABLE_INFO) {
+    throw Exception("table not exist");
+  }
 
-void IndexScanExecutor::Init() {}
+  Transaction *txn = exec_ctx_->GetTransaction();
+  if (txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ &&
+      !table_info_->table_->LockTable(txn, LockManager::LockMode::INTENTION_SHARED)) {
+    throw Exception("lock table error");
+  }
+  Schema *key_schema = index_info_->index_->GetKeySchema();
+  std::optional<Tuple> low_key;
+  std::optional<Tuple> high_key;
+  if (!plan_->GetLowKey().empty()) {
+    low_key.emplace(plan_->GetLowKey(), key_schema);
+  }
+  if (!plan_->GetHighKey().empty()) {
+    high_key.emplace(plan_->GetHighKey(), key_schema);
+  }
+  rids_.clear();
+  cursor_ = 0;
+  index_info_->index_->ScanRange(low_key.has_value() ? &low_key.value() : nullptr,
+                                 high_key.has_value() ? &high_key.value() : nullptr, &rids_, txn);
+  if (txn->GetState() == TransactionState::ABORTED) {
+    throw Exception("lock index range error");
+  }
+}
 
-bool IndexScanExecutor::Next(Tuple *tuple, RID *rid) { return false; }
+bool IndexScanExecutor::Next(Tuple *tuple, RID *rid) {
+  auto pred = plan_->GetPredicate();
+  while (cursor_ < rids_.size()) {
+    RID next_rid = rids_[cursor_++];
+    // A row deleted since the index was read is skipped.
+    if (!table_info_->table_->GetTuple(next_rid, tuple, exec_ctx_->GetTransaction())) {
+      if (exec_ctx_->GetTransaction()->GetState() == TransactionState::ABORTED) {
+        throw Exception("lock row error");
+      }
+      continue;
+    }
+    if (pred != nullptr && !pred->Evaluate(tuple, &table_info_->schema_).GetAs<bool>()) {
+      continue;
+    }
+    *rid = next_rid;
+    return true;
+  }
+  return false;
+}
 
 }  // namespace bustub
@@ -40,21 +40,24 @@ void InsertExecutor::Init() {
   indexs_ = catalog->GetTableIndexes(table_info_->name_);
 }
 
-void InsertExecutor::InsertOne(const Tuple &tuple) {}
+void InsertExecutor::InsertOne(const Tuple &tuple, RID *rid) {
+  Transaction *txn = exec_ctx_->GetTransaction();
+  if (!table_info_->table_->InsertTuple(tuple, rid, txn)) {
+    throw Exception("too large to insert");
+  }
+  for (auto index : indexs_) {
+    auto key = tuple.KeyFromTuple(table_info_->schema_, index->key_schema_, index->index_->GetKeyAttrs());
+    index->index_->InsertEntry(key, *rid, txn);
+    txn->GetIndexWriteSet()->emplace_back(*rid, table_info_->oid_, WType::INSERT, tuple, index->index_oid_,
+                                          exec_ctx_->GetCatalog());
+  }
+}
 
 bool InsertExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) {
   if (plan_->IsRawInsert()) {
     auto values = plan_->RawValues();
     for (const auto &value : values) {
-      Tuple tmp_tuple(value, &table_info_->schema_);
-      bool success = table_info_->table_->InsertTuple(tmp_tuple, rid, exec_ctx_->GetTransaction());
-      // update index
-      for (auto index : indexs_) {
-        index->index_->InsertEntry(tmp_tuple, *rid, exec_ctx_->GetTransaction());
-      }
-      if (!success) {
-        throw Exception("too large to insert");
-      }
+      InsertOne(Tuple(value, &table_info_->schema_), rid);
     }
   } else {
     // assert valid has been done
@@ -65,13 +68,7 @@ bool InsertExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) {
     // get value form child
     Tuple tmp_tuple;
     while (child_executor_->Next(&tmp_tuple, rid)) {
-      bool success = table_info_->table_->InsertTuple(tmp_tuple, rid, exec_ctx_->GetTransaction());
-      for (auto index : indexs_) {
-        index->index_->InsertEntry(tmp_tuple, *rid, exec_ctx_->GetTransaction());
-      }
-      if (!success) {
-        throw Exception("too large to insert");
-      }
+      InsertOne(tmp_tuple, rid);
     }
   }
   return false;
@@ -37,6 +37,13 @@ void SeqScanExecutor::Init() {
   }
   // create table iter
   TableHeap *table_heap = catalog->GetTable(plan_->GetTableOid())->table_.get();
+  // Under REPEATABLE_READ the scan would lock every row it passes and keep the locks, one shared lock on the table
+  // does the same. Other isolation levels lock rows one by one under an intention lock.
+  Transaction *txn = exec_ctx_->GetTransaction();
+  if (txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ &&
+      !table_heap->LockTable(txn, LockManager::LockMode::SHARED)) {
+    throw Exception("lock table error");
+  }
   iter_.emplace(table_heap->Begin(exec_ctx_->GetTransaction()));
 }
 
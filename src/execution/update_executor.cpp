@@ -14,6 +14,7 @@
 
 #include "common/exception.h"
 #include "execution/executors/update_executor.h"
+#include "execution/plans/seq_scan_plan.h"
 #include "storage/table/tuple.h"
 
 namespace bustub {
@@ -33,21 +34,40 @@ void UpdateExecutor::Init() {
     throw Exception("table not exist");
   }
   indexs_ = catalog->GetTableIndexes(table_info_->name_);
+
+  // A child scan without a predicate hands over every row of the table, one exclusive lock on the table covers them
+  // all. Otherwise the rows are locked one by one under an intention lock.
+  auto child_plan = plan_->GetChildPlan();
+  if (child_plan->GetType() == PlanType::SeqScan) {
+    auto scan_plan = static_cast<const SeqScanPlanNode *>(child_plan);
+    if (scan_plan->GetTableOid() == plan_->TableOid() && scan_plan->GetPredicate() == nullptr &&
+        !table_info_->table_->LockTable(exec_ctx_->GetTransaction(), LockManager::LockMode::EXCLUSIVE)) {
+      throw Exception("lock table error");
+    }
+  }
   child_executor_->Init();
 }
 
 bool UpdateExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) {
   Tuple tmp_tuple;
+  Transaction *txn = exec_ctx_->GetTransaction();
   while (child_executor_->Next(&tmp_tuple, rid)) {
     auto new_tuple = GenerateUpdatedTuple(tmp_tuple);
-    auto success = table_info_->table_->UpdateTuple(new_tuple, *rid, exec_ctx_->GetTransaction());
+    // A row that was not updated keeps its index entries, and its key ranges stay unlocked.
+    if (!table_info_->table_->UpdateTuple(new_tuple, *rid, txn)) {
+      throw Exception("update error");
+    }
     // update indexs
     for (auto index : indexs_) {
-      index->index_->DeleteEntry(tmp_tuple, tmp_tuple.GetRid(), exec_ctx_->GetTransaction());
-      index->index_->InsertEntry(new_tuple, *rid, exec_ctx_->GetTransaction());
-    }
-    if (!success) {
-      throw Exception("update error");
+      const auto &key_attrs = index->index_->GetKeyAttrs();
+      auto old_key = tmp_tuple.KeyFromTuple(table_info_->schema_, index->key_schema_, key_attrs);
+      auto new_key = new_tuple.KeyFromTuple(table_info_->schema_, index->key_schema_, key_attrs);
+      index->index_->DeleteEntry(old_key, *rid, txn);
+      index->index_->InsertEntry(new_key, *rid, txn);
+      IndexWriteRecord record(*rid, table_info_->oid_, WType::UPDATE, new_tuple, index->index_oid_,
+                              exec_ctx_->GetCatalog());
+      record.old_tuple_ = tmp_tuple;
+      txn->GetIndexWriteSet()->push_back(record);
     }
   }
 
@@ -87,6 +87,15 @@ class BufferPoolManager {
   /** @return size of the buffer pool */
   virtual size_t GetPoolSize() = 0;
 
+  /**
+   * Collect the dirty page table for a fuzzy checkpoint: every page that may hold changes that are not on disk yet,
+   * mapped to its recLSN, the oldest LSN that may have changed it since it was last written out.
+   * @param[out] dirty_page_table the dirty pages and their recLSNs are added to this map
+   */
+  void GetDirtyPageTable(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) {
+    GetDirtyPageTableImp(dirty_page_table);
+  }
+
  protected:
   /**
    * Grading function. Do not modify!
@@ -141,5 +150,11 @@ class BufferPoolManager {
    * Flushes all the pages in the buffer pool to disk.
    */
   virtual void FlushAllPgsImp() = 0;
+
+  /**
+   * Adds every page that may be dirty to dirty_page_table along with its recLSN.
+   * @param[out] dirty_page_table the dirty page table being collected
+   */
+  virtual void GetDirtyPageTableImp(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) = 0;
 };
 }  // namespace bustub
@@ -58,6 +58,12 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /** @return pointer to all the pages in the buffer pool */
   Page *GetPages() { return pages_; }
 
+  /** @return how many evictions had to force the log to disk before writing back their victim */
+  uint64_t GetNumLogForcedEvictions() const { return log_forced_evictions_; }
+
+  /** @return how many explicit page flushes had to force the log to disk first */
+  uint64_t GetNumLogForcedFlushes() const { return log_forced_flushes_; }
+
  protected:
   /**
    * Fetch the requested page from the buffer pool.
@@ -77,7 +83,7 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /**
    * Flushes the target page to disk.
    * @param page_id id of page to be flushed, cannot be INVALID_PAGE_ID
-   * @return false if the page could not be found in the page table, true otherwise
+   * @return false if the page could not be found in the page table or could not be written, true otherwise
    */
   bool FlushPgImp(page_id_t page_id) override;
 
@@ -100,6 +106,49 @@ class BufferPoolManagerInstance : public BufferPoolManager {
    */
   void FlushAllPgsImp() override;
 
+  /**
+   * Adds every page that may be dirty to dirty_page_table along with its recLSN.
+   * @param[out] dirty_page_table the dirty page table being collected
+   */
+  void GetDirtyPageTableImp(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) override;
+
+  /**
+   * Pick a frame to evict from the replacer. Among the first few candidates, a frame that can be written back without
+   * forcing the log (it is clean, or its page LSN is already persistent) is preferred.
+   * @param[out] frame_id the victim frame
+   * @return false if every frame is pinned
+   */
+  bool PickVictim(frame_id_t *frame_id);
+
+  /**
+   * Evict a page from the replacer to make room for another one: it is written back if it is dirty and dropped from
+   * the page table. If the log has to be forced first, latch_ is released while the log manager waits for the disk.
+   * @param lock the lock the caller holds on latch_
+   * @param[out] frame_id the frame that is free now
+   * @return false if every frame is pinned, or the victim could not be written back and stays cached
+   */
+  bool EvictVictim(std::unique_lock<std::mutex> *lock, frame_id_t *frame_id);
+
+  /**
+   * Force the log up to the page LSN if that part of it is not persistent yet, before page is written back.
+   * @param page the page about to be written back
+   * @return true if the log had to be forced
+   */
+  bool ForceLog(Page *page);
+
+  /**
+   * @param page a page about to be written back
+   * @return the LSN the log has to be persistent up to before page is written back, INVALID_LSN if it already is
+   */
+  lsn_t UnpersistedLSN(Page *page);
+
+  /**
+   * Start tracking the recLSN of a page that is being pinned. Every change made while it is pinned is logged after
+   * this point, so the next LSN is a safe lower bound. Pages that are already dirty keep their older recLSN.
+   * @param page the page being pinned
+   */
+  void TrackRecLSN(Page *page);
+
   /**
    * Allocate a page on disk.∂
    * @return the id of the allocated page
@@ -129,6 +178,12 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   const uint32_t instance_index_ = 0;
   /** Each BPI maintains its own counter for page_ids to hand out, must ensure they mod back to its instance_index_ */
   std::atomic<page_id_t> next_page_id_ = instance_index_;
+  /** How many replacer candidates PickVictim considers when looking for a victim that does not force the log. */
+  static constexpr size_t VICTIM_CANDIDATES = 8;
+  /** Evictions that forced the log, see EvictVictim. */
+  std::atomic<uint64_t> log_forced_evictions_{0};
+  /** FlushPage/FlushAllPages writes that forced the log. */
+  std::atomic<uint64_t> log_forced_flushes_{0};
 
   /** Array of buffer pool pages. */
   Page *pages_;
@@ -40,6 +40,9 @@ class LRUReplacer : public Replacer {
 
   bool Victim(frame_id_t *frame_id) override;
 
+  bool VictimPreferring(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &cheap,
+                        size_t max_candidates) override;
+
   void Pin(frame_id_t frame_id) override;
 
   void Unpin(frame_id_t frame_id) override;
@@ -15,6 +15,7 @@
 #include <cstddef>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 #include "buffer/buffer_pool_manager.h"
 #include "recovery/log_manager.h"
@@ -91,6 +92,12 @@ class ParallelBufferPoolManager : public BufferPoolManager {
    */
   void FlushAllPgsImp() override;
 
+  /**
+   * Adds every page that may be dirty to dirty_page_table along with its recLSN.
+   * @param[out] dirty_page_table the dirty page table being collected
+   */
+  void GetDirtyPageTableImp(std::unordered_map<page_id_t, lsn_t> *dirty_page_table) override;
+
  protected:
   std::vector<std::unique_ptr<BufferPoolManager>> managers_{};
   std::mutex latch_{};
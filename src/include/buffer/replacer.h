@@ -12,6 +12,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <functional>
+
 #include "common/config.h"
 
 namespace bustub {
@@ -31,6 +34,20 @@ class Replacer {
    */
   virtual bool Victim(frame_id_t *frame_id) = 0;
 
+  /**
+   * Remove a victim frame, preferring frames that are cheap to evict among the first candidates the replacement policy
+   * would pick. Policies that cannot rank their candidates simply return Victim.
+   * @param[out] frame_id id of frame that was removed
+   * @param cheap returns true for frames that are cheap to evict
+   * @param max_candidates how many candidates to look at before falling back to the first one
+   * @return true if a victim frame was found, false otherwise
+   */
+  virtual bool VictimPreferring(frame_id_t *frame_id,
+                                __attribute__((unused)) const std::function<bool(frame_id_t)> &cheap,
+                                __attribute__((unused)) size_t max_candidates) {
+    return Victim(frame_id);
+  }
+
   /**
    * Pins a frame, indicating that it should not be victimized until it is unpinned.
    * @param frame_id the id of the frame to pin
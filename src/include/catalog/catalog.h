@@ -21,6 +21,7 @@
 #include "buffer/buffer_pool_manager.h"
 #include "catalog/schema.h"
 #include "container/hash/hash_function.h"
+#include "storage/index/b_plus_tree_index.h"
 #include "storage/index/extendible_hash_table_index.h"
 #include "storage/index/index.h"
 #include "storage/table/table_heap.h"
@@ -57,6 +58,9 @@ struct TableInfo {
   const table_oid_t oid_;
 };
 
+/** The structures an index can be built on. */
+enum class IndexType { HASH, BPLUSTREE };
+
 /**
  * The IndexInfo class maintains metadata about a index.
  */
@@ -131,6 +135,7 @@ class Catalog {
 
     // Fetch the table OID for the new table
     const auto table_oid = next_table_oid_.fetch_add(1);
+    table->SetTableOid(table_oid);
 
     // Construct the table information
     auto meta = std::make_unique<TableInfo>(schema, table_name, std::move(table), table_oid);
@@ -186,12 +191,15 @@ class Catalog {
    * @param key_attrs Key attributes
    * @param keysize Size of the key
    * @param hash_function The hash function for the index
+   * @param index_type The structure to build the index on; only B+ tree indexes support range scans. A B+ tree keeps
+   * its root in the header page, which must have been allocated as the first page of the buffer pool
    * @return A (non-owning) pointer to the metadata of the new table
    */
   template <class KeyType, class ValueType, class KeyComparator>
   IndexInfo *CreateIndex(Transaction *txn, const std::string &index_name, const std::string &table_name,
                          const Schema &schema, const Schema &key_schema, const std::vector<uint32_t> &key_attrs,
-                         std::size_t keysize, HashFunction<KeyType> hash_function) {
+                         std::size_t keysize, HashFunction<KeyType> hash_function,
+                         IndexType index_type = IndexType::HASH) {
     // Reject the creation request for nonexistent table
     if (table_names_.find(table_name) == table_names_.end()) {
       return NULL_INDEX_INFO;
@@ -211,11 +219,14 @@ class Catalog {
     auto meta = std::make_unique<IndexMetadata>(index_name, table_name, &schema, key_attrs);
 
     // Construct the index, take ownership of metadata
-    // TODO(Kyle): We should update the API for CreateIndex
-    // to allow specification of the index type itself, not
-    // just the key, value, and comparator types
-    auto index = std::make_unique<ExtendibleHashTableIndex<KeyType, ValueType, KeyComparator>>(std::move(meta), bpm_,
-                                                                                               hash_function);
+    std::unique_ptr<Index> index;
+    if (index_type == IndexType::BPLUSTREE) {
+      index = std::make_unique<BPlusTreeIndex<KeyType, ValueType, KeyComparator>>(std::move(meta), bpm_, lock_manager_,
+                                                                                  log_manager_);
+    } else {
+      index = std::make_unique<ExtendibleHashTableIndex<KeyType, ValueType, KeyComparator>>(
+          std::move(meta), bpm_, hash_function, log_manager_);
+    }
 
     // Populate the index with all tuples in table heap
     auto *table_meta = GetTable(table_name);
@@ -324,7 +335,7 @@ class Catalog {
 
  private:
   [[maybe_unused]] BufferPoolManager *bpm_;
-  [[maybe_unused]] LockManager *lock_manager_;
+  LockManager *lock_manager_;
   [[maybe_unused]] LogManager *log_manager_;
 
   /**
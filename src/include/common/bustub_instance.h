@@ -39,7 +39,8 @@ class BustubInstance {
     transaction_manager_ = new TransactionManager(lock_manager_, log_manager_);
 
     // checkpoints
-    checkpoint_manager_ = new CheckpointManager(transaction_manager_, log_manager_, buffer_pool_manager_);
+    checkpoint_manager_ =
+        new CheckpointManager(transaction_manager_, log_manager_, buffer_pool_manager_, disk_manager_);
   }
 
   ~BustubInstance() {
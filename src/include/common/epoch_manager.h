@@ -0,0 +1,132 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager.h
+//
+// Identification: src/include/common/epoch_manager.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+
+#include "common/macros.h"
+
+namespace bustub {
+
+/** Default number of threads that can be inside an epoch of one EpochManager at the same time. */
+static constexpr size_t DEFAULT_EPOCH_SLOTS = 64;
+/** Default number of retired objects an EpochManager keeps before Retire tries to free some itself. */
+static constexpr size_t DEFAULT_EPOCH_GARBAGE_THRESHOLD = 1024;
+
+class EpochManager;
+
+/**
+ * EpochGuard pins the current epoch for as long as it lives: nothing retired while it lives is freed before it goes
+ * away. Take one before reading a shared structure without latches, and drop every pointer read through it with it.
+ */
+class EpochGuard {
+ public:
+  explicit EpochGuard(EpochManager *epoch_manager);
+  ~EpochGuard();
+
+  DISALLOW_COPY_AND_MOVE(EpochGuard);
+
+ private:
+  EpochManager *epoch_manager_;
+  /** The slot of the manager that publishes our epoch. */
+  size_t slot_;
+};
+
+/**
+ * EpochManager defers freeing objects that lock-free readers may still hold, until no reader can have them any more.
+ *
+ * Readers announce themselves with an EpochGuard, which copies the global epoch into a slot of their own while it
+ * lives. A writer unlinks an object so that no new reader finds it, then hands it to Retire, which files it under the
+ * global epoch of the moment. The global epoch only moves on when every reader inside an epoch is in the current one,
+ * so once it is two ahead of an object's epoch, every reader that could have found the object has left, and the object
+ * is freed.
+ *
+ * Garbage is bounded: past the garbage threshold, Retire tries to move the epoch on and frees what it can itself, and
+ * past twice the threshold a thread that holds no guard waits in Retire until the readers let it free enough. So
+ * guards are meant to be short, and a thread must not retire while it holds something a reader inside a guard waits
+ * for. The manager must outlive every guard, and frees what is still retired when it is destroyed.
+ */
+class EpochManager {
+ public:
+  /**
+   * @param num_slots how many threads can hold a guard at the same time, more wait for a slot
+   * @param garbage_threshold how many retired objects Retire lets pile up before it frees some itself
+   */
+  explicit EpochManager(size_t num_slots = DEFAULT_EPOCH_SLOTS,
+                        size_t garbage_threshold = DEFAULT_EPOCH_GARBAGE_THRESHOLD);
+
+  /** Frees everything still retired. No guard may be alive. */
+  ~EpochManager();
+
+  DISALLOW_COPY_AND_MOVE(EpochManager);
+
+  /**
+   * Hand over an object that is no longer reachable for new readers, to be freed by deleter once the readers that
+   * might still have it are gone. May wait for readers when there is too much garbage, see above.
+   */
+  void Retire(void *object, void (*deleter)(void *));
+
+  /** Retire an object allocated with new. */
+  template <typename T>
+  void Retire(T *object) {
+    Retire(object, [](void *obj) { delete static_cast<T *>(obj); });
+  }
+
+  /**
+   * Move the global epoch on if every reader is in the current one, then free what no reader can hold any more.
+   * @return the number of objects freed
+   */
+  size_t Reclaim();
+
+  /** @return the global epoch */
+  inline uint64_t GetEpoch() const { return global_epoch_; }
+
+  /** @return the number of objects retired and not freed yet */
+  size_t GetGarbageCount();
+
+ private:
+  friend class EpochGuard;
+
+  /** The epoch one reader is in, 0 if the slot is free. Slots sit on cache lines of their own. */
+  struct alignas(64) EpochSlot {
+    std::atomic<uint64_t> epoch_{0};
+  };
+
+  /** An object waiting for its epoch to end. */
+  struct Retired {
+    uint64_t epoch_;
+    void *object_;
+    void (*deleter_)(void *);
+  };
+
+  /** Publish the global epoch in a free slot. @return the slot */
+  size_t Enter();
+  /** Free the slot taken by Enter. */
+  void Exit(size_t slot);
+  /** Move the global epoch on unless a reader is still in an older one. */
+  bool TryAdvance();
+
+  std::atomic<uint64_t> global_epoch_{1};
+  size_t num_slots_;
+  std::unique_ptr<EpochSlot[]> slots_;
+  size_t garbage_threshold_;
+  /** Protects garbage_. */
+  std::mutex garbage_latch_;
+  /** Retired objects, oldest epoch first. */
+  std::deque<Retired> garbage_;
+};
+
+}  // namespace bustub
@@ -13,11 +13,15 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <list>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -29,12 +33,92 @@ namespace bustub {
 
 class TransactionManager;
 
+/** Default number of shards of the lock table. */
+static constexpr size_t DEFAULT_LOCK_TABLE_SHARDS = 64;
+/** Default number of row locks a transaction may hold on one table before they are escalated to a table lock. */
+static constexpr size_t DEFAULT_LOCK_ESCALATION_THRESHOLD = 5000;
+
+/** What the deadlock detector found so far, and what it took. */
+struct DeadlockStats {
+  /** Number of completed detection passes. */
+  uint64_t passes_{0};
+  /** Number of cycles broken, one transaction aborted each. */
+  uint64_t deadlocks_{0};
+  /** How long the last pass took to build the waits-for graph and break its cycles. */
+  std::chrono::microseconds last_pass_duration_{0};
+  /** The longest pass so far. */
+  std::chrono::microseconds max_pass_duration_{0};
+};
+
+/** Default number of rows the lock manager keeps contention counts of. */
+static constexpr size_t DEFAULT_HOT_LOCK_ROWS = 16;
+/** By default one lock request of this many of each thread is sampled for the contention counters. */
+static constexpr uint32_t DEFAULT_CONTENTION_SAMPLE_EVERY = 64;
+
+/** The sampled lock waits on one row or table, or on all of them together. */
+struct LockContention {
+  /** Number of sampled requests that had to wait. */
+  uint64_t waits_{0};
+  /** How many of waits_ may have been waits on other rows, which the row took the counters of. 0 for tables. */
+  uint64_t error_{0};
+  /** Total and longest time the waits took, whether they ended in a grant or an abort. */
+  std::chrono::microseconds total_wait_{0};
+  std::chrono::microseconds max_wait_{0};
+  /** The longest queue a sampled request had to wait in, counting itself and the granted requests. */
+  size_t max_queue_length_{0};
+
+  inline void Record(std::chrono::microseconds wait, size_t queue_length) {
+    waits_++;
+    total_wait_ += wait;
+    max_wait_ = std::max(max_wait_, wait);
+    max_queue_length_ = std::max(max_queue_length_, queue_length);
+  }
+};
+
+/** What the contention instrumentation of a lock manager sampled since it was last reset. */
+struct LockContentionStats {
+  /** One lock request of every sample_every_ of each thread is sampled, none if 0. */
+  uint32_t sample_every_{0};
+  /** Number of sampled lock requests, whether they waited or not. */
+  uint64_t requests_{0};
+  /** The sampled waits on all rows and tables together. */
+  LockContention all_;
+  /** The most waited for rows, most waits first. */
+  std::vector<std::pair<RID, LockContention>> hot_rows_;
+  /** Every table with sampled waits, most waits first. */
+  std::vector<std::pair<table_oid_t, LockContention>> hot_tables_;
+};
+
 /**
- * LockManager handles transactions asking for locks on records.
+ * LockManager handles transactions asking for locks on records, and on tables as a whole.
+ *
+ * Locks form a two-level hierarchy. A table can be locked in shared (S) or exclusive (X) mode, which covers all of its
+ * rows, or in one of the intention modes: intention shared (IS) and intention exclusive (IX) announce shared or
+ * exclusive locks on single rows, shared intention exclusive (SIX) reads the whole table and writes single rows. Rows
+ * only know S and X, and are locked under the matching intention lock on their table.
+ *
+ * Deadlocks are either prevented or detected. Under PREVENTION, wound-wait: a transaction that needs a lock held or
+ * requested in a conflicting mode by a younger transaction aborts (wounds) the younger one, and waits for older ones.
+ * Under DETECTION everybody waits, and a background thread builds the waits-for graph every cycle_detection_interval
+ * and aborts the youngest transaction of every cycle in it. Requests are granted in FIFO order.
+ *
+ * The lock table is split into shards by RID, and every RID has its own request queue with its own latch. A shard
+ * latch is only held to find, create or remove a queue; granting, waiting and releasing only take the latch of the
+ * queue, so transactions locking different rows do not contend.
+ *
+ * Lock waits are instrumented to find the rows and tables transactions queue up for. A sample of the lock requests is
+ * counted, and the sampled requests that cannot be granted right away are timed. Waits are summed up per table, and
+ * per row for the rows waited for most: the Space-Saving algorithm keeps counters for a fixed number of rows, and a
+ * row that is not among them takes over the counters of the least waited for one. Any row that had more than 1/k of
+ * the waits is among k counters. Requests that are not sampled only count up a thread-local counter, and only one of
+ * every DEFAULT_CONTENTION_SAMPLE_EVERY is sampled unless SetContentionSampling says otherwise.
  */
 class LockManager {
-  enum class LockMode { SHARED, EXCLUSIVE };
+ public:
+  enum class LockMode { SHARED, EXCLUSIVE, INTENTION_SHARED, INTENTION_EXCLUSIVE, SHARED_INTENTION_EXCLUSIVE };
+  enum class DeadlockMode { PREVENTION, DETECTION };
 
+ private:
   class LockRequest {
    public:
     LockRequest(txn_id_t txn_id, LockMode lock_mode) : txn_id_(txn_id), lock_mode_(lock_mode), granted_(false) {}
@@ -46,20 +130,38 @@ class LockManager {
 
   class LockRequestQueue {
    public:
+    /** Protects everything below. */
+    std::mutex latch_;
     std::list<LockRequest> request_queue_;
     // for notifying blocked transactions on this rid
     std::condition_variable cv_;
     // txn_id of an upgrading transaction (if any)
     txn_id_t upgrading_ = INVALID_TXN_ID;
+    /** Set when the empty queue was taken out of the lock table, whoever still holds it looks the RID up again. */
+    bool removed_{false};
+    /** The row the queue is for, or the table if it is a queue of table locks. */
+    RID rid_;
+    table_oid_t oid_{INVALID_TABLE_OID};
+  };
+
+  /** A part of the lock table. */
+  struct LockTableShard {
+    /** Protects queues_, but not the queues themselves. */
+    std::mutex latch_;
+    std::unordered_map<RID, std::shared_ptr<LockRequestQueue>> queues_;
   };
 
  public:
   /**
-   * Creates a new lock manager configured for the deadlock prevention policy.
+   * Creates a new lock manager configured for the deadlock policy. Under DETECTION the detector thread starts right
+   * away.
+   * @param deadlock_mode whether deadlocks are prevented or detected
+   * @param num_shards number of shards of the lock table
    */
-  LockManager() = default;
+  explicit LockManager(DeadlockMode deadlock_mode = DeadlockMode::PREVENTION,
+                       size_t num_shards = DEFAULT_LOCK_TABLE_SHARDS);
 
-  ~LockManager() = default;
+  ~LockManager();
 
   /*
    * [LOCK_NOTE]: For all locking functions, we:
@@ -68,6 +170,9 @@ class LockManager {
    * 3. it is undefined behavior to try locking an already locked RID in the
    * same transaction, i.e. the transaction is responsible for keeping track of
    * its current locks.
+   *
+   * A request that breaks two-phase locking aborts the transaction and returns false, as does a waiting transaction
+   * that is wounded by an older one, and any request of a read-only transaction.
    */
 
   /**
@@ -104,11 +209,236 @@ class LockManager {
    */
   bool Unlock(Transaction *txn, const RID &rid);
 
+  /**
+   * Release a lock that only protected one operation, not data the transaction read or wrote, such as the lock an
+   * insert into an index holds on the next key while it inserts. Unlike Unlock, this does not end the growing phase.
+   * @param txn the transaction releasing the lock, it should actually hold the lock
+   * @param rid the RID that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool UnlockInstant(Transaction *txn, const RID &rid);
+
+  /**
+   * Acquire a lock on a table. A transaction that already holds a weaker lock on the table has it upgraded to the
+   * weakest mode covering both, e.g. S and IX make SIX; a stronger lock is kept as is. READ_UNCOMMITTED transactions
+   * can only take IX and X. See [LOCK_NOTE] in header file.
+   * @param txn the transaction requesting the lock
+   * @param mode the requested lock mode
+   * @param oid the table to be locked
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockTable(Transaction *txn, LockMode mode, table_oid_t oid);
+
+  /**
+   * Release the lock the transaction holds on a table. Releasing S, SIX or X ends the growing phase, except for S
+   * under READ_COMMITTED.
+   * @param txn the transaction releasing the lock
+   * @param oid the table that is locked by the transaction
+   * @return true if the unlock is successful, false otherwise
+   */
+  bool UnlockTable(Transaction *txn, table_oid_t oid);
+
+  /**
+   * Replace the row locks a transaction holds on a table by one lock on the table: X if any of the rows is locked
+   * exclusively, S otherwise. The row locks are released without ending the growing phase.
+   * @param txn the transaction holding the row locks
+   * @param oid the table the rows belong to
+   * @param rows the rows of the table txn holds locks on
+   * @return true if the table lock is granted, false otherwise; the row locks are kept then
+   */
+  bool EscalateTableLock(Transaction *txn, table_oid_t oid, const std::vector<RID> &rows);
+
+  /**
+   * Set how many row locks a transaction may take on one table before TableHeap escalates them, 0 never escalates.
+   * @param threshold the number of row locks
+   */
+  inline void SetEscalationThreshold(size_t threshold) { escalation_threshold_ = threshold; }
+  inline size_t GetEscalationThreshold() const { return escalation_threshold_; }
+
+  /**
+   * Look up the lock a transaction holds on a table.
+   * @param[out] mode set to the mode of the lock
+   * @return false if txn holds no lock on table oid
+   */
+  static bool GetTableLockMode(Transaction *txn, table_oid_t oid, LockMode *mode);
+
+  /** @return true if a lock in mode held implies everything a lock in mode requested allows */
+  static inline bool Covers(LockMode held, LockMode requested) { return Combine(held, requested) == held; }
+
+  /*** Graph API ***/
+  /**
+   * Adds an edge from t1 -> t2, meaning t1 waits for t2.
+   * @param t1 transaction waiting for a lock
+   * @param t2 transaction being waited for
+   */
+  void AddEdge(txn_id_t t1, txn_id_t t2);
+
+  /**
+   * Removes an edge from t1 -> t2.
+   * @param t1 transaction waiting for a lock
+   * @param t2 transaction being waited for
+   */
+  void RemoveEdge(txn_id_t t1, txn_id_t t2);
+
+  /**
+   * Checks if the graph has a cycle. The search starts from the lowest transaction id and follows the lowest edges
+   * first, so the same graph always yields the same cycle.
+   * @param[out] txn_id if the graph has a cycle, the youngest transaction in it
+   * @return false if the graph has no cycle, otherwise stores the youngest transaction id in txn_id
+   */
+  bool HasCycle(txn_id_t *txn_id);
+
+  /** @return the list of all edges in the graph, used for testing only */
+  std::vector<std::pair<txn_id_t, txn_id_t>> GetEdgeList();
+
+  /**
+   * Build the waits-for graph from the request queues and abort the youngest transaction of each cycle in it, waking
+   * it up wherever it waits. The detector thread runs this every cycle_detection_interval.
+   * @return the number of transactions aborted
+   */
+  size_t DetectDeadlocks();
+
+  /** @return a snapshot of the deadlock detection metrics */
+  DeadlockStats GetDeadlockStats();
+
+  /**
+   * Configure the contention instrumentation, and reset it.
+   * @param sample_every sample one lock request of every sample_every of each thread, 1 samples all, 0 none
+   * @param hot_rows the number of rows to keep wait counters for
+   */
+  void SetContentionSampling(uint32_t sample_every, size_t hot_rows = DEFAULT_HOT_LOCK_ROWS);
+
+  /** @return a snapshot of the lock waits sampled since the last reset */
+  LockContentionStats GetContentionStats();
+
+  /** Forget the lock waits sampled so far. */
+  void ResetContentionStats();
+
  private:
-  std::mutex latch_;
+  /** Body of the detector thread: detect deadlocks every cycle_detection_interval until stopped. */
+  void RunCycleDetection();
+
+  /**
+   * Add the edges of the requests waiting in queue to the graph, and remember where they wait. A waiting request
+   * waits for the granted requests and the requests queued before it that it conflicts with.
+   */
+  void AddQueueEdges(LockRequestQueue *queue, std::unordered_map<txn_id_t, LockRequestQueue *> *waiting_in);
+
+  /** Take t and its edges out of the graph. */
+  void RemoveVertex(txn_id_t t);
+
+  /** Depth-first search for a cycle through the vertices reachable from t. The caller holds waits_for_latch_. */
+  bool FindCycle(txn_id_t t, std::vector<txn_id_t> *path, std::unordered_set<txn_id_t> *on_path,
+                 std::unordered_set<txn_id_t> *visited, txn_id_t *victim);
+
+  /** @return true if two transactions may hold locks in modes a and b at the same time */
+  static bool Compatible(LockMode a, LockMode b);
+
+  /** @return the weakest mode that allows everything both a and b allow */
+  static LockMode Combine(LockMode a, LockMode b);
+
+  /** @return the set of txn that tracks its table locks in mode */
+  static std::shared_ptr<std::unordered_set<table_oid_t>> TableLockSet(Transaction *txn, LockMode mode);
+
+  /** @return the shard rid belongs to */
+  inline LockTableShard &ShardOf(const RID &rid) { return lock_table_[std::hash<RID>()(rid) % lock_table_.size()]; }
+
+  /**
+   * Find the queue of rid and latch it.
+   * @param create whether to create the queue if there is none
+   * @param[out] lock set to hold the latch of the queue
+   * @return the queue, nullptr if there is none and create is false
+   */
+  std::shared_ptr<LockRequestQueue> LatchQueue(const RID &rid, bool create, std::unique_lock<std::mutex> *lock);
+
+  /** Take the queue of rid out of the lock table if it is still empty. The caller must not hold its latch. */
+  void RemoveQueueIfEmpty(const RID &rid, const std::shared_ptr<LockRequestQueue> &queue);
+
+  /**
+   * Drop the lock txn holds on rid from the lock table and from txn's lock sets, without changing its state.
+   * @param[out] mode set to the mode of the released lock
+   * @return false if txn holds no lock on rid
+   */
+  bool ReleaseRow(Transaction *txn, const RID &rid, LockMode *mode);
+
+  /** Find or create the queue of table oid and latch it. Table queues are few and are never removed. */
+  LockRequestQueue *LatchTableQueue(table_oid_t oid, std::unique_lock<std::mutex> *lock);
+
+  /**
+   * Replace the granted request of txn in queue by a waiting request in mode ahead of all other waiting requests, and
+   * block until it is granted. The caller holds lock and checked that no other upgrade is waiting in queue.
+   * @return false if txn held no lock in queue or was aborted, it holds no lock in queue then
+   */
+  bool Upgrade(Transaction *txn, LockRequestQueue *queue, LockMode mode, std::unique_lock<std::mutex> *lock);
+
+  /**
+   * Add or turn request into a waiting request of txn in mode and block until it is granted. The caller holds lock.
+   * @return false if txn was aborted while waiting, its request is gone then
+   */
+  bool Acquire(Transaction *txn, LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+               std::unique_lock<std::mutex> *lock);
+
+  /** @return true if request conflicts with no granted request and no request queued before it */
+  static bool Grantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request);
+
+  /**
+   * Abort every younger transaction in the queue whose request conflicts with a request of txn in mode. The ones that
+   * wait in this queue are woken up; the caller hands the others to NotifyWounded once it dropped the queue latch.
+   * @return the wounded transactions that hold their lock in this queue, and may wait in another one
+   */
+  static std::vector<txn_id_t> Wound(Transaction *txn, LockMode mode, LockRequestQueue *queue);
+
+  /** Record the queue txn_id waits in under wound-wait, nullptr once it stopped waiting. No queue latch is held. */
+  void SetWaitingIn(txn_id_t txn_id, LockRequestQueue *queue);
+
+  /** Wake the wounded transactions up in the queues they wait in. No queue latch is held. */
+  void NotifyWounded(const std::vector<txn_id_t> &wounded);
+
+  /** @return true if the calling thread's lock request is to be sampled, and count it */
+  bool SampleRequest();
+
+  /** Add a sampled wait in queue to the contention counters. It started when the queue was queue_length long. */
+  void RecordWait(const LockRequestQueue &queue, std::chrono::microseconds wait, size_t queue_length);
 
   /** Lock table for lock requests. */
-  std::unordered_map<RID, LockRequestQueue> lock_table_;
+  std::vector<LockTableShard> lock_table_;
+
+  /** Protects table_lock_table_, but not the queues. */
+  std::mutex table_lock_table_latch_;
+  /** Request queues of table locks. */
+  std::unordered_map<table_oid_t, std::unique_ptr<LockRequestQueue>> table_lock_table_;
+
+  std::atomic<size_t> escalation_threshold_{DEFAULT_LOCK_ESCALATION_THRESHOLD};
+
+  const DeadlockMode deadlock_mode_;
+  /** Protects waiting_in_. Taken before a queue latch, never while one is held. */
+  std::mutex waiting_latch_;
+  /**
+   * Under wound-wait, the queue every blocked transaction waits in. A queue stays while a transaction waits in it, its
+   * request keeps it from being removed.
+   */
+  std::unordered_map<txn_id_t, LockRequestQueue *> waiting_in_;
+  /** Protects waits_for_. */
+  std::mutex waits_for_latch_;
+  /** Waits-for graph, rebuilt by every detection pass. */
+  std::unordered_map<txn_id_t, std::vector<txn_id_t>> waits_for_;
+  /** Protects deadlock_stats_. */
+  std::mutex stats_latch_;
+  DeadlockStats deadlock_stats_;
+  /** Contention instrumentation: the sampling rate, and the number of sampled requests. */
+  std::atomic<uint32_t> contention_sample_every_{DEFAULT_CONTENTION_SAMPLE_EVERY};
+  std::atomic<uint64_t> sampled_requests_{0};
+  /** Protects the wait counters below. */
+  std::mutex contention_latch_;
+  size_t hot_row_capacity_{DEFAULT_HOT_LOCK_ROWS};
+  LockContention all_waits_;
+  std::unordered_map<RID, LockContention> hot_rows_;
+  std::unordered_map<table_oid_t, LockContention> hot_tables_;
+  /** Protects enable_cycle_detection_, and wakes the detector thread up to stop. */
+  std::mutex cycle_detection_latch_;
+  std::condition_variable cycle_detection_cv_;
+  bool enable_cycle_detection_{false};
+  std::thread *cycle_detection_thread_{nullptr};
 };
 
 }  // namespace bustub
@@ -14,9 +14,11 @@
 
 #include <atomic>
 #include <deque>
+#include <limits>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
 
 #include "common/config.h"
@@ -44,9 +46,14 @@ namespace bustub {
 enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 /**
- * Transaction isolation level.
+ * Transaction isolation level. SNAPSHOT_ISOLATION reads the versions committed before the transaction began without
+ * taking any locks, and aborts on writing a row someone else wrote since.
  */
-enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED };
+enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED, SNAPSHOT_ISOLATION };
+
+/** Commit timestamps order the versions of a row. */
+using timestamp_t = int64_t;
+static constexpr timestamp_t MAX_TIMESTAMP = std::numeric_limits<timestamp_t>::max();
 
 /**
  * Type of write operation.
@@ -58,6 +65,9 @@ class Catalog;
 using table_oid_t = uint32_t;
 using index_oid_t = uint32_t;
 
+/** The oid of no table. */
+static constexpr table_oid_t INVALID_TABLE_OID = std::numeric_limits<table_oid_t>::max();
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -74,6 +84,22 @@ class TableWriteRecord {
   TableHeap *table_;
 };
 
+/**
+ * ReadRecord tracks what an optimistic transaction read of a row, to validate it at commit.
+ */
+class TableReadRecord {
+ public:
+  TableReadRecord(RID rid, bool exists, const Tuple &tuple, TableHeap *table)
+      : rid_(rid), exists_(exists), tuple_(tuple), table_(table) {}
+
+  RID rid_;
+  /** False if the row did not exist. */
+  bool exists_;
+  /** The version read. */
+  Tuple tuple_;
+  TableHeap *table_;
+};
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -145,23 +171,34 @@ class TransactionAbortException : public std::exception {
 
 /**
  * Transaction tracks information related to a transaction.
+ *
+ * A read-only transaction reads a snapshot, see TransactionManager::BeginReadOnly. It never locks or writes, so its
+ * sets are only allocated when something asks for them, by its own thread.
  */
 class Transaction {
  public:
-  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ)
+  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ,
+                       bool read_only = false)
       : state_(TransactionState::GROWING),
         isolation_level_(isolation_level),
         thread_id_(std::this_thread::get_id()),
         txn_id_(txn_id),
+        table_write_set_{NewSet<std::deque<TableWriteRecord>>(read_only)},
+        index_write_set_{NewSet<std::deque<IndexWriteRecord>>(read_only)},
         prev_lsn_(INVALID_LSN),
-        shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
-    // Initialize the sets that will be tracked.
-    table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
-    index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
-    page_set_ = std::make_shared<std::deque<bustub::Page *>>();
-    deleted_page_set_ = std::make_shared<std::unordered_set<page_id_t>>();
-  }
+        read_only_(read_only),
+        page_set_{NewSet<std::deque<bustub::Page *>>(read_only)},
+        deleted_page_set_{NewSet<std::unordered_set<page_id_t>>(read_only)},
+        shared_lock_set_{NewSet<std::unordered_set<RID>>(read_only)},
+        exclusive_lock_set_{NewSet<std::unordered_set<RID>>(read_only)},
+        s_table_lock_set_{NewSet<std::unordered_set<table_oid_t>>(read_only)},
+        x_table_lock_set_{NewSet<std::unordered_set<table_oid_t>>(read_only)},
+        is_table_lock_set_{NewSet<std::unordered_set<table_oid_t>>(read_only)},
+        ix_table_lock_set_{NewSet<std::unordered_set<table_oid_t>>(read_only)},
+        six_table_lock_set_{NewSet<std::unordered_set<table_oid_t>>(read_only)},
+        row_lock_counts_{NewSet<std::unordered_map<table_oid_t, size_t>>(read_only)},
+        read_set_{NewSet<std::unordered_map<RID, TableReadRecord>>(read_only)},
+        buffered_write_set_{NewSet<std::unordered_map<RID, TableWriteRecord>>(read_only)} {}
 
   ~Transaction() = default;
 
@@ -177,20 +214,20 @@ class Transaction {
   inline IsolationLevel GetIsolationLevel() const { return isolation_level_; }
 
   /** @return the list of table write records of this transaction */
-  inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return table_write_set_; }
+  inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return Lazy(&table_write_set_); }
 
   /** @return the list of index write records of this transaction */
-  inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return index_write_set_; }
+  inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return Lazy(&index_write_set_); }
 
   /** @return the page set */
-  inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return page_set_; }
+  inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return Lazy(&page_set_); }
 
   /**
    * Adds a tuple write record into the table write set.
    * @param write_record write record to be added
    */
   inline void AppendTableWriteRecord(const TableWriteRecord &write_record) {
-    table_write_set_->push_back(write_record);
+    Lazy(&table_write_set_)->push_back(write_record);
   }
 
   /**
@@ -198,35 +235,70 @@ class Transaction {
    * @param write_record write record to be added
    */
   inline void AppendTableWriteRecord(const IndexWriteRecord &write_record) {
-    index_write_set_->push_back(write_record);
+    Lazy(&index_write_set_)->push_back(write_record);
   }
 
   /**
    * Adds a page into the page set.
    * @param page page to be added
    */
-  inline void AddIntoPageSet(Page *page) { page_set_->push_back(page); }
+  inline void AddIntoPageSet(Page *page) { Lazy(&page_set_)->push_back(page); }
 
   /** @return the deleted page set */
-  inline std::shared_ptr<std::unordered_set<page_id_t>> GetDeletedPageSet() { return deleted_page_set_; }
+  inline std::shared_ptr<std::unordered_set<page_id_t>> GetDeletedPageSet() { return Lazy(&deleted_page_set_); }
 
   /**
    * Adds a page to the deleted page set.
    * @param page_id id of the page to be marked as deleted
    */
-  inline void AddIntoDeletedPageSet(page_id_t page_id) { deleted_page_set_->insert(page_id); }
+  inline void AddIntoDeletedPageSet(page_id_t page_id) { Lazy(&deleted_page_set_)->insert(page_id); }
 
   /** @return the set of resources under a shared lock */
-  inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() { return shared_lock_set_; }
+  inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() { return Lazy(&shared_lock_set_); }
 
   /** @return the set of resources under an exclusive lock */
-  inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() { return exclusive_lock_set_; }
+  inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() { return Lazy(&exclusive_lock_set_); }
 
   /** @return true if rid is shared locked by this transaction */
-  bool IsSharedLocked(const RID &rid) { return shared_lock_set_->find(rid) != shared_lock_set_->end(); }
+  bool IsSharedLocked(const RID &rid) { return Contains(shared_lock_set_, rid); }
 
   /** @return true if rid is exclusively locked by this transaction */
-  bool IsExclusiveLocked(const RID &rid) { return exclusive_lock_set_->find(rid) != exclusive_lock_set_->end(); }
+  bool IsExclusiveLocked(const RID &rid) { return Contains(exclusive_lock_set_, rid); }
+
+  /** @return the set of tables under a shared lock */
+  inline std::shared_ptr<std::unordered_set<table_oid_t>> GetSharedTableLockSet() { return Lazy(&s_table_lock_set_); }
+
+  /** @return the set of tables under an exclusive lock */
+  inline std::shared_ptr<std::unordered_set<table_oid_t>> GetExclusiveTableLockSet() {
+    return Lazy(&x_table_lock_set_);
+  }
+
+  /** @return the set of tables under an intention shared lock */
+  inline std::shared_ptr<std::unordered_set<table_oid_t>> GetIntentionSharedTableLockSet() {
+    return Lazy(&is_table_lock_set_);
+  }
+
+  /** @return the set of tables under an intention exclusive lock */
+  inline std::shared_ptr<std::unordered_set<table_oid_t>> GetIntentionExclusiveTableLockSet() {
+    return Lazy(&ix_table_lock_set_);
+  }
+
+  /** @return the set of tables under a shared intention exclusive lock */
+  inline std::shared_ptr<std::unordered_set<table_oid_t>> GetSharedIntentionExclusiveTableLockSet() {
+    return Lazy(&six_table_lock_set_);
+  }
+
+  /** @return true if table oid is shared locked by this transaction */
+  bool IsTableSharedLocked(table_oid_t oid) { return Contains(s_table_lock_set_, oid); }
+
+  /** @return true if table oid is exclusively locked by this transaction */
+  bool IsTableExclusiveLocked(table_oid_t oid) { return Contains(x_table_lock_set_, oid); }
+
+  /** @return true if table oid is locked in shared intention exclusive mode by this transaction */
+  bool IsTableSharedIntentionExclusiveLocked(table_oid_t oid) { return Contains(six_table_lock_set_, oid); }
+
+  /** @return the number of row locks taken on each table since its last escalation, maintained by TableHeap */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, size_t>> GetRowLockCounts() { return Lazy(&row_lock_counts_); }
 
   /** @return the current state of the transaction */
   inline TransactionState GetState() { return state_; }
@@ -246,9 +318,56 @@ class Transaction {
    */
   inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
+  /** @return true if Commit should return as soon as the COMMIT record is appended, without waiting for the flush */
+  inline bool IsAsyncCommit() const { return async_commit_; }
+
+  /**
+   * Choose between synchronous and asynchronous commit for this transaction. After an asynchronous commit the COMMIT
+   * record's LSN is available through GetPrevLSN() and can be waited on with LogManager::WaitUntilPersistent().
+   * @param async_commit true to commit asynchronously
+   */
+  inline void SetAsyncCommit(bool async_commit) { async_commit_ = async_commit; }
+
+  /** @return true if the transaction was begun read-only, it aborts on any write or lock request */
+  inline bool IsReadOnly() const { return read_only_; }
+
+  /** @return true if the transaction runs under optimistic concurrency control */
+  inline bool IsOptimistic() const { return optimistic_; }
+
+  /**
+   * Choose optimistic concurrency control for this transaction, before its first read or write. It reads the latest
+   * committed versions without locks, buffers its updates and deletes, and is validated when it commits.
+   * @param optimistic true to run optimistically
+   */
+  inline void SetOptimistic(bool optimistic) { optimistic_ = optimistic; }
+
+  /** @return true while an optimistic transaction installs its buffered writes at commit */
+  inline bool IsWritePhase() const { return write_phase_; }
+  inline void SetWritePhase(bool write_phase) { write_phase_ = write_phase; }
+
+  /** @return the rows an optimistic transaction read, with what it read of them the first time */
+  inline std::shared_ptr<std::unordered_map<RID, TableReadRecord>> GetReadSet() { return Lazy(&read_set_); }
+
+  /** @return the updates and deletes an optimistic transaction buffers until it commits, one per row */
+  inline std::shared_ptr<std::unordered_map<RID, TableWriteRecord>> GetBufferedWriteSet() {
+    return Lazy(&buffered_write_set_);
+  }
+
+  /** @return the timestamp of the last commit a snapshot transaction sees */
+  inline timestamp_t GetReadTs() const { return read_ts_; }
+  inline void SetReadTs(timestamp_t read_ts) { read_ts_ = read_ts; }
+
+  /** @return the timestamp the versions written by this transaction were committed with, 0 if there are none */
+  inline timestamp_t GetCommitTs() const { return commit_ts_; }
+  inline void SetCommitTs(timestamp_t commit_ts) { commit_ts_ = commit_ts; }
+
+  /** @return the slot the transaction manager publishes the read timestamp of a snapshot transaction in */
+  inline size_t GetSnapshotSlot() const { return snapshot_slot_; }
+  inline void SetSnapshotSlot(size_t snapshot_slot) { snapshot_slot_ = snapshot_slot; }
+
  private:
-  /** The current transaction state. */
-  TransactionState state_;
+  /** The current transaction state. The lock manager aborts transactions from other threads, see Wound. */
+  std::atomic<TransactionState> state_;
   /** The isolation level of the transaction. */
   IsolationLevel isolation_level_;
   /** The thread ID, used in single-threaded transactions. */
@@ -262,6 +381,14 @@ class Transaction {
   std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
   /** The LSN of the last record written by the transaction. */
   lsn_t prev_lsn_;
+  /** True if the transaction only reads, see BeginReadOnly. */
+  bool read_only_;
+  /** True if the transaction does not wait for its COMMIT record to be flushed. */
+  bool async_commit_{false};
+  /** MVCC: the snapshot the transaction reads and the timestamp its writes committed at. */
+  timestamp_t read_ts_{0};
+  timestamp_t commit_ts_{0};
+  size_t snapshot_slot_{0};
 
   /** Concurrent index: the pages that were latched during index operation. */
   std::shared_ptr<std::deque<Page *>> page_set_;
@@ -272,6 +399,42 @@ class Transaction {
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   /** LockManager: the set of exclusive-locked tuples held by this transaction. */
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  /** LockManager: the sets of tables held by this transaction, one per lock mode. */
+  std::shared_ptr<std::unordered_set<table_oid_t>> s_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> x_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> is_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> ix_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> six_table_lock_set_;
+  /** LockManager: the number of row locks taken on each table, for lock escalation. */
+  std::shared_ptr<std::unordered_map<table_oid_t, size_t>> row_lock_counts_;
+
+  /** OCC: whether the transaction is optimistic, and whether it is installing its writes. */
+  bool optimistic_{false};
+  bool write_phase_{false};
+  /** OCC: the read set to validate, and the writes buffered until commit. */
+  std::shared_ptr<std::unordered_map<RID, TableReadRecord>> read_set_;
+  std::shared_ptr<std::unordered_map<RID, TableWriteRecord>> buffered_write_set_;
+
+  /** @return a new empty container, or nullptr for a read-only transaction until Lazy allocates it */
+  template <typename T>
+  static std::shared_ptr<T> NewSet(bool read_only) {
+    return read_only ? nullptr : std::make_shared<T>();
+  }
+
+  /** @return the container set points at, allocated first if the transaction did not have it yet */
+  template <typename T>
+  static inline const std::shared_ptr<T> &Lazy(std::shared_ptr<T> *set) {
+    if (*set == nullptr) {
+      *set = std::make_shared<T>();
+    }
+    return *set;
+  }
+
+  /** @return true if set holds key, false if it was not allocated */
+  template <typename T, typename K>
+  static inline bool Contains(const std::shared_ptr<T> &set, const K &key) {
+    return set != nullptr && set->find(key) != set->end();
+  }
 };
 
 }  // namespace bustub
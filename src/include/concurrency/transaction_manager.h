@@ -13,25 +13,47 @@
 #pragma once
 
 #include <atomic>
-#include <shared_mutex>
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "concurrency/transaction_registry.h"
 #include "recovery/log_manager.h"
 
 namespace bustub {
 class LockManager;
 
+/** Default number of snapshot transactions whose read timestamps are published without a latch. */
+static constexpr size_t DEFAULT_SNAPSHOT_SLOTS = 64;
+
 /**
  * TransactionManager keeps track of all the transactions running in the system.
+ *
+ * Snapshot transactions publish their read timestamps in slots of their own, on cache lines of their own, so that
+ * beginning and ending a snapshot touches no shared latch. Only when every slot is taken do further snapshots go to a
+ * latched overflow set. Garbage collection reads the slots to find the oldest snapshot.
  */
 class TransactionManager {
  public:
-  explicit TransactionManager(LockManager *lock_manager, LogManager *log_manager = nullptr)
-      : lock_manager_(lock_manager), log_manager_(log_manager) {}
+  /**
+   * @param lock_manager the lock manager of the transactions
+   * @param log_manager the log manager, nullptr to log nothing
+   * @param snapshot_slots how many snapshot transactions publish their read timestamps without a latch
+   */
+  explicit TransactionManager(LockManager *lock_manager, LogManager *log_manager = nullptr,
+                              size_t snapshot_slots = DEFAULT_SNAPSHOT_SLOTS)
+      : lock_manager_(lock_manager),
+        log_manager_(log_manager),
+        num_snapshot_slots_(snapshot_slots),
+        snapshot_slots_(new SnapshotSlot[snapshot_slots]) {}
 
   ~TransactionManager() = default;
 
@@ -44,10 +66,24 @@ class TransactionManager {
   Transaction *Begin(Transaction *txn = nullptr, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ);
 
   /**
-   * Commits a transaction.
+   * Begins a read-only transaction. It reads the snapshot of the last commit like a SNAPSHOT_ISOLATION transaction,
+   * but leaves out everything a transaction only needs to write: it allocates no lock or write sets, logs neither
+   * BEGIN nor COMMIT, is not registered as running and does not hold checkpoints back. Any write or lock request
+   * aborts it. Commit and Abort only end its snapshot.
+   * @return the new transaction, to be deleted by the caller once finished like any other
+   */
+  Transaction *BeginReadOnly();
+
+  /**
+   * Commits a transaction. Synchronous commits return once the COMMIT record is persistent, asynchronous commits
+   * return as soon as it is appended and rely on the log manager to flush it within its commit lag.
+   *
+   * An optimistic transaction installs its buffered writes and is validated first; if what it read changed in the
+   * meantime, it is aborted instead.
    * @param txn the transaction to commit
+   * @return false if the transaction failed validation and was aborted
    */
-  void Commit(Transaction *txn);
+  bool Commit(Transaction *txn);
 
   /**
    * Aborts a transaction
@@ -55,28 +91,64 @@ class TransactionManager {
    */
   void Abort(Transaction *txn);
 
-  /**
-   * Global list of running transactions
-   */
-
-  /** The transaction map is a global list of all the running transactions in the system. */
-  static std::unordered_map<txn_id_t, Transaction *> txn_map;
-  static std::shared_mutex txn_map_mutex;
+  /** The registry of all the running transactions in the system. Transactions leave it when they finish. */
+  static TransactionRegistry txn_registry;
 
   /**
    * Locates and returns the transaction with the given transaction ID.
-   * @param txn_id the id of the transaction to be found, it must exist!
+   * @param txn_id the id of the transaction to be found, it must be running!
    * @return the transaction with the given transaction id
    */
   static Transaction *GetTransaction(txn_id_t txn_id) {
-    TransactionManager::txn_map_mutex.lock_shared();
-    assert(TransactionManager::txn_map.find(txn_id) != TransactionManager::txn_map.end());
-    auto *res = TransactionManager::txn_map[txn_id];
+    auto *res = txn_registry.Find(txn_id);
     assert(res != nullptr);
-    TransactionManager::txn_map_mutex.unlock_shared();
     return res;
   }
 
+  /**
+   * @return the id of the oldest running transaction in the system, INVALID_TXN_ID if there is none. Every transaction
+   * begun with Begin counts, whatever its isolation level; read-only ones are not registered and only hold back the
+   * snapshot watermark.
+   */
+  static txn_id_t GetOldestActiveTransaction() { return txn_registry.GetOldestActive(); }
+
+  /** @return the number of running transactions in the system */
+  static size_t GetRunningTransactionCount() { return txn_registry.Size(); }
+
+  /**
+   * Set whether transactions created by Begin commit asynchronously. Individual transactions can still override it
+   * with Transaction::SetAsyncCommit.
+   * @param async_commit true to make asynchronous commit the default
+   */
+  void SetAsyncCommit(bool async_commit) { async_commit_ = async_commit; }
+
+  /**
+   * Set whether transactions created by Begin run under optimistic concurrency control. Individual transactions can
+   * still override it with Transaction::SetOptimistic before their first operation.
+   * @param optimistic true to make optimistic concurrency control the default
+   */
+  void SetOptimistic(bool optimistic) { optimistic_ = optimistic; }
+
+  /**
+   * Snapshot the active transaction table for a fuzzy checkpoint. Only maintained while logging is enabled.
+   * @return every transaction that has logged BEGIN but not COMMIT or ABORT yet, with the LSN of its BEGIN record
+   */
+  std::vector<std::pair<txn_id_t, lsn_t>> GetActiveTransactionTable();
+
+  /**
+   * Drop the row versions that no running snapshot transaction can read any more: those replaced by a commit at or
+   * before the oldest snapshot. Commit and Abort of transactions that may write call it; it is cheap when there is
+   * nothing to drop.
+   * @return the number of versions dropped
+   */
+  size_t GarbageCollect();
+
+  /** @return the read timestamp of the oldest running snapshot transaction, or the last commit if there is none */
+  timestamp_t GetWatermark();
+
+  /** @return the timestamp of the last commit that wrote anything */
+  timestamp_t GetLastCommitTs();
+
   /** Prevents all transactions from performing operations, used for checkpointing. */
   void BlockAllTransactions();
 
@@ -84,6 +156,20 @@ class TransactionManager {
   void ResumeTransactions();
 
  private:
+  /**
+   * The validation and write phases of an optimistic transaction. Its buffered writes are installed like those of a
+   * locking transaction, in RID order so that committing transactions do not deadlock over each other's rows. Then
+   * every read is validated while the written rows are locked.
+   * @return false if a write failed or a read is stale
+   */
+  bool InstallAndValidate(Transaction *txn);
+
+  /** Register the snapshot of a starting transaction: it reads what was committed up to now. */
+  void BeginSnapshot(Transaction *txn);
+
+  /** Unregister the snapshot of a finished transaction. */
+  void EndSnapshot(Transaction *txn);
+
   /**
    * Releases all the locks held by the given transaction.
    * @param txn the transaction whose locks should be released
@@ -99,14 +185,63 @@ class TransactionManager {
     for (auto locked_rid : lock_set) {
       lock_manager_->Unlock(txn, locked_rid);
     }
+    // Table locks last, the row locks are held under them.
+    std::unordered_set<table_oid_t> table_lock_set;
+    for (const auto &tables :
+         {txn->GetSharedTableLockSet(), txn->GetExclusiveTableLockSet(), txn->GetIntentionSharedTableLockSet(),
+          txn->GetIntentionExclusiveTableLockSet(), txn->GetSharedIntentionExclusiveTableLockSet()}) {
+      table_lock_set.insert(tables->begin(), tables->end());
+    }
+    for (auto oid : table_lock_set) {
+      lock_manager_->UnlockTable(txn, oid);
+    }
   }
 
   std::atomic<txn_id_t> next_txn_id_{0};
+  /** Default commit mode for new transactions. */
+  std::atomic<bool> async_commit_{false};
+  /** Default concurrency control for new transactions. */
+  std::atomic<bool> optimistic_{false};
   LockManager *lock_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
 
   /** The global transaction latch is used for checkpointing. */
   ReaderWriterLatch global_txn_latch_;
+
+  /** Transactions that logged BEGIN but no COMMIT or ABORT yet, mapped to the LSN of their BEGIN record. */
+  std::unordered_map<txn_id_t, lsn_t> active_txns_;
+  /**
+   * Protects active_txns_. Held while BEGIN, COMMIT and ABORT are appended so a transaction is registered exactly
+   * when its BEGIN is in the log and the table is consistent with every LSN a checkpoint sees.
+   */
+  std::mutex active_txns_latch_;
+
+  /** The read timestamp of one snapshot transaction, NO_SNAPSHOT if the slot is free. */
+  struct alignas(64) SnapshotSlot {
+    static constexpr timestamp_t NO_SNAPSHOT = MAX_TIMESTAMP;
+    std::atomic<timestamp_t> read_ts_{NO_SNAPSHOT};
+  };
+
+  /**
+   * Serializes commits that wrote something, so their timestamps are published in order. Taken at every isolation
+   * level, as every writer saves versions, see TableHeap::SaveVersion.
+   */
+  std::mutex commit_latch_;
+  /** Written under commit_latch_, read without it. */
+  std::atomic<timestamp_t> last_commit_ts_{0};
+  size_t num_snapshot_slots_;
+  std::unique_ptr<SnapshotSlot[]> snapshot_slots_;
+  /** Protects snapshots_. */
+  std::mutex timestamp_latch_;
+  /** The read timestamps of the snapshot transactions that found no free slot. */
+  std::multiset<timestamp_t> snapshots_;
+  /** Protects committed_writes_. */
+  std::mutex gc_latch_;
+  /**
+   * The rows written by each commit, in timestamp order, until the versions they replaced are dropped. Tables must
+   * outlive the transactions that wrote them.
+   */
+  std::deque<std::pair<timestamp_t, std::vector<std::pair<TableHeap *, RID>>>> committed_writes_;
 };
 
 }  // namespace bustub
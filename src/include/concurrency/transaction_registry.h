@@ -0,0 +1,94 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.h
+//
+// Identification: src/include/concurrency/transaction_registry.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <map>
+#include <shared_mutex>
+#include <vector>
+
+#include "common/config.h"
+#include "concurrency/transaction.h"
+
+namespace bustub {
+
+/** Default number of shards of the transaction registry. */
+static constexpr size_t DEFAULT_TXN_REGISTRY_SHARDS = 16;
+
+/**
+ * TransactionRegistry maps the ids of running transactions to their objects, so that the lock manager can reach the
+ * transactions it only knows the ids of. A transaction is registered when it begins and removed when it finished, so
+ * the registry only ever holds the transactions in flight.
+ *
+ * The registry is split into shards by id. Lookups take the latch of their shard in shared mode, registering and
+ * removing take it exclusively, so beginning and finishing transactions only contend when their ids share a shard.
+ * Ids are handed out in the order transactions begin, and every shard keeps its transactions ordered by id: the oldest
+ * running transaction is the smallest of the first entries of the shards. A transaction handed its id by RegisterNew
+ * is registered in the same step as far as GetOldestActive is concerned, which never misses one that got an id before
+ * it looked.
+ *
+ * The registry does not own the transactions. Whoever removes one must be sure nobody still uses what a lookup
+ * returned; the lock manager only looks up transactions with a request in one of its queues, which they leave before
+ * they finish.
+ */
+class TransactionRegistry {
+ public:
+  /** @param num_shards number of shards of the registry */
+  explicit TransactionRegistry(size_t num_shards = DEFAULT_TXN_REGISTRY_SHARDS) : shards_(num_shards) {}
+
+  /** Register txn under its id, replacing whatever was registered under it before. */
+  void Register(Transaction *txn);
+
+  /**
+   * Create a transaction and register it. Creating transactions share a latch, GetOldestActive waits for them.
+   * @param make creates the transaction, handing it the next id
+   * @return the new transaction
+   */
+  template <typename MakeTxn>
+  Transaction *RegisterNew(MakeTxn make) {
+    std::shared_lock lock(begin_latch_);
+    Transaction *txn = make();
+    Register(txn);
+    return txn;
+  }
+
+  /** Remove txn. Another transaction registered under the same id since stays. */
+  void Unregister(Transaction *txn);
+
+  /** @return the transaction registered under txn_id, nullptr if there is none */
+  Transaction *Find(txn_id_t txn_id);
+
+  /**
+   * @return the smallest id registered, INVALID_TXN_ID if the registry is empty. A transaction that finishes during
+   * the call may still be returned.
+   */
+  txn_id_t GetOldestActive();
+
+  /** @return the number of registered transactions */
+  size_t Size();
+
+ private:
+  /** A part of the registry. */
+  struct Shard {
+    /** Protects txns_. */
+    std::shared_mutex latch_;
+    std::map<txn_id_t, Transaction *> txns_;
+  };
+
+  inline Shard &ShardOf(txn_id_t txn_id) { return shards_[static_cast<size_t>(txn_id) % shards_.size()]; }
+
+  /** Held shared from handing out an id to registering it, and exclusively while looking for the oldest id. */
+  std::shared_mutex begin_latch_;
+  std::vector<Shard> shards_;
+};
+
+}  // namespace bustub
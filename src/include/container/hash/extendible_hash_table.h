@@ -20,6 +20,7 @@
 #include "common/config.h"
 #include "concurrency/transaction.h"
 #include "container/hash/hash_function.h"
+#include "recovery/log_manager.h"
 #include "storage/page/hash_table_bucket_page.h"
 #include "storage/page/hash_table_directory_page.h"
 
@@ -31,6 +32,12 @@ namespace bustub {
  * Implementation of extendible hash table that is backed by a buffer pool
  * manager. Non-unique keys are supported. Supports insert and delete. The
  * table grows/shrinks dynamically as buckets become full/empty.
+ *
+ * With a log manager and logging enabled, every change to a bucket or the
+ * directory is written ahead to the log (see log_record.h), so recovery
+ * brings the table back instead of it having to be rebuilt. The records
+ * of a split are ordered so that the table is consistent after any prefix
+ * of them: the new bucket first, then the directory, then the old bucket.
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 class ExtendibleHashTable {
@@ -41,9 +48,12 @@ class ExtendibleHashTable {
    * @param buffer_pool_manager buffer pool manager to be used
    * @param comparator comparator for keys
    * @param hash_fn the hash function
+   * @param log_manager the log manager, or nullptr to not log changes
+   * @param directory_page_id the directory of an existing table to open, INVALID_PAGE_ID creates a new one
    */
   explicit ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager,
-                               const KeyComparator &comparator, HashFunction<KeyType> hash_fn);
+                               const KeyComparator &comparator, HashFunction<KeyType> hash_fn,
+                               LogManager *log_manager = nullptr, page_id_t directory_page_id = INVALID_PAGE_ID);
 
   /**
    * Inserts a key-value pair into the hash table.
@@ -85,6 +95,11 @@ class ExtendibleHashTable {
    */
   void VerifyIntegrity();
 
+  /**
+   * @return the directory page, which is enough to open the table again; INVALID_PAGE_ID until the first access
+   */
+  page_id_t GetDirectoryPageId() const { return directory_page_id_; }
+
  private:
   /**
    * Hash - simple helper to downcast MurmurHash's 64-bit hash to 32-bit
@@ -166,9 +181,26 @@ class ExtendibleHashTable {
    */
   void Merge(Transaction *transaction, const KeyType &key, const ValueType &value);
 
+  /** @return true if changes are written to the log */
+  inline bool IsLogging() const { return enable_logging && log_manager_ != nullptr; }
+
+  /** Append log_record on behalf of transaction, which may be nullptr, and return its LSN. */
+  lsn_t AppendLogRecord(Transaction *transaction, LogRecord *log_record);
+
+  /** Log the insert or removal of (key, value) at bucket_idx of a bucket. */
+  void LogBucketChange(Transaction *transaction, LogRecordType type, HASH_TABLE_BUCKET_TYPE *bucket,
+                       uint32_t bucket_idx, const KeyType &key, const ValueType &value);
+
+  /** Log the entries a bucket keeps after a split. */
+  void LogBucketSplit(Transaction *transaction, HASH_TABLE_BUCKET_TYPE *bucket);
+
+  /** Log the directory after a change to its depths or bucket pointers. */
+  void LogDirectoryUpdate(Transaction *transaction, HashTableDirectoryPage *dir_page);
+
   // member variables
   page_id_t directory_page_id_;
   BufferPoolManager *buffer_pool_manager_;
+  LogManager *log_manager_;
   KeyComparator comparator_;
 
   // Readers includes inserts and removes, writers are splits and merges
@@ -17,6 +17,7 @@
 #include "common/rid.h"
 #include "execution/executor_context.h"
 #include "execution/executors/abstract_executor.h"
+#include "catalog/catalog.h"
 #include "execution/plans/index_scan_plan.h"
 #include "storage/table/tuple.h"
 
@@ -44,5 +45,11 @@ class IndexScanExecutor : public AbstractExecutor {
  private:
   /** The index scan plan node to be executed. */
   const IndexScanPlanNode *plan_;
+  const IndexInfo *index_info_{nullptr};
+  const TableInfo *table_info_{nullptr};
+  /** The rows the index found in the range, in key order. */
+  std::vector<RID> rids_;
+  /** The next row of rids_ to return. */
+  size_t cursor_{0};
 };
 }  // namespace bustub
@@ -61,7 +61,8 @@ class InsertExecutor : public AbstractExecutor {
   const Schema *GetOutputSchema() override { return plan_->OutputSchema(); };
 
  private:
-  void InsertOne(const Tuple &tuple);
+  /** Insert a tuple into the table and its indexes. */
+  void InsertOne(const Tuple &tuple, RID *rid);
   /** The insert plan node to be executed*/
   const InsertPlanNode *plan_;
   std::unique_ptr<AbstractExecutor> child_executor_{};
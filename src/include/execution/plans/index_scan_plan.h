@@ -12,13 +12,17 @@
 
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "catalog/catalog.h"
 #include "execution/expressions/abstract_expression.h"
 #include "execution/plans/abstract_plan.h"
 
 namespace bustub {
 /**
- * IndexScanPlanNode identifies a table that should be scanned with an optional predicate.
+ * IndexScanPlanNode identifies a table that should be scanned through an ordered index, over an optional range of index
+ * keys and with an optional predicate.
  */
 class IndexScanPlanNode : public AbstractPlanNode {
  public:
@@ -32,6 +36,23 @@ class IndexScanPlanNode : public AbstractPlanNode {
   IndexScanPlanNode(const Schema *output, const AbstractExpression *predicate, index_oid_t index_oid)
       : AbstractPlanNode(output, {}), predicate_{predicate}, index_oid_(index_oid) {}
 
+  /**
+   * Creates a new index scan plan node over a range of index keys.
+   * @param output the output format of this scan plan node
+   * @param predicate the predicate to scan with, tuples are returned if predicate(tuple) == true or predicate ==
+   * nullptr
+   * @param index_oid the identifier of the index to scan with
+   * @param low_key the values of the smallest index key to return, empty for no lower bound
+   * @param high_key the values of the largest index key to return, empty for no upper bound
+   */
+  IndexScanPlanNode(const Schema *output, const AbstractExpression *predicate, index_oid_t index_oid,
+                    std::vector<Value> low_key, std::vector<Value> high_key)
+      : AbstractPlanNode(output, {}),
+        predicate_{predicate},
+        index_oid_(index_oid),
+        low_key_(std::move(low_key)),
+        high_key_(std::move(high_key)) {}
+
   PlanType GetType() const override { return PlanType::IndexScan; }
 
   /** @return the predicate to test tuples against; tuples should only be returned if they evaluate to true */
@@ -40,11 +61,20 @@ class IndexScanPlanNode : public AbstractPlanNode {
   /** @return the identifier of the table that should be scanned */
   index_oid_t GetIndexOid() const { return index_oid_; }
 
+  /** @return the values of the smallest index key to return, empty for no lower bound */
+  const std::vector<Value> &GetLowKey() const { return low_key_; }
+
+  /** @return the values of the largest index key to return, empty for no upper bound */
+  const std::vector<Value> &GetHighKey() const { return high_key_; }
+
  private:
   /** The predicate that all returned tuples must satisfy. */
   const AbstractExpression *predicate_;
   /** The table whose tuples should be scanned. */
   index_oid_t index_oid_;
+  /** The bounds of the range of index keys, inclusive. */
+  std::vector<Value> low_key_;
+  std::vector<Value> high_key_;
 };
 
 }  // namespace bustub
@@ -12,32 +12,111 @@
 
 #pragma once
 
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "recovery/log_manager.h"
 
 namespace bustub {
 
+/** Progress of the checkpoint being taken, and totals over all checkpoints so far. */
+struct CheckpointStats {
+  /** Number of checkpoints completed. */
+  uint64_t checkpoints_{0};
+  /** True while a checkpoint is writing back pages. */
+  bool in_progress_{false};
+  /** Dirty pages the current (or last) checkpoint has to write back. */
+  size_t pages_to_write_{0};
+  /** Pages the current (or last) checkpoint has written back so far. */
+  size_t pages_written_{0};
+  /** Page writes that were held back because foreground reads were queued, over all checkpoints. */
+  uint64_t throttled_writes_{0};
+  /** How long the last completed checkpoint took. */
+  std::chrono::milliseconds last_duration_{0};
+};
+
 /**
- * CheckpointManager creates consistent checkpoints by blocking all other transactions temporarily.
+ * CheckpointManager takes ARIES-style fuzzy checkpoints while transactions keep running. A checkpoint is bracketed by
+ * CHECKPOINT_BEGIN and CHECKPOINT_END records; the END record carries the active transaction table and the dirty page
+ * table with recLSNs. Recovery starts redo at the oldest of those LSNs instead of the start of the log, and the log
+ * segments before it are deleted.
+ *
+ * Dirty pages are written back one at a time. With a checkpoint interval set, the writes are paced to finish after
+ * completion_target * interval rather than all at once, and a write is postponed while foreground page reads are
+ * queued at the disk, as long as the checkpoint is not behind its schedule.
  */
 class CheckpointManager {
  public:
   CheckpointManager(TransactionManager *transaction_manager, LogManager *log_manager,
-                    BufferPoolManager *buffer_pool_manager)
+                    BufferPoolManager *buffer_pool_manager, DiskManager *disk_manager = nullptr)
       : transaction_manager_(transaction_manager),
         log_manager_(log_manager),
-        buffer_pool_manager_(buffer_pool_manager) {}
+        buffer_pool_manager_(buffer_pool_manager),
+        disk_manager_(disk_manager) {}
 
-  ~CheckpointManager() = default;
+  ~CheckpointManager() { StopCheckpointThread(); }
 
+  /**
+   * Take a fuzzy checkpoint. Dirty pages are written back first so the dirty page table, and with it the redo work, is
+   * small; transactions are never blocked.
+   */
   void BeginCheckpoint();
+
+  /** A fuzzy checkpoint is complete when BeginCheckpoint returns, this is kept for callers of the blocking API. */
   void EndCheckpoint();
 
+  /** Start a thread that takes a checkpoint every checkpoint interval. Does nothing if the interval is zero. */
+  void RunCheckpointThread();
+  /** Stop and join the checkpoint thread, waiting for a checkpoint in progress to finish. */
+  void StopCheckpointThread();
+
+  /**
+   * Set the time between two checkpoints of the checkpoint thread. A zero interval (the default) also turns pacing
+   * off, so BeginCheckpoint writes back all pages as fast as it can.
+   */
+  inline void SetCheckpointInterval(std::chrono::milliseconds interval) { checkpoint_interval_ = interval; }
+  inline std::chrono::milliseconds GetCheckpointInterval() const { return checkpoint_interval_; }
+
+  /** Set the fraction of the checkpoint interval, between 0 and 1, over which page writes are spread. */
+  inline void SetCompletionTarget(double completion_target) {
+    BUSTUB_ASSERT(completion_target >= 0 && completion_target <= 1, "Completion target must be within [0, 1].");
+    completion_target_ = completion_target;
+  }
+  inline double GetCompletionTarget() const { return completion_target_; }
+
+  /** @return a snapshot of the checkpoint progress metrics */
+  CheckpointStats GetStats();
+
  private:
-  TransactionManager *transaction_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** How long a postponed write sleeps before it looks at the foreground read queue again. */
+  static constexpr auto IO_BACKOFF = std::chrono::microseconds(200);
+
+  /** Write back pages one by one, paced according to the checkpoint interval and completion target. */
+  void WritePages(const std::vector<page_id_t> &pages);
+
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  /** Used to watch the foreground read queue, may be nullptr. */
+  DiskManager *disk_manager_;
+
+  std::chrono::milliseconds checkpoint_interval_{0};
+  double completion_target_{0.5};
+
+  /** Protects stats_. */
+  std::mutex stats_latch_;
+  CheckpointStats stats_;
+
+  /** Protects checkpoint_thread_ and stop_requested_. */
+  std::mutex thread_latch_;
+  std::condition_variable thread_cv_;
+  std::thread *checkpoint_thread_{nullptr};
+  bool stop_requested_{false};
 };
 
 }  // namespace bustub
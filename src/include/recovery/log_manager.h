@@ -13,9 +13,11 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <future>              // NOLINT
 #include <mutex>               // NOLINT
+#include <thread>              // NOLINT
 
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
@@ -25,11 +27,19 @@ namespace bustub {
 /**
  * LogManager maintains a separate thread that is awakened whenever the log buffer is full or whenever a timeout
  * happens. When the thread is awakened, the log buffer's content is written into the disk log file.
+ *
+ * The manager is double buffered: appenders keep filling one buffer while the flush thread writes the previous batch
+ * out of the other, so a single WriteLog makes every record appended since the last flush durable (group commit).
+ *
+ * Appending does not take latch_. An appender claims its LSN and its byte range with one compare-and-swap on the
+ * reservation word, serializes the record into that range concurrently with other appenders, and then publishes the
+ * bytes it filled. The flush thread seals the active buffer by pointing the reservation word at the other one and
+ * only writes the sealed buffer once every reserved byte in it has been published.
  */
 class LogManager {
  public:
   explicit LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
+      : reservation_(MakeReservation(0, 0, 0)), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
     flush_buffer_ = new char[LOG_BUFFER_SIZE];
   }
@@ -46,29 +56,104 @@ class LogManager {
 
   lsn_t AppendLogRecord(LogRecord *log_record);
 
-  inline lsn_t GetNextLSN() { return next_lsn_; }
+  /**
+   * Block until every log record up to and including lsn has been written to disk, waking the flush thread early
+   * instead of waiting for the timeout. Returns immediately if the flush thread is not running.
+   * @param lsn the log sequence number that must become persistent
+   */
+  void WaitUntilPersistent(lsn_t lsn);
+
+  /**
+   * Make sure lsn becomes persistent within the asynchronous commit lag without blocking the caller. Used by
+   * asynchronously committing transactions; callers that later need the guarantee can use WaitUntilPersistent.
+   * @param lsn the log sequence number that must become persistent
+   */
+  void ScheduleFlush(lsn_t lsn);
+
+  /**
+   * Complete a checkpoint: once its CHECKPOINT_END record is persistent, make it the master record recovery starts
+   * from and delete the log segments that only hold records older than oldest_lsn. Nothing happens if the record
+   * cannot be made persistent because the flush thread is not running.
+   * @param checkpoint_lsn LSN of the CHECKPOINT_END record
+   * @param oldest_lsn oldest LSN recovery may still need to read
+   */
+  void TruncateLog(lsn_t checkpoint_lsn, lsn_t oldest_lsn);
+
+  /** Set the upper bound on how long an asynchronously committed record may stay in memory. */
+  inline void SetAsyncCommitLag(std::chrono::milliseconds lag) { async_commit_lag_ = lag; }
+  inline std::chrono::milliseconds GetAsyncCommitLag() const { return async_commit_lag_; }
+
+  inline lsn_t GetNextLSN() { return ReservedLSN(reservation_); }
+  /**
+   * Continue a log this manager did not write, e.g. the shipped log of a standby that is promoted: the next record
+   * gets next_lsn, and everything before it is already on disk. Must be called before anything is appended.
+   */
+  inline void SetNextLSN(lsn_t next_lsn) {
+    BUSTUB_ASSERT(ReservedOffset(reservation_) == 0, "Log records were appended already.");
+    reservation_ = MakeReservation(next_lsn, ReservedBuffer(reservation_), 0);
+    persistent_lsn_ = next_lsn - 1;
+  }
   inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
-  inline char *GetLogBuffer() { return log_buffer_; }
+  inline char *GetLogBuffer() { return BufferAt(ReservedBuffer(reservation_)); }
 
  private:
-  // TODO(students): you may add your own member variables
+  /** Block the flush thread until the timeout, a flush request or the earliest asynchronous commit deadline. */
+  void WaitForFlushTrigger(std::unique_lock<std::mutex> *lock);
+
+  /** Seal the active buffer and write it to disk. The caller must hold latch_, which is dropped during I/O. */
+  void FlushLogBuffer(std::unique_lock<std::mutex> *lock);
+
+  /** Write log_record to dst in the compact format described in log_record.h. */
+  static void SerializeLogRecord(LogRecord *log_record, char *dst);
+
+  /*
+   * Layout of the reservation word:
+   * | next LSN (32 bits) | active buffer (1 bit) | bytes reserved in the active buffer (31 bits) |
+   */
+  static constexpr uint64_t BUFFER_BIT = 1ULL << 31;
+  static constexpr uint64_t OFFSET_MASK = BUFFER_BIT - 1;
 
-  /** The atomic counter which records the next log sequence number. */
-  std::atomic<lsn_t> next_lsn_;
+  static inline uint64_t MakeReservation(lsn_t next_lsn, int buffer, int offset) {
+    return (static_cast<uint64_t>(next_lsn) << 32) | (buffer != 0 ? BUFFER_BIT : 0) | static_cast<uint64_t>(offset);
+  }
+  static inline lsn_t ReservedLSN(uint64_t word) { return static_cast<lsn_t>(word >> 32); }
+  static inline int ReservedBuffer(uint64_t word) { return (word & BUFFER_BIT) != 0 ? 1 : 0; }
+  static inline int ReservedOffset(uint64_t word) { return static_cast<int>(word & OFFSET_MASK); }
+
+  inline char *BufferAt(int buffer) { return buffer == 0 ? log_buffer_ : flush_buffer_; }
+
+  /** Next LSN, active buffer and reserved bytes, advanced together by appenders. See the layout above. */
+  std::atomic<uint64_t> reservation_;
   /** The log records before and including the persistent lsn have been written to disk. */
   std::atomic<lsn_t> persistent_lsn_;
 
+  /** Buffer 0. log_buffer_ and flush_buffer_ trade roles on every flush; the reservation word says which is active. */
   char *log_buffer_;
+  /** Buffer 1. */
   char *flush_buffer_;
-
+  /** Bytes whose serialization has completed, per buffer. A sealed buffer is complete once this matches its size. */
+  std::atomic<int> filled_bytes_[2]{{0}, {0}};
+  /** Set when an appender or a committing transaction wants the flush thread to run before the timeout. */
+  bool flush_requested_{false};
+  /** Time by which the oldest unflushed asynchronous commit must be on disk, time_point::max() if there is none. */
+  std::chrono::steady_clock::time_point flush_deadline_{std::chrono::steady_clock::time_point::max()};
+  /** How long an asynchronous commit may wait for the flush thread. */
+  std::chrono::milliseconds async_commit_lag_{10};
+
+  /** Protects flush_requested_, flush_deadline_ and the flush thread. Appenders only take it on a full buffer. */
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
+  std::thread *flush_thread_{nullptr};
 
+  /** Wakes the flush thread. */
   std::condition_variable cv_;
+  /** Wakes appenders waiting for the full buffer to be sealed. */
+  std::condition_variable append_cv_;
+  /** Wakes transactions waiting for persistent_lsn_ to advance. */
+  std::condition_variable flushed_cv_;
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  DiskManager *disk_manager_;
 };
 
 }  // namespace bustub
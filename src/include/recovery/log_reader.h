@@ -0,0 +1,93 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.h
+//
+// Identification: src/include/recovery/log_reader.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <future>  // NOLINT
+#include <vector>
+
+#include "common/macros.h"
+#include "recovery/log_record.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/** Default number of log bytes the reader fetches per disk read. */
+static constexpr int DEFAULT_LOG_READ_SIZE = 1024 * 1024;
+
+/**
+ * LogReader decodes the log as a stream of LogRecords.
+ *
+ * It keeps two buffers. While records are decoded from one, the next chunk of the log is read into the other in the
+ * background. A record cut off by the end of a chunk is carried over to the front of the next one, so callers never
+ * see chunk or segment boundaries.
+ *
+ * Sequential reading (redo) benefits from the read-ahead. Seek serves positions inside the current chunk from memory
+ * and otherwise loads the chunk ending at the target, which suits undo walking backwards through the log.
+ */
+class LogReader {
+ public:
+  /**
+   * @param disk_manager the disk manager holding the log
+   * @param offset logical log offset of the first record to read
+   * @param read_size number of bytes fetched per disk read, at least LOG_BUFFER_SIZE
+   */
+  LogReader(DiskManager *disk_manager, int offset, int read_size = DEFAULT_LOG_READ_SIZE);
+
+  ~LogReader();
+
+  DISALLOW_COPY(LogReader);
+
+  /**
+   * Decode the next record.
+   * @param[out] log_record the decoded record
+   * @return false at the end of the log, including a torn record at its tail
+   */
+  bool Next(LogRecord *log_record);
+
+  /** Continue reading at offset, which must be the start of a record. */
+  void Seek(int offset);
+
+  /** @return the log offset of the record last returned by Next */
+  inline int GetRecordOffset() const { return record_offset_; }
+
+ private:
+  /** Append the next chunk after the undecoded tail of the current one. @return false at the end of the log */
+  bool Refill();
+  /** Start reading the chunk at offset into the idle buffer. */
+  void StartReadAhead(int offset);
+  /** Wait for and drop a pending read-ahead. */
+  void CancelReadAhead();
+
+  DiskManager *disk_manager_;
+  int read_size_;
+
+  /**
+   * Each buffer is LOG_BUFFER_SIZE bytes of room for a carried-over tail followed by read_size_ bytes for a chunk.
+   */
+  std::vector<char> buffers_[2];
+  /** Buffer being decoded, the other one is the read-ahead target. */
+  int active_{0};
+  /** First valid byte in the active buffer, at log offset data_offset_. */
+  const char *data_;
+  int data_offset_;
+  int data_size_{0};
+  /** Position of the next record, relative to data_. */
+  int pos_{0};
+  int record_offset_{-1};
+
+  /** Pending read of the chunk at read_ahead_offset_ into the idle buffer. */
+  std::future<int> read_ahead_;
+  int read_ahead_offset_{-1};
+};
+
+}  // namespace bustub
@@ -14,6 +14,8 @@
 
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,31 +34,92 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** Start of a fuzzy checkpoint. */
+  CHECKPOINT_BEGIN,
+  /** End of a fuzzy checkpoint, carrying the active transaction table and the dirty page table. */
+  CHECKPOINT_END,
+  /** Storing an entry in a hash table bucket. */
+  HASH_BUCKET_INSERT,
+  /** Removing an entry from a hash table bucket. */
+  HASH_BUCKET_REMOVE,
+  /** Rewriting a hash table bucket with the entries it keeps after a split, for both halves. */
+  HASH_BUCKET_SPLIT,
+  /** Changing the hash table directory when buckets are split or merged. */
+  HASH_DIRECTORY_UPDATE,
+  /** Storing an entry in a B+ tree leaf, with the pages a split changed. */
+  BPLUS_TREE_INSERT,
+  /** Removing an entry from a B+ tree leaf, with the pages a merge or redistribution changed. */
+  BPLUS_TREE_REMOVE,
 };
 
 /**
  * For every write operation on the table page, you should write ahead a corresponding log record.
  *
- * For EACH log record, HEADER is like (5 fields in common, 20 bytes in total).
- *---------------------------------------------
- * | size | LSN | transID | prevLSN | LogType |
- *---------------------------------------------
+ * Log records use a compact variable-length encoding. All integers marked (v) are unsigned LEB128 varints (7 bits per
+ * byte, high bit set on every byte but the last), so small txn ids, LSN deltas, page ids and lengths take one or two
+ * bytes instead of four.
+ *
+ * For EACH log record, HEADER is like (5 fields in common).
+ *--------------------------------------------------------------------------
+ * | size (v) | LogType (1) | LSN (v) | transID + 1 (v) | LSN - prevLSN (v) |
+ *--------------------------------------------------------------------------
+ * size covers the whole record including itself. transID + 1 is 0 for INVALID_TXN_ID, and the prevLSN delta is 0 when
+ * there is no previous record (INVALID_LSN). A RID is | page_id + 1 (v) | slot (v) |, a tuple is | length (v) | data |.
+ *
  * For insert type log record
- *---------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
- *---------------------------------------------------------------
+ *----------------------------
+ * | HEADER | RID | tuple |
+ *----------------------------
  * For delete type (including markdelete, rollbackdelete, applydelete)
- *----------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
- *---------------------------------------------------------------
- * For update type log record
- *-----------------------------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
- *-----------------------------------------------------------------------------------
+ *----------------------------
+ * | HEADER | RID | tuple |
+ *----------------------------
+ * For update type log record, the new tuple is byte-diff encoded against the old one
+ *---------------------------------------------------------------------------------------
+ * | HEADER | RID | old tuple | new_length (v) | run_count (v) | run_1 | ... | run_n |
+ *---------------------------------------------------------------------------------------
+ * where each run is | gap (v) | run_length (v) | bytes |. gap is counted from the end of the previous run (or from the
+ * start of the tuple); bytes not covered by a run are copied from the old tuple at the same position.
+ *
  * For new page type log record
- *--------------------------
- * | HEADER | prev_page_id |
- *--------------------------
+ *------------------------------------------------
+ * | HEADER | prev_page_id + 1 (v) | page_id + 1 (v) |
+ *------------------------------------------------
+ * For checkpoint end type log record, whose prevLSN is the LSN of its CHECKPOINT_BEGIN
+ *------------------------------------------------------------------------------------------
+ * | HEADER | txn_count (v) | txn_1 | ... | txn_n | page_count (v) | page_1 | ... | page_m |
+ *------------------------------------------------------------------------------------------
+ * where each txn is | transID + 1 (v) | LSN of its BEGIN (v) | and each page is | page_id + 1 (v) | recLSN (v) |.
+ * Checkpoint records belong to no transaction, their transID is INVALID_TXN_ID.
+ *
+ * Hash index records hold the raw bytes of the (key, value) pairs as entries, | entry_size (v) | count (v) | bytes |
+ * with count * entry_size bytes. Recovery only needs the entry size to find its way around a bucket page.
+ *
+ * For hash bucket insert and remove type log records, which hold one entry
+ *---------------------------------------------------------------------------------------------
+ * | HEADER | directory_page_id + 1 (v) | bucket_page_id + 1 (v) | slot (v) | hash (v) | entries |
+ *---------------------------------------------------------------------------------------------
+ * For hash bucket split type log record, holding every entry the bucket keeps
+ *----------------------------------------------------
+ * | HEADER | bucket_page_id + 1 (v) | entries |
+ *----------------------------------------------------
+ * For hash directory update type log record, with one bucket per directory slot
+ *-------------------------------------------------------------------------------------------
+ * | HEADER | directory_page_id + 1 (v) | global_depth (v) | bucket_1 | ... | bucket_(2^global_depth) |
+ *-------------------------------------------------------------------------------------------
+ * where each bucket is | bucket_page_id + 1 (v) | local_depth (v) |. Transactions without a Transaction object (e.g.
+ * index builds) log with INVALID_TXN_ID and are never undone.
+ *
+ * For B+ tree insert and remove type log records, which hold one entry
+ *----------------------------------------------------------------------------------------------------------
+ * | HEADER | name_length (v) | index_name | leaf_page_id + 1 (v) | slot (v) | entries | restructured (v) |
+ *----------------------------------------------------------------------------------------------------------
+ * followed, if restructured is 1, by the tree pages the split or merge left behind
+ *---------------------------------------------------------------------
+ * | root_page_id + 1 (v) | page_count (v) | page_1 | ... | page_n |
+ *---------------------------------------------------------------------
+ * where each page is | page_id + 1 (v) | length (v) | bytes |, the part of the page in use. A page carried whole is
+ * not also changed at the slot.
  */
 class LogRecord {
   friend class LogManager;
@@ -67,7 +130,7 @@ class LogRecord {
 
   // constructor for Transaction type(BEGIN/COMMIT/ABORT)
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type)
-      : size_(HEADER_SIZE), txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type) {}
+      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type) {}
 
   // constructor for INSERT/DELETE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &rid, const Tuple &tuple)
@@ -81,8 +144,8 @@ class LogRecord {
       delete_rid_ = rid;
       delete_tuple_ = tuple;
     }
-    // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
+    // calculate log record body size
+    body_size_ = RIDSize(rid) + TupleSize(tuple);
   }
 
   // constructor for UPDATE type
@@ -94,20 +157,112 @@ class LogRecord {
         update_rid_(update_rid),
         old_tuple_(old_tuple),
         new_tuple_(new_tuple) {
-    // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() + new_tuple.GetLength() + 2 * sizeof(int32_t);
+    // calculate log record body size
+    body_size_ = RIDSize(update_rid) + TupleSize(old_tuple) + EncodeTupleDiff(old_tuple, new_tuple, nullptr);
   }
 
   // constructor for NEWPAGE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t prev_page_id, page_id_t page_id)
-      : size_(HEADER_SIZE),
-        txn_id_(txn_id),
+      : txn_id_(txn_id),
         prev_lsn_(prev_lsn),
         log_record_type_(log_record_type),
         prev_page_id_(prev_page_id),
         page_id_(page_id) {
-    // calculate log record size, header size + sizeof(prev_page_id) + sizeof(page_id)
-    size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
+    // calculate log record body size
+    body_size_ = VarintSize(prev_page_id + 1) + VarintSize(page_id + 1);
+  }
+
+  // constructor for CHECKPOINT_END type
+  LogRecord(lsn_t begin_lsn, std::vector<std::pair<txn_id_t, lsn_t>> active_txns,
+            std::vector<std::pair<page_id_t, lsn_t>> dirty_pages)
+      : prev_lsn_(begin_lsn),
+        log_record_type_(LogRecordType::CHECKPOINT_END),
+        active_txns_(std::move(active_txns)),
+        dirty_pages_(std::move(dirty_pages)) {
+    // calculate log record body size
+    body_size_ = VarintSize(active_txns_.size()) + VarintSize(dirty_pages_.size());
+    for (const auto &[txn_id, first_lsn] : active_txns_) {
+      body_size_ += VarintSize(txn_id + 1) + VarintSize(first_lsn);
+    }
+    for (const auto &[page_id, rec_lsn] : dirty_pages_) {
+      body_size_ += VarintSize(page_id + 1) + VarintSize(rec_lsn);
+    }
+  }
+
+  // constructor for HASH_BUCKET_INSERT/HASH_BUCKET_REMOVE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t directory_page_id,
+            page_id_t bucket_page_id, uint32_t slot, uint32_t hash, uint32_t entry_size, std::vector<char> entry)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(bucket_page_id),
+        directory_page_id_(directory_page_id),
+        slot_(slot),
+        hash_(hash),
+        entry_size_(entry_size),
+        entries_(std::move(entry)) {
+    assert(log_record_type == LogRecordType::HASH_BUCKET_INSERT ||
+           log_record_type == LogRecordType::HASH_BUCKET_REMOVE);
+    // calculate log record body size
+    body_size_ = VarintSize(directory_page_id + 1) + VarintSize(bucket_page_id + 1) + VarintSize(slot) +
+                 VarintSize(hash) + EntriesSize();
+  }
+
+  // constructor for HASH_BUCKET_SPLIT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, page_id_t bucket_page_id, uint32_t entry_size, std::vector<char> entries)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(LogRecordType::HASH_BUCKET_SPLIT),
+        page_id_(bucket_page_id),
+        entry_size_(entry_size),
+        entries_(std::move(entries)) {
+    // calculate log record body size
+    body_size_ = VarintSize(bucket_page_id + 1) + EntriesSize();
+  }
+
+  // constructor for HASH_DIRECTORY_UPDATE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, page_id_t directory_page_id, uint32_t global_depth,
+            std::vector<std::pair<page_id_t, uint32_t>> buckets)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(LogRecordType::HASH_DIRECTORY_UPDATE),
+        page_id_(directory_page_id),
+        global_depth_(global_depth),
+        buckets_(std::move(buckets)) {
+    assert(buckets_.size() == (1U << global_depth));
+    // calculate log record body size
+    body_size_ = VarintSize(directory_page_id + 1) + VarintSize(global_depth);
+    for (const auto &[bucket_page_id, local_depth] : buckets_) {
+      body_size_ += VarintSize(bucket_page_id + 1) + VarintSize(local_depth);
+    }
+  }
+
+  // constructor for BPLUS_TREE_INSERT/BPLUS_TREE_REMOVE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, std::string index_name,
+            page_id_t leaf_page_id, uint32_t slot, uint32_t entry_size, std::vector<char> entry, bool restructured,
+            page_id_t root_page_id, std::vector<std::pair<page_id_t, std::vector<char>>> tree_pages)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(leaf_page_id),
+        slot_(slot),
+        entry_size_(entry_size),
+        entries_(std::move(entry)),
+        index_name_(std::move(index_name)),
+        restructured_(restructured),
+        root_page_id_(root_page_id),
+        tree_pages_(std::move(tree_pages)) {
+    assert(log_record_type == LogRecordType::BPLUS_TREE_INSERT || log_record_type == LogRecordType::BPLUS_TREE_REMOVE);
+    assert(restructured || tree_pages_.empty());
+    // calculate log record body size
+    body_size_ = VarintSize(index_name_.size()) + index_name_.size() + VarintSize(leaf_page_id + 1) + VarintSize(slot) +
+                 EntriesSize() + VarintSize(restructured ? 1 : 0);
+    if (restructured) {
+      body_size_ += VarintSize(root_page_id + 1) + VarintSize(tree_pages_.size());
+      for (const auto &[page_id, data] : tree_pages_) {
+        body_size_ += VarintSize(page_id + 1) + VarintSize(data.size()) + data.size();
+      }
+    }
   }
 
   ~LogRecord() = default;
@@ -128,6 +283,51 @@ class LogRecord {
 
   inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+  inline page_id_t GetNewPageId() { return page_id_; }
+
+  /** @return the transactions active at a checkpoint and the LSNs of their BEGIN records */
+  inline std::vector<std::pair<txn_id_t, lsn_t>> &GetActiveTransactionTable() { return active_txns_; }
+
+  /** @return the pages that were dirty at a checkpoint and their recLSNs */
+  inline std::vector<std::pair<page_id_t, lsn_t>> &GetDirtyPageTable() { return dirty_pages_; }
+
+  /** @return the hash table bucket or directory page a hash index record changes, the leaf of a B+ tree record */
+  inline page_id_t GetIndexPageId() { return page_id_; }
+
+  /** @return the directory of the hash table a bucket insert or remove belongs to */
+  inline page_id_t GetDirectoryPageId() { return directory_page_id_; }
+
+  /** @return the bucket slot of a hash bucket insert or remove, the leaf slot of a B+ tree record */
+  inline uint32_t GetSlot() { return slot_; }
+
+  /** @return the hash of the key of a hash bucket insert or remove */
+  inline uint32_t GetHash() { return hash_; }
+
+  /** @return the size of each entry of a hash bucket or B+ tree record */
+  inline uint32_t GetEntrySize() { return entry_size_; }
+
+  /** @return the raw bytes of the entries of a hash bucket or B+ tree record, back to back */
+  inline std::vector<char> &GetEntries() { return entries_; }
+
+  /** @return the global depth of a hash directory update */
+  inline uint32_t GetGlobalDepth() { return global_depth_; }
+
+  /** @return the bucket page id and local depth of every directory slot of a hash directory update */
+  inline std::vector<std::pair<page_id_t, uint32_t>> &GetDirectoryBuckets() { return buckets_; }
+
+  /** @return the name the B+ tree of a B+ tree record keeps its root under in the header page */
+  inline const std::string &GetIndexName() { return index_name_; }
+
+  /** @return whether the change of a B+ tree record split or merged pages, or changed the root */
+  inline bool IsRestructured() { return restructured_; }
+
+  /** @return the root of the tree after the change of a restructured B+ tree record */
+  inline page_id_t GetRootPageId() { return root_page_id_; }
+
+  /** @return the pages a restructured B+ tree record carries whole, with the bytes of each that are in use */
+  inline std::vector<std::pair<page_id_t, std::vector<char>>> &GetTreePages() { return tree_pages_; }
+
+  /** @return the encoded length of the record; only known once it has been appended or deserialized */
   inline int32_t GetSize() { return size_; }
 
   inline lsn_t GetLSN() { return lsn_; }
@@ -152,8 +352,59 @@ class LogRecord {
   }
 
  private:
-  // the length of log record(for serialization, in bytes)
+  /** @return the encoded length of this record if it is assigned the given lsn */
+  int32_t EncodedSize(lsn_t lsn) const {
+    uint32_t header_size = 1 + VarintSize(lsn) + VarintSize(txn_id_ + 1) + VarintSize(PrevLSNDelta(lsn));
+    uint32_t length = header_size + body_size_;
+    // The size field counts itself, so grow it until its own varint length settles.
+    uint32_t size_length = 1;
+    while (VarintSize(length + size_length) != size_length) {
+      size_length++;
+    }
+    return static_cast<int32_t>(length + size_length);
+  }
+
+  inline uint32_t PrevLSNDelta(lsn_t lsn) const {
+    return prev_lsn_ == INVALID_LSN ? 0 : static_cast<uint32_t>(lsn - prev_lsn_);
+  }
+
+  /*
+   * Helpers for the compact encoding, see the format description above. They are shared by LogManager (encoding) and
+   * LogRecovery (decoding). Decoders return nullptr if the input ends before the value does.
+   */
+  static uint32_t VarintSize(uint32_t value);
+  static char *EncodeVarint(char *dst, uint32_t value);
+  static const char *DecodeVarint(const char *src, const char *end, uint32_t *value);
+
+  static inline uint32_t RIDSize(const RID &rid) {
+    return VarintSize(rid.GetPageId() + 1) + VarintSize(rid.GetSlotNum());
+  }
+  static char *EncodeRID(char *dst, const RID &rid);
+  static const char *DecodeRID(const char *src, const char *end, RID *rid);
+
+  static inline uint32_t TupleSize(const Tuple &tuple) { return VarintSize(tuple.GetLength()) + tuple.GetLength(); }
+  static char *EncodeTuple(char *dst, const Tuple &tuple);
+  static const char *DecodeTuple(const char *src, const char *end, Tuple *tuple);
+
+  /**
+   * Byte-diff encode new_tuple against old_tuple.
+   * @param dst where to write the encoding, or nullptr to only compute its length
+   * @return the length of the encoding in bytes
+   */
+  static uint32_t EncodeTupleDiff(const Tuple &old_tuple, const Tuple &new_tuple, char *dst);
+  static const char *DecodeTupleDiff(const char *src, const char *end, const Tuple &old_tuple, Tuple *new_tuple);
+
+  inline uint32_t EntriesSize() const {
+    uint32_t count = entry_size_ == 0 ? 0 : entries_.size() / entry_size_;
+    return VarintSize(entry_size_) + VarintSize(count) + entries_.size();
+  }
+  char *EncodeEntries(char *dst) const;
+  const char *DecodeEntries(const char *src, const char *end);
+
+  // the length of log record(for serialization, in bytes), set when the record is appended or deserialized
   int32_t size_{0};
+  // the length of everything after the header, fixed at construction
+  uint32_t body_size_{0};
   // must have fields
   lsn_t lsn_{INVALID_LSN};
   txn_id_t txn_id_{INVALID_TXN_ID};
@@ -176,7 +427,25 @@ class LogRecord {
   // case4: for new page operation
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
-  static const int HEADER_SIZE = 20;
+
+  // case5: for checkpoint end
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+
+  // case6: for hash index operations, page_id_ is the bucket or directory page
+  page_id_t directory_page_id_{INVALID_PAGE_ID};
+  uint32_t slot_{0};
+  uint32_t hash_{0};
+  uint32_t entry_size_{0};
+  std::vector<char> entries_;
+  uint32_t global_depth_{0};
+  std::vector<std::pair<page_id_t, uint32_t>> buckets_;
+
+  // case7: for B+ tree operations, page_id_, slot_ and entries_ are the leaf change as for hash buckets
+  std::string index_name_;
+  bool restructured_{false};
+  page_id_t root_page_id_{INVALID_PAGE_ID};
+  std::vector<std::pair<page_id_t, std::vector<char>>> tree_pages_;
 };  // namespace bustub
 
 }  // namespace bustub
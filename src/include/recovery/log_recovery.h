@@ -13,11 +13,18 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
 #include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "recovery/log_reader.h"
 #include "recovery/log_record.h"
 
 namespace bustub {
@@ -28,30 +35,131 @@ namespace bustub {
 class LogRecovery {
  public:
   LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
-      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
-  }
+      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager) {}
 
-  ~LogRecovery() {
-    delete[] log_buffer_;
-    log_buffer_ = nullptr;
-  }
+  ~LogRecovery() = default;
 
+  /**
+   * Replay the log from the last checkpoint, or from the oldest segment if there is none. The calling thread reads and
+   * decodes the log and hands every record to one of the redo threads by page id, so records of one page are applied
+   * in log order while different pages are redone concurrently.
+   */
   void Redo();
+  /**
+   * Roll back the transactions redo found without a COMMIT or ABORT, visiting their records from the newest to the
+   * oldest across all of them.
+   */
   void Undo();
-  bool DeserializeLogRecord(const char *data, LogRecord *log_record);
+
+  /**
+   * Redo for a standby that applies the log as it arrives. Replays the complete records from offset on, keeping the
+   * active transaction table of earlier calls, so Undo can finish the job once no more records will come.
+   * @param offset log offset of the first record to replay, where the previous call stopped
+   * @return the offset after the last complete record, where the next call continues
+   */
+  int ContinueRedo(int offset);
+
+  /**
+   * Let undo revert the entry changes of a B+ tree. That takes the key comparator, which the log does not carry, so
+   * the tree is opened after Redo and registered before Undo. The entry changes of trees that are not registered stay.
+   * @param index_name the name the tree keeps its root under in the header page
+   * @param undo reverts the entry change of a BPLUS_TREE_INSERT or BPLUS_TREE_REMOVE record
+   */
+  void RegisterIndex(const std::string &index_name, std::function<void(LogRecord *)> undo);
+
+  /** @return the LSN after the last record read by redo */
+  inline lsn_t GetNextLSN() const { return next_lsn_; }
+
+  /** Set the number of threads that apply records during redo, 0 applies them on the reading thread. */
+  inline void SetRedoThreads(int redo_threads) { redo_threads_ = redo_threads; }
+  inline int GetRedoThreads() const { return redo_threads_; }
+
+  /** Set how many bytes the log reader fetches ahead of the decoder per disk read. */
+  inline void SetReadSize(int read_size) { read_size_ = read_size; }
+
+  /**
+   * Decode one log record in the compact format described in log_record.h.
+   * @param data start of the encoded record
+   * @param[out] log_record the decoded record
+   * @param max_size number of readable bytes at data
+   * @return true if a complete record was decoded, false if it is truncated or data holds no record
+   */
+  static bool DeserializeLogRecord(const char *data, LogRecord *log_record, int max_size = LOG_BUFFER_SIZE);
 
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** Records handed from the reader to a redo thread in one go. */
+  static constexpr size_t REDO_BATCH_SIZE = 64;
+  /** Batches a redo thread may have queued before the reader waits for it. */
+  static constexpr size_t MAX_QUEUED_BATCHES = 16;
+
+  /** A record and the page a redo thread applies it to. */
+  struct RedoTask {
+    page_id_t page_id_;
+    LogRecord log_record_;
+  };
+
+  /** Bounded queue of batches for one redo thread. */
+  class RedoQueue {
+   public:
+    /** Hand a batch to the worker, waiting while its queue is full. */
+    void Push(std::vector<RedoTask> &&batch);
+    /** @return false once the queue is closed and drained */
+    bool Pop(std::vector<RedoTask> *batch);
+    /** No more batches will be pushed. */
+    void Close();
+
+   private:
+    std::mutex latch_;
+    std::condition_variable cv_;
+    std::deque<std::vector<RedoTask>> batches_;
+    bool closed_{false};
+  };
+
+  void RunRedoWorker(RedoQueue *queue);
+
+  /**
+   * Replay the log from start_offset to its end, skipping the page changes older than redo_lsn.
+   * @return the offset after the last complete record
+   */
+  int RedoLog(int start_offset, lsn_t redo_lsn);
+
+  /**
+   * Read the CHECKPOINT_END record the master record points at.
+   * @param[out] checkpoint the checkpoint record
+   * @return false if no complete checkpoint is on disk
+   */
+  bool ReadCheckpoint(LogRecord *checkpoint);
+
+  /** Reapply the part of log_record that touches page_id unless the page already reflects it. */
+  void RedoLogRecord(LogRecord *log_record, page_id_t page_id);
+  /** Revert the change described by log_record. */
+  void UndoLogRecord(LogRecord *log_record);
+  /** Revert a hash bucket insert or remove in whichever bucket the entry lives in now. */
+  void UndoHashBucketRecord(LogRecord *log_record);
+
+  static inline bool IsBPlusTreeRecord(LogRecord *log_record) {
+    return log_record->log_record_type_ == LogRecordType::BPLUS_TREE_INSERT ||
+           log_record->log_record_type_ == LogRecordType::BPLUS_TREE_REMOVE;
+  }
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
 
   /** Maintain active transactions and its corresponding latest lsn. */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
+  /** The first LSN of every active transaction. */
+  std::unordered_map<txn_id_t, lsn_t> active_txn_first_lsn_;
   /** Mapping the log sequence number to log file offset for undos. */
   std::unordered_map<lsn_t, int> lsn_mapping_;
+  /** ContinueRedo has dropped the offsets of the records before this LSN. */
+  lsn_t pruned_lsn_{0};
+  lsn_t next_lsn_{0};
+  /** Reverts the entry changes of the B+ trees registered by name. */
+  std::unordered_map<std::string, std::function<void(LogRecord *)>> index_undo_;
 
-  int offset_ __attribute__((__unused__));
-  char *log_buffer_;
+  int redo_threads_{4};
+  /** Bytes the log reader fetches per disk read. */
+  int read_size_{DEFAULT_LOG_READ_SIZE};
 };
 
 }  // namespace bustub
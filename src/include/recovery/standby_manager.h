@@ -0,0 +1,134 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// standby_manager.h
+//
+// Identification: src/include/recovery/standby_manager.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+
+namespace bustub {
+
+/** How far a standby has come, and what its promotion took. */
+struct StandbyStats {
+  /** Number of log records copied from the primary. */
+  uint64_t records_shipped_{0};
+  /** Number of log bytes copied from the primary. */
+  uint64_t bytes_shipped_{0};
+  /** LSN of the last record redone, INVALID_LSN if there is none yet. */
+  lsn_t applied_lsn_{INVALID_LSN};
+  /** True once the standby has been promoted. */
+  bool promoted_{false};
+  /** Records that were still to be shipped and redone when the standby was promoted. */
+  uint64_t promotion_records_{0};
+  /** How long the promotion took, including undo. */
+  std::chrono::milliseconds promotion_duration_{0};
+};
+
+/**
+ * StandbyManager keeps a warm standby of a primary database by log shipping. The standby is a database of its own, in
+ * another directory or process: it has its own database file, log, buffer pool and log manager. It tails the log
+ * segments the primary writes next to its database file, copies every complete record into its own log and redoes it
+ * right away through its own buffer pool, keeping the active transaction table of the primary up to date.
+ *
+ * The standby never writes log records of its own before promotion, and read-only queries can run against its buffer
+ * pool in the meantime. They see the changes of transactions still in flight on the primary, like READ_UNCOMMITTED.
+ *
+ * On failover, Promote only has to apply what arrived since the last catch-up and undo the transactions that did not
+ * finish, instead of running recovery over the log since the last checkpoint. The standby's log manager then
+ * continues the LSN sequence of the primary.
+ *
+ * The standby starts from an empty database file, or a copy of the primary's taken after the oldest log segment still
+ * on disk was started, and ships from the start of that segment on. The primary must keep its segments until they
+ * are shipped; a standby that falls behind a truncation stops and has to be set up again.
+ */
+class StandbyManager {
+ public:
+  /**
+   * @param primary_db_file the primary's database file; its log segments are read, the file itself is not
+   * @param disk_manager the standby's disk manager, whose log must be empty
+   * @param buffer_pool_manager the standby's buffer pool, shared with read-only queries
+   * @param log_manager the standby's log manager, which takes over the log when the standby is promoted
+   */
+  StandbyManager(const std::string &primary_db_file, DiskManager *disk_manager,
+                 BufferPoolManager *buffer_pool_manager, LogManager *log_manager);
+
+  ~StandbyManager();
+
+  /**
+   * Copy the records the primary wrote since the last call into the standby's log and redo them.
+   * @return the number of records applied
+   */
+  size_t CatchUp();
+
+  /** Start a thread that calls CatchUp every replay interval. */
+  void RunReplayThread();
+  /** Stop and join the replay thread. */
+  void StopReplayThread();
+
+  /** Set how long the replay thread waits between two catch-ups. */
+  inline void SetReplayInterval(std::chrono::milliseconds interval) { replay_interval_ = interval; }
+  inline std::chrono::milliseconds GetReplayInterval() const { return replay_interval_; }
+
+  /**
+   * Fail over: apply the last records the primary wrote, roll back the transactions that did not commit, and hand the
+   * log over to the standby's log manager. The standby is a primary afterwards and stops tailing the old one.
+   */
+  void Promote();
+
+  /** @return a snapshot of the replication progress */
+  StandbyStats GetStats();
+
+ private:
+  /** Copy the complete records after ship_offset_ from the primary's log into ours. The caller holds latch_. */
+  size_t ShipLog();
+  /** Append the primary's log bytes [start, end) to our log. */
+  void CopyLog(int start, int end, lsn_t first_lsn);
+  /** CatchUp without taking latch_. */
+  size_t CatchUpLocked();
+
+  /** Opened on the primary's files to read its log, never written through. */
+  DiskManager *primary_log_;
+  DiskManager *disk_manager_;
+  LogManager *log_manager_;
+  LogRecovery recovery_;
+
+  /** Primary log offset of the next record to ship, -1 before the first catch-up. */
+  int ship_offset_{-1};
+  /** Offset in our log where redo continues. */
+  int redo_offset_;
+  /** DiskManager::WriteLog wants the buffers of consecutive writes to alternate. */
+  std::vector<char> ship_buffers_[2];
+  int ship_buffer_{0};
+
+  /** Serializes catch-ups and the promotion. */
+  std::mutex latch_;
+  /** Protects stats_. */
+  std::mutex stats_latch_;
+  StandbyStats stats_;
+
+  std::chrono::milliseconds replay_interval_{10};
+  /** Protects replay_thread_ and stop_requested_. */
+  std::mutex thread_latch_;
+  std::condition_variable thread_cv_;
+  std::thread *replay_thread_{nullptr};
+  bool stop_requested_{false};
+};
+
+}  // namespace bustub
@@ -17,14 +17,47 @@
 #include <future>  // NOLINT
 #include <mutex>   // NOLINT
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
+#include "common/macros.h"
 
 namespace bustub {
 
+/** Default upper bound on the size of one log segment file, including its header. */
+static constexpr int DEFAULT_LOG_SEGMENT_SIZE = 16 * 1024 * 1024;
+/** Size of the header at the start of every log segment file. */
+static constexpr int LOG_SEGMENT_HEADER_SIZE = 20;
+/** Most pages written through the double-write buffer at once; bigger batches are split. */
+static constexpr int DOUBLE_WRITE_BATCH_PAGES = 64;
+/** Size of the header at the start of the double-write file. */
+static constexpr int DOUBLE_WRITE_HEADER_SIZE = 16;
+
 /**
  * DiskManager takes care of the allocation and deallocation of pages within a database. It performs the reading and
  * writing of pages to and from disk, providing a logical file layer within the context of a database management system.
+ *
+ * The log is split into segment files: "<db>.log" is segment 0 and segment n is "<db>.log.n". Log offsets are logical,
+ * they keep growing across segments, and every segment starts with a header:
+ * -------------------------------------------------------------------------------------
+ * | magic (4) | segment number (4) | start LSN (4) | start offset (4) | checkpoint LSN (4) |
+ * -------------------------------------------------------------------------------------
+ * A single WriteLog never spans two segments, so every segment starts on a log record boundary. Segments that are no
+ * longer needed for recovery can be deleted with RemoveLogSegmentsBefore.
+ *
+ * The checkpoint LSN is the master record: the LSN of the last complete checkpoint. It is updated in place in the
+ * header of the segment being written and carried over into every new segment, so the newest segment always has it.
+ *
+ * A page write interrupted by a crash can leave a torn page, part old and part new, which redo cannot repair. With the
+ * double-write buffer turned on, every batch of pages is first written to "<db>.dwb" and synced, and only then written
+ * in place and synced before the next batch replaces it:
+ * -------------------------------------------------------------------------------------------
+ * | magic (4) | page count (4) | checksum (8) | page ids (4 each) | pages (PAGE_SIZE each) |
+ * -------------------------------------------------------------------------------------------
+ * The checksum covers the page ids and the pages. The last batch always holds the newest version ever written of its
+ * pages, so RepairTornPages can copy all of them back in place. A batch whose checksum does not match was torn itself,
+ * before any of its pages were written in place, and is ignored.
  */
 class DiskManager {
  public:
@@ -45,8 +78,27 @@ class DiskManager {
    * Write a page to the database file.
    * @param page_id id of the page
    * @param page_data raw page data
+   * @return false on an I/O error
+   */
+  bool WritePage(page_id_t page_id, const char *page_data);
+
+  /**
+   * Write a batch of pages to the database file, through the double-write buffer if it is turned on.
+   * @param pages the id and raw data of every page to write
+   * @return false on an I/O error, the pages of later batches are not written then
+   */
+  bool WritePages(const std::vector<std::pair<page_id_t, const char *>> &pages);
+
+  /** Turn the double-write buffer on or off. It is off by default. */
+  void SetDoubleWrite(bool double_write);
+  inline bool GetDoubleWrite() const { return double_write_; }
+
+  /**
+   * Copy the pages of the last complete double-write batch back in place, repairing pages torn by a crash, and empty
+   * the double-write file. Recovery calls this before redo.
+   * @return the number of pages restored
    */
-  void WritePage(page_id_t page_id, const char *page_data);
+  int RepairTornPages();
 
   /**
    * Read a page from the database file.
@@ -56,21 +108,83 @@ class DiskManager {
   void ReadPage(page_id_t page_id, char *page_data);
 
   /**
-   * Flush the entire log buffer into disk.
+   * Flush the entire log buffer into disk. Starts a new segment first if the data does not fit into the current one.
    * @param log_data raw log data
    * @param size size of log entry
+   * @param first_lsn LSN of the first record in log_data, recorded in the header if a new segment is started
    */
-  void WriteLog(char *log_data, int size);
+  void WriteLog(char *log_data, int size, lsn_t first_lsn = INVALID_LSN);
 
   /**
-   * Read a log entry from the log file.
+   * Read a log entry from the log file. A read never crosses the end of a segment, the rest of the buffer is zeroed.
    * @param[out] log_data output buffer
    * @param size size of the log entry
-   * @param offset offset of the log entry in the file
-   * @return true if the read was successful, false otherwise
+   * @param offset logical offset of the log entry
+   * @return true if the read was successful, false otherwise (past the end, or in a removed segment)
    */
   bool ReadLog(char *log_data, int size, int offset);
 
+  /**
+   * Read log bytes without padding. Like ReadLog, a read never crosses the end of a segment.
+   * @param[out] log_data output buffer
+   * @param size maximum number of bytes to read
+   * @param offset logical offset to start reading at
+   * @return the number of bytes read, 0 at the end of the log or in a removed segment, -1 on an I/O error
+   */
+  int ReadLogBytes(char *log_data, int size, int offset);
+
+  /**
+   * Close the current log segment and direct further writes to a new one. Reuses the current segment if it is empty.
+   * @param start_lsn LSN of the first record that will be written to the new segment
+   * @return the logical offset at which the new segment starts
+   */
+  int StartLogSegment(lsn_t start_lsn);
+
+  /**
+   * Delete every log segment that ends at or before offset. The segment being written is never deleted.
+   * @param offset logical log offset that is still needed for recovery
+   */
+  void RemoveLogSegmentsBefore(int offset);
+
+  /** @return the logical offset of the oldest log byte still on disk, where recovery starts reading */
+  int GetLogStartOffset();
+
+  /** @return the start LSN recorded in the oldest log segment still on disk */
+  lsn_t GetLogStartLSN();
+
+  /**
+   * @param lsn a log sequence number
+   * @return the logical offset of the segment that holds lsn, i.e. the newest segment starting at or before it, or the
+   * start of the log if lsn is older than every segment still on disk
+   */
+  int GetLogSegmentOffset(lsn_t lsn);
+
+  /**
+   * Durably record lsn as the last complete checkpoint in the master record.
+   * @param lsn LSN of the CHECKPOINT_END record
+   */
+  void SetCheckpointLSN(lsn_t lsn);
+
+  /** @return the LSN of the last complete checkpoint, INVALID_LSN if there is none */
+  lsn_t GetCheckpointLSN();
+
+  /** @return the number of log segment files on disk */
+  int GetNumLogSegments();
+
+  /**
+   * Re-read the log segments from disk. A standby opens a DiskManager on the primary's files and calls this to see
+   * what the primary, possibly another process, appended, started or deleted since. Must not be used while this
+   * DiskManager writes the log itself.
+   */
+  void RefreshLogSegments();
+
+  /** Set the upper bound on the size of a segment file. It must leave room for a full log buffer. */
+  inline void SetLogSegmentSize(int size) {
+    BUSTUB_ASSERT(size >= LOG_SEGMENT_HEADER_SIZE + LOG_BUFFER_SIZE, "Log segment must fit a full log buffer.");
+    log_segment_size_ = size;
+  }
+  inline int GetLogSegmentSize() const { return log_segment_size_; }
+
   /** @return the number of disk flushes */
   int GetNumFlushes() const;
 
@@ -80,6 +194,12 @@ class DiskManager {
   /** @return the number of disk writes */
   int GetNumWrites() const;
 
+  /** @return the number of pages written to the double-write file, on top of the in-place writes */
+  inline int GetNumDoubleWrites() const { return num_double_writes_; }
+
+  /** @return the number of ReadPage calls waiting for or doing I/O right now, i.e. the foreground read queue */
+  inline int GetNumPendingReads() const { return num_pending_reads_; }
+
   /**
    * Sets the future which is used to check for non-blocking flushes.
    * @param f the non-blocking flush check
@@ -90,18 +210,66 @@ class DiskManager {
   inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
 
  private:
+  static constexpr uint32_t LOG_SEGMENT_MAGIC = 0x4c415742;   // "BWAL"
+  static constexpr uint32_t DOUBLE_WRITE_MAGIC = 0x42574442;  // "BDWB"
+
+  /** In-memory copy of a segment header plus the number of log bytes in the segment. */
+  struct LogSegment {
+    int number_;
+    lsn_t start_lsn_;
+    int start_offset_;
+    int size_;
+  };
+
   int GetFileSize(const std::string &file_name);
-  // stream to write log file
+  /** ReadPage without the bookkeeping of pending reads. */
+  void ReadPageImpl(page_id_t page_id, char *page_data);
+  /** Write one page in place without flushing. The caller must hold db_io_latch_. */
+  bool WritePageImpl(page_id_t page_id, const char *page_data);
+  /** Write pages [begin, end) to the double-write file and flush it. The caller must hold db_io_latch_. */
+  bool WriteDoubleWriteBatch(const std::vector<std::pair<page_id_t, const char *>> &pages, size_t begin, size_t end);
+  /** @return the file name of log segment number */
+  std::string LogSegmentFileName(int number) const;
+  /** Find the existing segments of log_name_, creating segment 0 if there are none. */
+  void OpenLogSegments();
+  /** Rebuild log_segments_ and the master record from the segment files on disk. */
+  void ScanLogSegments();
+  /** Create segment number with a fresh header and make it the one log_io_ appends to. */
+  void CreateLogSegment(int number, lsn_t start_lsn, int start_offset);
+  /** Overwrite the header of an existing segment, e.g. after the checkpoint LSN changed. */
+  void WriteLogSegmentHeader(const LogSegment &segment);
+  /** @return false if file_name is not a segment written by us */
+  bool ReadLogSegmentHeader(const std::string &file_name, LogSegment *segment, lsn_t *checkpoint_lsn);
+
+  // stream to write log file, always open on the last segment
   std::fstream log_io_;
+  // stream to read older segments, open on log_read_segment_
+  std::ifstream log_read_io_;
+  int log_read_segment_{-1};
   std::string log_name_;
+  /** Segments still on disk, oldest first. The last one is being appended to. */
+  std::vector<LogSegment> log_segments_;
+  int log_segment_size_{DEFAULT_LOG_SEGMENT_SIZE};
+  /** The master record, see above. */
+  lsn_t checkpoint_lsn_{INVALID_LSN};
+  /** Protects the log streams, log_segments_ and checkpoint_lsn_. */
+  std::mutex log_io_latch_;
   // stream to write db file
   std::fstream db_io_;
   std::string file_name_;
+  // stream to write the double-write file, only open while double-write is on
+  std::fstream double_write_io_;
+  std::string double_write_name_;
+  bool double_write_{false};
+  /** Staging area for one double-write batch. */
+  std::vector<char> double_write_buffer_;
   int num_flushes_;
   int num_writes_;
+  std::atomic<int> num_double_writes_{0};
+  std::atomic<int> num_pending_reads_{0};
   bool flush_log_;
   std::future<void> *flush_log_f_;
-  // With multiple buffer pool instances, need to protect file access
+  // With multiple buffer pool instances, need to protect file access. Also protects the double-write file.
   std::mutex db_io_latch_;
 };
 
@@ -10,11 +10,14 @@
 //===----------------------------------------------------------------------===//
 #pragma once
 
+#include <deque>
 #include <queue>
 #include <string>
 #include <vector>
 
+#include "common/rwlatch.h"
 #include "concurrency/transaction.h"
+#include "recovery/log_manager.h"
 #include "storage/index/index_iterator.h"
 #include "storage/page/b_plus_tree_internal_page.h"
 #include "storage/page/b_plus_tree_leaf_page.h"
@@ -32,6 +35,22 @@ namespace bustub {
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ *
+ * Concurrent operations crab down the tree with page latches: a page is latched before the latch on its parent is let
+ * go. Lookups read latch every page. Inserts and removes first go down the same way and write latch only the leaf,
+ * which is enough as long as the leaf cannot split or merge. Otherwise they start over from the root with write
+ * latches, and keep the latches on the pages above the leaf that the split or merge may change. The root latch guards
+ * root_page_id_ until the root page is latched.
+ *
+ * Iterators read latch the leaf they are on and move from leaf to leaf, left to right. A leaf is latched only after
+ * the leaf to its left when two are held, so iterators and merges do not deadlock. A thread must not modify the tree
+ * while it holds an iterator that is not at the end.
+ *
+ * With a log manager, every insert and remove writes one log record before it lets go of its latches: the entry and
+ * the leaf slot it went into or out of, and if pages split or merged, every page the change left behind whole along
+ * with the root. Redo restores a split or merge from that one record, so it is never half done after a crash, and
+ * it is never undone either: undo removes or puts back the entry through the tree, found by its key. The parent page
+ * ids that splits and merges set in the children they move are not logged, the tree only reads them for printing.
  */
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTree {
@@ -39,8 +58,13 @@ class BPlusTree {
   using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
 
  public:
+  /**
+   * @param log_manager the log manager, or nullptr to not log changes
+   * @param root_page_id the root of an existing tree to open, as kept in the header page; INVALID_PAGE_ID for a new one
+   */
   explicit BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE);
+                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE,
+                     LogManager *log_manager = nullptr, page_id_t root_page_id = INVALID_PAGE_ID);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
@@ -76,34 +100,107 @@ class BPlusTree {
 
   // read data from file and remove one by one
   void RemoveFromFile(const std::string &file_name, Transaction *transaction = nullptr);
-  // expose for test purpose
+  // expose for test purpose, the leaf is returned read latched
   Page *FindLeafPage(const KeyType &key, bool leftMost = false);
 
- private:
-  void StartNewTree(const KeyType &key, const ValueType &value);
-
-  bool InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
+  /**
+   * Revert the entry change of a BPLUS_TREE_INSERT or BPLUS_TREE_REMOVE record during recovery, by removing the entry
+   * or inserting it again. See LogRecovery::RegisterIndex.
+   */
+  void UndoLogRecord(LogRecord *log_record);
 
-  void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key, BPlusTreePage *new_node,
-                        Transaction *transaction = nullptr);
+ private:
+  /** What an operation may do to the pages it latches. */
+  enum class Operation { FIND, INSERT, REMOVE };
+
+  /**
+   * The latches one operation holds. They are released when it goes away, or when the operation crabs past them.
+   * Writers keep them here rather than in the page set of their transaction, which they may not have.
+   */
+  struct LatchContext {
+    LatchContext(BPlusTree *tree, Operation operation, bool pessimistic)
+        : tree_(tree), operation_(operation), pessimistic_(pessimistic) {}
+    ~LatchContext() { tree_->ReleaseLatches(this); }
+
+    DISALLOW_COPY_AND_MOVE(LatchContext);
+
+    BPlusTree *tree_;
+    Operation operation_;
+    /** Write latch every page on the way down, instead of only the leaf. */
+    bool pessimistic_;
+    /** Whether the root latch is held, exclusive for pessimistic operations and shared otherwise. */
+    bool root_locked_{false};
+    /** Whether the operation changed the pages it holds. */
+    bool dirty_{false};
+    /** Whether pages split, merged or moved entries between them, or the root changed. */
+    bool restructured_{false};
+    /** The latched and pinned pages, top down. Each is the parent of the next one. */
+    std::deque<Page *> pages_;
+    /** Siblings that merges and redistributions changed, write latched and pinned until the change is logged. */
+    std::vector<Page *> siblings_;
+    /** Pages created by splits, pinned but not latched: nobody finds them before the latches above are released. */
+    std::vector<Page *> new_pages_;
+    /** The pages emptied by merges, deleted once every latch is released. */
+    std::vector<page_id_t> deleted_;
+  };
+
+  /**
+   * Go down to the leaf for key, or to the leftmost one, crabbing with the latches ctx asks for.
+   * @return the leaf, also the last page of ctx; nullptr if the tree is empty, with the root latch still held
+   */
+  Page *FindLeafPage(const KeyType &key, bool left_most, LatchContext *ctx);
+
+  /** Latch a page on the way down and add it to ctx, releasing what ctx held unless it may still have to change. */
+  void CrabInto(Page *page, bool is_root, LatchContext *ctx);
+
+  /** @return true if the operation cannot make node split or merge, so the pages above it stay as they are */
+  bool IsSafe(BPlusTreePage *node, Operation operation, bool is_root) const;
+
+  /** @return true if ctx takes the write latch of page rather than the read latch */
+  bool TakesWriteLatch(Page *page, const LatchContext &ctx) const;
+
+  /** Release the pages and the root latch ctx holds, then delete the pages it emptied. */
+  void ReleaseLatches(LatchContext *ctx);
+
+  /** @return the position of node among the pages ctx holds; the page before it, if any, is its parent */
+  size_t PositionOf(BPlusTreePage *node, const LatchContext &ctx) const;
+
+  void StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction, LatchContext *ctx);
+
+  bool InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction, LatchContext *ctx);
+
+  void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key, BPlusTreePage *new_node, LatchContext *ctx);
 
   template <typename N>
-  N *Split(N *node);
+  N *Split(N *node, LatchContext *ctx);
 
   template <typename N>
-  bool CoalesceOrRedistribute(N *node, Transaction *transaction = nullptr);
+  void CoalesceOrRedistribute(N *node, LatchContext *ctx);
 
   template <typename N>
-  bool Coalesce(N **neighbor_node, N **node, BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> **parent,
-                int index, Transaction *transaction = nullptr);
+  void Coalesce(N **neighbor_node, N **node, BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> **parent,
+                int index, LatchContext *ctx);
 
   template <typename N>
-  void Redistribute(N *neighbor_node, N *node, int index);
+  void Redistribute(N *neighbor_node, N *node, InternalPage *parent, int index);
 
-  bool AdjustRoot(BPlusTreePage *node);
+  void AdjustRoot(BPlusTreePage *node, LatchContext *ctx);
 
   void UpdateRootPageId(int insert_record = 0);
 
+  Page *FetchTreePage(page_id_t page_id);
+
+  inline bool IsLogging() const { return enable_logging && log_manager_ != nullptr; }
+
+  /**
+   * Write ahead the entry change of an insert or remove, while ctx still holds its latches. A restructured change
+   * carries every page ctx holds or created that is not deleted, and the root. The pages get the LSN of the record.
+   * @param leaf the leaf the entry went into or out of
+   * @param slot the position of the entry in the leaf
+   */
+  void LogEntryChange(LogRecordType type, Transaction *transaction, const KeyType &key, const ValueType &value,
+                      Page *leaf, int slot, LatchContext *ctx);
+
   /* Debug Routines for FREE!! */
   void ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const;
 
@@ -116,6 +213,9 @@ class BPlusTree {
   KeyComparator comparator_;
   int leaf_max_size_;
   int internal_max_size_;
+  /** Protects root_page_id_, see above. */
+  mutable ReaderWriterLatch root_latch_;
+  LogManager *log_manager_;
 };
 
 }  // namespace bustub
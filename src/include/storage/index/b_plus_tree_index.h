@@ -16,6 +16,7 @@
 #include <string>
 #include <vector>
 
+#include "concurrency/lock_manager.h"
 #include "storage/index/b_plus_tree.h"
 #include "storage/index/index.h"
 
@@ -23,10 +24,26 @@ namespace bustub {
 
 #define BPLUSTREE_INDEX_TYPE BPlusTreeIndex<KeyType, ValueType, KeyComparator>
 
+/**
+ * BPlusTreeIndex is a unique index on a B+ tree.
+ *
+ * With a lock manager and logging enabled, the index protects the ranges transactions scan against phantoms with
+ * next-key locking. A key stands for the gap before it, and the RIDs in the index are the keys' locks: they live in
+ * the same lock manager as the table rows. The gap after the largest key belongs to a RID of the index's own, which
+ * is no table row.
+ * - A scan under REPEATABLE_READ takes shared locks on every key in its range and on the key after it, until commit.
+ * - An insert holds an exclusive lock on the key after the new one while it inserts, so it waits for the scans that
+ *   read that gap. A scan that comes later finds the new key, and the lock the table holds on its row.
+ * - A delete takes an exclusive lock on the key after the deleted one until commit, since the gap before that key
+ *   grows by the deleted key.
+ * Inserts and deletes outside the ranges scanned do not wait for the scans. Locks are never taken while the tree is
+ * latched: the index finds the keys to lock, locks them, and checks they are still the right ones.
+ */
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
  public:
-  BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager);
+  BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager,
+                 LockManager *lock_manager = nullptr, LogManager *log_manager = nullptr);
 
   void InsertEntry(const Tuple &key, RID rid, Transaction *transaction) override;
 
@@ -34,6 +51,9 @@ class BPlusTreeIndex : public Index {
 
   void ScanKey(const Tuple &key, std::vector<RID> *result, Transaction *transaction) override;
 
+  void ScanRange(const Tuple *low_key, const Tuple *high_key, std::vector<RID> *result,
+                 Transaction *transaction) override;
+
   INDEXITERATOR_TYPE GetBeginIterator();
 
   INDEXITERATOR_TYPE GetBeginIterator(const KeyType &key);
@@ -41,10 +61,31 @@ class BPlusTreeIndex : public Index {
   INDEXITERATOR_TYPE GetEndIterator();
 
  protected:
+  /** @return true if txn takes locks on the keys it writes */
+  bool IsLockingWrites(Transaction *txn) const;
+  /** @return true if txn takes locks on the ranges it scans */
+  bool IsLockingScans(Transaction *txn) const;
+
+  /**
+   * Collect the values of the keys in [low, high], and the value of the first key after the range.
+   * @param low the smallest key, nullptr for no lower bound
+   * @param high the largest key, nullptr for no upper bound
+   * @param values the values in the range
+   * @return the value of the key after the range, the supremum if there is none
+   */
+  ValueType CollectRange(const KeyType *low, const KeyType *high, std::vector<ValueType> *values);
+
+  /** @return the value of the first key not smaller than key, or greater than key if strict; the supremum if none */
+  ValueType NextKey(const KeyType &key, bool strict);
+
   // comparator for key
   KeyComparator comparator_;
   // container
   BPlusTree<KeyType, ValueType, KeyComparator> container_;
+  /** Locks the keys, nullptr if the index takes no locks. */
+  LockManager *lock_manager_;
+  /** Stands for the gap after the largest key. */
+  RID supremum_;
 };
 
 }  // namespace bustub
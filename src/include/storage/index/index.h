@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "catalog/schema.h"
+#include "common/exception.h"
 #include "storage/table/tuple.h"
 #include "type/value.h"
 
@@ -175,6 +176,18 @@ class Index {
    */
   virtual void ScanKey(const Tuple &key, std::vector<RID> *result, Transaction *transaction) = 0;
 
+  /**
+   * Search the index for all keys in a range, in key order. Only ordered indexes support this.
+   * @param low_key The smallest key of the range, nullptr for no lower bound
+   * @param high_key The largest key of the range, nullptr for no upper bound
+   * @param result The collection of RIDs that is populated with results of the search
+   * @param transaction The transaction context
+   */
+  virtual void ScanRange(const Tuple *low_key, const Tuple *high_key, std::vector<RID> *result,
+                         Transaction *transaction) {
+    throw Exception(ExceptionType::NOT_IMPLEMENTED, "Index " + GetName() + " does not support range scans.");
+  }
+
  private:
   /** The Index structure owns its metadata */
   std::unique_ptr<IndexMetadata> metadata_;
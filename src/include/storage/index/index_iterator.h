@@ -19,25 +19,49 @@ namespace bustub {
 
 #define INDEXITERATOR_TYPE IndexIterator<KeyType, ValueType, KeyComparator>
 
+/**
+ * IndexIterator walks the leaves of a B+ tree in key order. It keeps the leaf it is on pinned and read latched, and
+ * latches the next leaf before it lets go of the current one. A default constructed iterator is the end.
+ */
 INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
+  using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
+
  public:
-  // you may define your own constructor based on your member variables
   IndexIterator();
+  /**
+   * @param buffer_pool_manager the buffer pool of the tree
+   * @param page the pinned and read latched leaf to start on, released by the iterator
+   * @param index the entry to start at, may be past the last entry of the leaf
+   */
+  IndexIterator(BufferPoolManager *buffer_pool_manager, Page *page, int index);
+  IndexIterator(IndexIterator &&other) noexcept;
   ~IndexIterator();
 
+  DISALLOW_COPY(IndexIterator);
+
   bool IsEnd();
 
   const MappingType &operator*();
 
   IndexIterator &operator++();
 
-  bool operator==(const IndexIterator &itr) const { throw std::runtime_error("unimplemented"); }
+  bool operator==(const IndexIterator &itr) const {
+    return page_ == itr.page_ && (page_ == nullptr || index_ == itr.index_);
+  }
 
-  bool operator!=(const IndexIterator &itr) const { throw std::runtime_error("unimplemented"); }
+  bool operator!=(const IndexIterator &itr) const { return !(*this == itr); }
 
  private:
-  // add your own private member variables here
+  /** Move on to the next leaf with entries while the current one has none left. */
+  void SkipExhaustedLeaves();
+  /** Unlatch and unpin the leaf. */
+  void Release();
+
+  BufferPoolManager *buffer_pool_manager_{nullptr};
+  /** The pinned and read latched leaf, nullptr at the end. */
+  Page *page_{nullptr};
+  int index_{0};
 };
 
 }  // namespace bustub
@@ -33,8 +33,9 @@ namespace bustub {
  *  ----------------------------------------------------------------
  *
  *  Here '+' means concatenation.
- *  The above format omits the space required for the occupied_ and
- *  readable_ arrays. More information is in storage/page/hash_table_page_defs.h.
+ *  The above format omits the page id and LSN header and the space required
+ *  for the occupied_ and readable_ arrays. More information is in
+ *  storage/page/hash_table_page_defs.h.
  *
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
@@ -43,6 +44,18 @@ class HashTableBucketPage {
   // Delete all constructor / destructor to ensure memory safety
   HashTableBucketPage() = delete;
 
+  /** @return the page id of this page */
+  page_id_t GetPageId() const { return page_id_; }
+
+  /** Sets the page id of this page. */
+  void SetPageId(page_id_t page_id) { page_id_ = page_id; }
+
+  /** @return the lsn of this page */
+  lsn_t GetLSN() const { return lsn_; }
+
+  /** Sets the LSN of this page. */
+  void SetLSN(lsn_t lsn) { lsn_ = lsn; }
+
   /**
    * Scan the bucket and collect values that have the matching key
    *
@@ -56,16 +69,18 @@ class HashTableBucketPage {
    *
    * @param key key to insert
    * @param value value to insert
+   * @param[out] bucket_idx if not nullptr, the index the pair was stored at
    * @return true if inserted, false if duplicate KV pair or bucket is full
    */
-  bool Insert(KeyType key, ValueType value, KeyComparator cmp);
+  bool Insert(KeyType key, ValueType value, KeyComparator cmp, uint32_t *bucket_idx = nullptr);
 
   /**
    * Removes a key and value.
    *
+   * @param[out] bucket_idx if not nullptr, the index the pair was removed from
    * @return true if removed, false if not found
    */
-  bool Remove(KeyType key, ValueType value, KeyComparator cmp);
+  bool Remove(KeyType key, ValueType value, KeyComparator cmp, uint32_t *bucket_idx = nullptr);
 
   /**
    * Gets the key at an index in the bucket.
@@ -164,10 +179,12 @@ class HashTableBucketPage {
     size_t bit_idx = bucket_idx % 8;
     readable_[char_idx] &= ~(1 << (7 - bit_idx));
   };
+  page_id_t page_id_;
+  lsn_t lsn_;
   //  For more on BUCKET_ARRAY_SIZE see storage/page/hash_table_page_defs.h
-  char occupied_[(BUCKET_ARRAY_SIZE - 1) / 8 + 1];
+  char occupied_[BUCKET_BITMAP_SIZE_OF(sizeof(MappingType))];
   // 0 if tombstone/brand new (never occupied), 1 otherwise.
-  char readable_[(BUCKET_ARRAY_SIZE - 1) / 8 + 1];
+  char readable_[BUCKET_BITMAP_SIZE_OF(sizeof(MappingType))];
   MappingType array_[0];
 };
 
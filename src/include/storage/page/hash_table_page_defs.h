@@ -34,11 +34,23 @@
 #define HASH_TABLE_BUCKET_TYPE HashTableBucketPage<KeyType, ValueType, KeyComparator>
 #define DIRECTORY_ARRAY_SIZE 512
 
+/**
+ * A bucket page starts with its page id and LSN, at the same offsets as in every other logged page, so the buffer pool
+ * can enforce the WAL rule for it and recovery can tell which records it reflects.
+ */
+#define BUCKET_HEADER_SIZE 8
+
 /**
  * BUCKET_ARRAY_SIZE is the number of (key, value) pairs that can be stored in an extendible hashing bucket page.
  * It is an approximate calculation based on the size of MappingType (which is a std::pair of KeyType and ValueType).
- * For each key/value pair, we need two additional bits for occupied_ and readable_. 4 * (PAGE_SIZE - 4) / (4 * sizeof
- * (MappingType) + 1) = (PAGE_SIZE - 4)/(sizeof (MappingType) + 0.25) because 0.25 bytes = 2 bits is the space required
- * to maintain the occupied and readable flags for a key value pair.
+ * For each key/value pair, we need two additional bits for occupied_ and readable_. 4 * (PAGE_SIZE - 16) / (4 * sizeof
+ * (MappingType) + 1) = (PAGE_SIZE - 16)/(sizeof (MappingType) + 0.25) because 0.25 bytes = 2 bits is the space required
+ * to maintain the occupied and readable flags for a key value pair. The 16 bytes hold the header and the padding of
+ * the two flag arrays.
+ *
+ * Each flag array is padded to a multiple of 4 bytes, so the pairs always start at a multiple of 8. The layout then only
+ * depends on the size of a pair, which is all that recovery knows about the buckets it redoes.
  */
-#define BUCKET_ARRAY_SIZE (4 * PAGE_SIZE / (4 * sizeof(MappingType) + 1))
+#define BUCKET_ARRAY_SIZE_OF(entry_size) (4 * (PAGE_SIZE - 2 * BUCKET_HEADER_SIZE) / (4 * (entry_size) + 1))
+#define BUCKET_BITMAP_SIZE_OF(entry_size) (((BUCKET_ARRAY_SIZE_OF(entry_size) - 1) / 32 + 1) * 4)
+#define BUCKET_ARRAY_SIZE BUCKET_ARRAY_SIZE_OF(sizeof(MappingType))
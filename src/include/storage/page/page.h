@@ -86,6 +86,11 @@ class Page {
   int pin_count_ = 0;
   /** True if the page is dirty, i.e. it is different from its corresponding page on disk. */
   bool is_dirty_ = false;
+  /**
+   * Lower bound on the LSN of any change to this page that may not be on disk yet (the ARIES recLSN), INVALID_LSN if
+   * the page on disk is known to be up to date.
+   */
+  lsn_t rec_lsn_ = INVALID_LSN;
   /** Page latch. */
   ReaderWriterLatch rwlatch_;
 };
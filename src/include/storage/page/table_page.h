@@ -77,7 +77,7 @@ class TablePage : public Page {
    * @param tuple tuple to insert
    * @param[out] rid rid of the inserted tuple
    * @param txn transaction performing the insert
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if the transaction's table lock covers the tuple
    * @param log_manager the log manager
    * @return true if the insert is successful (i.e. there is enough space)
    */
@@ -87,7 +87,7 @@ class TablePage : public Page {
    * Mark a tuple as deleted. This does not actually delete the tuple.
    * @param rid rid of the tuple to mark as deleted
    * @param txn transaction performing the delete
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if the transaction's table lock covers the tuple
    * @param log_manager the log manager
    * @return true if marking the tuple as deleted is successful (i.e the tuple exists)
    */
@@ -99,7 +99,7 @@ class TablePage : public Page {
    * @param[out] old_tuple old value of the tuple
    * @param rid rid of the tuple
    * @param txn transaction performing the update
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if the transaction's table lock covers the tuple
    * @param log_manager the log manager
    * @return true if updating the tuple succeeded
    */
@@ -117,7 +117,7 @@ class TablePage : public Page {
    * @param rid rid of the tuple to read
    * @param[out] tuple the tuple that was read
    * @param txn transaction performing the read
-   * @param lock_manager the lock manager
+   * @param lock_manager the lock manager, nullptr if the transaction's table lock covers the tuple
    * @return true if the read is successful (i.e. the tuple exists)
    */
   bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager);
@@ -126,16 +126,18 @@ class TablePage : public Page {
 
   /**
    * @param[out] first_rid the RID of the first tuple in this page
+   * @param with_deleted also return slots whose tuple is deleted, for snapshots that may still see it
    * @return true if the first tuple exists, false otherwise
    */
-  bool GetFirstTupleRid(RID *first_rid);
+  bool GetFirstTupleRid(RID *first_rid, bool with_deleted = false);
 
   /**
    * @param cur_rid the RID of the current tuple
    * @param[out] next_rid the RID of the tuple following the current tuple
+   * @param with_deleted also return slots whose tuple is deleted, for snapshots that may still see it
    * @return true if the next tuple exists, false otherwise
    */
-  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid);
+  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool with_deleted = false);
 
  private:
   static_assert(sizeof(page_id_t) == 4);
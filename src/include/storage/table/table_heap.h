@@ -12,6 +12,11 @@
 
 #pragma once
 
+#include <array>
+#include <deque>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
 #include "buffer/buffer_pool_manager.h"
 #include "recovery/log_manager.h"
 #include "storage/page/table_page.h"
@@ -23,6 +28,12 @@ namespace bustub {
 /**
  * TableHeap represents a physical table on disk.
  * This is just a doubly-linked list of pages.
+ *
+ * The pages always hold the newest version of a row, committed or not. The versions it replaced are kept in memory
+ * in a version chain per row for as long as a snapshot transaction may still read them; see
+ * TransactionManager::GarbageCollect.
+ *
+ * Inserts, deletes and updates abort read-only transactions.
  */
 class TableHeap {
   friend class TableIterator;
@@ -108,11 +119,168 @@ class TableHeap {
   /** @return the id of the first page of this table */
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  /**
+   * Set the oid of the table this heap stores. Rows are locked under an intention lock on the table from then on; a
+   * heap without an oid only takes row locks.
+   */
+  inline void SetTableOid(table_oid_t table_oid) { table_oid_ = table_oid; }
+  inline table_oid_t GetTableOid() const { return table_oid_; }
+
+  /**
+   * Lock the whole table, for executors that pick a coarser granularity than single rows. Like the row locks, table
+   * locks are only taken while logging is enabled.
+   * @param txn the transaction taking the lock
+   * @param mode the lock mode
+   * @return false if the transaction was aborted
+   */
+  bool LockTable(Transaction *txn, LockManager::LockMode mode);
+
+  /**
+   * Make the versions txn wrote of rid the current ones at commit_ts. Called on commit for every row txn wrote,
+   * before its deletes are applied.
+   */
+  void CommitVersion(const RID &rid, Transaction *txn, timestamp_t commit_ts);
+
+  /** Forget the version txn saved of rid before writing it, once the page holds it again. Called on abort. */
+  void AbortVersion(const RID &rid, Transaction *txn);
+
+  /**
+   * Drop the versions of rid that no snapshot reads any more.
+   * @param watermark the read timestamp of the oldest running snapshot transaction
+   * @return the number of versions dropped
+   */
+  size_t PruneVersions(const RID &rid, timestamp_t watermark);
+
+  /** @return the number of old versions kept for snapshot reads */
+  size_t GetVersionCount();
+
+  /**
+   * Validate a read of an optimistic transaction that installed its writes: the latest committed version of the row
+   * must still be the one it read, and nobody else may be writing the row.
+   * @return false if the read is stale
+   */
+  bool ValidateRead(const TableReadRecord &read, Transaction *txn);
+
  private:
+  /** A version of a row that was replaced, valid for snapshots reading at [begin_ts_, end_ts_). */
+  struct TupleVersion {
+    Tuple tuple_;
+    /** False if the row did not exist: before it was inserted, or after it was deleted. */
+    bool exists_;
+    timestamp_t begin_ts_;
+    /** MAX_TIMESTAMP until the transaction that replaced the version commits. */
+    timestamp_t end_ts_;
+  };
+
+  /** The replaced versions of a row, newest first. */
+  struct VersionChain {
+    /** The transaction whose write to the row is not committed yet, INVALID_TXN_ID if there is none. */
+    txn_id_t writer_{INVALID_TXN_ID};
+    /** The commit timestamp of the version in the table page, once writer_ is done. */
+    timestamp_t head_ts_{0};
+    std::deque<TupleVersion> versions_;
+  };
+
+  /** Number of parts the version chains are split into by RID. */
+  static constexpr size_t VERSION_SHARDS = 16;
+
+  /** A part of the version chains, so that writers of different rows rarely share a latch. */
+  struct VersionShard {
+    /** Protects chains_. */
+    std::mutex latch_;
+    /** The version chains of the rows that were written while a snapshot may need what they replaced. */
+    std::unordered_map<RID, VersionChain> chains_;
+  };
+
+  inline VersionShard &ShardOf(const RID &rid) { return version_shards_[std::hash<RID>()(rid) % VERSION_SHARDS]; }
+
+  /**
+   * Save the version of rid that txn is about to replace, the first time txn writes the row. A snapshot transaction
+   * must not write a row that was written after its snapshot was taken, or that is being written by someone else;
+   * it is aborted instead. The caller holds the write latch of the row's page.
+   *
+   * Every writer saves versions, at every isolation level, even when no snapshot is running: a snapshot that begins
+   * before the write commits must not read the uncommitted tuple in the page, and only writer_ tells it apart. Versions
+   * nobody can read any more are collected at the next writing commit.
+   * @param old_tuple the version in the page, nullptr if txn inserts the row
+   * @param[out] saved whether a version was saved, which AbortVersion drops if the write fails
+   * @return false if txn was aborted
+   */
+  bool SaveVersion(const RID &rid, Transaction *txn, const Tuple *old_tuple, bool *saved);
+
+  /**
+   * Read the version of rid committed last at read_ts, or the one txn wrote. The caller holds the read latch of the
+   * row's page.
+   * @param[out] own_write set if txn wrote the version read
+   */
+  bool GetVisibleVersion(TablePage *page, const RID &rid, Tuple *tuple, Transaction *txn, timestamp_t read_ts,
+                         bool *own_write);
+
+  /**
+   * Buffer an update or delete of an optimistic transaction until it commits. The row has to exist for txn, which
+   * makes the write a read of the row as well.
+   * @return false if the row does not exist
+   */
+  bool BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn);
+
+  /** Take the shared lock on rid a read needs, or the exclusive one a write needs, before the page is latched. */
+  bool LockRow(Transaction *txn, const RID &rid, LockManager *row_lock_manager, bool exclusive);
+
+  /**
+   * @return true if someone else is writing the row, or if txn reads a snapshot and someone else wrote the row since
+   * it was taken
+   */
+  static inline bool HasWriteConflict(const VersionChain &chain, Transaction *txn) {
+    return chain.writer_ != txn->GetTransactionId() &&
+           (chain.writer_ != INVALID_TXN_ID || (IsSnapshot(txn) && chain.head_ts_ > txn->GetReadTs()));
+  }
+
+  /** @return true if txn reads a snapshot */
+  static inline bool IsSnapshot(Transaction *txn) {
+    return txn != nullptr && txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION;
+  }
+
+  /** @return true if txn is an optimistic transaction that buffers its writes */
+  static inline bool IsBuffering(Transaction *txn) {
+    return txn != nullptr && txn->IsOptimistic() && !txn->IsWritePhase();
+  }
+
+  /** @return true if txn reads versions without locks */
+  static inline bool ReadsVersions(Transaction *txn) { return IsSnapshot(txn) || IsBuffering(txn); }
+
+  /**
+   * Take the intention lock a row read or write needs on the table.
+   * @param[out] row_lock_manager set to the lock manager to lock the row with, nullptr if the row needs no lock of
+   * its own because the lock txn holds on the table covers it
+   * @return false if the transaction was aborted
+   */
+  bool LockForRow(Transaction *txn, bool write, LockManager **row_lock_manager);
+
+  /**
+   * Count the lock txn took on rid if the row was not locked before, and escalate the row locks txn holds on this
+   * table once there are more than the lock manager's escalation threshold.
+   * @param was_locked whether txn held a lock on rid before the operation
+   * @param row_lock_manager what LockForRow returned for the operation
+   */
+  void CountRowLock(Transaction *txn, const RID &rid, bool was_locked, LockManager *row_lock_manager);
+
+  /** @return true if txn holds a lock on the row rid */
+  static inline bool IsRowLocked(Transaction *txn, const RID &rid) {
+    return txn != nullptr && (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid));
+  }
+
+  /** @return true if this heap takes locks for txn */
+  inline bool IsLocking(Transaction *txn) const {
+    return enable_logging && txn != nullptr && lock_manager_ != nullptr && table_oid_ != INVALID_TABLE_OID;
+  }
+
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
   page_id_t first_page_id_{};
+  table_oid_t table_oid_{INVALID_TABLE_OID};
+
+  std::array<VersionShard, VERSION_SHARDS> version_shards_;
 };
 
 }  // namespace bustub
@@ -56,6 +56,9 @@ class TableIterator {
   }
 
  private:
+  /** Move tuple_'s rid to the next slot in the table, or to the end, without reading the tuple. */
+  void NextRid();
+
   TableHeap *table_heap_;
   Tuple *tuple_;
   Transaction *txn_;
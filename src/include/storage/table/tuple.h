@@ -31,6 +31,7 @@ class Tuple {
   friend class TablePage;
   friend class TableHeap;
   friend class TableIterator;
+  friend class LogRecord;
 
  public:
   // Default constructor (to create a dummy tuple)
@@ -75,7 +76,7 @@ class Tuple {
   Value GetValue(const Schema *schema, uint32_t column_idx) const;
 
   // Generates a key tuple given schemas and attributes
-  Tuple KeyFromTuple(const Schema &schema, const Schema &key_schema, const std::vector<uint32_t> &key_attrs);
+  Tuple KeyFromTuple(const Schema &schema, const Schema &key_schema, const std::vector<uint32_t> &key_attrs) const;
 
   // Is the column value null ?
   inline bool IsNull(const Schema *schema, uint32_t column_idx) const {
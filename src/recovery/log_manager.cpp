@@ -12,6 +12,10 @@
 
 #include "recovery/log_manager.h"
 
+#include <cstring>
+
+#include "common/macros.h"
+
 namespace bustub {
 /*
  * set enable_logging = true
@@ -22,33 +26,260 @@ namespace bustub {
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::unique_lock lock(latch_);
+  if (flush_thread_ != nullptr) {
+    return;
+  }
+  enable_logging = true;
+  flush_thread_ = new std::thread([this] {
+    std::unique_lock flush_lock(latch_);
+    while (enable_logging) {
+      WaitForFlushTrigger(&flush_lock);
+      FlushLogBuffer(&flush_lock);
+    }
+    // Anything appended before logging was turned off still has to reach the disk.
+    FlushLogBuffer(&flush_lock);
+  });
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  std::thread *flush_thread;
+  {
+    std::scoped_lock lock(latch_);
+    if (flush_thread_ == nullptr) {
+      return;
+    }
+    enable_logging = false;
+    flush_thread = flush_thread_;
+  }
+  cv_.notify_one();
+  flush_thread->join();
+
+  std::scoped_lock lock(latch_);
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+  // Nobody is left to advance persistent_lsn_, do not keep committers waiting for it.
+  flushed_cv_.notify_all();
+}
+
+/*
+ * Sleep until log_timeout has passed, someone requested a flush, or the deadline of an asynchronous commit is due.
+ * ScheduleFlush may move the deadline earlier while we sleep, so it is re-read after every wakeup.
+ */
+void LogManager::WaitForFlushTrigger(std::unique_lock<std::mutex> *lock) {
+  auto timeout = std::chrono::steady_clock::now() + log_timeout;
+  while (!flush_requested_ && enable_logging) {
+    auto wake_at = std::min(timeout, flush_deadline_);
+    if (cv_.wait_until(*lock, wake_at) == std::cv_status::timeout) {
+      return;
+    }
+  }
+}
+
+/*
+ * Seal the active buffer by pointing new reservations at the other one, then write the sealed batch out with a single
+ * WriteLog. Appenders keep going on the other buffer while the I/O is in flight; at most one batch is in flight since
+ * only the flush thread calls this.
+ */
+void LogManager::FlushLogBuffer(std::unique_lock<std::mutex> *lock) {
+  uint64_t sealed = reservation_.load();
+  while (!reservation_.compare_exchange_weak(
+      sealed, MakeReservation(ReservedLSN(sealed), 1 - ReservedBuffer(sealed), 0))) {
+  }
+  int buffer = ReservedBuffer(sealed);
+  int flush_size = ReservedOffset(sealed);
+  flush_requested_ = false;
+  flush_deadline_ = std::chrono::steady_clock::time_point::max();
+  // The sealed buffer starts right after the previous batch.
+  lsn_t first_lsn = persistent_lsn_ + 1;
+  lock->unlock();
+  append_cv_.notify_all();
+
+  // Appenders that reserved space before the seal may still be copying their records in. They only memcpy, so spin.
+  while (filled_bytes_[buffer].load(std::memory_order_acquire) != flush_size) {
+    std::this_thread::yield();
+  }
+  filled_bytes_[buffer] = 0;
+  disk_manager_->WriteLog(BufferAt(buffer), flush_size, first_lsn);
+
+  lock->lock();
+  // Every LSN handed out before the seal lives in this buffer or in an earlier batch.
+  persistent_lsn_ = ReservedLSN(sealed) - 1;
+  flushed_cv_.notify_all();
+}
+
+/*
+ * Block the caller until its log records are durable. Every waiter that arrives while a batch is being written sets
+ * flush_requested_ again, so all of them are made durable together by the next WriteLog.
+ */
+void LogManager::WaitUntilPersistent(lsn_t lsn) {
+  std::unique_lock lock(latch_);
+  while (persistent_lsn_ < lsn && flush_thread_ != nullptr) {
+    flush_requested_ = true;
+    cv_.notify_one();
+    flushed_cv_.wait(lock);
+  }
+}
+
+/*
+ * Arm the flush deadline for an asynchronous commit. Only the earliest deadline matters, later commits are covered by
+ * the same flush.
+ */
+void LogManager::ScheduleFlush(lsn_t lsn) {
+  std::scoped_lock lock(latch_);
+  if (persistent_lsn_ >= lsn) {
+    return;
+  }
+  auto deadline = std::chrono::steady_clock::now() + async_commit_lag_;
+  if (deadline < flush_deadline_) {
+    flush_deadline_ = deadline;
+    cv_.notify_one();
+  }
+}
+
+/*
+ * The master record must never point past the durable log, so it is only written once the checkpoint is on disk.
+ * Segments are deleted whole: the one holding oldest_lsn and everything after it stays.
+ */
+void LogManager::TruncateLog(lsn_t checkpoint_lsn, lsn_t oldest_lsn) {
+  WaitUntilPersistent(checkpoint_lsn);
+  if (persistent_lsn_ < checkpoint_lsn) {
+    return;
+  }
+  disk_manager_->SetCheckpointLSN(checkpoint_lsn);
+  disk_manager_->RemoveLogSegmentsBefore(disk_manager_->GetLogSegmentOffset(oldest_lsn));
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
  *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The LSN and the byte range are claimed together with a compare-and-swap on reservation_, so records sit in the
+ * buffer in LSN order. The encoded size depends on the LSN (it is a varint), so it is recomputed whenever the CAS
+ * loses a race. If the record does not fit, wake the flush thread and wait for it to seal the full buffer.
  */
-lsn_t LogManager::AppendLogRecord(LogRecord *log_record) { return INVALID_LSN; }
+lsn_t LogManager::AppendLogRecord(LogRecord *log_record) {
+  uint64_t reserved = reservation_.load();
+  int size;
+  while (true) {
+    size = log_record->EncodedSize(ReservedLSN(reserved));
+    BUSTUB_ASSERT(size <= LOG_BUFFER_SIZE, "Log record does not fit into the log buffer.");
+    if (ReservedOffset(reserved) + size > LOG_BUFFER_SIZE) {
+      std::unique_lock lock(latch_);
+      flush_requested_ = true;
+      cv_.notify_one();
+      append_cv_.wait(lock, [&] { return ReservedOffset(reservation_) + size <= LOG_BUFFER_SIZE; });
+      reserved = reservation_.load();
+      continue;
+    }
+    uint64_t next =
+        MakeReservation(ReservedLSN(reserved) + 1, ReservedBuffer(reserved), ReservedOffset(reserved) + size);
+    if (reservation_.compare_exchange_weak(reserved, next)) {
+      break;
+    }
+  }
+
+  // The range is ours alone, serialize without holding any latch.
+  log_record->lsn_ = ReservedLSN(reserved);
+  log_record->size_ = size;
+  SerializeLogRecord(log_record, BufferAt(ReservedBuffer(reserved)) + ReservedOffset(reserved));
+  // Publish the bytes so the flush thread knows the sealed buffer holds no half-written records.
+  filled_bytes_[ReservedBuffer(reserved)].fetch_add(size, std::memory_order_release);
+  return log_record->lsn_;
+}
+
+/*
+ * Encode the record in the compact format documented in log_record.h. lsn_ and size_ must already be set.
+ */
+void LogManager::SerializeLogRecord(LogRecord *log_record, char *dst) {
+  char *pos = LogRecord::EncodeVarint(dst, log_record->size_);
+  *pos++ = static_cast<char>(log_record->log_record_type_);
+  pos = LogRecord::EncodeVarint(pos, log_record->lsn_);
+  pos = LogRecord::EncodeVarint(pos, log_record->txn_id_ + 1);
+  pos = LogRecord::EncodeVarint(pos, log_record->PrevLSNDelta(log_record->lsn_));
+
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      pos = LogRecord::EncodeRID(pos, log_record->insert_rid_);
+      pos = LogRecord::EncodeTuple(pos, log_record->insert_tuple_);
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      pos = LogRecord::EncodeRID(pos, log_record->delete_rid_);
+      pos = LogRecord::EncodeTuple(pos, log_record->delete_tuple_);
+      break;
+    case LogRecordType::UPDATE:
+      pos = LogRecord::EncodeRID(pos, log_record->update_rid_);
+      pos = LogRecord::EncodeTuple(pos, log_record->old_tuple_);
+      pos += LogRecord::EncodeTupleDiff(log_record->old_tuple_, log_record->new_tuple_, pos);
+      break;
+    case LogRecordType::NEWPAGE:
+      pos = LogRecord::EncodeVarint(pos, log_record->prev_page_id_ + 1);
+      pos = LogRecord::EncodeVarint(pos, log_record->page_id_ + 1);
+      break;
+    case LogRecordType::CHECKPOINT_END:
+      pos = LogRecord::EncodeVarint(pos, log_record->active_txns_.size());
+      for (const auto &[txn_id, first_lsn] : log_record->active_txns_) {
+        pos = LogRecord::EncodeVarint(pos, txn_id + 1);
+        pos = LogRecord::EncodeVarint(pos, first_lsn);
+      }
+      pos = LogRecord::EncodeVarint(pos, log_record->dirty_pages_.size());
+      for (const auto &[page_id, rec_lsn] : log_record->dirty_pages_) {
+        pos = LogRecord::EncodeVarint(pos, page_id + 1);
+        pos = LogRecord::EncodeVarint(pos, rec_lsn);
+      }
+      break;
+    case LogRecordType::HASH_BUCKET_INSERT:
+    case LogRecordType::HASH_BUCKET_REMOVE:
+      pos = LogRecord::EncodeVarint(pos, log_record->directory_page_id_ + 1);
+      pos = LogRecord::EncodeVarint(pos, log_record->page_id_ + 1);
+      pos = LogRecord::EncodeVarint(pos, log_record->slot_);
+      pos = LogRecord::EncodeVarint(pos, log_record->hash_);
+      pos = log_record->EncodeEntries(pos);
+      break;
+    case LogRecordType::HASH_BUCKET_SPLIT:
+      pos = LogRecord::EncodeVarint(pos, log_record->page_id_ + 1);
+      pos = log_record->EncodeEntries(pos);
+      break;
+    case LogRecordType::HASH_DIRECTORY_UPDATE:
+      pos = LogRecord::EncodeVarint(pos, log_record->page_id_ + 1);
+      pos = LogRecord::EncodeVarint(pos, log_record->global_depth_);
+      for (const auto &[bucket_page_id, local_depth] : log_record->buckets_) {
+        pos = LogRecord::EncodeVarint(pos, bucket_page_id + 1);
+        pos = LogRecord::EncodeVarint(pos, local_depth);
+      }
+      break;
+    case LogRecordType::BPLUS_TREE_INSERT:
+    case LogRecordType::BPLUS_TREE_REMOVE:
+      pos = LogRecord::EncodeVarint(pos, log_record->index_name_.size());
+      memcpy(pos, log_record->index_name_.data(), log_record->index_name_.size());
+      pos += log_record->index_name_.size();
+      pos = LogRecord::EncodeVarint(pos, log_record->page_id_ + 1);
+      pos = LogRecord::EncodeVarint(pos, log_record->slot_);
+      pos = log_record->EncodeEntries(pos);
+      pos = LogRecord::EncodeVarint(pos, log_record->restructured_ ? 1 : 0);
+      if (log_record->restructured_) {
+        pos = LogRecord::EncodeVarint(pos, log_record->root_page_id_ + 1);
+        pos = LogRecord::EncodeVarint(pos, log_record->tree_pages_.size());
+        for (const auto &[page_id, data] : log_record->tree_pages_) {
+          pos = LogRecord::EncodeVarint(pos, page_id + 1);
+          pos = LogRecord::EncodeVarint(pos, data.size());
+          memcpy(pos, data.data(), data.size());
+          pos += data.size();
+        }
+      }
+      break;
+    default:
+      // BEGIN/COMMIT/ABORT/CHECKPOINT_BEGIN only have the header.
+      break;
+  }
+  BUSTUB_ASSERT(pos == dst + log_record->size_, "Encoded size does not match the serialized record.");
+}
 
 }  // namespace bustub
@@ -0,0 +1,118 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.cpp
+//
+// Identification: src/recovery/log_reader.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "recovery/log_recovery.h"
+
+namespace bustub {
+
+LogReader::LogReader(DiskManager *disk_manager, int offset, int read_size)
+    : disk_manager_(disk_manager), read_size_(read_size), data_offset_(offset) {
+  BUSTUB_ASSERT(read_size_ >= LOG_BUFFER_SIZE, "A chunk must be able to hold the largest log record.");
+  buffers_[0].resize(LOG_BUFFER_SIZE + read_size_);
+  buffers_[1].resize(LOG_BUFFER_SIZE + read_size_);
+  data_ = buffers_[active_].data() + LOG_BUFFER_SIZE;
+}
+
+LogReader::~LogReader() { CancelReadAhead(); }
+
+/*
+ * Decode from memory and only go to disk when the record at pos_ is incomplete. A failed refill leaves the reader
+ * where it was, so Next keeps returning false at the end of the log.
+ */
+bool LogReader::Next(LogRecord *log_record) {
+  while (!LogRecovery::DeserializeLogRecord(data_ + pos_, log_record, data_size_ - pos_)) {
+    if (!Refill()) {
+      return false;
+    }
+  }
+  record_offset_ = data_offset_ + pos_;
+  pos_ += log_record->GetSize();
+  return true;
+}
+
+/*
+ * The read-ahead chunk was read into the idle buffer after its LOG_BUFFER_SIZE bytes of head room. Copy the tail of
+ * the current chunk into that head room, right before the new chunk, and make the idle buffer the active one.
+ */
+bool LogReader::Refill() {
+  int tail = data_size_ - pos_;
+  if (tail >= LOG_BUFFER_SIZE) {
+    // Any complete record would have decoded, this is garbage.
+    return false;
+  }
+  int chunk_offset = data_offset_ + data_size_;
+  char *idle = buffers_[1 - active_].data();
+  int read_count;
+  if (read_ahead_.valid() && read_ahead_offset_ == chunk_offset) {
+    read_count = read_ahead_.get();
+  } else {
+    CancelReadAhead();
+    read_count = disk_manager_->ReadLogBytes(idle + LOG_BUFFER_SIZE, read_size_, chunk_offset);
+  }
+  if (read_count <= 0) {
+    return false;
+  }
+
+  std::memcpy(idle + LOG_BUFFER_SIZE - tail, data_ + pos_, tail);
+  active_ = 1 - active_;
+  data_ = idle + LOG_BUFFER_SIZE - tail;
+  data_offset_ = chunk_offset - tail;
+  data_size_ = tail + read_count;
+  pos_ = 0;
+  StartReadAhead(chunk_offset + read_count);
+  return true;
+}
+
+/*
+ * Undo visits records from the newest to the oldest. On a miss, load the chunk that ends just past offset so that the
+ * records before it can be served from memory too. That chunk may start in a removed segment or end at a segment
+ * boundary before offset; fall back to reading from offset then.
+ */
+void LogReader::Seek(int offset) {
+  if (offset >= data_offset_ && offset < data_offset_ + data_size_) {
+    pos_ = offset - data_offset_;
+    return;
+  }
+  CancelReadAhead();
+  char *chunk = buffers_[active_].data() + LOG_BUFFER_SIZE;
+  int chunk_offset = std::max(0, offset - read_size_ + LOG_BUFFER_SIZE);
+  int read_count = disk_manager_->ReadLogBytes(chunk, read_size_, chunk_offset);
+  if (offset >= chunk_offset + read_count) {
+    chunk_offset = offset;
+    read_count = std::max(0, disk_manager_->ReadLogBytes(chunk, read_size_, chunk_offset));
+  }
+  data_ = chunk;
+  data_offset_ = chunk_offset;
+  data_size_ = read_count;
+  pos_ = offset - chunk_offset;
+}
+
+void LogReader::StartReadAhead(int offset) {
+  read_ahead_offset_ = offset;
+  char *dst = buffers_[1 - active_].data() + LOG_BUFFER_SIZE;
+  read_ahead_ = std::async(std::launch::async,
+                           [this, dst, offset] { return disk_manager_->ReadLogBytes(dst, read_size_, offset); });
+}
+
+void LogReader::CancelReadAhead() {
+  if (read_ahead_.valid()) {
+    read_ahead_.get();
+  }
+  read_ahead_offset_ = -1;
+}
+
+}  // namespace bustub
@@ -0,0 +1,198 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_record.cpp
+//
+// Identification: src/recovery/log_record.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_record.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bustub {
+
+/*
+ * Runs of differing bytes that are at most this far apart are merged into one run, since starting a new run costs at
+ * least two bytes (gap and length).
+ */
+static constexpr uint32_t DIFF_MERGE_DISTANCE = 2;
+
+uint32_t LogRecord::VarintSize(uint32_t value) {
+  uint32_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+char *LogRecord::EncodeVarint(char *dst, uint32_t value) {
+  auto *out = reinterpret_cast<uint8_t *>(dst);
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<uint8_t>(value);
+  return reinterpret_cast<char *>(out);
+}
+
+const char *LogRecord::DecodeVarint(const char *src, const char *end, uint32_t *value) {
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28 && src < end; shift += 7) {
+    auto byte = static_cast<uint8_t>(*src++);
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return src;
+    }
+  }
+  return nullptr;
+}
+
+char *LogRecord::EncodeRID(char *dst, const RID &rid) {
+  dst = EncodeVarint(dst, rid.GetPageId() + 1);
+  return EncodeVarint(dst, rid.GetSlotNum());
+}
+
+const char *LogRecord::DecodeRID(const char *src, const char *end, RID *rid) {
+  uint32_t page_id;
+  uint32_t slot_num;
+  if ((src = DecodeVarint(src, end, &page_id)) == nullptr || (src = DecodeVarint(src, end, &slot_num)) == nullptr) {
+    return nullptr;
+  }
+  rid->Set(static_cast<page_id_t>(page_id) - 1, slot_num);
+  return src;
+}
+
+char *LogRecord::EncodeTuple(char *dst, const Tuple &tuple) {
+  dst = EncodeVarint(dst, tuple.GetLength());
+  memcpy(dst, tuple.GetData(), tuple.GetLength());
+  return dst + tuple.GetLength();
+}
+
+const char *LogRecord::DecodeTuple(const char *src, const char *end, Tuple *tuple) {
+  uint32_t length;
+  if ((src = DecodeVarint(src, end, &length)) == nullptr || length > static_cast<uint32_t>(end - src)) {
+    return nullptr;
+  }
+  if (tuple->allocated_) {
+    delete[] tuple->data_;
+  }
+  tuple->size_ = length;
+  tuple->data_ = new char[length];
+  memcpy(tuple->data_, src, length);
+  tuple->allocated_ = true;
+  return src + length;
+}
+
+/*
+ * A run is a maximal range of bytes that differ between the tuples (every byte past the end of the old tuple differs).
+ * The tuples are walked twice, once to size the encoding and once to write it, because the run count comes first.
+ */
+uint32_t LogRecord::EncodeTupleDiff(const Tuple &old_tuple, const Tuple &new_tuple, char *dst) {
+  const char *old_data = old_tuple.GetData();
+  const char *new_data = new_tuple.GetData();
+  const uint32_t old_length = old_tuple.GetLength();
+  const uint32_t new_length = new_tuple.GetLength();
+  auto differs = [&](uint32_t i) { return i >= old_length || old_data[i] != new_data[i]; };
+  // Find the next run starting at or after from. Returns false if there is none.
+  auto next_run = [&](uint32_t from, uint32_t *start, uint32_t *end) {
+    while (from < new_length && !differs(from)) {
+      from++;
+    }
+    if (from == new_length) {
+      return false;
+    }
+    *start = from;
+    *end = from + 1;
+    for (uint32_t i = *end; i < new_length && i <= *end + DIFF_MERGE_DISTANCE; i++) {
+      if (differs(i)) {
+        *end = i + 1;
+      }
+    }
+    return true;
+  };
+
+  uint32_t start;
+  uint32_t end;
+  uint32_t run_count = 0;
+  uint32_t runs_size = 0;
+  for (uint32_t prev_end = 0; next_run(prev_end, &start, &end); prev_end = end) {
+    run_count++;
+    runs_size += VarintSize(start - prev_end) + VarintSize(end - start) + (end - start);
+  }
+  uint32_t total = VarintSize(new_length) + VarintSize(run_count) + runs_size;
+  if (dst == nullptr) {
+    return total;
+  }
+
+  dst = EncodeVarint(dst, new_length);
+  dst = EncodeVarint(dst, run_count);
+  for (uint32_t prev_end = 0; next_run(prev_end, &start, &end); prev_end = end) {
+    dst = EncodeVarint(dst, start - prev_end);
+    dst = EncodeVarint(dst, end - start);
+    memcpy(dst, new_data + start, end - start);
+    dst += end - start;
+  }
+  return total;
+}
+
+const char *LogRecord::DecodeTupleDiff(const char *src, const char *end, const Tuple &old_tuple, Tuple *new_tuple) {
+  uint32_t new_length;
+  uint32_t run_count;
+  if ((src = DecodeVarint(src, end, &new_length)) == nullptr || (src = DecodeVarint(src, end, &run_count)) == nullptr) {
+    return nullptr;
+  }
+  auto *data = new char[new_length];
+  memcpy(data, old_tuple.GetData(), std::min(new_length, old_tuple.GetLength()));
+  uint32_t pos = 0;
+  for (uint32_t run = 0; run < run_count; run++) {
+    uint32_t gap;
+    uint32_t run_length;
+    if ((src = DecodeVarint(src, end, &gap)) == nullptr || (src = DecodeVarint(src, end, &run_length)) == nullptr ||
+        pos + gap + run_length > new_length || run_length > static_cast<uint32_t>(end - src)) {
+      delete[] data;
+      return nullptr;
+    }
+    pos += gap;
+    memcpy(data + pos, src, run_length);
+    src += run_length;
+    pos += run_length;
+  }
+
+  if (new_tuple->allocated_) {
+    delete[] new_tuple->data_;
+  }
+  new_tuple->size_ = new_length;
+  new_tuple->data_ = data;
+  new_tuple->allocated_ = true;
+  return src;
+}
+
+char *LogRecord::EncodeEntries(char *dst) const {
+  dst = EncodeVarint(dst, entry_size_);
+  dst = EncodeVarint(dst, entry_size_ == 0 ? 0 : entries_.size() / entry_size_);
+  memcpy(dst, entries_.data(), entries_.size());
+  return dst + entries_.size();
+}
+
+const char *LogRecord::DecodeEntries(const char *src, const char *end) {
+  uint32_t count;
+  if ((src = DecodeVarint(src, end, &entry_size_)) == nullptr || (src = DecodeVarint(src, end, &count)) == nullptr) {
+    return nullptr;
+  }
+  uint64_t length = static_cast<uint64_t>(entry_size_) * count;
+  if (length > static_cast<uint64_t>(end - src)) {
+    return nullptr;
+  }
+  entries_.assign(src, src + length);
+  return src + length;
+}
+
+}  // namespace bustub
@@ -12,15 +12,310 @@
 
 #include "recovery/log_recovery.h"
 
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <utility>
+
+#include "storage/page/b_plus_tree_leaf_page.h"
+#include "storage/page/hash_table_directory_page.h"
+#include "storage/page/hash_table_page_defs.h"
+#include "storage/page/header_page.h"
 #include "storage/page/table_page.h"
 
 namespace bustub {
+
+namespace {
+
+/**
+ * A hash table bucket page seen as an array of raw entries of a given size, laid out as described in
+ * storage/page/hash_table_page_defs.h. Recovery only knows the size of the entries of the records it applies.
+ */
+class BucketPageImage {
+ public:
+  BucketPageImage(char *data, uint32_t entry_size)
+      : data_(data),
+        entry_size_(entry_size),
+        bitmap_size_(BUCKET_BITMAP_SIZE_OF(entry_size)),
+        array_size_(BUCKET_ARRAY_SIZE_OF(entry_size)) {}
+
+  uint32_t ArraySize() const { return array_size_; }
+
+  bool IsReadable(uint32_t slot) const { return (Readable()[slot / 8] & (1 << (7 - slot % 8))) != 0; }
+
+  /** @return true if slot holds exactly the entry bytes */
+  bool Holds(uint32_t slot, const char *entry) const {
+    return IsReadable(slot) && memcmp(Entry(slot), entry, entry_size_) == 0;
+  }
+
+  void Put(uint32_t slot, const char *entry) {
+    Occupied()[slot / 8] |= static_cast<char>(1 << (7 - slot % 8));
+    Readable()[slot / 8] |= static_cast<char>(1 << (7 - slot % 8));
+    memcpy(Entry(slot), entry, entry_size_);
+  }
+
+  void Remove(uint32_t slot) { Readable()[slot / 8] &= static_cast<char>(~(1 << (7 - slot % 8))); }
+
+  /** @return the first slot holding the entry bytes, ArraySize() if there is none */
+  uint32_t Find(const char *entry) const {
+    uint32_t slot = 0;
+    while (slot < array_size_ && !Holds(slot, entry)) {
+      slot++;
+    }
+    return slot;
+  }
+
+  /** @return the first slot that is not readable, ArraySize() if the bucket is full */
+  uint32_t FindFree() const {
+    uint32_t slot = 0;
+    while (slot < array_size_ && IsReadable(slot)) {
+      slot++;
+    }
+    return slot;
+  }
+
+  /** Replace the content of the bucket with count entries, stored from the first slot on. */
+  void Reset(page_id_t page_id, const char *entries, uint32_t count) {
+    memset(data_, 0, PAGE_SIZE);
+    memcpy(data_, &page_id, sizeof(page_id_t));
+    for (uint32_t slot = 0; slot < count; slot++) {
+      Put(slot, entries + slot * entry_size_);
+    }
+  }
+
+ private:
+  char *Occupied() const { return data_ + BUCKET_HEADER_SIZE; }
+  char *Readable() const { return data_ + BUCKET_HEADER_SIZE + bitmap_size_; }
+  char *Entry(uint32_t slot) const { return data_ + BUCKET_HEADER_SIZE + 2 * bitmap_size_ + slot * entry_size_; }
+
+  char *data_;
+  uint32_t entry_size_;
+  uint32_t bitmap_size_;
+  uint32_t array_size_;
+};
+
+/**
+ * A B+ tree leaf page seen as an array of raw entries of a given size after the leaf header, laid out as described in
+ * storage/page/b_plus_tree_leaf_page.h. Recovery only knows the size of the entries of the records it applies.
+ */
+class LeafPageImage {
+ public:
+  LeafPageImage(char *data, uint32_t entry_size)
+      : node_(reinterpret_cast<BPlusTreePage *>(data)), data_(data), entry_size_(entry_size) {}
+
+  void Insert(uint32_t slot, const char *entry) {
+    memmove(Entry(slot + 1), Entry(slot), (node_->GetSize() - slot) * entry_size_);
+    memcpy(Entry(slot), entry, entry_size_);
+    node_->IncreaseSize(1);
+  }
+
+  void Remove(uint32_t slot) {
+    memmove(Entry(slot), Entry(slot + 1), (node_->GetSize() - slot - 1) * entry_size_);
+    node_->IncreaseSize(-1);
+  }
+
+ private:
+  char *Entry(uint32_t slot) const { return data_ + LEAF_PAGE_HEADER_SIZE + slot * entry_size_; }
+
+  BPlusTreePage *node_;
+  char *data_;
+  uint32_t entry_size_;
+};
+
+}  // namespace
+
 /*
  * deserialize a log record from log buffer
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
+ *
+ * See log_record.h for the compact format. A zero size marks the zero-filled space past the end of the log.
  */
-bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) { return false; }
+bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record, int max_size) {
+  const char *end = data + max_size;
+  uint32_t size;
+  const char *pos = LogRecord::DecodeVarint(data, end, &size);
+  if (pos == nullptr || size == 0 || size > static_cast<uint32_t>(max_size)) {
+    return false;
+  }
+  end = data + size;
+  if (pos >= end) {
+    return false;
+  }
+  auto type = static_cast<LogRecordType>(static_cast<uint8_t>(*pos++));
+  if (type == LogRecordType::INVALID || static_cast<int>(type) > static_cast<int>(LogRecordType::BPLUS_TREE_REMOVE)) {
+    return false;
+  }
+  uint32_t lsn;
+  uint32_t txn_id;
+  uint32_t prev_lsn_delta;
+  if ((pos = LogRecord::DecodeVarint(pos, end, &lsn)) == nullptr ||
+      (pos = LogRecord::DecodeVarint(pos, end, &txn_id)) == nullptr ||
+      (pos = LogRecord::DecodeVarint(pos, end, &prev_lsn_delta)) == nullptr) {
+    return false;
+  }
+  log_record->size_ = static_cast<int32_t>(size);
+  log_record->log_record_type_ = type;
+  log_record->lsn_ = static_cast<lsn_t>(lsn);
+  log_record->txn_id_ = static_cast<txn_id_t>(txn_id) - 1;
+  log_record->prev_lsn_ = prev_lsn_delta == 0 ? INVALID_LSN : static_cast<lsn_t>(lsn - prev_lsn_delta);
+
+  switch (type) {
+    case LogRecordType::INSERT:
+      if ((pos = LogRecord::DecodeRID(pos, end, &log_record->insert_rid_)) == nullptr ||
+          (pos = LogRecord::DecodeTuple(pos, end, &log_record->insert_tuple_)) == nullptr) {
+        return false;
+      }
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      if ((pos = LogRecord::DecodeRID(pos, end, &log_record->delete_rid_)) == nullptr ||
+          (pos = LogRecord::DecodeTuple(pos, end, &log_record->delete_tuple_)) == nullptr) {
+        return false;
+      }
+      break;
+    case LogRecordType::UPDATE:
+      if ((pos = LogRecord::DecodeRID(pos, end, &log_record->update_rid_)) == nullptr ||
+          (pos = LogRecord::DecodeTuple(pos, end, &log_record->old_tuple_)) == nullptr ||
+          (pos = LogRecord::DecodeTupleDiff(pos, end, log_record->old_tuple_, &log_record->new_tuple_)) == nullptr) {
+        return false;
+      }
+      break;
+    case LogRecordType::NEWPAGE: {
+      uint32_t prev_page_id;
+      uint32_t page_id;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &prev_page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr) {
+        return false;
+      }
+      log_record->prev_page_id_ = static_cast<page_id_t>(prev_page_id) - 1;
+      log_record->page_id_ = static_cast<page_id_t>(page_id) - 1;
+      break;
+    }
+    case LogRecordType::CHECKPOINT_END: {
+      uint32_t count;
+      uint32_t id;
+      uint32_t entry_lsn;
+      log_record->active_txns_.clear();
+      log_record->dirty_pages_.clear();
+      if ((pos = LogRecord::DecodeVarint(pos, end, &count)) == nullptr) {
+        return false;
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        if ((pos = LogRecord::DecodeVarint(pos, end, &id)) == nullptr ||
+            (pos = LogRecord::DecodeVarint(pos, end, &entry_lsn)) == nullptr) {
+          return false;
+        }
+        log_record->active_txns_.emplace_back(static_cast<txn_id_t>(id) - 1, static_cast<lsn_t>(entry_lsn));
+      }
+      if ((pos = LogRecord::DecodeVarint(pos, end, &count)) == nullptr) {
+        return false;
+      }
+      for (uint32_t i = 0; i < count; i++) {
+        if ((pos = LogRecord::DecodeVarint(pos, end, &id)) == nullptr ||
+            (pos = LogRecord::DecodeVarint(pos, end, &entry_lsn)) == nullptr) {
+          return false;
+        }
+        log_record->dirty_pages_.emplace_back(static_cast<page_id_t>(id) - 1, static_cast<lsn_t>(entry_lsn));
+      }
+      break;
+    }
+    case LogRecordType::HASH_BUCKET_INSERT:
+    case LogRecordType::HASH_BUCKET_REMOVE: {
+      uint32_t directory_page_id;
+      uint32_t page_id;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &directory_page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &log_record->slot_)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &log_record->hash_)) == nullptr ||
+          (pos = log_record->DecodeEntries(pos, end)) == nullptr) {
+        return false;
+      }
+      log_record->directory_page_id_ = static_cast<page_id_t>(directory_page_id) - 1;
+      log_record->page_id_ = static_cast<page_id_t>(page_id) - 1;
+      if (log_record->entries_.size() != log_record->entry_size_) {
+        return false;
+      }
+      break;
+    }
+    case LogRecordType::HASH_BUCKET_SPLIT: {
+      uint32_t page_id;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr ||
+          (pos = log_record->DecodeEntries(pos, end)) == nullptr) {
+        return false;
+      }
+      log_record->page_id_ = static_cast<page_id_t>(page_id) - 1;
+      break;
+    }
+    case LogRecordType::HASH_DIRECTORY_UPDATE: {
+      uint32_t page_id;
+      uint32_t bucket_page_id;
+      uint32_t local_depth;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &log_record->global_depth_)) == nullptr ||
+          (1U << std::min(log_record->global_depth_, 31U)) > DIRECTORY_ARRAY_SIZE) {
+        return false;
+      }
+      log_record->page_id_ = static_cast<page_id_t>(page_id) - 1;
+      log_record->buckets_.clear();
+      for (uint32_t i = 0; i < (1U << log_record->global_depth_); i++) {
+        if ((pos = LogRecord::DecodeVarint(pos, end, &bucket_page_id)) == nullptr ||
+            (pos = LogRecord::DecodeVarint(pos, end, &local_depth)) == nullptr) {
+          return false;
+        }
+        log_record->buckets_.emplace_back(static_cast<page_id_t>(bucket_page_id) - 1, local_depth);
+      }
+      break;
+    }
+    case LogRecordType::BPLUS_TREE_INSERT:
+    case LogRecordType::BPLUS_TREE_REMOVE: {
+      uint32_t length;
+      uint32_t page_id;
+      uint32_t restructured;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &length)) == nullptr || length > static_cast<uint32_t>(end - pos)) {
+        return false;
+      }
+      log_record->index_name_.assign(pos, length);
+      pos += length;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &log_record->slot_)) == nullptr ||
+          (pos = log_record->DecodeEntries(pos, end)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &restructured)) == nullptr) {
+        return false;
+      }
+      log_record->page_id_ = static_cast<page_id_t>(page_id) - 1;
+      log_record->restructured_ = restructured != 0;
+      log_record->tree_pages_.clear();
+      if (log_record->entries_.size() != log_record->entry_size_) {
+        return false;
+      }
+      if (!log_record->restructured_) {
+        break;
+      }
+      uint32_t root_page_id;
+      uint32_t count;
+      if ((pos = LogRecord::DecodeVarint(pos, end, &root_page_id)) == nullptr ||
+          (pos = LogRecord::DecodeVarint(pos, end, &count)) == nullptr) {
+        return false;
+      }
+      log_record->root_page_id_ = static_cast<page_id_t>(root_page_id) - 1;
+      for (uint32_t i = 0; i < count; i++) {
+        if ((pos = LogRecord::DecodeVarint(pos, end, &page_id)) == nullptr ||
+            (pos = LogRecord::DecodeVarint(pos, end, &length)) == nullptr || length > PAGE_SIZE ||
+            length > static_cast<uint32_t>(end - pos)) {
+          return false;
+        }
+        log_record->tree_pages_.emplace_back(static_cast<page_id_t>(page_id) - 1, std::vector<char>(pos, pos + length));
+        pos += length;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return pos == end;
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
@@ -28,13 +323,456 @@ bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record)
  *log buffer to reduce unnecessary I/O operations), remember to compare page's
  *LSN with log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
+ *
+ * With a checkpoint, pages outside its dirty page table were on disk up to CHECKPOINT_BEGIN and the others up to
+ * their recLSN, so older records are not redone. Reading starts earlier still if a transaction that was active at the
+ * checkpoint began before that, since undo may need every record of it.
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo() {
+  active_txn_.clear();
+  active_txn_first_lsn_.clear();
+  lsn_mapping_.clear();
+  pruned_lsn_ = 0;
+  // Redo relies on the page LSN, which is meaningless on a torn page.
+  int repaired = disk_manager_->RepairTornPages();
+  if (repaired > 0) {
+    LOG_INFO("Restored %d pages from the double-write buffer", repaired);
+  }
+
+  lsn_t redo_lsn = INVALID_LSN;
+  int start_offset = disk_manager_->GetLogStartOffset();
+  LogRecord checkpoint;
+  if (ReadCheckpoint(&checkpoint)) {
+    redo_lsn = checkpoint.prev_lsn_;
+    for (const auto &[page_id, rec_lsn] : checkpoint.dirty_pages_) {
+      redo_lsn = std::min(redo_lsn, rec_lsn);
+    }
+    lsn_t read_lsn = redo_lsn;
+    for (const auto &[txn_id, first_lsn] : checkpoint.active_txns_) {
+      read_lsn = std::min(read_lsn, first_lsn);
+    }
+    start_offset = disk_manager_->GetLogSegmentOffset(read_lsn);
+  }
+  RedoLog(start_offset, redo_lsn);
+}
+
+/*
+ * Records of transactions that ended before the oldest active one began are never undone, so their offsets are
+ * dropped as the replay moves on. LSNs are handed out one by one, which lets the loop visit just the dropped ones.
+ */
+int LogRecovery::ContinueRedo(int offset) {
+  int end_offset = RedoLog(offset, INVALID_LSN);
+  lsn_t oldest_lsn = next_lsn_;
+  for (const auto &[txn_id, first_lsn] : active_txn_first_lsn_) {
+    oldest_lsn = std::min(oldest_lsn, first_lsn);
+  }
+  if (lsn_mapping_.empty()) {
+    pruned_lsn_ = oldest_lsn;
+  }
+  for (; pruned_lsn_ < oldest_lsn; pruned_lsn_++) {
+    lsn_mapping_.erase(pruned_lsn_);
+  }
+  return end_offset;
+}
+
+int LogRecovery::RedoLog(int start_offset, lsn_t redo_lsn) {
+  // This thread reads and decodes; each worker owns the pages that hash to it and applies their records in log order.
+  std::vector<std::unique_ptr<RedoQueue>> queues;
+  std::vector<std::thread> workers;
+  std::vector<std::vector<RedoTask>> batches(redo_threads_);
+  for (int i = 0; i < redo_threads_; i++) {
+    queues.emplace_back(std::make_unique<RedoQueue>());
+    workers.emplace_back([this, queue = queues.back().get()] { RunRedoWorker(queue); });
+  }
+  auto dispatch = [&](const LogRecord &log_record, page_id_t page_id) {
+    if (redo_threads_ == 0) {
+      RedoTask task{page_id, log_record};
+      RedoLogRecord(&task.log_record_, page_id);
+      return;
+    }
+    int worker = static_cast<int>(page_id % redo_threads_);
+    batches[worker].push_back({page_id, log_record});
+    if (batches[worker].size() >= REDO_BATCH_SIZE) {
+      queues[worker]->Push(std::move(batches[worker]));
+      batches[worker].clear();
+    }
+  };
+
+  LogReader reader(disk_manager_, start_offset, read_size_);
+  LogRecord log_record;
+  int end_offset = start_offset;
+  while (reader.Next(&log_record)) {
+    end_offset = reader.GetRecordOffset() + log_record.size_;
+    next_lsn_ = log_record.lsn_ + 1;
+    if (log_record.log_record_type_ == LogRecordType::CHECKPOINT_BEGIN ||
+        log_record.log_record_type_ == LogRecordType::CHECKPOINT_END) {
+      // Checkpoint records belong to no transaction and change no page.
+      continue;
+    }
+    // Index changes made without a transaction are redone but never undone.
+    if (log_record.txn_id_ != INVALID_TXN_ID) {
+      lsn_mapping_[log_record.lsn_] = reader.GetRecordOffset();
+      if (log_record.log_record_type_ == LogRecordType::COMMIT ||
+          log_record.log_record_type_ == LogRecordType::ABORT) {
+        active_txn_.erase(log_record.txn_id_);
+        active_txn_first_lsn_.erase(log_record.txn_id_);
+      } else {
+        active_txn_[log_record.txn_id_] = log_record.lsn_;
+        active_txn_first_lsn_.emplace(log_record.txn_id_, log_record.lsn_);
+      }
+    }
+    if (log_record.lsn_ < redo_lsn) {
+      continue;
+    }
+    switch (log_record.log_record_type_) {
+      case LogRecordType::INSERT:
+        dispatch(log_record, log_record.insert_rid_.GetPageId());
+        break;
+      case LogRecordType::MARKDELETE:
+      case LogRecordType::APPLYDELETE:
+      case LogRecordType::ROLLBACKDELETE:
+        dispatch(log_record, log_record.delete_rid_.GetPageId());
+        break;
+      case LogRecordType::UPDATE:
+        dispatch(log_record, log_record.update_rid_.GetPageId());
+        break;
+      case LogRecordType::NEWPAGE:
+        // The link from the previous page is applied by the worker owning that page, in order with its other records.
+        dispatch(log_record, log_record.page_id_);
+        if (log_record.prev_page_id_ != INVALID_PAGE_ID) {
+          dispatch(log_record, log_record.prev_page_id_);
+        }
+        break;
+      case LogRecordType::HASH_BUCKET_INSERT:
+      case LogRecordType::HASH_BUCKET_REMOVE:
+      case LogRecordType::HASH_BUCKET_SPLIT:
+      case LogRecordType::HASH_DIRECTORY_UPDATE:
+        dispatch(log_record, log_record.page_id_);
+        break;
+      case LogRecordType::BPLUS_TREE_INSERT:
+      case LogRecordType::BPLUS_TREE_REMOVE: {
+        // Every page of a split or merge is restored from the one record, so a crash never leaves half of it behind.
+        bool leaf_whole = false;
+        for (const auto &[page_id, data] : log_record.tree_pages_) {
+          dispatch(log_record, page_id);
+          leaf_whole = leaf_whole || page_id == log_record.page_id_;
+        }
+        // A leaf a merge deleted is not redone at all.
+        if (!leaf_whole && log_record.page_id_ != INVALID_PAGE_ID) {
+          dispatch(log_record, log_record.page_id_);
+        }
+        if (log_record.restructured_) {
+          dispatch(log_record, HEADER_PAGE_ID);
+        }
+        break;
+      }
+      default:
+        // BEGIN/COMMIT/ABORT do not touch any page.
+        break;
+    }
+  }
+
+  for (int i = 0; i < redo_threads_; i++) {
+    if (!batches[i].empty()) {
+      queues[i]->Push(std::move(batches[i]));
+    }
+    queues[i]->Close();
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return end_offset;
+}
+
+/*
+ * The master record only ever points at a persistent CHECKPOINT_END, so a miss means the log ends before it (e.g. the
+ * log was replaced) and recovery falls back to the whole log.
+ */
+bool LogRecovery::ReadCheckpoint(LogRecord *checkpoint) {
+  lsn_t checkpoint_lsn = disk_manager_->GetCheckpointLSN();
+  if (checkpoint_lsn == INVALID_LSN) {
+    return false;
+  }
+  LogReader reader(disk_manager_, disk_manager_->GetLogSegmentOffset(checkpoint_lsn), read_size_);
+  while (reader.Next(checkpoint) && checkpoint->lsn_ <= checkpoint_lsn) {
+    if (checkpoint->lsn_ == checkpoint_lsn) {
+      return checkpoint->log_record_type_ == LogRecordType::CHECKPOINT_END;
+    }
+  }
+  return false;
+}
+
+void LogRecovery::RedoQueue::Push(std::vector<RedoTask> &&batch) {
+  std::unique_lock lock(latch_);
+  // Bound the backlog so a slow worker throttles the reader instead of letting decoded records pile up.
+  cv_.wait(lock, [&] { return batches_.size() < MAX_QUEUED_BATCHES; });
+  batches_.push_back(std::move(batch));
+  lock.unlock();
+  cv_.notify_all();
+}
+
+bool LogRecovery::RedoQueue::Pop(std::vector<RedoTask> *batch) {
+  std::unique_lock lock(latch_);
+  cv_.wait(lock, [&] { return !batches_.empty() || closed_; });
+  if (batches_.empty()) {
+    return false;
+  }
+  *batch = std::move(batches_.front());
+  batches_.pop_front();
+  lock.unlock();
+  cv_.notify_all();
+  return true;
+}
+
+void LogRecovery::RedoQueue::Close() {
+  {
+    std::scoped_lock lock(latch_);
+    closed_ = true;
+  }
+  cv_.notify_all();
+}
+
+void LogRecovery::RunRedoWorker(RedoQueue *queue) {
+  std::vector<RedoTask> batch;
+  while (queue->Pop(&batch)) {
+    for (auto &task : batch) {
+      RedoLogRecord(&task.log_record_, task.page_id_);
+    }
+  }
+}
+
+/*
+ * Only page_id is touched, so workers owning different pages never race. A NEWPAGE record is applied twice: once to
+ * the new page and once to the previous page, which only needs its next page pointer.
+ */
+void LogRecovery::RedoLogRecord(LogRecord *log_record, page_id_t page_id) {
+  lsn_t lsn = log_record->lsn_;
+  auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch a page during redo.");
+  // A standby serves queries while it redoes.
+  page->WLatch();
+
+  if (IsBPlusTreeRecord(log_record) && page_id == HEADER_PAGE_ID) {
+    // The header page keeps no LSN, the root of every record is set in log order, the same as the tree set it.
+    auto *header_page = reinterpret_cast<HeaderPage *>(page);
+    if (!header_page->InsertRecord(log_record->index_name_, log_record->root_page_id_)) {
+      header_page->UpdateRecord(log_record->index_name_, log_record->root_page_id_);
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+    return;
+  }
+
+  if (log_record->log_record_type_ == LogRecordType::NEWPAGE && page_id != log_record->page_id_) {
+    // Linking the previous page is not logged separately, so always make sure the link is there.
+    bool relink = page->GetNextPageId() != log_record->page_id_;
+    if (relink) {
+      page->SetNextPageId(log_record->page_id_);
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, relink);
+    return;
+  }
+
+  bool redo = page->GetLSN() < lsn;
+  if (redo) {
+    switch (log_record->log_record_type_) {
+      case LogRecordType::HASH_BUCKET_INSERT:
+        BucketPageImage(page->GetData(), log_record->entry_size_).Put(log_record->slot_, log_record->entries_.data());
+        break;
+      case LogRecordType::HASH_BUCKET_REMOVE:
+        BucketPageImage(page->GetData(), log_record->entry_size_).Remove(log_record->slot_);
+        break;
+      case LogRecordType::HASH_BUCKET_SPLIT: {
+        uint32_t count = log_record->entry_size_ == 0 ? 0 : log_record->entries_.size() / log_record->entry_size_;
+        BucketPageImage(page->GetData(), log_record->entry_size_)
+            .Reset(page_id, log_record->entries_.data(), count);
+        break;
+      }
+      case LogRecordType::HASH_DIRECTORY_UPDATE: {
+        auto *dir_page = reinterpret_cast<HashTableDirectoryPage *>(page->GetData());
+        dir_page->SetPageId(page_id);
+        while (dir_page->GetGlobalDepth() < log_record->global_depth_) {
+          dir_page->IncrGlobalDepth();
+        }
+        while (dir_page->GetGlobalDepth() > log_record->global_depth_) {
+          dir_page->DecrGlobalDepth();
+        }
+        for (uint32_t i = 0; i < log_record->buckets_.size(); i++) {
+          dir_page->SetBucketPageId(i, log_record->buckets_[i].first);
+          dir_page->SetLocalDepth(i, log_record->buckets_[i].second);
+        }
+        break;
+      }
+      case LogRecordType::BPLUS_TREE_INSERT:
+      case LogRecordType::BPLUS_TREE_REMOVE: {
+        auto whole = std::find_if(log_record->tree_pages_.begin(), log_record->tree_pages_.end(),
+                                  [&](const auto &tree_page) { return tree_page.first == page_id; });
+        if (whole != log_record->tree_pages_.end()) {
+          memset(page->GetData(), 0, PAGE_SIZE);
+          memcpy(page->GetData(), whole->second.data(), whole->second.size());
+        } else if (log_record->log_record_type_ == LogRecordType::BPLUS_TREE_INSERT) {
+          LeafPageImage(page->GetData(), log_record->entry_size_).Insert(log_record->slot_, log_record->entries_.data());
+        } else {
+          LeafPageImage(page->GetData(), log_record->entry_size_).Remove(log_record->slot_);
+        }
+        break;
+      }
+      case LogRecordType::NEWPAGE:
+        page->Init(page_id, PAGE_SIZE, log_record->prev_page_id_, nullptr, nullptr);
+        break;
+      case LogRecordType::INSERT: {
+        RID inserted_rid;
+        page->InsertTuple(log_record->insert_tuple_, &inserted_rid, nullptr, nullptr, nullptr);
+        BUSTUB_ASSERT(inserted_rid == log_record->insert_rid_, "Redo must reproduce the logged RID.");
+        break;
+      }
+      case LogRecordType::MARKDELETE:
+        page->MarkDelete(log_record->delete_rid_, nullptr, nullptr, nullptr);
+        break;
+      case LogRecordType::APPLYDELETE:
+        page->ApplyDelete(log_record->delete_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::ROLLBACKDELETE:
+        page->RollbackDelete(log_record->delete_rid_, nullptr, nullptr);
+        break;
+      case LogRecordType::UPDATE: {
+        Tuple old_tuple;
+        page->UpdateTuple(log_record->new_tuple_, &old_tuple, log_record->update_rid_, nullptr, nullptr, nullptr);
+        break;
+      }
+      default:
+        break;
+    }
+    page->SetLSN(lsn);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, redo);
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  // Always undo the newest remaining record, so the reader walks backwards through the log and mostly stays in memory.
+  std::priority_queue<lsn_t> to_undo;
+  for (const auto &[txn_id, last_lsn] : active_txn_) {
+    to_undo.push(last_lsn);
+  }
+  LogReader reader(disk_manager_, disk_manager_->GetLogStartOffset(), read_size_);
+  LogRecord log_record;
+  while (!to_undo.empty()) {
+    auto offset = lsn_mapping_.find(to_undo.top());
+    to_undo.pop();
+    BUSTUB_ASSERT(offset != lsn_mapping_.end(), "Every redone record must have a known offset.");
+    reader.Seek(offset->second);
+    if (!reader.Next(&log_record)) {
+      continue;
+    }
+    UndoLogRecord(&log_record);
+    if (log_record.prev_lsn_ != INVALID_LSN) {
+      to_undo.push(log_record.prev_lsn_);
+    }
+  }
+  active_txn_.clear();
+  active_txn_first_lsn_.clear();
+  lsn_mapping_.clear();
+}
+
+void LogRecovery::UndoLogRecord(LogRecord *log_record) {
+  if (log_record->log_record_type_ == LogRecordType::HASH_BUCKET_INSERT ||
+      log_record->log_record_type_ == LogRecordType::HASH_BUCKET_REMOVE) {
+    UndoHashBucketRecord(log_record);
+    return;
+  }
+  if (IsBPlusTreeRecord(log_record)) {
+    auto index = index_undo_.find(log_record->index_name_);
+    if (index != index_undo_.end()) {
+      index->second(log_record);
+    }
+    return;
+  }
+
+  RID rid;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      rid = log_record->insert_rid_;
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      rid = log_record->delete_rid_;
+      break;
+    case LogRecordType::UPDATE:
+      rid = log_record->update_rid_;
+      break;
+    default:
+      // Nothing to revert for BEGIN and NEWPAGE; an empty page in the chain is harmless. Hash bucket splits and
+      // directory updates stay as well, the entries they moved are found through the directory.
+      return;
+  }
+
+  auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch a page during undo.");
+  page->WLatch();
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      page->ApplyDelete(rid, nullptr, nullptr);
+      break;
+    case LogRecordType::MARKDELETE:
+      page->RollbackDelete(rid, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE: {
+      RID inserted_rid;
+      page->InsertTuple(log_record->delete_tuple_, &inserted_rid, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::ROLLBACKDELETE:
+      page->MarkDelete(rid, nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE: {
+      Tuple new_tuple;
+      page->UpdateTuple(log_record->old_tuple_, &new_tuple, rid, nullptr, nullptr, nullptr);
+      break;
+    }
+    default:
+      break;
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+}
+
+void LogRecovery::RegisterIndex(const std::string &index_name, std::function<void(LogRecord *)> undo) {
+  index_undo_[index_name] = std::move(undo);
+}
+
+/*
+ * Later splits may have moved the entry to another bucket since it was logged, so the bucket is looked up again
+ * through the directory by the hash of the key, the same way the hash table would find it.
+ */
+void LogRecovery::UndoHashBucketRecord(LogRecord *log_record) {
+  auto *dir_page = reinterpret_cast<HashTableDirectoryPage *>(
+      buffer_pool_manager_->FetchPage(log_record->directory_page_id_)->GetData());
+  page_id_t page_id = dir_page->GetBucketPageId(log_record->hash_ & dir_page->GetGlobalDepthMask());
+  buffer_pool_manager_->UnpinPage(log_record->directory_page_id_, false);
+  Page *page = buffer_pool_manager_->FetchPage(page_id);
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch a page during undo.");
+  BucketPageImage bucket(page->GetData(), log_record->entry_size_);
+  const char *entry = log_record->entries_.data();
+  bool same_slot = page_id == log_record->page_id_ && log_record->slot_ < bucket.ArraySize();
+
+  if (log_record->log_record_type_ == LogRecordType::HASH_BUCKET_INSERT) {
+    uint32_t slot = same_slot && bucket.Holds(log_record->slot_, entry) ? log_record->slot_ : bucket.Find(entry);
+    if (slot != bucket.ArraySize()) {
+      bucket.Remove(slot);
+    }
+  } else {
+    uint32_t slot = same_slot && !bucket.IsReadable(log_record->slot_) ? log_record->slot_ : bucket.FindFree();
+    BUSTUB_ASSERT(slot != bucket.ArraySize(), "No room left to restore a removed hash table entry.");
+    bucket.Put(slot, entry);
+  }
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
 
 }  // namespace bustub
@@ -0,0 +1,184 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// standby_manager.cpp
+//
+// Identification: src/recovery/standby_manager.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/standby_manager.h"
+
+#include "common/logger.h"
+#include "recovery/log_reader.h"
+
+namespace bustub {
+
+/*
+ * Queries follow the next page links of table pages, so records are applied in log order on the replay thread: a new
+ * page is always initialized before the page in front of it links to it.
+ */
+StandbyManager::StandbyManager(const std::string &primary_db_file, DiskManager *disk_manager,
+                               BufferPoolManager *buffer_pool_manager, LogManager *log_manager)
+    : primary_log_(new DiskManager(primary_db_file)),
+      disk_manager_(disk_manager),
+      log_manager_(log_manager),
+      recovery_(disk_manager, buffer_pool_manager),
+      redo_offset_(disk_manager->GetLogStartOffset()) {
+  recovery_.SetRedoThreads(0);
+  recovery_.SetReadSize(LOG_BUFFER_SIZE);
+  for (auto &buffer : ship_buffers_) {
+    buffer.resize(LOG_BUFFER_SIZE);
+  }
+}
+
+StandbyManager::~StandbyManager() {
+  StopReplayThread();
+  primary_log_->ShutDown();
+  delete primary_log_;
+}
+
+size_t StandbyManager::CatchUp() {
+  std::scoped_lock lock(latch_);
+  return CatchUpLocked();
+}
+
+size_t StandbyManager::CatchUpLocked() {
+  size_t shipped = ShipLog();
+  if (shipped > 0) {
+    redo_offset_ = recovery_.ContinueRedo(redo_offset_);
+    std::scoped_lock stats_lock(stats_latch_);
+    stats_.applied_lsn_ = recovery_.GetNextLSN() - 1;
+  }
+  return shipped;
+}
+
+/*
+ * Only records the reader decodes completely are shipped, so a record the primary is still writing waits for the next
+ * call. They are copied as the primary wrote them, in pieces of at most a log buffer: WriteLog keeps a write within a
+ * segment, which keeps the segments of our log starting on record boundaries.
+ */
+size_t StandbyManager::ShipLog() {
+  if (stats_.promoted_) {
+    return 0;
+  }
+  primary_log_->RefreshLogSegments();
+  if (primary_log_->GetNumLogSegments() == 0) {
+    return 0;
+  }
+  if (ship_offset_ < 0) {
+    ship_offset_ = primary_log_->GetLogStartOffset();
+  }
+  if (ship_offset_ < primary_log_->GetLogStartOffset()) {
+    LOG_WARN("The primary removed log segments before they were shipped, the standby has to be set up again");
+    return 0;
+  }
+
+  LogReader reader(primary_log_, ship_offset_, LOG_BUFFER_SIZE);
+  LogRecord log_record;
+  size_t shipped = 0;
+  int chunk_start = ship_offset_;
+  lsn_t chunk_lsn = INVALID_LSN;
+  while (reader.Next(&log_record)) {
+    int record_end = reader.GetRecordOffset() + log_record.GetSize();
+    if (record_end - chunk_start > LOG_BUFFER_SIZE) {
+      CopyLog(chunk_start, reader.GetRecordOffset(), chunk_lsn);
+      chunk_start = reader.GetRecordOffset();
+      chunk_lsn = INVALID_LSN;
+    }
+    if (chunk_lsn == INVALID_LSN) {
+      chunk_lsn = log_record.GetLSN();
+    }
+    ship_offset_ = record_end;
+    shipped++;
+  }
+  if (chunk_start < ship_offset_) {
+    CopyLog(chunk_start, ship_offset_, chunk_lsn);
+  }
+
+  std::scoped_lock stats_lock(stats_latch_);
+  stats_.records_shipped_ += shipped;
+  return shipped;
+}
+
+void StandbyManager::CopyLog(int start, int end, lsn_t first_lsn) {
+  char *buffer = ship_buffers_[ship_buffer_].data();
+  ship_buffer_ = 1 - ship_buffer_;
+  int size = 0;
+  while (start + size < end) {
+    // A read stops at the end of a segment, records never span one.
+    int read = primary_log_->ReadLogBytes(buffer + size, end - start - size, start + size);
+    BUSTUB_ASSERT(read > 0, "Decoded log records must be readable.");
+    size += read;
+  }
+  disk_manager_->WriteLog(buffer, size, first_lsn);
+
+  std::scoped_lock stats_lock(stats_latch_);
+  stats_.bytes_shipped_ += size;
+}
+
+/*
+ * The shipped log is on our disk up to the last record, so the log manager continues right after it. The old
+ * primary's segments stay untouched.
+ */
+void StandbyManager::Promote() {
+  StopReplayThread();
+  std::scoped_lock lock(latch_);
+  if (stats_.promoted_) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  size_t replayed = CatchUpLocked();
+  recovery_.Undo();
+  log_manager_->SetNextLSN(recovery_.GetNextLSN());
+
+  std::scoped_lock stats_lock(stats_latch_);
+  stats_.promoted_ = true;
+  stats_.promotion_records_ = replayed;
+  stats_.promotion_duration_ =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+
+void StandbyManager::RunReplayThread() {
+  std::scoped_lock lock(thread_latch_);
+  if (replay_thread_ != nullptr) {
+    return;
+  }
+  stop_requested_ = false;
+  replay_thread_ = new std::thread([this] {
+    std::unique_lock thread_lock(thread_latch_);
+    while (!thread_cv_.wait_for(thread_lock, replay_interval_, [this] { return stop_requested_; })) {
+      thread_lock.unlock();
+      CatchUp();
+      thread_lock.lock();
+    }
+  });
+}
+
+void StandbyManager::StopReplayThread() {
+  std::thread *replay_thread;
+  {
+    std::scoped_lock lock(thread_latch_);
+    if (replay_thread_ == nullptr) {
+      return;
+    }
+    stop_requested_ = true;
+    replay_thread = replay_thread_;
+  }
+  thread_cv_.notify_one();
+  replay_thread->join();
+
+  std::scoped_lock lock(thread_latch_);
+  delete replay_thread_;
+  replay_thread_ = nullptr;
+}
+
+StandbyStats StandbyManager::GetStats() {
+  std::scoped_lock lock(stats_latch_);
+  return stats_;
+}
+
+}  // namespace bustub
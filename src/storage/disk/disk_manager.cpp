@@ -10,9 +10,14 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <mutex>  // NOLINT
 #include <string>
@@ -20,12 +25,28 @@
 
 #include "common/exception.h"
 #include "common/logger.h"
+#include "common/util/hash_util.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
 
 static char *buffer_used;
 
+/*
+ * The file streams do not expose their descriptors. Once a stream is flushed its data is in the page cache of the
+ * file, which any descriptor of the file can sync.
+ * @param data_only sync what reading the data back needs (fdatasync), not every change of the file's metadata
+ */
+static bool SyncFile(const std::string &file_name, bool data_only) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = (data_only ? ::fdatasync(fd) : ::fsync(fd)) == 0;
+  ::close(fd);
+  return synced;
+}
+
 /**
  * Constructor: open/create a single database file & log file
  * @input db_file: database file name
@@ -38,20 +59,8 @@ DiskManager::DiskManager(const std::string &db_file)
     return;
   }
   log_name_ = file_name_.substr(0, n) + ".log";
-
-  log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app | std::ios::out);
-    log_io_.close();
-    // reopen with original mode
-    log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-    if (!log_io_.is_open()) {
-      throw Exception("can't open dblog file");
-    }
-  }
+  double_write_name_ = file_name_.substr(0, n) + ".dwb";
+  OpenLogSegments();
 
   std::scoped_lock scoped_db_io_latch(db_io_latch_);
   db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
@@ -77,15 +86,46 @@ void DiskManager::ShutDown() {
   {
     std::scoped_lock scoped_db_io_latch(db_io_latch_);
     db_io_.close();
+    double_write_io_.close();
   }
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
   log_io_.close();
+  log_read_io_.close();
 }
 
 /**
  * Write the contents of the specified page into disk file
  */
-void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
+bool DiskManager::WritePage(page_id_t page_id, const char *page_data) { return WritePages({{page_id, page_data}}); }
+
+/**
+ * Write a batch of pages. With double-write on, the in-place writes of a batch only start once the batch is synced to
+ * the double-write file, and the next batch only overwrites the double-write file once they are synced as well.
+ * Flushing alone leaves the writes in the OS page cache, where a power loss can tear both copies of a page.
+ */
+bool DiskManager::WritePages(const std::vector<std::pair<page_id_t, const char *>> &pages) {
   std::scoped_lock scoped_db_io_latch(db_io_latch_);
+  for (size_t begin = 0; begin < pages.size(); begin += DOUBLE_WRITE_BATCH_PAGES) {
+    size_t end = std::min(pages.size(), begin + DOUBLE_WRITE_BATCH_PAGES);
+    if (double_write_ && !WriteDoubleWriteBatch(pages, begin, end)) {
+      return false;
+    }
+    for (size_t i = begin; i < end; i++) {
+      if (!WritePageImpl(pages[i].first, pages[i].second)) {
+        return false;
+      }
+    }
+    // needs to flush to keep disk file in sync
+    db_io_.flush();
+    if (double_write_ && !SyncFile(file_name_, false)) {
+      LOG_DEBUG("I/O error while syncing the db file");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DiskManager::WritePageImpl(page_id_t page_id, const char *page_data) {
   size_t offset = static_cast<size_t>(page_id) * PAGE_SIZE;
   // set write cursor to offset
   num_writes_ += 1;
@@ -94,16 +134,110 @@ void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
   // check for I/O error
   if (db_io_.bad()) {
     LOG_DEBUG("I/O error while writing");
-    return;
+    return false;
+  }
+  return true;
+}
+
+bool DiskManager::WriteDoubleWriteBatch(const std::vector<std::pair<page_id_t, const char *>> &pages, size_t begin,
+                                        size_t end) {
+  auto count = static_cast<uint32_t>(end - begin);
+  size_t body_size = count * (sizeof(page_id_t) + PAGE_SIZE);
+  double_write_buffer_.resize(DOUBLE_WRITE_HEADER_SIZE + body_size);
+  char *body = double_write_buffer_.data() + DOUBLE_WRITE_HEADER_SIZE;
+  for (size_t i = begin; i < end; i++) {
+    memcpy(body + (i - begin) * sizeof(page_id_t), &pages[i].first, sizeof(page_id_t));
+    memcpy(body + count * sizeof(page_id_t) + (i - begin) * PAGE_SIZE, pages[i].second, PAGE_SIZE);
+  }
+  hash_t checksum = HashUtil::HashBytes(body, body_size);
+  memcpy(double_write_buffer_.data(), &DOUBLE_WRITE_MAGIC, sizeof(uint32_t));
+  memcpy(double_write_buffer_.data() + 4, &count, sizeof(uint32_t));
+  memcpy(double_write_buffer_.data() + 8, &checksum, sizeof(hash_t));
+
+  double_write_io_.seekp(0);
+  double_write_io_.write(double_write_buffer_.data(), double_write_buffer_.size());
+  double_write_io_.flush();
+  if (double_write_io_.bad() || !SyncFile(double_write_name_, true)) {
+    LOG_DEBUG("I/O error while writing the double-write buffer");
+    return false;
+  }
+  num_double_writes_ += count;
+  return true;
+}
+
+void DiskManager::SetDoubleWrite(bool double_write) {
+  std::scoped_lock scoped_db_io_latch(db_io_latch_);
+  if (double_write && !double_write_io_.is_open()) {
+    double_write_io_.open(double_write_name_, std::ios::binary | std::ios::in | std::ios::out);
+    if (!double_write_io_.is_open()) {
+      double_write_io_.clear();
+      double_write_io_.open(double_write_name_, std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out);
+      if (!double_write_io_.is_open()) {
+        throw Exception("can't open double-write file");
+      }
+    }
+  }
+  if (!double_write) {
+    double_write_io_.close();
+  }
+  double_write_ = double_write;
+}
+
+/*
+ * Every page goes through the double-write file before it is written in place, and a later write of the same page
+ * replaces the batch there. So copying back the last batch is always safe, whether its in-place writes were torn,
+ * completed or never started.
+ */
+int DiskManager::RepairTornPages() {
+  std::scoped_lock scoped_db_io_latch(db_io_latch_);
+  std::ifstream double_write_in(double_write_name_, std::ios::binary | std::ios::in);
+  if (!double_write_in.is_open()) {
+    return 0;
+  }
+  uint32_t header[2] = {0, 0};
+  hash_t checksum = 0;
+  double_write_in.read(reinterpret_cast<char *>(header), sizeof(header));
+  double_write_in.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+  uint32_t count = header[1];
+  if (double_write_in.gcount() != static_cast<std::streamsize>(sizeof(checksum)) || header[0] != DOUBLE_WRITE_MAGIC ||
+      count == 0 || count > static_cast<uint32_t>(DOUBLE_WRITE_BATCH_PAGES)) {
+    return 0;
+  }
+  std::vector<char> body(count * (sizeof(page_id_t) + PAGE_SIZE));
+  double_write_in.read(body.data(), body.size());
+  if (double_write_in.gcount() != static_cast<std::streamsize>(body.size()) ||
+      HashUtil::HashBytes(body.data(), body.size()) != checksum) {
+    LOG_DEBUG("Ignoring a torn double-write batch");
+    return 0;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    page_id_t page_id;
+    memcpy(&page_id, body.data() + i * sizeof(page_id_t), sizeof(page_id_t));
+    WritePageImpl(page_id, body.data() + count * sizeof(page_id_t) + i * PAGE_SIZE);
   }
-  // needs to flush to keep disk file in sync
   db_io_.flush();
+  double_write_in.close();
+  if (!SyncFile(file_name_, false)) {
+    // Keep the batch, copying it back again after another crash is still safe.
+    LOG_DEBUG("I/O error while syncing the db file");
+    return static_cast<int>(count);
+  }
+  // The pages are in place now, a later crash must not copy these old versions back.
+  std::filesystem::resize_file(double_write_name_, 0);
+  return static_cast<int>(count);
 }
 
 /**
  * Read the contents of the specified page into the given memory area
+ * The read counts as pending from the moment it waits for the latch, so background writers can see the queue.
  */
 void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
+  num_pending_reads_++;
+  ReadPageImpl(page_id, page_data);
+  num_pending_reads_--;
+}
+
+void DiskManager::ReadPageImpl(page_id_t page_id, char *page_data) {
   std::scoped_lock scoped_db_io_latch(db_io_latch_);
   int offset = page_id * PAGE_SIZE;
   // check if read beyond file length
@@ -133,7 +267,7 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
  * Write the contents of the log into disk file
  * Only return when sync is done, and only perform sequence write
  */
-void DiskManager::WriteLog(char *log_data, int size) {
+void DiskManager::WriteLog(char *log_data, int size, lsn_t first_lsn) {
   // enforce swap log buffer
   assert(log_data != buffer_used);
   buffer_used = log_data;
@@ -149,6 +283,13 @@ void DiskManager::WriteLog(char *log_data, int size) {
     assert(flush_log_f_->wait_for(std::chrono::seconds(10)) == std::future_status::ready);
   }
 
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  LogSegment *segment = &log_segments_.back();
+  if (segment->size_ > 0 && LOG_SEGMENT_HEADER_SIZE + segment->size_ + size > log_segment_size_) {
+    CreateLogSegment(segment->number_ + 1, first_lsn, segment->start_offset_ + segment->size_);
+    segment = &log_segments_.back();
+  }
+
   num_flushes_ += 1;
   // sequence write
   log_io_.write(log_data, size);
@@ -160,6 +301,7 @@ void DiskManager::WriteLog(char *log_data, int size) {
   }
   // needs to flush to keep disk file in sync
   log_io_.flush();
+  segment->size_ += size;
   flush_log_ = false;
 }
 
@@ -169,26 +311,124 @@ void DiskManager::WriteLog(char *log_data, int size) {
  * @return: false means already reach the end
  */
 bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-  if (offset >= GetFileSize(log_name_)) {
-    // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
+  int read_count = ReadLogBytes(log_data, size, offset);
+  if (read_count <= 0) {
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
+  // if the segment ends before reading "size"
+  if (read_count < size) {
+    memset(log_data + read_count, 0, size - read_count);
+  }
+  return true;
+}
+
+/**
+ * Read up to size log bytes starting at offset, stopping at the end of the segment that holds offset
+ * @return: the number of bytes read, 0 at the end of the log, -1 on an I/O error
+ */
+int DiskManager::ReadLogBytes(char *log_data, int size, int offset) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  // segments are sorted by offset, find the last one starting at or before offset
+  auto it = std::upper_bound(log_segments_.begin(), log_segments_.end(), offset,
+                             [](int off, const LogSegment &segment) { return off < segment.start_offset_; });
+  if (it == log_segments_.begin()) {
+    // LOG_DEBUG("offset is in a removed segment");
+    return 0;
+  }
+  const LogSegment &segment = *std::prev(it);
+  int segment_offset = offset - segment.start_offset_;
+  if (segment_offset >= segment.size_) {
+    // LOG_DEBUG("end of log file");
+    return 0;
+  }
 
-  if (log_io_.bad()) {
+  if (log_read_segment_ != segment.number_) {
+    log_read_io_.close();
+    log_read_io_.clear();
+    log_read_io_.open(LogSegmentFileName(segment.number_), std::ios::binary | std::ios::in);
+    log_read_segment_ = segment.number_;
+  }
+  log_read_io_.seekg(LOG_SEGMENT_HEADER_SIZE + segment_offset);
+  log_read_io_.read(log_data, std::min(size, segment.size_ - segment_offset));
+
+  if (log_read_io_.bad()) {
     LOG_DEBUG("I/O error while reading log");
-    return false;
+    return -1;
   }
-  // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
-  if (read_count < size) {
-    log_io_.clear();
-    memset(log_data + read_count, 0, size - read_count);
+  int read_count = log_read_io_.gcount();
+  log_read_io_.clear();
+  return read_count;
+}
+
+/**
+ * Switch the log to a new segment. An empty current segment is simply relabeled, so back to back calls do not leave
+ * empty files behind.
+ */
+int DiskManager::StartLogSegment(lsn_t start_lsn) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  LogSegment &segment = log_segments_.back();
+  if (segment.size_ == 0) {
+    segment.start_lsn_ = start_lsn;
+    WriteLogSegmentHeader(segment);
+    return segment.start_offset_;
   }
+  CreateLogSegment(segment.number_ + 1, start_lsn, segment.start_offset_ + segment.size_);
+  return log_segments_.back().start_offset_;
+}
 
-  return true;
+/**
+ * Delete the oldest segments as long as they end at or before offset
+ */
+void DiskManager::RemoveLogSegmentsBefore(int offset) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  size_t removed = 0;
+  while (removed + 1 < log_segments_.size() &&
+         log_segments_[removed].start_offset_ + log_segments_[removed].size_ <= offset) {
+    if (log_read_segment_ == log_segments_[removed].number_) {
+      log_read_io_.close();
+      log_read_segment_ = -1;
+    }
+    std::remove(LogSegmentFileName(log_segments_[removed].number_).c_str());
+    removed++;
+  }
+  log_segments_.erase(log_segments_.begin(), log_segments_.begin() + removed);
+}
+
+int DiskManager::GetLogStartOffset() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return log_segments_.front().start_offset_;
+}
+
+lsn_t DiskManager::GetLogStartLSN() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return log_segments_.front().start_lsn_;
+}
+
+int DiskManager::GetLogSegmentOffset(lsn_t lsn) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  auto it = std::upper_bound(log_segments_.begin(), log_segments_.end(), lsn,
+                             [](lsn_t l, const LogSegment &segment) { return l < segment.start_lsn_; });
+  return it == log_segments_.begin() ? log_segments_.front().start_offset_ : std::prev(it)->start_offset_;
+}
+
+/**
+ * Update the master record in the header of the segment being written. Older segments keep a stale value, but
+ * recovery only reads it from the newest one.
+ */
+void DiskManager::SetCheckpointLSN(lsn_t lsn) {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  checkpoint_lsn_ = lsn;
+  WriteLogSegmentHeader(log_segments_.back());
+}
+
+lsn_t DiskManager::GetCheckpointLSN() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return checkpoint_lsn_;
+}
+
+int DiskManager::GetNumLogSegments() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  return static_cast<int>(log_segments_.size());
 }
 
 /**
@@ -215,4 +455,113 @@ int DiskManager::GetFileSize(const std::string &file_name) {
   return rc == 0 ? static_cast<int>(stat_buf.st_size) : -1;
 }
 
+std::string DiskManager::LogSegmentFileName(int number) const {
+  return number == 0 ? log_name_ : log_name_ + "." + std::to_string(number);
+}
+
+/**
+ * Collect the segments of this log from its directory. Files without a valid header (e.g. an empty log created before
+ * anything was written) are not segments; if nothing valid is found the log starts over with segment 0.
+ */
+void DiskManager::OpenLogSegments() {
+  ScanLogSegments();
+  if (log_segments_.empty()) {
+    CreateLogSegment(0, 0, 0);
+    return;
+  }
+  log_io_.open(LogSegmentFileName(log_segments_.back().number_),
+               std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
+  if (!log_io_.is_open()) {
+    throw Exception("can't open dblog file");
+  }
+}
+
+/**
+ * Segments written by another DiskManager show up, grow and disappear behind our back, so the list is rebuilt from
+ * the files. The read stream is reopened, its segment may have been deleted and replaced.
+ */
+void DiskManager::RefreshLogSegments() {
+  std::scoped_lock scoped_log_io_latch(log_io_latch_);
+  ScanLogSegments();
+  log_read_io_.close();
+  log_read_segment_ = -1;
+}
+
+void DiskManager::ScanLogSegments() {
+  log_segments_.clear();
+  std::filesystem::path log_path(log_name_);
+  std::filesystem::path log_dir = log_path.has_parent_path() ? log_path.parent_path() : std::filesystem::path(".");
+  std::string prefix = log_path.filename().string() + ".";
+  std::error_code ec;
+  int newest_number = -1;
+  for (const auto &entry : std::filesystem::directory_iterator(log_dir, ec)) {
+    std::string name = entry.path().filename().string();
+    bool is_segment = name == log_path.filename().string() ||
+                      (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+                       name.find_first_not_of("0123456789", prefix.size()) == std::string::npos);
+    LogSegment segment;
+    lsn_t checkpoint_lsn;
+    if (is_segment && ReadLogSegmentHeader(entry.path().string(), &segment, &checkpoint_lsn)) {
+      log_segments_.push_back(segment);
+      // the newest segment has the current master record
+      if (log_segments_.size() == 1 || segment.number_ > newest_number) {
+        newest_number = segment.number_;
+        checkpoint_lsn_ = checkpoint_lsn;
+      }
+    }
+  }
+  std::sort(log_segments_.begin(), log_segments_.end(),
+            [](const LogSegment &a, const LogSegment &b) { return a.number_ < b.number_; });
+}
+
+void DiskManager::CreateLogSegment(int number, lsn_t start_lsn, int start_offset) {
+  log_io_.close();
+  log_io_.clear();
+  // create a new file
+  log_io_.open(LogSegmentFileName(number), std::ios::binary | std::ios::trunc | std::ios::out);
+  if (!log_io_.is_open()) {
+    throw Exception("can't open dblog file");
+  }
+  int32_t header[] = {static_cast<int32_t>(LOG_SEGMENT_MAGIC), number, start_lsn, start_offset, checkpoint_lsn_};
+  log_io_.write(reinterpret_cast<char *>(header), sizeof(header));
+  log_io_.close();
+  // reopen with original mode
+  log_io_.open(LogSegmentFileName(number), std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
+  if (!log_io_.is_open()) {
+    throw Exception("can't open dblog file");
+  }
+  log_segments_.push_back({number, start_lsn, start_offset, 0});
+}
+
+/**
+ * log_io_ appends, so the header is rewritten through a separate stream.
+ */
+void DiskManager::WriteLogSegmentHeader(const LogSegment &segment) {
+  int32_t header[] = {static_cast<int32_t>(LOG_SEGMENT_MAGIC), segment.number_, segment.start_lsn_,
+                      segment.start_offset_, checkpoint_lsn_};
+  std::fstream header_io(LogSegmentFileName(segment.number_), std::ios::binary | std::ios::in | std::ios::out);
+  header_io.write(reinterpret_cast<char *>(header), sizeof(header));
+  header_io.flush();
+  if (header_io.bad()) {
+    LOG_DEBUG("I/O error while writing log segment header");
+  }
+}
+
+bool DiskManager::ReadLogSegmentHeader(const std::string &file_name, LogSegment *segment, lsn_t *checkpoint_lsn) {
+  int file_size = GetFileSize(file_name);
+  if (file_size < LOG_SEGMENT_HEADER_SIZE) {
+    return false;
+  }
+  int32_t header[5];
+  std::ifstream header_io(file_name, std::ios::binary | std::ios::in);
+  header_io.read(reinterpret_cast<char *>(header), sizeof(header));
+  if (header_io.gcount() != static_cast<std::streamsize>(sizeof(header)) ||
+      static_cast<uint32_t>(header[0]) != LOG_SEGMENT_MAGIC) {
+    return false;
+  }
+  *segment = {header[1], header[2], header[3], file_size - LOG_SEGMENT_HEADER_SIZE};
+  *checkpoint_lsn = header[4];
+  return true;
+}
+
 }  // namespace bustub
@@ -9,7 +9,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <string>
+#include <type_traits>
 
 #include "common/exception.h"
 #include "common/rid.h"
@@ -19,19 +21,26 @@
 namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                          int leaf_max_size, int internal_max_size)
+                          int leaf_max_size, int internal_max_size, LogManager *log_manager, page_id_t root_page_id)
     : index_name_(std::move(name)),
-      root_page_id_(INVALID_PAGE_ID),
+      root_page_id_(root_page_id),
       buffer_pool_manager_(buffer_pool_manager),
       comparator_(comparator),
       leaf_max_size_(leaf_max_size),
-      internal_max_size_(internal_max_size) {}
+      // An internal page takes one more child than its max size before it splits, leave room for it.
+      internal_max_size_(std::min(internal_max_size, static_cast<int>(INTERNAL_PAGE_SIZE) - 1)),
+      log_manager_(log_manager) {}
 
 /*
  * Helper function to decide whether current b+tree is empty
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::IsEmpty() const { return true; }
+bool BPLUSTREE_TYPE::IsEmpty() const {
+  root_latch_.RLock();
+  bool empty = root_page_id_ == INVALID_PAGE_ID;
+  root_latch_.RUnlock();
+  return empty;
+}
 /*****************************************************************************
  * SEARCH
  *****************************************************************************/
@@ -42,7 +51,17 @@ bool BPLUSTREE_TYPE::IsEmpty() const { return true; }
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction) {
-  return false;
+  LatchContext ctx(this, Operation::FIND, false);
+  Page *page = FindLeafPage(key, false, &ctx);
+  if (page == nullptr) {
+    return false;
+  }
+  ValueType value;
+  if (!reinterpret_cast<LeafPage *>(page->GetData())->Lookup(key, &value, comparator_)) {
+    return false;
+  }
+  result->push_back(value);
+  return true;
 }
 
 /*****************************************************************************
@@ -52,11 +71,39 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result
  * Insert constant key & value pair into b+ tree
  * if current tree is empty, start new tree, update root page id and insert
  * entry, otherwise insert into leaf page.
+ * The first attempt write latches only the leaf. If the leaf may split, or
+ * there is no leaf yet, the insert starts over with write latches from the
+ * root down.
  * @return: since we only support unique key, if user try to insert duplicate
  * keys return false, otherwise return true.
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *transaction) { return false; }
+bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *transaction) {
+  {
+    LatchContext ctx(this, Operation::INSERT, false);
+    Page *page = FindLeafPage(key, false, &ctx);
+    if (page != nullptr) {
+      auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+      ValueType existing;
+      if (leaf->Lookup(key, &existing, comparator_)) {
+        return false;
+      }
+      if (IsSafe(leaf, Operation::INSERT, false)) {
+        int slot = leaf->KeyIndex(key, comparator_);
+        leaf->Insert(key, value, comparator_);
+        ctx.dirty_ = true;
+        LogEntryChange(LogRecordType::BPLUS_TREE_INSERT, transaction, key, value, page, slot, &ctx);
+        return true;
+      }
+    }
+  }
+  LatchContext ctx(this, Operation::INSERT, true);
+  if (FindLeafPage(key, false, &ctx) == nullptr) {
+    StartNewTree(key, value, transaction, &ctx);
+    return true;
+  }
+  return InsertIntoLeaf(key, value, transaction, &ctx);
+}
 /*
  * Insert constant key & value pair into an empty tree
  * User needs to first ask for new page from buffer pool manager(NOTICE: throw
@@ -64,19 +111,51 @@ bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transact
  * tree's root page id and insert entry directly into leaf page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {}
+void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction,
+                                  LatchContext *ctx) {
+  page_id_t page_id;
+  Page *page = buffer_pool_manager_->NewPage(&page_id);
+  if (page == nullptr) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "Cannot allocate a page for a new B+ tree.");
+  }
+  auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+  leaf->Init(page_id, INVALID_PAGE_ID, leaf_max_size_);
+  leaf->Insert(key, value, comparator_);
+  root_page_id_ = page_id;
+  UpdateRootPageId(1);
+  ctx->new_pages_.push_back(page);
+  ctx->restructured_ = true;
+  LogEntryChange(LogRecordType::BPLUS_TREE_INSERT, transaction, key, value, page, 0, ctx);
+}
 
 /*
  * Insert constant key & value pair into leaf page
- * User needs to first find the right leaf page as insertion target, then look
- * through leaf page to see whether insert key exist or not. If exist, return
- * immdiately, otherwise insert entry. Remember to deal with split if necessary.
+ * The leaf is the last page ctx holds, below every page the insert may
+ * split. Look through the leaf page to see whether insert key exist or not.
+ * If exist, return immdiately, otherwise insert entry. Remember to deal with
+ * split if necessary.
  * @return: since we only support unique key, if user try to insert duplicate
  * keys return false, otherwise return true.
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction) {
-  return false;
+bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction,
+                                    LatchContext *ctx) {
+  Page *page = ctx->pages_.back();
+  auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+  ValueType existing;
+  if (leaf->Lookup(key, &existing, comparator_)) {
+    return false;
+  }
+  ctx->dirty_ = true;
+  int slot = leaf->KeyIndex(key, comparator_);
+  if (leaf->Insert(key, value, comparator_) >= leaf->GetMaxSize()) {
+    LeafPage *new_leaf = Split(leaf, ctx);
+    new_leaf->SetNextPageId(leaf->GetNextPageId());
+    leaf->SetNextPageId(new_leaf->GetPageId());
+    InsertIntoParent(leaf, new_leaf->KeyAt(0), new_leaf, ctx);
+  }
+  LogEntryChange(LogRecordType::BPLUS_TREE_INSERT, transaction, key, value, page, slot, ctx);
+  return true;
 }
 
 /*
@@ -85,11 +164,27 @@ bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
  * User needs to first ask for new page from buffer pool manager(NOTICE: throw
  * an "out of memory" exception if returned value is nullptr), then move half
  * of key & value pairs from input page to newly created page
+ * The new page is not latched: nobody finds it before the latches on the
+ * pages that point to it are released. It stays pinned in ctx until then.
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
-N *BPLUSTREE_TYPE::Split(N *node) {
-  return nullptr;
+N *BPLUSTREE_TYPE::Split(N *node, LatchContext *ctx) {
+  page_id_t page_id;
+  Page *page = buffer_pool_manager_->NewPage(&page_id);
+  if (page == nullptr) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "Cannot allocate a page to split a B+ tree page.");
+  }
+  auto *new_node = reinterpret_cast<N *>(page->GetData());
+  new_node->Init(page_id, node->GetParentPageId(), node->GetMaxSize());
+  if constexpr (std::is_same_v<N, LeafPage>) {
+    node->MoveHalfTo(new_node);
+  } else {
+    node->MoveHalfTo(new_node, buffer_pool_manager_);
+  }
+  ctx->new_pages_.push_back(page);
+  ctx->restructured_ = true;
+  return new_node;
 }
 
 /*
@@ -97,13 +192,39 @@ N *BPLUSTREE_TYPE::Split(N *node) {
  * @param   old_node      input page from split() method
  * @param   key
  * @param   new_node      returned page from split() method
- * User needs to first find the parent page of old_node, parent node must be
- * adjusted to take info of new_node into account. Remember to deal with split
- * recursively if necessary.
+ * The parent of old_node is the page ctx holds above it; a page that splits
+ * keeps its parent latched, or the root latch if it is the root. Parent node
+ * must be adjusted to take info of new_node into account. Remember to deal
+ * with split recursively if necessary.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &key, BPlusTreePage *new_node,
-                                      Transaction *transaction) {}
+                                      LatchContext *ctx) {
+  size_t position = PositionOf(old_node, *ctx);
+  if (position == 0) {
+    BUSTUB_ASSERT(ctx->root_locked_, "Only the root splits without its parent latched.");
+    page_id_t root_id;
+    Page *page = buffer_pool_manager_->NewPage(&root_id);
+    if (page == nullptr) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "Cannot allocate a new B+ tree root page.");
+    }
+    auto *root = reinterpret_cast<InternalPage *>(page->GetData());
+    root->Init(root_id, INVALID_PAGE_ID, internal_max_size_);
+    root->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
+    old_node->SetParentPageId(root_id);
+    new_node->SetParentPageId(root_id);
+    root_page_id_ = root_id;
+    UpdateRootPageId();
+    ctx->new_pages_.push_back(page);
+    return;
+  }
+  auto *parent = reinterpret_cast<InternalPage *>(ctx->pages_[position - 1]->GetData());
+  new_node->SetParentPageId(parent->GetPageId());
+  if (parent->InsertNodeAfter(old_node->GetPageId(), key, new_node->GetPageId()) > parent->GetMaxSize()) {
+    InternalPage *new_parent = Split(parent, ctx);
+    InsertIntoParent(parent, new_parent->KeyAt(0), new_parent, ctx);
+  }
+}
 
 /*****************************************************************************
  * REMOVE
@@ -114,41 +235,126 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
  * If not, User needs to first find the right leaf page as deletion target, then
  * delete entry from leaf page. Remember to deal with redistribute or merge if
  * necessary.
+ * Like Insert, the first attempt write latches only the leaf, and the remove
+ * starts over with write latches from the root down if the leaf may merge or
+ * borrow from a sibling.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {}
+void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
+  {
+    LatchContext ctx(this, Operation::REMOVE, false);
+    Page *page = FindLeafPage(key, false, &ctx);
+    if (page == nullptr) {
+      return;
+    }
+    auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+    ValueType existing;
+    if (!leaf->Lookup(key, &existing, comparator_)) {
+      return;
+    }
+    // Whether the leaf is the root is not known here. Above its min size it is safe either way.
+    if (IsSafe(leaf, Operation::REMOVE, false)) {
+      int slot = leaf->KeyIndex(key, comparator_);
+      leaf->RemoveAndDeleteRecord(key, comparator_);
+      ctx.dirty_ = true;
+      LogEntryChange(LogRecordType::BPLUS_TREE_REMOVE, transaction, key, existing, page, slot, &ctx);
+      return;
+    }
+  }
+  LatchContext ctx(this, Operation::REMOVE, true);
+  Page *page = FindLeafPage(key, false, &ctx);
+  if (page == nullptr) {
+    return;
+  }
+  auto *leaf = reinterpret_cast<LeafPage *>(page->GetData());
+  ValueType existing;
+  if (!leaf->Lookup(key, &existing, comparator_)) {
+    return;
+  }
+  int slot = leaf->KeyIndex(key, comparator_);
+  leaf->RemoveAndDeleteRecord(key, comparator_);
+  ctx.dirty_ = true;
+  CoalesceOrRedistribute(leaf, &ctx);
+  LogEntryChange(LogRecordType::BPLUS_TREE_REMOVE, transaction, key, existing, page, slot, &ctx);
+}
 
 /*
  * User needs to first find the sibling of input page. If sibling's size + input
  * page's size > page's max size, then redistribute. Otherwise, merge.
  * Using template N to represent either internal page or leaf page.
- * @return: true means target leaf page should be deleted, false means no
- * deletion happens
+ * Pages that end up empty are added to the deleted pages of ctx.
+ * The left sibling is latched before node, so node is unlatched while the
+ * sibling is: only readers can get to node in the meantime, the parent is
+ * write latched. The sibling stays latched in ctx until the change is logged.
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
-bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
-  return false;
+void BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, LatchContext *ctx) {
+  size_t position = PositionOf(node, *ctx);
+  if (position == 0) {
+    // Without its parent, node is the root if ctx holds the root latch, or else a page that cannot underflow.
+    if (ctx->root_locked_) {
+      AdjustRoot(node, ctx);
+    }
+    return;
+  }
+  if (node->GetSize() >= node->GetMinSize()) {
+    return;
+  }
+  Page *node_page = ctx->pages_[position];
+  auto *parent = reinterpret_cast<InternalPage *>(ctx->pages_[position - 1]->GetData());
+  int index = parent->ValueIndex(node->GetPageId());
+  // The left sibling, or the right one for the first child.
+  page_id_t neighbor_id = parent->ValueAt(index == 0 ? 1 : index - 1);
+  Page *neighbor_page = FetchTreePage(neighbor_id);
+  if (index == 0) {
+    neighbor_page->WLatch();
+  } else {
+    node_page->WUnlatch();
+    neighbor_page->WLatch();
+    node_page->WLatch();
+  }
+  auto *neighbor = reinterpret_cast<N *>(neighbor_page->GetData());
+
+  // Leaves stay below their max size, internal pages may fill up to it.
+  int capacity = node->IsLeafPage() ? node->GetMaxSize() - 1 : node->GetMaxSize();
+  if (neighbor->GetSize() + node->GetSize() > capacity) {
+    Redistribute(neighbor, node, parent, index);
+  } else {
+    Coalesce(&neighbor, &node, &parent, index, ctx);
+  }
+  ctx->siblings_.push_back(neighbor_page);
+  ctx->restructured_ = true;
 }
 
 /*
- * Move all the key & value pairs from one page to its sibling page, and notify
- * buffer pool manager to delete this page. Parent page must be adjusted to
- * take info of deletion into account. Remember to deal with coalesce or
+ * Move all the key & value pairs from one page to its sibling page, and add
+ * the emptied page to the deleted pages of ctx. Parent page must be adjusted
+ * to take info of deletion into account. Remember to deal with coalesce or
  * redistribute recursively if necessary.
  * Using template N to represent either internal page or leaf page.
  * @param   neighbor_node      sibling page of input "node"
  * @param   node               input from method coalesceOrRedistribute()
  * @param   parent             parent page of input "node"
- * @return  true means parent node should be deleted, false means no deletion
- * happend
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
-bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
+void BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
                               BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> **parent, int index,
-                              Transaction *transaction) {
-  return false;
+                              LatchContext *ctx) {
+  // The right page of the two is merged into the left one. For the first child that is the neighbor.
+  if (index == 0) {
+    std::swap(*neighbor_node, *node);
+  }
+  int node_index = (*parent)->ValueIndex((*node)->GetPageId());
+  if constexpr (std::is_same_v<N, LeafPage>) {
+    (*node)->MoveAllTo(*neighbor_node);
+  } else {
+    (*node)->MoveAllTo(*neighbor_node, (*parent)->KeyAt(node_index), buffer_pool_manager_);
+  }
+  ctx->deleted_.push_back((*node)->GetPageId());
+  (*parent)->Remove(node_index);
+  CoalesceOrRedistribute(*parent, ctx);
 }
 
 /*
@@ -159,22 +365,56 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node, N **node,
  * Using template N to represent either internal page or leaf page.
  * @param   neighbor_node      sibling page of input "node"
  * @param   node               input from method coalesceOrRedistribute()
+ * @param   parent             parent page of input "node"
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
-void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {}
+void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, InternalPage *parent, int index) {
+  if (index == 0) {
+    if constexpr (std::is_same_v<N, LeafPage>) {
+      neighbor_node->MoveFirstToEndOf(node);
+    } else {
+      neighbor_node->MoveFirstToEndOf(node, parent->KeyAt(1), buffer_pool_manager_);
+    }
+    parent->SetKeyAt(1, neighbor_node->KeyAt(0));
+  } else {
+    if constexpr (std::is_same_v<N, LeafPage>) {
+      neighbor_node->MoveLastToFrontOf(node);
+    } else {
+      neighbor_node->MoveLastToFrontOf(node, parent->KeyAt(index), buffer_pool_manager_);
+    }
+    parent->SetKeyAt(index, node->KeyAt(0));
+  }
+}
 /*
  * Update root page if necessary
  * NOTE: size of root page can be less than min size and this method is only
- * called within coalesceOrRedistribute() method
+ * called within coalesceOrRedistribute() method, with the root latch held
  * case 1: when you delete the last element in root page, but root page still
  * has one last child
  * case 2: when you delete the last element in whole b+ tree
- * @return : true means root page should be deleted, false means no deletion
- * happend
+ * The old root is added to the deleted pages of ctx.
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) { return false; }
+void BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node, LatchContext *ctx) {
+  if (old_root_node->IsLeafPage()) {
+    if (old_root_node->GetSize() > 0) {
+      return;
+    }
+    root_page_id_ = INVALID_PAGE_ID;
+  } else {
+    if (old_root_node->GetSize() > 1) {
+      return;
+    }
+    root_page_id_ = reinterpret_cast<InternalPage *>(old_root_node)->RemoveAndReturnOnlyChild();
+    Page *page = FetchTreePage(root_page_id_);
+    reinterpret_cast<BPlusTreePage *>(page->GetData())->SetParentPageId(INVALID_PAGE_ID);
+    buffer_pool_manager_->UnpinPage(root_page_id_, true);
+  }
+  UpdateRootPageId();
+  ctx->deleted_.push_back(old_root_node->GetPageId());
+  ctx->restructured_ = true;
+}
 
 /*****************************************************************************
  * INDEX ITERATOR
@@ -185,7 +425,13 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) { return false; }
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() { return INDEXITERATOR_TYPE(); }
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
+  Page *page = FindLeafPage(KeyType(), true);
+  if (page == nullptr) {
+    return INDEXITERATOR_TYPE();
+  }
+  return INDEXITERATOR_TYPE(buffer_pool_manager_, page, 0);
+}
 
 /*
  * Input parameter is low key, find the leaf page that contains the input key
@@ -193,7 +439,14 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() { return INDEXITERATOR_TYPE(); }
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) { return INDEXITERATOR_TYPE(); }
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
+  Page *page = FindLeafPage(key);
+  if (page == nullptr) {
+    return INDEXITERATOR_TYPE();
+  }
+  int index = reinterpret_cast<LeafPage *>(page->GetData())->KeyIndex(key, comparator_);
+  return INDEXITERATOR_TYPE(buffer_pool_manager_, page, index);
+}
 
 /*
  * Input parameter is void, construct an index iterator representing the end
@@ -208,31 +461,221 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::End() { return INDEXITERATOR_TYPE(); }
  *****************************************************************************/
 /*
  * Find leaf page containing particular key, if leftMost flag == true, find
- * the left most leaf page
+ * the left most leaf page. The leaf is returned read latched and pinned.
  */
 INDEX_TEMPLATE_ARGUMENTS
 Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, bool leftMost) {
-  throw Exception(ExceptionType::NOT_IMPLEMENTED, "Implement this for test");
+  LatchContext ctx(this, Operation::FIND, false);
+  Page *page = FindLeafPage(key, leftMost, &ctx);
+  if (page != nullptr) {
+    // Handed over to the caller.
+    ctx.pages_.pop_back();
+  }
+  return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, bool left_most, LatchContext *ctx) {
+  if (ctx->pessimistic_) {
+    root_latch_.WLock();
+  } else {
+    root_latch_.RLock();
+  }
+  ctx->root_locked_ = true;
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    return nullptr;
+  }
+  Page *page = FetchTreePage(root_page_id_);
+  CrabInto(page, true, ctx);
+  auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  while (!node->IsLeafPage()) {
+    auto *internal = reinterpret_cast<InternalPage *>(node);
+    page_id_t child_id = left_most ? internal->ValueAt(0) : internal->Lookup(key, comparator_);
+    page = FetchTreePage(child_id);
+    CrabInto(page, false, ctx);
+    node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  }
+  return page;
+}
+
+/*
+ * The page is not latched yet, but its type is only set when the page is created, before it is linked into the tree.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::CrabInto(Page *page, bool is_root, LatchContext *ctx) {
+  if (TakesWriteLatch(page, *ctx)) {
+    page->WLatch();
+  } else {
+    page->RLatch();
+  }
+  if (!ctx->pessimistic_ || IsSafe(reinterpret_cast<BPlusTreePage *>(page->GetData()), ctx->operation_, is_root)) {
+    ReleaseLatches(ctx);
+  }
+  ctx->pages_.push_back(page);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::IsSafe(BPlusTreePage *node, Operation operation, bool is_root) const {
+  switch (operation) {
+    case Operation::FIND:
+      return true;
+    case Operation::INSERT:
+      // Leaves split when they reach their max size, internal pages when they go past it.
+      return node->GetSize() < (node->IsLeafPage() ? node->GetMaxSize() - 1 : node->GetMaxSize());
+    case Operation::REMOVE:
+      if (is_root) {
+        // The root goes when it runs empty as a leaf, or down to one child as an internal page.
+        return node->GetSize() > (node->IsLeafPage() ? 1 : 2);
+      }
+      return node->GetSize() > node->GetMinSize();
+  }
+  return false;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::TakesWriteLatch(Page *page, const LatchContext &ctx) const {
+  return ctx.pessimistic_ ||
+         (ctx.operation_ != Operation::FIND && reinterpret_cast<BPlusTreePage *>(page->GetData())->IsLeafPage());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::ReleaseLatches(LatchContext *ctx) {
+  if (ctx->root_locked_) {
+    if (ctx->pessimistic_) {
+      root_latch_.WUnlock();
+    } else {
+      root_latch_.RUnlock();
+    }
+    ctx->root_locked_ = false;
+  }
+  for (Page *page : ctx->pages_) {
+    if (TakesWriteLatch(page, *ctx)) {
+      page->WUnlatch();
+    } else {
+      page->RUnlatch();
+    }
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), ctx->dirty_);
+  }
+  ctx->pages_.clear();
+  for (Page *page : ctx->siblings_) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+  }
+  ctx->siblings_.clear();
+  for (Page *page : ctx->new_pages_) {
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+  }
+  ctx->new_pages_.clear();
+  for (page_id_t page_id : ctx->deleted_) {
+    buffer_pool_manager_->DeletePage(page_id);
+  }
+  ctx->deleted_.clear();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+size_t BPLUSTREE_TYPE::PositionOf(BPlusTreePage *node, const LatchContext &ctx) const {
+  for (size_t i = 0; i < ctx.pages_.size(); i++) {
+    if (ctx.pages_[i]->GetPageId() == node->GetPageId()) {
+      return i;
+    }
+  }
+  UNREACHABLE("The page is not held by the operation.");
+}
+
+/*
+ * Fetch a page of the tree, throw an "out of memory" exception if the buffer pool has no frame for it.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FetchTreePage(page_id_t page_id) {
+  Page *page = buffer_pool_manager_->FetchPage(page_id);
+  if (page == nullptr) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "Cannot fetch a B+ tree page.");
+  }
+  return page;
+}
+
+/*
+ * The pages are copied up to the end of their last entry, redo zeroes the rest. A leaf that a merge deleted is left
+ * out, redo only restores the sibling that took its entries.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogEntryChange(LogRecordType type, Transaction *transaction, const KeyType &key,
+                                    const ValueType &value, Page *leaf, int slot, LatchContext *ctx) {
+  if (!IsLogging()) {
+    return;
+  }
+  auto is_deleted = [&](Page *page) {
+    return std::find(ctx->deleted_.begin(), ctx->deleted_.end(), page->GetPageId()) != ctx->deleted_.end();
+  };
+  std::vector<Page *> pages;
+  std::vector<std::pair<page_id_t, std::vector<char>>> tree_pages;
+  if (ctx->restructured_) {
+    pages.insert(pages.end(), ctx->pages_.begin(), ctx->pages_.end());
+    pages.insert(pages.end(), ctx->siblings_.begin(), ctx->siblings_.end());
+    pages.insert(pages.end(), ctx->new_pages_.begin(), ctx->new_pages_.end());
+    pages.erase(std::remove_if(pages.begin(), pages.end(), is_deleted), pages.end());
+    for (Page *page : pages) {
+      auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+      size_t length = node->IsLeafPage()
+                          ? LEAF_PAGE_HEADER_SIZE + node->GetSize() * sizeof(MappingType)
+                          : INTERNAL_PAGE_HEADER_SIZE + node->GetSize() * sizeof(std::pair<KeyType, page_id_t>);
+      tree_pages.emplace_back(page->GetPageId(), std::vector<char>(page->GetData(), page->GetData() + length));
+    }
+  }
+  MappingType entry(key, value);
+  std::vector<char> entry_data(reinterpret_cast<const char *>(&entry),
+                               reinterpret_cast<const char *>(&entry) + sizeof(MappingType));
+  LogRecord log_record(transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                       transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(), type, index_name_,
+                       is_deleted(leaf) ? INVALID_PAGE_ID : leaf->GetPageId(), slot, sizeof(MappingType),
+                       std::move(entry_data), ctx->restructured_, root_page_id_, std::move(tree_pages));
+  lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+  if (transaction != nullptr) {
+    transaction->SetPrevLSN(lsn);
+  }
+  reinterpret_cast<BPlusTreePage *>(leaf->GetData())->SetLSN(lsn);
+  for (Page *page : pages) {
+    reinterpret_cast<BPlusTreePage *>(page->GetData())->SetLSN(lsn);
+  }
+}
+
+/*
+ * Splits and merges stay, the entry is looked up by its key wherever they moved it since.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::UndoLogRecord(LogRecord *log_record) {
+  BUSTUB_ASSERT(log_record->GetEntries().size() == sizeof(MappingType), "The record holds an entry of another tree.");
+  const auto *entry = reinterpret_cast<const MappingType *>(log_record->GetEntries().data());
+  if (log_record->GetLogRecordType() == LogRecordType::BPLUS_TREE_INSERT) {
+    Remove(entry->first);
+  } else {
+    Insert(entry->first, entry->second);
+  }
 }
 
 /*
  * Update/Insert root page id in header page(where page_id = 0, header_page is
  * defined under include/page/header_page.h)
  * Call this method everytime root page id is changed.
+ * The header page is shared by every index, it is write latched while it changes.
  * @parameter: insert_record      defualt value is false. When set to true,
  * insert a record <index_name, root_page_id> into header page instead of
  * updating it.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
-  HeaderPage *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  HeaderPage *header_page = static_cast<HeaderPage *>(FetchTreePage(HEADER_PAGE_ID));
+  header_page->WLatch();
   if (insert_record != 0) {
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
+    // create a new record<index_name + root_page_id> in header_page, a tree that became empty before has one already
+    if (!header_page->InsertRecord(index_name_, root_page_id_)) {
+      header_page->UpdateRecord(index_name_, root_page_id_);
+    }
   } else {
     // update root_page_id in header_page
     header_page->UpdateRecord(index_name_, root_page_id_);
   }
+  header_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
 }
 
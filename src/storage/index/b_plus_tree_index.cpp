@@ -11,15 +11,25 @@
 
 #include "storage/index/b_plus_tree_index.h"
 
+#include <atomic>
+
 namespace bustub {
+
+/** Hands out the slots of the supremum RIDs, so that every index has its own. */
+static std::atomic<uint32_t> next_supremum_slot{0};
+
 /*
  * Constructor
  */
 INDEX_TEMPLATE_ARGUMENTS
-BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager)
+BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager,
+                                     LockManager *lock_manager, LogManager *log_manager)
     : Index(std::move(metadata)),
       comparator_(GetMetadata()->GetKeySchema()),
-      container_(GetMetadata()->GetName(), buffer_pool_manager, comparator_) {}
+      container_(GetMetadata()->GetName(), buffer_pool_manager, comparator_, LEAF_PAGE_SIZE, INTERNAL_PAGE_SIZE,
+                 log_manager),
+      lock_manager_(lock_manager),
+      supremum_(INVALID_PAGE_ID, next_supremum_slot++) {}
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid, Transaction *transaction) {
@@ -27,7 +37,28 @@ void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid, Transaction *t
   KeyType index_key;
   index_key.SetFromKey(key);
 
-  container_.Insert(index_key, rid, transaction);
+  if (!IsLockingWrites(transaction)) {
+    container_.Insert(index_key, rid, transaction);
+    return;
+  }
+  while (true) {
+    RID next = NextKey(index_key, false);
+    // A lock the transaction held before protects something else as well, and stays.
+    bool held = transaction->IsSharedLocked(next) || transaction->IsExclusiveLocked(next);
+    if (!lock_manager_->LockExclusive(transaction, next)) {
+      return;
+    }
+    bool still_next = NextKey(index_key, false) == next;
+    if (still_next) {
+      container_.Insert(index_key, rid, transaction);
+    }
+    if (!held) {
+      lock_manager_->UnlockInstant(transaction, next);
+    }
+    if (still_next) {
+      return;
+    }
+  }
 }
 
 INDEX_TEMPLATE_ARGUMENTS
@@ -36,6 +67,20 @@ void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid, Transaction *t
   KeyType index_key;
   index_key.SetFromKey(key);
 
+  if (IsLockingWrites(transaction)) {
+    // Nobody inserts before the next key or deletes it while the lock is held, it cannot change once it is locked.
+    RID next = NextKey(index_key, true);
+    while (true) {
+      if (!lock_manager_->LockExclusive(transaction, next)) {
+        return;
+      }
+      RID now_next = NextKey(index_key, true);
+      if (now_next == next) {
+        break;
+      }
+      next = now_next;
+    }
+  }
   container_.Remove(index_key, transaction);
 }
 
@@ -45,7 +90,92 @@ void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> *result, T
   KeyType index_key;
   index_key.SetFromKey(key);
 
-  container_.GetValue(index_key, result, transaction);
+  if (!IsLockingScans(transaction)) {
+    container_.GetValue(index_key, result, transaction);
+    return;
+  }
+  // A missing key must stay missing, the lookup locks the gap like a range of one key.
+  ScanRange(&key, &key, result, transaction);
+}
+
+/*
+ * The keys are collected under the leaf latches of an iterator and locked without them. Whatever got into the range
+ * in between is found when the range is collected again, and locked in the next round, until nothing changes any more.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanRange(const Tuple *low_key, const Tuple *high_key, std::vector<RID> *result,
+                                     Transaction *transaction) {
+  KeyType low;
+  KeyType high;
+  if (low_key != nullptr) {
+    low.SetFromKey(*low_key);
+  }
+  if (high_key != nullptr) {
+    high.SetFromKey(*high_key);
+  }
+  const KeyType *low_bound = low_key == nullptr ? nullptr : &low;
+  const KeyType *high_bound = high_key == nullptr ? nullptr : &high;
+
+  std::vector<RID> values;
+  RID next = CollectRange(low_bound, high_bound, &values);
+  if (IsLockingScans(transaction)) {
+    while (true) {
+      for (const RID &value : values) {
+        if (!lock_manager_->LockShared(transaction, value)) {
+          return;
+        }
+      }
+      if (!lock_manager_->LockShared(transaction, next)) {
+        return;
+      }
+      std::vector<RID> now_values;
+      RID now_next = CollectRange(low_bound, high_bound, &now_values);
+      if (now_values == values && now_next == next) {
+        break;
+      }
+      values = std::move(now_values);
+      next = now_next;
+    }
+  }
+  result->insert(result->end(), values.begin(), values.end());
+}
+
+/*
+ * Optimistic transactions validate at commit instead, and rollbacks only restore what their transaction had locked.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::IsLockingWrites(Transaction *txn) const {
+  return enable_logging && lock_manager_ != nullptr && txn != nullptr && !txn->IsOptimistic() &&
+         txn->GetState() != TransactionState::ABORTED;
+}
+
+/*
+ * Only REPEATABLE_READ protects reads from phantoms. Snapshot isolation reads versions and takes no read locks.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::IsLockingScans(Transaction *txn) const {
+  return IsLockingWrites(txn) && txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType BPLUSTREE_INDEX_TYPE::CollectRange(const KeyType *low, const KeyType *high, std::vector<ValueType> *values) {
+  auto iterator = low == nullptr ? container_.Begin() : container_.Begin(*low);
+  for (; !iterator.IsEnd(); ++iterator) {
+    if (high != nullptr && comparator_((*iterator).first, *high) > 0) {
+      return (*iterator).second;
+    }
+    values->push_back((*iterator).second);
+  }
+  return supremum_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType BPLUSTREE_INDEX_TYPE::NextKey(const KeyType &key, bool strict) {
+  auto iterator = container_.Begin(key);
+  if (strict && !iterator.IsEnd() && comparator_((*iterator).first, key) == 0) {
+    ++iterator;
+  }
+  return iterator.IsEnd() ? supremum_ : (*iterator).second;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
@@ -3,28 +3,78 @@
  */
 #include <cassert>
 
+#include "common/exception.h"
 #include "storage/index/index_iterator.h"
 
 namespace bustub {
 
-/*
- * NOTE: you can change the destructor/constructor method here
- * set your own input parameters
- */
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE::IndexIterator() = default;
 
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::~IndexIterator() = default;
+INDEXITERATOR_TYPE::IndexIterator(BufferPoolManager *buffer_pool_manager, Page *page, int index)
+    : buffer_pool_manager_(buffer_pool_manager), page_(page), index_(index) {
+  SkipExhaustedLeaves();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::IndexIterator(IndexIterator &&other) noexcept
+    : buffer_pool_manager_(other.buffer_pool_manager_), page_(other.page_), index_(other.index_) {
+  other.page_ = nullptr;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::~IndexIterator() { Release(); }
+
+INDEX_TEMPLATE_ARGUMENTS
+bool INDEXITERATOR_TYPE::IsEnd() { return page_ == nullptr; }
+
+INDEX_TEMPLATE_ARGUMENTS
+const MappingType &INDEXITERATOR_TYPE::operator*() {
+  assert(!IsEnd());
+  return reinterpret_cast<LeafPage *>(page_->GetData())->GetItem(index_);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-bool INDEXITERATOR_TYPE::IsEnd() { throw std::runtime_error("unimplemented"); }
+INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() {
+  assert(!IsEnd());
+  index_++;
+  SkipExhaustedLeaves();
+  return *this;
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-const MappingType &INDEXITERATOR_TYPE::operator*() { throw std::runtime_error("unimplemented"); }
+void INDEXITERATOR_TYPE::SkipExhaustedLeaves() {
+  while (page_ != nullptr) {
+    auto *leaf = reinterpret_cast<LeafPage *>(page_->GetData());
+    if (index_ < leaf->GetSize()) {
+      return;
+    }
+    page_id_t next_page_id = leaf->GetNextPageId();
+    Page *next_page = nullptr;
+    if (next_page_id != INVALID_PAGE_ID) {
+      next_page = buffer_pool_manager_->FetchPage(next_page_id);
+      if (next_page == nullptr) {
+        Release();
+        throw Exception(ExceptionType::OUT_OF_MEMORY, "Cannot fetch the next leaf of a B+ tree.");
+      }
+      // Latched before the current leaf is let go, so that no merge moves entries past the iterator in between.
+      next_page->RLatch();
+    }
+    Release();
+    page_ = next_page;
+    index_ = 0;
+  }
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() { throw std::runtime_error("unimplemented"); }
+void INDEXITERATOR_TYPE::Release() {
+  if (page_ != nullptr) {
+    page_->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_->GetPageId(), false);
+    page_ = nullptr;
+  }
+}
 
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
 
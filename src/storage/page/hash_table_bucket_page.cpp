@@ -34,7 +34,7 @@ bool HASH_TABLE_BUCKET_TYPE::GetValue(KeyType key, KeyComparator cmp, std::vecto
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
-bool HASH_TABLE_BUCKET_TYPE::Insert(KeyType key, ValueType value, KeyComparator cmp) {
+bool HASH_TABLE_BUCKET_TYPE::Insert(KeyType key, ValueType value, KeyComparator cmp, uint32_t *bucket_idx) {
   int ins_idx = -1;
   for (size_t i = 0; i < BUCKET_ARRAY_SIZE; i++) {
     if (!IsReadable(i)) {
@@ -55,12 +55,15 @@ bool HASH_TABLE_BUCKET_TYPE::Insert(KeyType key, ValueType value, KeyComparator
   }
   SetReadable(ins_idx);
   array_[ins_idx] = MappingType(key, value);
+  if (bucket_idx != nullptr) {
+    *bucket_idx = ins_idx;
+  }
 
   return true;
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
-bool HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, KeyComparator cmp) {
+bool HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, KeyComparator cmp, uint32_t *bucket_idx) {
   for (size_t i = 0; i < BUCKET_ARRAY_SIZE; i++) {
     if (!IsReadable(i)) {
       continue;
@@ -68,6 +71,9 @@ bool HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, KeyComparator
     if (cmp(key, array_[i].first) == 0 && value == array_[i].second)  // duplicate key
     {
       SetUnreadable(i);
+      if (bucket_idx != nullptr) {
+        *bucket_idx = i;
+      }
       return true;
     }
   }
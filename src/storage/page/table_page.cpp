@@ -17,12 +17,18 @@
 
 namespace bustub {
 
+/**
+ * Recovery replays changes without a transaction. A standby does so while the primary it tails in the same process
+ * has logging turned on.
+ */
+static inline bool IsLogging(Transaction *txn) { return enable_logging && txn != nullptr; }
+
 void TablePage::Init(page_id_t page_id, uint32_t page_size, page_id_t prev_page_id, LogManager *log_manager,
                      Transaction *txn) {
   // Set the page ID.
   memcpy(GetData(), &page_id, sizeof(page_id));
   // Log that we are creating a new page.
-  if (enable_logging) {
+  if (IsLogging(txn)) {
     LogRecord log_record =
         LogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::NEWPAGE, prev_page_id, page_id);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
@@ -73,11 +79,13 @@ bool TablePage::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, Lock
   }
 
   // Write the log record.
-  if (enable_logging) {
-    BUSTUB_ASSERT(!txn->IsSharedLocked(*rid) && !txn->IsExclusiveLocked(*rid), "A new tuple should not be locked.");
-    // Acquire an exclusive lock on the new tuple.
-    bool locked = lock_manager->LockExclusive(txn, *rid);
-    BUSTUB_ASSERT(locked, "Locking a new tuple should always work.");
+  if (IsLogging(txn)) {
+    // Acquire an exclusive lock on the new tuple, unless the caller's table lock covers it.
+    if (lock_manager != nullptr) {
+      BUSTUB_ASSERT(!txn->IsSharedLocked(*rid) && !txn->IsExclusiveLocked(*rid), "A new tuple should not be locked.");
+      bool locked = lock_manager->LockExclusive(txn, *rid);
+      BUSTUB_ASSERT(locked, "Locking a new tuple should always work.");
+    }
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::INSERT, *rid, tuple);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
     SetLSN(lsn);
@@ -90,7 +98,7 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -99,20 +107,23 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is already deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
   }
 
-  if (enable_logging) {
+  if (IsLogging(txn)) {
     // Acquire an exclusive lock, upgrading from a shared lock if necessary.
-    if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
+    // Without a lock manager, the caller's table lock covers the tuple.
+    if (lock_manager != nullptr) {
+      if (txn->IsSharedLocked(rid)) {
+        if (!lock_manager->LockUpgrade(txn, rid)) {
+          return false;
+        }
+      } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
         return false;
       }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
-      return false;
     }
     Tuple dummy_tuple;
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::MARKDELETE, rid, dummy_tuple);
@@ -134,7 +145,7 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -142,7 +153,7 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -163,14 +174,17 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   old_tuple->rid_ = rid;
   old_tuple->allocated_ = true;
 
-  if (enable_logging) {
+  if (IsLogging(txn)) {
     // Acquire an exclusive lock, upgrading from shared if necessary.
-    if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
+    // Without a lock manager, the caller's table lock covers the tuple.
+    if (lock_manager != nullptr) {
+      if (txn->IsSharedLocked(rid)) {
+        if (!lock_manager->LockUpgrade(txn, rid)) {
+          return false;
+        }
+      } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
         return false;
       }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
-      return false;
     }
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::UPDATE, rid, *old_tuple, new_tuple);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
@@ -218,9 +232,7 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
   delete_tuple.rid_ = rid;
   delete_tuple.allocated_ = true;
 
-  if (enable_logging) {
-    BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own the exclusive lock!");
-
+  if (IsLogging(txn)) {
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::APPLYDELETE, rid, delete_tuple);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
     SetLSN(lsn);
@@ -247,8 +259,7 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
 
 void TablePage::RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   // Log the rollback.
-  if (enable_logging) {
-    BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own an exclusive lock on the RID.");
+  if (IsLogging(txn)) {
     Tuple dummy_tuple;
     LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ROLLBACKDELETE, rid, dummy_tuple);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
@@ -271,7 +282,7 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   uint32_t slot_num = rid.GetSlotNum();
   // If somehow we have more slots than tuples, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -280,14 +291,14 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (IsLogging(txn)) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
   }
 
   // Otherwise we have a valid tuple, try to acquire at least a shared lock.
-  if (enable_logging) {
+  if (IsLogging(txn) && lock_manager != nullptr) {
     if (!txn->IsSharedLocked(rid) && !txn->IsExclusiveLocked(rid) && !lock_manager->LockShared(txn, rid)) {
       return false;
     }
@@ -306,10 +317,10 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   return true;
 }
 
-bool TablePage::GetFirstTupleRid(RID *first_rid) {
+bool TablePage::GetFirstTupleRid(RID *first_rid, bool with_deleted) {
   // Find and return the first valid tuple.
   for (uint32_t i = 0; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (with_deleted || !IsDeleted(GetTupleSize(i))) {
       first_rid->Set(GetTablePageId(), i);
       return true;
     }
@@ -318,12 +329,12 @@ bool TablePage::GetFirstTupleRid(RID *first_rid) {
   return false;
 }
 
-bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid) {
+bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool with_deleted) {
   LOG_DEBUG("cur rid pgid:%d,pg id:%d", cur_rid.GetPageId(), GetTablePageId());
   BUSTUB_ASSERT(cur_rid.GetPageId() == GetTablePageId(), "Wrong table!");
   // Find and return the first valid tuple after our current slot number.
   for (auto i = cur_rid.GetSlotNum() + 1; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (with_deleted || !IsDeleted(GetTupleSize(i))) {
       next_rid->Set(GetTablePageId(), i);
       return true;
     }
@@ -11,6 +11,9 @@
 //===----------------------------------------------------------------------===//
 
 #include <cassert>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
 
 #include "common/logger.h"
 #include "storage/table/table_heap.h"
@@ -37,6 +40,10 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_m
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
   if (tuple.size_ + 32 > PAGE_SIZE) {  // larger than one page size
     txn->SetState(TransactionState::ABORTED);
     return false;
@@ -48,10 +55,16 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
     return false;
   }
 
+  LockManager *row_lock_manager;
+  if (!LockForRow(txn, true, &row_lock_manager)) {
+    buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), false);
+    return false;
+  }
+
   cur_page->WLatch();
   // Insert into the first page with enough space. If no such page exists, create a new page and insert into that.
   // INVARIANT: cur_page is WLatched if you leave the loop normally.
-  while (!cur_page->InsertTuple(tuple, rid, txn, lock_manager_, log_manager_)) {
+  while (!cur_page->InsertTuple(tuple, rid, txn, row_lock_manager, log_manager_)) {
     auto next_page_id = cur_page->GetNextPageId();
     // If the next page is a valid page,
     if (next_page_id != INVALID_PAGE_ID) {
@@ -81,16 +94,27 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
       cur_page = new_page;
     }
   }
+  // Before the insert the row did not exist, which is what older snapshots have to keep seeing.
+  bool saved;
+  SaveVersion(*rid, txn, nullptr, &saved);
   // This line has caused most of us to double-take and "whoa double unlatch".
   // We are not, in fact, double unlatching. See the invariant above.
   cur_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(cur_page->GetTablePageId(), true);
   // Update the transaction's write set.
   txn->GetWriteSet()->emplace_back(*rid, WType::INSERT, Tuple{}, this);
+  CountRowLock(txn, *rid, false, row_lock_manager);
   return true;
 }
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (IsBuffering(txn)) {
+    return BufferWrite(rid, WType::DELETE, Tuple{}, txn);
+  }
   // TODO(Amadou): remove empty page
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
@@ -99,17 +123,44 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  LockManager *row_lock_manager;
+  if (!LockForRow(txn, true, &row_lock_manager)) {
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
   // Otherwise, mark the tuple as deleted.
+  bool was_locked = IsRowLocked(txn, rid);
+  if (!LockRow(txn, rid, row_lock_manager, true)) {
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
+  Tuple old_tuple;
+  bool saved = false;
+  if (page->GetTuple(rid, &old_tuple, nullptr, nullptr) && !SaveVersion(rid, txn, &old_tuple, &saved)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  if (!page->MarkDelete(rid, txn, row_lock_manager, log_manager_) && saved) {
+    AbortVersion(rid, txn);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
   // Update the transaction's write set.
   txn->GetWriteSet()->emplace_back(rid, WType::DELETE, Tuple{}, this);
+  CountRowLock(txn, rid, was_locked, row_lock_manager);
   return true;
 }
 
 bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (IsBuffering(txn)) {
+    return BufferWrite(rid, WType::UPDATE, tuple, txn);
+  }
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -117,16 +168,38 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  LockManager *row_lock_manager;
+  if (!LockForRow(txn, true, &row_lock_manager)) {
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
   // Update the tuple; but first save the old value for rollbacks.
   Tuple old_tuple;
+  bool was_locked = IsRowLocked(txn, rid);
+  // Rolling back an update restores the saved version in place, AbortVersion forgets it afterwards.
+  bool rollback = txn->GetState() == TransactionState::ABORTED;
+  if (!rollback && !LockRow(txn, rid, row_lock_manager, true)) {
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
   page->WLatch();
-  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_);
+  bool saved = false;
+  if (!rollback && page->GetTuple(rid, &old_tuple, nullptr, nullptr) && !SaveVersion(rid, txn, &old_tuple, &saved)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, row_lock_manager, log_manager_);
+  if (!is_updated && saved) {
+    AbortVersion(rid, txn);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_updated);
-  // Update the transaction's write set.
-  if (is_updated && txn->GetState() != TransactionState::ABORTED) {
+  // Update the transaction's write set. A transaction wounded meanwhile still has to roll this update back.
+  if (is_updated && !rollback) {
     txn->GetWriteSet()->emplace_back(rid, WType::UPDATE, old_tuple, this);
   }
+  CountRowLock(txn, rid, was_locked, row_lock_manager);
   return is_updated;
 }
 
@@ -134,9 +207,15 @@ void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+  BUSTUB_ASSERT(!enable_logging || txn->IsExclusiveLocked(rid) || txn->IsTableExclusiveLocked(table_oid_),
+                "We must own the exclusive lock!");
   // Delete the tuple from the page.
   page->WLatch();
   page->ApplyDelete(rid, txn, log_manager_);
+  if (txn->GetState() == TransactionState::ABORTED) {
+    // The rolled back insert frees the slot; its version has to go before another insert can take the slot over.
+    AbortVersion(rid, txn);
+  }
   lock_manager_->Unlock(txn, rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
@@ -146,6 +225,8 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+  BUSTUB_ASSERT(!enable_logging || txn->IsExclusiveLocked(rid) || txn->IsTableExclusiveLocked(table_oid_),
+                "We must own an exclusive lock on the RID.");
   // Rollback the delete.
   page->WLatch();
   page->RollbackDelete(rid, txn, log_manager_);
@@ -154,6 +235,18 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
 }
 
 bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
+  // An optimistic transaction reads its own buffered writes.
+  if (IsBuffering(txn)) {
+    auto buffered = txn->GetBufferedWriteSet()->find(rid);
+    if (buffered != txn->GetBufferedWriteSet()->end()) {
+      if (buffered->second.wtype_ == WType::DELETE) {
+        return false;
+      }
+      *tuple = buffered->second.tuple_;
+      tuple->rid_ = rid;
+      return true;
+    }
+  }
   // Find the page which contains the tuple.
   auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -161,14 +254,306 @@ bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  // Snapshot and optimistic reads take no locks and never abort. Optimistic ones read the latest committed version.
+  if (ReadsVersions(txn)) {
+    bool own_write;
+    page->RLatch();
+    bool res =
+        GetVisibleVersion(page, rid, tuple, txn, IsSnapshot(txn) ? txn->GetReadTs() : MAX_TIMESTAMP, &own_write);
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+    if (IsBuffering(txn) && !own_write) {
+      txn->GetReadSet()->try_emplace(rid, rid, res, res ? *tuple : Tuple{}, this);
+    }
+    return res;
+  }
+  LockManager *row_lock_manager;
+  if (!LockForRow(txn, false, &row_lock_manager)) {
+    buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+    return false;
+  }
   // Read the tuple from the page.
+  bool was_locked = IsRowLocked(txn, rid);
+  if (!LockRow(txn, rid, row_lock_manager, false)) {
+    buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+    return false;
+  }
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res = page->GetTuple(rid, tuple, txn, row_lock_manager);
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+  CountRowLock(txn, rid, was_locked, row_lock_manager);
   return res;
 }
 
+bool TableHeap::LockTable(Transaction *txn, LockManager::LockMode mode) {
+  if (!IsLocking(txn)) {
+    return true;
+  }
+  return lock_manager_->LockTable(txn, mode, table_oid_);
+}
+
+bool TableHeap::LockForRow(Transaction *txn, bool write, LockManager **row_lock_manager) {
+  *row_lock_manager = lock_manager_;
+  if (!IsLocking(txn)) {
+    return true;
+  }
+  // Reads under READ_UNCOMMITTED take no locks at all.
+  if (!write && txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+    *row_lock_manager = nullptr;
+    return true;
+  }
+  auto intention = write ? LockManager::LockMode::INTENTION_EXCLUSIVE : LockManager::LockMode::INTENTION_SHARED;
+  LockManager::LockMode held;
+  if (LockManager::GetTableLockMode(txn, table_oid_, &held)) {
+    if (LockManager::Covers(held, write ? LockManager::LockMode::EXCLUSIVE : LockManager::LockMode::SHARED)) {
+      *row_lock_manager = nullptr;
+      return true;
+    }
+    // An aborted transaction rolls back its writes under the locks it still holds, without asking for new ones.
+    if (LockManager::Covers(held, intention)) {
+      return true;
+    }
+  }
+  return lock_manager_->LockTable(txn, intention, table_oid_);
+}
+
+/*
+ * Row locks do not say which table they belong to, the rows of this table are the ones on its pages.
+ */
+void TableHeap::CountRowLock(Transaction *txn, const RID &rid, bool was_locked, LockManager *row_lock_manager) {
+  if (row_lock_manager == nullptr || !IsLocking(txn) || was_locked || !IsRowLocked(txn, rid)) {
+    return;
+  }
+  size_t &count = (*txn->GetRowLockCounts())[table_oid_];
+  count++;
+  size_t threshold = lock_manager_->GetEscalationThreshold();
+  if (threshold == 0 || count <= threshold) {
+    return;
+  }
+
+  std::unordered_set<page_id_t> page_ids;
+  for (page_id_t page_id = first_page_id_; page_id != INVALID_PAGE_ID;) {
+    auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    page->RLatch();
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_ids.insert(page_id);
+    page_id = next_page_id;
+  }
+  std::vector<RID> rows;
+  for (const auto &lock_set : {txn->GetSharedLockSet(), txn->GetExclusiveLockSet()}) {
+    for (const RID &locked : *lock_set) {
+      if (page_ids.count(locked.GetPageId()) != 0) {
+        rows.push_back(locked);
+      }
+    }
+  }
+  if (lock_manager_->EscalateTableLock(txn, table_oid_, rows)) {
+    count = 0;
+  }
+}
+
+/*
+ * TablePage takes row locks as well, but under the page latch: a reader holding the latch while it waits for a
+ * writer's lock would keep that writer from latching the page for its next row. Once locked here, the page finds the
+ * lock held and never waits.
+ */
+bool TableHeap::LockRow(Transaction *txn, const RID &rid, LockManager *row_lock_manager, bool exclusive) {
+  if (!exclusive) {
+    if (row_lock_manager == nullptr || !IsLocking(txn) || txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid)) {
+      return true;
+    }
+    return row_lock_manager->LockShared(txn, rid);
+  }
+  // A snapshot transaction that loses the write conflict anyway does not wait for the lock first.
+  if (IsSnapshot(txn)) {
+    VersionShard &shard = ShardOf(rid);
+    std::scoped_lock lock(shard.latch_);
+    auto it = shard.chains_.find(rid);
+    if (it != shard.chains_.end() && HasWriteConflict(it->second, txn)) {
+      txn->SetState(TransactionState::ABORTED);
+      return false;
+    }
+  }
+  if (row_lock_manager == nullptr || !IsLocking(txn) || txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (txn->IsSharedLocked(rid)) {
+    return row_lock_manager->LockUpgrade(txn, rid);
+  }
+  return row_lock_manager->LockExclusive(txn, rid);
+}
+
+/*
+ * Writers hold the row's exclusive lock when they get here, if locks are taken at all. Without locks, snapshot and
+ * optimistic transactions still do not overwrite each other: who finds writer_ taken is aborted, the first writer
+ * wins.
+ */
+bool TableHeap::SaveVersion(const RID &rid, Transaction *txn, const Tuple *old_tuple, bool *saved) {
+  VersionShard &shard = ShardOf(rid);
+  std::scoped_lock lock(shard.latch_);
+  *saved = false;
+  VersionChain &chain = shard.chains_[rid];
+  if (chain.writer_ == txn->GetTransactionId()) {
+    return true;
+  }
+  if ((IsSnapshot(txn) || txn->IsOptimistic()) && old_tuple != nullptr && HasWriteConflict(chain, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  if (old_tuple != nullptr) {
+    chain.versions_.push_front(TupleVersion{*old_tuple, true, chain.head_ts_, MAX_TIMESTAMP});
+  } else {
+    chain.versions_.push_front(TupleVersion{Tuple{}, false, chain.head_ts_, MAX_TIMESTAMP});
+  }
+  chain.writer_ = txn->GetTransactionId();
+  *saved = true;
+  return true;
+}
+
+/*
+ * Without a pending write, the page holds the version committed at head_ts_. Otherwise, and for snapshots older than
+ * head_ts_, the newest saved version that began at or before the snapshot is the one to read.
+ */
+bool TableHeap::GetVisibleVersion(TablePage *page, const RID &rid, Tuple *tuple, Transaction *txn, timestamp_t read_ts,
+                                  bool *own_write) {
+  VersionShard &shard = ShardOf(rid);
+  std::scoped_lock lock(shard.latch_);
+  auto it = shard.chains_.find(rid);
+  *own_write = it != shard.chains_.end() && it->second.writer_ == txn->GetTransactionId();
+  if (it == shard.chains_.end() || *own_write ||
+      (it->second.writer_ == INVALID_TXN_ID && it->second.head_ts_ <= read_ts)) {
+    return page->GetTuple(rid, tuple, nullptr, nullptr);
+  }
+  for (const TupleVersion &version : it->second.versions_) {
+    if (version.begin_ts_ <= read_ts) {
+      if (!version.exists_) {
+        return false;
+      }
+      *tuple = version.tuple_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TableHeap::CommitVersion(const RID &rid, Transaction *txn, timestamp_t commit_ts) {
+  VersionShard &shard = ShardOf(rid);
+  std::scoped_lock lock(shard.latch_);
+  auto it = shard.chains_.find(rid);
+  if (it == shard.chains_.end() || it->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  it->second.writer_ = INVALID_TXN_ID;
+  it->second.head_ts_ = commit_ts;
+  it->second.versions_.front().end_ts_ = commit_ts;
+}
+
+void TableHeap::AbortVersion(const RID &rid, Transaction *txn) {
+  VersionShard &shard = ShardOf(rid);
+  std::scoped_lock lock(shard.latch_);
+  auto it = shard.chains_.find(rid);
+  if (it == shard.chains_.end() || it->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  it->second.writer_ = INVALID_TXN_ID;
+  it->second.versions_.pop_front();
+  if (it->second.versions_.empty()) {
+    shard.chains_.erase(it);
+  }
+}
+
+/*
+ * A chain without versions is dropped as well: its head is older than every snapshot, like a row without a chain.
+ */
+size_t TableHeap::PruneVersions(const RID &rid, timestamp_t watermark) {
+  VersionShard &shard = ShardOf(rid);
+  std::scoped_lock lock(shard.latch_);
+  auto it = shard.chains_.find(rid);
+  if (it == shard.chains_.end()) {
+    return 0;
+  }
+  size_t pruned = 0;
+  auto &versions = it->second.versions_;
+  while (!versions.empty() && versions.back().end_ts_ <= watermark) {
+    versions.pop_back();
+    pruned++;
+  }
+  if (versions.empty() && it->second.writer_ == INVALID_TXN_ID) {
+    shard.chains_.erase(it);
+  }
+  return pruned;
+}
+
+bool TableHeap::BufferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn) {
+  auto buffered = txn->GetBufferedWriteSet();
+  auto it = buffered->find(rid);
+  if (it != buffered->end()) {
+    if (it->second.wtype_ == WType::DELETE) {
+      return false;
+    }
+    it->second.wtype_ = wtype;
+    it->second.tuple_ = tuple;
+    return true;
+  }
+  Tuple current;
+  if (!GetTuple(rid, &current, txn)) {
+    return false;
+  }
+  buffered->emplace(rid, TableWriteRecord(rid, wtype, tuple, this));
+  return true;
+}
+
+/*
+ * Comparing the contents instead of a version number also accepts a row that was changed and changed back, which
+ * leaves what the transaction read just as current.
+ */
+bool TableHeap::ValidateRead(const TableReadRecord &read, Transaction *txn) {
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(read.rid_.GetPageId()));
+  if (page == nullptr) {
+    return false;
+  }
+  Tuple current;
+  bool exists;
+  bool valid = true;
+  page->RLatch();
+  {
+    VersionShard &shard = ShardOf(read.rid_);
+    std::scoped_lock lock(shard.latch_);
+    auto it = shard.chains_.find(read.rid_);
+    if (it == shard.chains_.end() || it->second.writer_ == INVALID_TXN_ID) {
+      exists = page->GetTuple(read.rid_, &current, nullptr, nullptr);
+    } else if (it->second.writer_ == txn->GetTransactionId()) {
+      // We wrote the row ourselves, the latest committed version is the one we replaced.
+      exists = it->second.versions_.front().exists_;
+      current = it->second.versions_.front().tuple_;
+    } else {
+      exists = false;
+      valid = false;
+    }
+  }
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(read.rid_.GetPageId(), false);
+  if (!valid || exists != read.exists_) {
+    return false;
+  }
+  return !exists || (current.GetLength() == read.tuple_.GetLength() &&
+                     memcmp(current.GetData(), read.tuple_.GetData(), current.GetLength()) == 0);
+}
+
+size_t TableHeap::GetVersionCount() {
+  size_t count = 0;
+  for (VersionShard &shard : version_shards_) {
+    std::scoped_lock lock(shard.latch_);
+    for (const auto &[rid, chain] : shard.chains_) {
+      count += chain.versions_.size();
+    }
+  }
+  return count;
+}
+
 TableIterator TableHeap::Begin(Transaction *txn) {
   // Start an iterator from the first page.
   // TODO(Wuwen): Hacky fix for now. Removing empty pages is a better way to handle this.
@@ -178,7 +563,7 @@ TableIterator TableHeap::Begin(Transaction *txn) {
     auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
     page->RLatch();
     // If this fails because there is no tuple, then RID will be the default-constructed value, which means EOF.
-    auto found_tuple = page->GetFirstTupleRid(&rid);
+    auto found_tuple = page->GetFirstTupleRid(&rid, ReadsVersions(txn));
     page->RUnlatch();
     buffer_pool_manager_->UnpinPage(page_id, false);
     if (found_tuple) {
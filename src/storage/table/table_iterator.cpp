@@ -19,8 +19,10 @@ namespace bustub {
 
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
-  if (rid.GetPageId() != INVALID_PAGE_ID) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+  // A scan of versions visits deleted slots as well and skips the rows it does not see.
+  if (rid.GetPageId() != INVALID_PAGE_ID && !table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) &&
+      TableHeap::ReadsVersions(txn_)) {
+    ++(*this);
   }
 }
 
@@ -35,34 +37,37 @@ Tuple *TableIterator::operator->() {
 }
 
 TableIterator &TableIterator::operator++() {
+  do {
+    NextRid();
+  } while (*this != table_heap_->End() && !table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) &&
+           TableHeap::ReadsVersions(txn_));
+  return *this;
+}
+
+void TableIterator::NextRid() {
+  bool with_deleted = TableHeap::ReadsVersions(txn_);
   BufferPoolManager *buffer_pool_manager = table_heap_->buffer_pool_manager_;
   auto cur_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(tuple_->rid_.GetPageId()));
   cur_page->RLatch();
   assert(cur_page != nullptr);  // all pages are pinned
 
   RID next_tuple_rid;
-  if (!cur_page->GetNextTupleRid(tuple_->rid_,
-                                 &next_tuple_rid)) {  // end of this page
+  if (!cur_page->GetNextTupleRid(tuple_->rid_, &next_tuple_rid, with_deleted)) {  // end of this page
     while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
       auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
       cur_page->RUnlatch();
       buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
       cur_page = next_page;
       cur_page->RLatch();
-      if (cur_page->GetFirstTupleRid(&next_tuple_rid)) {
+      if (cur_page->GetFirstTupleRid(&next_tuple_rid, with_deleted)) {
         break;
       }
     }
   }
   tuple_->rid_ = next_tuple_rid;
-
-  if (*this != table_heap_->End()) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
-  }
-  // release until copy the tuple
+  // GetTuple latches the page itself; taking the read latch a second time would block behind a waiting writer.
   cur_page->RUnlatch();
   buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
-  return *this;
 }
 
 TableIterator TableIterator::operator++(int) {
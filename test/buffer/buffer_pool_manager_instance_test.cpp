@@ -11,11 +11,13 @@
 //===----------------------------------------------------------------------===//
 
 #include "buffer/buffer_pool_manager_instance.h"
+#include <chrono>  // NOLINT
 #include <cstdio>
 #include <random>
 #include <string>
 #include "buffer/buffer_pool_manager.h"
 #include "gtest/gtest.h"
+#include "recovery/log_manager.h"
 
 namespace bustub {
 
@@ -141,4 +143,50 @@ TEST(BufferPoolManagerInstanceTest, SampleTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+// Check that a dirty page is never written back before the log describing it, and that durable victims are preferred
+TEST(BufferPoolManagerInstanceTest, WalRuleOnEvictionTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 2;
+  auto saved_log_timeout = log_timeout;
+  // Only forced flushes can make the log persistent during this test.
+  log_timeout = std::chrono::seconds(15);
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *log_manager = new LogManager(disk_manager);
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, log_manager);
+  log_manager->RunFlushThread();
+
+  // Page 0 is changed by a log record that is not persistent yet, page 1 is clean.
+  page_id_t page_id_temp;
+  auto *page0 = bpm->NewPage(&page_id_temp);
+  ASSERT_NE(nullptr, page0);
+  LogRecord log_record(0, INVALID_LSN, LogRecordType::BEGIN);
+  lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+  page0->SetLSN(lsn);
+  EXPECT_TRUE(bpm->UnpinPage(0, true));
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id_temp));
+  EXPECT_TRUE(bpm->UnpinPage(1, false));
+
+  // Page 0 is least recently used, but evicting the clean page 1 does not need the log.
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id_temp));
+  EXPECT_EQ(0U, bpm->GetNumLogForcedEvictions());
+  EXPECT_LT(log_manager->GetPersistentLSN(), lsn);
+
+  // Now page 0 is the only victim left, its log record must be on disk before the page is.
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id_temp));
+  EXPECT_EQ(1U, bpm->GetNumLogForcedEvictions());
+  EXPECT_GE(log_manager->GetPersistentLSN(), lsn);
+
+  log_manager->StopFlushThread();
+  log_timeout = saved_log_timeout;
+  disk_manager->ShutDown();
+  remove("test.db");
+  remove("test.log");
+
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+}
+
 }  // namespace bustub
@@ -0,0 +1,126 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// epoch_manager_test.cpp
+//
+// Identification: test/common/epoch_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/epoch_manager.h"
+#include "common/logger.h"
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+/** A node of a shared structure that counts how many of its kind are freed. */
+struct TrackedNode {
+  static constexpr uint64_t MAGIC = 0x5eedfacecafebeef;
+  explicit TrackedNode(uint64_t value) : value_(value) {}
+  ~TrackedNode() {
+    magic_ = 0;
+    freed++;
+  }
+
+  uint64_t magic_{MAGIC};
+  uint64_t value_;
+  static std::atomic<size_t> freed;
+};
+
+std::atomic<size_t> TrackedNode::freed{0};
+
+// NOLINTNEXTLINE
+TEST(EpochManagerTest, GuardHoldsBackReclamationTest) {
+  TrackedNode::freed = 0;
+  EpochManager epoch_manager;
+  {
+    EpochGuard guard(&epoch_manager);
+    epoch_manager.Retire(new TrackedNode(1));
+    // The guard is in the epoch the node was retired in, the global epoch can move on once but no further.
+    EXPECT_EQ(epoch_manager.Reclaim(), 0U);
+    EXPECT_EQ(epoch_manager.Reclaim(), 0U);
+    EXPECT_EQ(epoch_manager.GetGarbageCount(), 1U);
+  }
+  EXPECT_EQ(epoch_manager.Reclaim(), 1U);
+  EXPECT_EQ(TrackedNode::freed, 1U);
+  EXPECT_EQ(epoch_manager.GetGarbageCount(), 0U);
+
+  // What is still retired when the manager goes away is freed with it.
+  {
+    EpochManager short_lived;
+    short_lived.Retire(new TrackedNode(2));
+    short_lived.Retire(new TrackedNode(3));
+  }
+  EXPECT_EQ(TrackedNode::freed, 3U);
+}
+
+/*
+ * Writers keep replacing the node behind a shared pointer and retire the old one, readers dereference whatever they
+ * find under a guard. A node freed too early is a heap-use-after-free under AddressSanitizer, or a wrong magic number
+ * without it. There are fewer slots than threads, so guards also wait for slots.
+ */
+// NOLINTNEXTLINE
+TEST(EpochManagerTest, ConcurrentRetireStressTest) {
+  const int num_readers = 6;
+  const int num_writers = 2;
+  const int writes_per_writer = 10000;
+  const size_t garbage_threshold = 64;
+  TrackedNode::freed = 0;
+  EpochManager epoch_manager(4, garbage_threshold);
+  std::atomic<TrackedNode *> shared{new TrackedNode(0)};
+  std::atomic<bool> done{false};
+  std::atomic<size_t> max_garbage{0};
+
+  std::vector<std::thread> threads;
+  for (int r = 0; r < num_readers; r++) {
+    threads.emplace_back([&] {
+      while (!done) {
+        EpochGuard guard(&epoch_manager);
+        TrackedNode *node = shared.load();
+        ASSERT_EQ(node->magic_, TrackedNode::MAGIC);
+        ASSERT_LE(node->value_, static_cast<uint64_t>(writes_per_writer + 1) * num_writers);
+        // Still not freed while we look at it.
+        ASSERT_EQ(node->magic_, TrackedNode::MAGIC);
+      }
+    });
+  }
+  for (int w = 0; w < num_writers; w++) {
+    threads.emplace_back([&, w] {
+      for (int i = 1; i <= writes_per_writer; i++) {
+        TrackedNode *old_node = shared.exchange(new TrackedNode(static_cast<uint64_t>(i) * num_writers + w));
+        epoch_manager.Retire(old_node);
+        size_t garbage = epoch_manager.GetGarbageCount();
+        size_t seen = max_garbage;
+        while (garbage > seen && !max_garbage.compare_exchange_weak(seen, garbage)) {
+        }
+      }
+    });
+  }
+  for (int w = 0; w < num_writers; w++) {
+    threads[num_readers + w].join();
+  }
+  done = true;
+  for (int r = 0; r < num_readers; r++) {
+    threads[r].join();
+  }
+
+  // Without guards, two epochs later everything retired is gone.
+  epoch_manager.Reclaim();
+  epoch_manager.Reclaim();
+  EXPECT_EQ(epoch_manager.GetGarbageCount(), 0U);
+  EXPECT_EQ(TrackedNode::freed, static_cast<size_t>(num_writers * writes_per_writer));
+  // Every writer waits past twice the threshold, and adds at most one more object before it does.
+  EXPECT_LE(max_garbage, 2 * garbage_threshold + num_writers);
+  LOG_INFO("epoch %d after %d retires, at most %d objects waiting", static_cast<int>(epoch_manager.GetEpoch()),
+           num_writers * writes_per_writer, static_cast<int>(max_garbage.load()));
+  delete shared.load();
+}
+
+}  // namespace bustub
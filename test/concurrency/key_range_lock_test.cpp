@@ -0,0 +1,206 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// key_range_lock_test.cpp
+//
+// Identification: test/concurrency/key_range_lock_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "catalog/catalog.h"
+#include "concurrency/transaction_manager.h"
+#include "execution/execution_engine.h"
+#include "execution/executor_context.h"
+#include "execution/expressions/column_value_expression.h"
+#include "execution/expressions/comparison_expression.h"
+#include "execution/expressions/constant_value_expression.h"
+#include "execution/plans/delete_plan.h"
+#include "execution/plans/index_scan_plan.h"
+#include "execution/plans/insert_plan.h"
+#include "execution/plans/seq_scan_plan.h"
+#include "gtest/gtest.h"
+#include "type/value_factory.h"
+
+namespace bustub {
+
+/** How long a transaction that should wait for a lock is given to get past it anyway. */
+static constexpr std::chrono::milliseconds BLOCK_CHECK_DELAY{100};
+
+class KeyRangeLockTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+    disk_manager_ = new DiskManager("test.db");
+    bpm_ = new BufferPoolManagerInstance(50, disk_manager_);
+    log_manager_ = new LogManager(disk_manager_);
+    lock_manager_ = new LockManager();
+    txn_mgr_ = new TransactionManager(lock_manager_, log_manager_);
+    catalog_ = new Catalog(bpm_, lock_manager_, log_manager_);
+    // The B+ tree keeps its root in the header page.
+    page_id_t header_page_id;
+    bpm_->NewPage(&header_page_id);
+    bpm_->UnpinPage(header_page_id, true);
+    // Transactions lock while logging is enabled.
+    log_manager_->RunFlushThread();
+
+    Transaction *txn = txn_mgr_->Begin();
+    table_info_ = catalog_->CreateTable(txn, "t", schema_);
+    index_info_ = catalog_->CreateIndex<GenericKey<8>, RID, GenericComparator<8>>(
+        txn, "t_a", "t", schema_, key_schema_, {0}, 8, HashFunction<GenericKey<8>>{}, IndexType::BPLUSTREE);
+    txn_mgr_->Commit(txn);
+    delete txn;
+  }
+
+  void TearDown() override {
+    log_manager_->StopFlushThread();
+    delete catalog_;
+    delete txn_mgr_;
+    delete lock_manager_;
+    delete log_manager_;
+    delete bpm_;
+    disk_manager_->ShutDown();
+    delete disk_manager_;
+    remove("test.db");
+    remove("test.log");
+  }
+
+  /** Run a plan in txn. @return the tuples it produced */
+  std::vector<Tuple> Execute(const AbstractPlanNode *plan, Transaction *txn) {
+    ExecutorContext exec_ctx(txn, catalog_, bpm_, txn_mgr_, lock_manager_);
+    ExecutionEngine engine(bpm_, txn_mgr_, catalog_);
+    std::vector<Tuple> result;
+    engine.Execute(plan, &result, txn, &exec_ctx);
+    return result;
+  }
+
+  void Insert(const std::vector<int32_t> &keys, Transaction *txn) {
+    std::vector<std::vector<Value>> rows;
+    for (int32_t key : keys) {
+      rows.push_back({ValueFactory::GetIntegerValue(key), ValueFactory::GetIntegerValue(0)});
+    }
+    InsertPlanNode plan(std::move(rows), table_info_->oid_);
+    Execute(&plan, txn);
+  }
+
+  void Delete(int32_t key, Transaction *txn) {
+    ColumnValueExpression column(0, 0, TypeId::INTEGER);
+    ConstantValueExpression constant(ValueFactory::GetIntegerValue(key));
+    ComparisonExpression predicate(&column, &constant, ComparisonType::Equal);
+    SeqScanPlanNode scan_plan(&schema_, &predicate, table_info_->oid_);
+    DeletePlanNode plan(&scan_plan, table_info_->oid_);
+    Execute(&plan, txn);
+  }
+
+  /** @return the keys in [low, high] that txn finds through the index, in key order */
+  std::vector<int32_t> ScanRange(int32_t low, int32_t high, Transaction *txn) {
+    IndexScanPlanNode plan(&schema_, nullptr, index_info_->index_oid_, {ValueFactory::GetIntegerValue(low)},
+                           {ValueFactory::GetIntegerValue(high)});
+    std::vector<int32_t> keys;
+    for (const Tuple &tuple : Execute(&plan, txn)) {
+      keys.push_back(tuple.GetValue(&schema_, 0).GetAs<int32_t>());
+    }
+    return keys;
+  }
+
+  void InsertCommitted(const std::vector<int32_t> &keys) {
+    Transaction *txn = txn_mgr_->Begin();
+    Insert(keys, txn);
+    txn_mgr_->Commit(txn);
+    delete txn;
+  }
+
+  DiskManager *disk_manager_;
+  BufferPoolManagerInstance *bpm_;
+  LogManager *log_manager_;
+  LockManager *lock_manager_;
+  TransactionManager *txn_mgr_;
+  Catalog *catalog_;
+  TableInfo *table_info_;
+  IndexInfo *index_info_;
+  Schema schema_{std::vector<Column>{{"a", TypeId::INTEGER}, {"b", TypeId::INTEGER}}};
+  Schema key_schema_{std::vector<Column>{{"a", TypeId::INTEGER}}};
+};
+
+/*
+ * A range scanned under REPEATABLE_READ stays as it was until the scan commits: an insert into the range waits for
+ * it, while inserts before and after the range go ahead.
+ */
+// NOLINTNEXTLINE
+TEST_F(KeyRangeLockTest, RangeScanBlocksOnlyInsertsIntoItsRangeTest) {
+  InsertCommitted({10, 20, 30, 40, 50});
+  Transaction *scanner = txn_mgr_->Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+  EXPECT_EQ(ScanRange(15, 35, scanner), (std::vector<int32_t>{20, 30}));
+
+  // Younger writers wait for the older scanner rather than wound it.
+  Transaction *outside = txn_mgr_->Begin();
+  Insert({5, 45, 60}, outside);
+  EXPECT_EQ(outside->GetState(), TransactionState::GROWING);
+  txn_mgr_->Commit(outside);
+  delete outside;
+
+  // The key after the range guards the gap between the last key in the range and the end of the range.
+  std::atomic<bool> inserted{false};
+  std::thread inside([&] {
+    Transaction *txn = txn_mgr_->Begin();
+    Insert({33}, txn);
+    inserted = true;
+    txn_mgr_->Commit(txn);
+    delete txn;
+  });
+  std::this_thread::sleep_for(BLOCK_CHECK_DELAY);
+  EXPECT_FALSE(inserted);
+  // No phantom for the scanner.
+  EXPECT_EQ(ScanRange(15, 35, scanner), (std::vector<int32_t>{20, 30}));
+  EXPECT_EQ(scanner->GetState(), TransactionState::GROWING);
+  txn_mgr_->Commit(scanner);
+  delete scanner;
+  inside.join();
+  EXPECT_TRUE(inserted);
+
+  Transaction *txn = txn_mgr_->Begin();
+  EXPECT_EQ(ScanRange(0, 100, txn), (std::vector<int32_t>{5, 10, 20, 30, 33, 40, 45, 50, 60}));
+  txn_mgr_->Commit(txn);
+  delete txn;
+}
+
+/*
+ * A delete keeps the gap it opens locked until it finishes, and an aborted delete puts the key back into the index.
+ */
+// NOLINTNEXTLINE
+TEST_F(KeyRangeLockTest, DeleteLocksTheGapUntilItFinishesTest) {
+  InsertCommitted({10, 20, 30, 40, 50});
+  // The deleter finds its row with a predicate scan, which takes no table lock under READ_COMMITTED.
+  Transaction *deleter = txn_mgr_->Begin(nullptr, IsolationLevel::READ_COMMITTED);
+  Delete(30, deleter);
+  EXPECT_EQ(deleter->GetState(), TransactionState::GROWING);
+
+  std::atomic<bool> scanned{false};
+  std::vector<int32_t> keys;
+  std::thread scan([&] {
+    Transaction *txn = txn_mgr_->Begin(nullptr, IsolationLevel::REPEATABLE_READ);
+    keys = ScanRange(25, 45, txn);
+    scanned = true;
+    txn_mgr_->Commit(txn);
+    delete txn;
+  });
+  std::this_thread::sleep_for(BLOCK_CHECK_DELAY);
+  EXPECT_FALSE(scanned);
+  txn_mgr_->Abort(deleter);
+  delete deleter;
+  scan.join();
+  EXPECT_EQ(keys, (std::vector<int32_t>{30, 40}));
+}
+
+}  // namespace bustub
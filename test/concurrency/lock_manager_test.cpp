@@ -2,13 +2,20 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
 #include <random>
 #include <thread>  // NOLINT
 
+#include "buffer/buffer_pool_manager_instance.h"
 #include "common/config.h"
+#include "common/logger.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
+#include "logging/common.h"
+#include "storage/table/table_heap.h"
 
 namespace bustub {
 
@@ -204,4 +211,565 @@ void WoundWaitBasicTest() {
 }
 TEST(LockManagerTest, DISABLED_WoundWaitBasicTest) { WoundWaitBasicTest(); }
 
+/*
+ * Every transaction locks rows no other transaction touches, so the only contention left is on the latches of the
+ * lock manager itself. A lock table with a single shard is compared with the default sharding.
+ */
+void DisjointRowsBenchmark() {
+  const int num_threads = 8;
+  const int txns_per_thread = 500;
+  const int rows_per_txn = 16;
+  for (size_t num_shards : {static_cast<size_t>(1), DEFAULT_LOCK_TABLE_SHARDS}) {
+    LockManager lock_mgr{LockManager::DeadlockMode::PREVENTION, num_shards};
+    TransactionManager txn_mgr{&lock_mgr};
+    auto task = [&](int thread) {
+      for (int t = 0; t < txns_per_thread; t++) {
+        Transaction *txn = txn_mgr.Begin();
+        for (int i = 0; i < rows_per_txn; i++) {
+          RID rid{thread, static_cast<uint32_t>(t * rows_per_txn + i)};
+          bool res = i % 2 == 0 ? lock_mgr.LockShared(txn, rid) : lock_mgr.LockExclusive(txn, rid);
+          EXPECT_TRUE(res);
+          if (i % 4 == 0) {
+            EXPECT_TRUE(lock_mgr.LockUpgrade(txn, rid));
+          }
+        }
+        CheckTxnLockSize(txn, rows_per_txn / 4, rows_per_txn * 3 / 4);
+        txn_mgr.Commit(txn);
+        CheckCommitted(txn);
+        CheckTxnLockSize(txn, 0, 0);
+        delete txn;
+      }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back(task, i);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double locks = static_cast<double>(num_threads) * txns_per_thread * (rows_per_txn + rows_per_txn / 4);
+    LOG_INFO("shards=%zu threads=%d %.0f lock requests/s", num_shards, num_threads, locks / elapsed.count());
+  }
+}
+TEST(LockManagerTest, DisjointRowsThroughputBenchmark) { DisjointRowsBenchmark(); }
+
+/*
+ * An older transaction wounds a younger one that waits for a lock, the younger gives up its request right away.
+ */
+void WoundWaitingTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  Transaction *old_txn = txn_mgr.Begin();
+  Transaction *holder = txn_mgr.Begin();
+  Transaction *young_txn = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockShared(holder, rid));
+  std::thread waiter([&] {
+    // Waits for the shared lock of the older holder.
+    EXPECT_FALSE(lock_mgr.LockExclusive(young_txn, rid));
+    CheckAborted(young_txn);
+    CheckTxnLockSize(young_txn, 0, 0);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // The oldest transaction shares the lock with the holder, but wounds the waiting exclusive request.
+  EXPECT_TRUE(lock_mgr.LockShared(old_txn, rid));
+  waiter.join();
+  CheckGrowing(old_txn);
+  CheckGrowing(holder);
+
+  txn_mgr.Abort(young_txn);
+  txn_mgr.Commit(holder);
+  txn_mgr.Commit(old_txn);
+  delete young_txn;
+  delete holder;
+  delete old_txn;
+}
+TEST(LockManagerTest, WoundWaitingTest) { WoundWaitingTest(); }
+
+/*
+ * A wounded transaction that holds the lock and waits for another row is woken up in the queue it waits in.
+ */
+void WoundElsewhereTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID wanted{0, 0};
+  RID other{0, 1};
+  Transaction *old_txn = txn_mgr.Begin();
+  Transaction *holder = txn_mgr.Begin();
+  Transaction *young_txn = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockExclusive(young_txn, wanted));
+  EXPECT_TRUE(lock_mgr.LockExclusive(holder, other));
+  std::thread waiter([&] {
+    // Waits for the older holder of the other row, until the oldest transaction wounds it.
+    EXPECT_FALSE(lock_mgr.LockExclusive(young_txn, other));
+    CheckAborted(young_txn);
+    txn_mgr.Abort(young_txn);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_TRUE(lock_mgr.LockExclusive(old_txn, wanted));
+  waiter.join();
+  CheckGrowing(old_txn);
+  CheckGrowing(holder);
+
+  txn_mgr.Commit(holder);
+  txn_mgr.Commit(old_txn);
+  delete young_txn;
+  delete holder;
+  delete old_txn;
+}
+TEST(LockManagerTest, WoundElsewhereTest) { WoundElsewhereTest(); }
+
+/*
+ * IS and IX are compatible, S waits until IX is gone, and a transaction holding S that asks for IX ends up with SIX.
+ */
+void TableLockTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  table_oid_t oid = 0;
+  Transaction *txn0 = txn_mgr.Begin();
+  Transaction *txn1 = txn_mgr.Begin();
+  Transaction *txn2 = txn_mgr.Begin();
+
+  EXPECT_TRUE(lock_mgr.LockTable(txn0, LockManager::LockMode::INTENTION_SHARED, oid));
+  EXPECT_TRUE(lock_mgr.LockTable(txn1, LockManager::LockMode::INTENTION_EXCLUSIVE, oid));
+  EXPECT_TRUE(lock_mgr.LockExclusive(txn1, RID{0, 0}));
+  std::atomic<bool> granted{false};
+  std::thread reader([&] {
+    EXPECT_TRUE(lock_mgr.LockTable(txn2, LockManager::LockMode::SHARED, oid));
+    granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  txn_mgr.Commit(txn1);
+  reader.join();
+  EXPECT_TRUE(txn2->IsTableSharedLocked(oid));
+  EXPECT_TRUE(txn1->GetIntentionExclusiveTableLockSet()->empty());
+
+  // S covers IS; S and IX combine to SIX, which is still compatible with the IS of txn0.
+  EXPECT_TRUE(lock_mgr.LockTable(txn2, LockManager::LockMode::INTENTION_SHARED, oid));
+  EXPECT_TRUE(txn2->IsTableSharedLocked(oid));
+  EXPECT_TRUE(lock_mgr.LockTable(txn2, LockManager::LockMode::INTENTION_EXCLUSIVE, oid));
+  EXPECT_TRUE(txn2->IsTableSharedIntentionExclusiveLocked(oid));
+  EXPECT_FALSE(txn2->IsTableSharedLocked(oid));
+
+  // Giving up an intention lock does not end the growing phase, giving up a lock that reads the table does.
+  EXPECT_TRUE(lock_mgr.UnlockTable(txn0, oid));
+  CheckGrowing(txn0);
+  EXPECT_TRUE(lock_mgr.UnlockTable(txn2, oid));
+  CheckShrinking(txn2);
+  EXPECT_FALSE(lock_mgr.LockTable(txn2, LockManager::LockMode::INTENTION_SHARED, oid));
+  CheckAborted(txn2);
+
+  txn_mgr.Commit(txn0);
+  txn_mgr.Abort(txn2);
+  delete txn0;
+  delete txn1;
+  delete txn2;
+}
+TEST(LockManagerTest, TableLockTest) { TableLockTest(); }
+
+/*
+ * A table heap locks single rows under an intention lock, and no rows at all when the transaction locked the table.
+ */
+void TableLockGranularityTest() {
+  const int num_tuples = 100;
+  remove("test.db");
+  remove("test.log");
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  auto *log_manager = new LogManager(disk_manager);
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr, log_manager};
+  log_manager->RunFlushThread();
+  Schema schema{std::vector<Column>{{"a", TypeId::VARCHAR, 20}, {"b", TypeId::SMALLINT}}};
+  table_oid_t oid = 0;
+
+  Transaction *txn = txn_mgr.Begin();
+  TableHeap table(bpm, &lock_mgr, log_manager, txn);
+  table.SetTableOid(oid);
+  std::vector<RID> rids(num_tuples);
+  for (auto &rid : rids) {
+    EXPECT_TRUE(table.InsertTuple(ConstructTuple(&schema), &rid, txn));
+  }
+  EXPECT_EQ(txn->GetIntentionExclusiveTableLockSet()->count(oid), 1U);
+  CheckTxnLockSize(txn, 0, num_tuples);
+  txn_mgr.Commit(txn);
+  delete txn;
+
+  // Row by row.
+  txn = txn_mgr.Begin();
+  int count = 0;
+  for (auto it = table.Begin(txn); it != table.End(); ++it) {
+    count++;
+  }
+  EXPECT_EQ(count, num_tuples);
+  EXPECT_EQ(txn->GetIntentionSharedTableLockSet()->count(oid), 1U);
+  CheckTxnLockSize(txn, num_tuples, 0);
+  txn_mgr.Commit(txn);
+  delete txn;
+
+  // A rolled back update is undone under the intention lock and the row lock the transaction holds.
+  txn = txn_mgr.Begin();
+  Tuple before;
+  Tuple after;
+  EXPECT_TRUE(table.GetTuple(rids[2], &before, txn));
+  EXPECT_TRUE(table.UpdateTuple(ConstructTuple(&schema), rids[2], txn));
+  txn_mgr.Abort(txn);
+  delete txn;
+  txn = txn_mgr.Begin();
+  EXPECT_TRUE(table.GetTuple(rids[2], &after, txn));
+  EXPECT_EQ(after.ToString(&schema), before.ToString(&schema));
+  txn_mgr.Commit(txn);
+  delete txn;
+
+  // One lock for the whole table, for reads and for writes.
+  txn = txn_mgr.Begin();
+  EXPECT_TRUE(table.LockTable(txn, LockManager::LockMode::SHARED));
+  count = 0;
+  for (auto it = table.Begin(txn); it != table.End(); ++it) {
+    count++;
+  }
+  EXPECT_EQ(count, num_tuples);
+  CheckTxnLockSize(txn, 0, 0);
+  EXPECT_TRUE(table.LockTable(txn, LockManager::LockMode::EXCLUSIVE));
+  EXPECT_TRUE(txn->IsTableExclusiveLocked(oid));
+  EXPECT_TRUE(table.UpdateTuple(ConstructTuple(&schema), rids[0], txn));
+  EXPECT_TRUE(table.MarkDelete(rids[1], txn));
+  CheckTxnLockSize(txn, 0, 0);
+  txn_mgr.Commit(txn);
+  CheckTxnLockSize(txn, 0, 0);
+  EXPECT_TRUE(txn->GetExclusiveTableLockSet()->empty());
+  delete txn;
+
+  log_manager->StopFlushThread();
+  delete log_manager;
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+TEST(LockManagerTest, TableLockGranularityTest) { TableLockGranularityTest(); }
+
+/*
+ * Past the threshold, the row locks of a transaction on one table turn into a table lock: S for a reader, X for a
+ * writer, SIX for a reader that starts writing rows.
+ */
+void LockEscalationTest() {
+  const size_t threshold = 10;
+  const int num_tuples = 30;
+  remove("test.db");
+  remove("test.log");
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  auto *log_manager = new LogManager(disk_manager);
+  LockManager lock_mgr{};
+  lock_mgr.SetEscalationThreshold(threshold);
+  TransactionManager txn_mgr{&lock_mgr, log_manager};
+  log_manager->RunFlushThread();
+  Schema schema{std::vector<Column>{{"a", TypeId::VARCHAR, 20}, {"b", TypeId::SMALLINT}}};
+  table_oid_t oid = 0;
+
+  // The writer holds the table in X after threshold + 1 inserts, the rest take no locks.
+  Transaction *writer = txn_mgr.Begin();
+  TableHeap table(bpm, &lock_mgr, log_manager, writer);
+  table.SetTableOid(oid);
+  std::vector<RID> rids(num_tuples);
+  for (size_t i = 0; i < rids.size(); i++) {
+    EXPECT_TRUE(table.InsertTuple(ConstructTuple(&schema), &rids[i], writer));
+    if (i < threshold) {
+      CheckTxnLockSize(writer, 0, i + 1);
+    }
+  }
+  EXPECT_TRUE(writer->IsTableExclusiveLocked(oid));
+  CheckTxnLockSize(writer, 0, 0);
+  CheckGrowing(writer);
+  txn_mgr.Commit(writer);
+  delete writer;
+
+  Transaction *reader = txn_mgr.Begin();
+  int count = 0;
+  for (auto it = table.Begin(reader); it != table.End(); ++it) {
+    count++;
+  }
+  EXPECT_EQ(count, num_tuples);
+  EXPECT_TRUE(reader->IsTableSharedLocked(oid));
+  CheckTxnLockSize(reader, 0, 0);
+  CheckGrowing(reader);
+  for (size_t i = 0; i <= threshold; i++) {
+    EXPECT_TRUE(table.UpdateTuple(ConstructTuple(&schema), rids[i], reader));
+    if (i < threshold) {
+      EXPECT_TRUE(reader->IsTableSharedIntentionExclusiveLocked(oid));
+      CheckTxnLockSize(reader, 0, i + 1);
+    }
+  }
+  EXPECT_TRUE(reader->IsTableExclusiveLocked(oid));
+  CheckTxnLockSize(reader, 0, 0);
+  txn_mgr.Commit(reader);
+  delete reader;
+
+  // Without escalation every row keeps its lock.
+  lock_mgr.SetEscalationThreshold(0);
+  reader = txn_mgr.Begin();
+  for (const RID &rid : rids) {
+    Tuple tuple;
+    EXPECT_TRUE(table.GetTuple(rid, &tuple, reader));
+  }
+  EXPECT_TRUE(reader->GetSharedTableLockSet()->empty());
+  CheckTxnLockSize(reader, num_tuples, 0);
+  txn_mgr.Commit(reader);
+  delete reader;
+
+  log_manager->StopFlushThread();
+  delete log_manager;
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+TEST(LockManagerTest, LockEscalationTest) { LockEscalationTest(); }
+
+
+void GraphTest() {
+  LockManager lock_mgr{};
+  std::vector<std::pair<txn_id_t, txn_id_t>> edges{{0, 1}, {1, 2}, {2, 3}, {3, 1}, {4, 0}};
+  for (const auto &[t1, t2] : edges) {
+    lock_mgr.AddEdge(t1, t2);
+  }
+  EXPECT_EQ(lock_mgr.GetEdgeList().size(), edges.size());
+
+  // The cycle 1 -> 2 -> 3 -> 1 is found from 0, its youngest transaction is the victim.
+  txn_id_t victim = INVALID_TXN_ID;
+  EXPECT_TRUE(lock_mgr.HasCycle(&victim));
+  EXPECT_EQ(victim, 3);
+  lock_mgr.RemoveEdge(3, 1);
+  EXPECT_FALSE(lock_mgr.HasCycle(&victim));
+  EXPECT_EQ(lock_mgr.GetEdgeList().size(), edges.size() - 1);
+}
+TEST(LockManagerTest, GraphTest) { GraphTest(); }
+
+/*
+ * Two transactions lock two rows in opposite order. Without prevention both wait, until the detector aborts the
+ * younger one and the older one gets its lock.
+ */
+void DeadlockDetectionTest() {
+  auto interval = cycle_detection_interval;
+  cycle_detection_interval = std::chrono::milliseconds(10);
+  {
+    LockManager lock_mgr{LockManager::DeadlockMode::DETECTION};
+    TransactionManager txn_mgr{&lock_mgr};
+    RID rid0{0, 0};
+    RID rid1{0, 1};
+    Transaction *older = txn_mgr.Begin();
+    Transaction *younger = txn_mgr.Begin();
+    EXPECT_TRUE(lock_mgr.LockExclusive(older, rid0));
+    EXPECT_TRUE(lock_mgr.LockExclusive(younger, rid1));
+
+    std::atomic<bool> older_granted{false};
+    std::thread older_thread([&] {
+      // Waits for the younger transaction, which prevention would have wounded.
+      older_granted = lock_mgr.LockShared(older, rid1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(older_granted);
+    CheckGrowing(younger);
+    EXPECT_EQ(lock_mgr.GetDeadlockStats().deadlocks_, 0U);
+
+    EXPECT_FALSE(lock_mgr.LockShared(younger, rid0));
+    CheckAborted(younger);
+    txn_mgr.Abort(younger);
+    older_thread.join();
+    EXPECT_TRUE(older_granted);
+    CheckGrowing(older);
+    txn_mgr.Commit(older);
+
+    DeadlockStats stats = lock_mgr.GetDeadlockStats();
+    EXPECT_EQ(stats.deadlocks_, 1U);
+    EXPECT_GT(stats.passes_, 0U);
+    EXPECT_LE(stats.last_pass_duration_, stats.max_pass_duration_);
+    LOG_INFO("%d passes, last took %dus, longest %dus", static_cast<int>(stats.passes_),
+             static_cast<int>(stats.last_pass_duration_.count()), static_cast<int>(stats.max_pass_duration_.count()));
+    delete older;
+    delete younger;
+  }
+  cycle_detection_interval = interval;
+}
+TEST(LockManagerTest, DeadlockDetectionTest) { DeadlockDetectionTest(); }
+
+/*
+ * A younger transaction waits for a lock an older one holds, until the older one commits.
+ */
+void WaitForLock(LockManager *lock_mgr, TransactionManager *txn_mgr, const RID &rid) {
+  Transaction *holder = txn_mgr->Begin();
+  Transaction *waiter = txn_mgr->Begin();
+  EXPECT_TRUE(lock_mgr->LockExclusive(holder, rid));
+  std::thread waiter_thread([&] { EXPECT_TRUE(lock_mgr->LockShared(waiter, rid)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  txn_mgr->Commit(holder);
+  waiter_thread.join();
+  txn_mgr->Commit(waiter);
+  delete holder;
+  delete waiter;
+}
+
+/*
+ * Sampling is sparse unless asked for. Every request is sampled here, and waits are counted per row and per table.
+ * With counters for two rows, the row waited for most keeps its exact count, and a row that shows up late takes over
+ * the counters of the coldest one.
+ */
+void ContentionStatsTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  EXPECT_EQ(lock_mgr.GetContentionStats().sample_every_, DEFAULT_CONTENTION_SAMPLE_EVERY);
+  lock_mgr.SetContentionSampling(1, 2);
+  RID hot{0, 0};
+  RID cold{0, 1};
+  RID late{0, 2};
+  for (const RID &rid : {hot, cold, hot, late, hot}) {
+    WaitForLock(&lock_mgr, &txn_mgr, rid);
+  }
+  // Locks that are granted right away are counted, but not as waits.
+  Transaction *txn = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockShared(txn, hot));
+  txn_mgr.Commit(txn);
+  delete txn;
+
+  LockContentionStats stats = lock_mgr.GetContentionStats();
+  EXPECT_EQ(stats.sample_every_, 1U);
+  EXPECT_EQ(stats.requests_, 11U);
+  EXPECT_EQ(stats.all_.waits_, 5U);
+  EXPECT_GE(stats.all_.total_wait_, std::chrono::milliseconds(5 * 10));
+  EXPECT_LE(stats.all_.max_wait_, stats.all_.total_wait_);
+  EXPECT_EQ(stats.all_.max_queue_length_, 2U);
+  ASSERT_EQ(stats.hot_rows_.size(), 2U);
+  EXPECT_EQ(stats.hot_rows_[0].first, hot);
+  EXPECT_EQ(stats.hot_rows_[0].second.waits_, 3U);
+  EXPECT_EQ(stats.hot_rows_[0].second.error_, 0U);
+  EXPECT_EQ(stats.hot_rows_[1].first, late);
+  EXPECT_EQ(stats.hot_rows_[1].second.waits_, 2U);
+  EXPECT_EQ(stats.hot_rows_[1].second.error_, 1U);
+  EXPECT_TRUE(stats.hot_tables_.empty());
+
+  // Table locks are counted per table.
+  table_oid_t oid = 3;
+  Transaction *holder = txn_mgr.Begin();
+  Transaction *waiter = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockTable(holder, LockManager::LockMode::EXCLUSIVE, oid));
+  std::thread waiter_thread(
+      [&] { EXPECT_TRUE(lock_mgr.LockTable(waiter, LockManager::LockMode::INTENTION_SHARED, oid)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  txn_mgr.Commit(holder);
+  waiter_thread.join();
+  txn_mgr.Commit(waiter);
+  delete holder;
+  delete waiter;
+  stats = lock_mgr.GetContentionStats();
+  EXPECT_EQ(stats.all_.waits_, 6U);
+  EXPECT_EQ(stats.hot_rows_.size(), 2U);
+  ASSERT_EQ(stats.hot_tables_.size(), 1U);
+  EXPECT_EQ(stats.hot_tables_[0].first, oid);
+  EXPECT_EQ(stats.hot_tables_[0].second.waits_, 1U);
+
+  lock_mgr.ResetContentionStats();
+  stats = lock_mgr.GetContentionStats();
+  EXPECT_EQ(stats.requests_, 0U);
+  EXPECT_EQ(stats.all_.waits_, 0U);
+  EXPECT_TRUE(stats.hot_rows_.empty());
+  EXPECT_TRUE(stats.hot_tables_.empty());
+}
+TEST(LockManagerTest, ContentionStatsTest) { ContentionStatsTest(); }
+
+/*
+ * Sampling one request in four counts every fourth request of the thread, and sampling can be turned off.
+ */
+void ContentionSamplingTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  for (uint32_t sample_every : {4U, 0U}) {
+    lock_mgr.SetContentionSampling(sample_every);
+    Transaction *txn = txn_mgr.Begin();
+    for (uint32_t i = 0; i < 20; i++) {
+      EXPECT_TRUE(lock_mgr.LockExclusive(txn, RID{1, i}));
+    }
+    txn_mgr.Commit(txn);
+    delete txn;
+    LockContentionStats stats = lock_mgr.GetContentionStats();
+    EXPECT_EQ(stats.sample_every_, sample_every);
+    EXPECT_EQ(stats.requests_, sample_every == 0 ? 0U : 5U);
+    EXPECT_EQ(stats.all_.waits_, 0U);
+  }
+}
+TEST(LockManagerTest, ContentionSamplingTest) { ContentionSamplingTest(); }
+
+/*
+ * Most lock requests go to a few hot rows, the others are spread over many. The instrumentation is run off, on every
+ * request and on a sample of them; the sampled hot rows have to be the hot rows of the workload.
+ */
+void HotRowsBenchmark() {
+  const int num_threads = 8;
+  const int txns_per_thread = 150;
+  const int rows_per_txn = 4;
+  const uint32_t num_hot_rows = 4;
+  const uint32_t num_cold_rows = 1000;
+  for (uint32_t sample_every : {0U, 1U, 16U}) {
+    LockManager lock_mgr{};
+    TransactionManager txn_mgr{&lock_mgr};
+    lock_mgr.SetContentionSampling(sample_every);
+    std::atomic<int> aborts{0};
+    auto task = [&](int thread) {
+      std::mt19937 gen(thread);
+      std::uniform_int_distribution<uint32_t> percent(0, 99);
+      std::uniform_int_distribution<uint32_t> hot_row(0, num_hot_rows - 1);
+      std::uniform_int_distribution<uint32_t> cold_row(num_hot_rows, num_hot_rows + num_cold_rows - 1);
+      for (int t = 0; t < txns_per_thread;) {
+        Transaction *txn = txn_mgr.Begin();
+        bool ok = true;
+        for (int i = 0; ok && i < rows_per_txn; i++) {
+          RID rid{0, percent(gen) < 80 ? hot_row(gen) : cold_row(gen)};
+          ok = txn->IsExclusiveLocked(rid) || lock_mgr.LockExclusive(txn, rid);
+        }
+        if (ok) {
+          txn_mgr.Commit(txn);
+          t++;
+        } else {
+          txn_mgr.Abort(txn);
+          aborts++;
+        }
+        delete txn;
+      }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back(task, i);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    LockContentionStats stats = lock_mgr.GetContentionStats();
+    LOG_INFO("sample_every=%u %.0f txns/s, %d aborts, %d of %d sampled requests waited %dus", sample_every,
+             num_threads * txns_per_thread / elapsed.count(), aborts.load(), static_cast<int>(stats.all_.waits_),
+             static_cast<int>(stats.requests_), static_cast<int>(stats.all_.total_wait_.count()));
+    if (sample_every == 0) {
+      EXPECT_EQ(stats.requests_, 0U);
+      continue;
+    }
+    ASSERT_GE(stats.hot_rows_.size(), num_hot_rows);
+    for (uint32_t i = 0; i < num_hot_rows; i++) {
+      LOG_INFO("  %s: %d waits, %dus, longest %dus", stats.hot_rows_[i].first.ToString().c_str(),
+               static_cast<int>(stats.hot_rows_[i].second.waits_),
+               static_cast<int>(stats.hot_rows_[i].second.total_wait_.count()),
+               static_cast<int>(stats.hot_rows_[i].second.max_wait_.count()));
+      EXPECT_LT(stats.hot_rows_[i].first.GetSlotNum(), num_hot_rows);
+    }
+  }
+}
+TEST(LockManagerTest, HotRowsBenchmark) { HotRowsBenchmark(); }
+
 }  // namespace bustub
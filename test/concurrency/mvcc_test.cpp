@@ -0,0 +1,595 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// mvcc_test.cpp
+//
+// Identification: test/concurrency/mvcc_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "common/logger.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "storage/table/table_heap.h"
+#include "type/value_factory.h"
+
+namespace bustub {
+
+class MvccTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+    disk_manager_ = new DiskManager("test.db");
+    bpm_ = new BufferPoolManagerInstance(50, disk_manager_);
+    log_manager_ = new LogManager(disk_manager_);
+    lock_manager_ = new LockManager();
+    txn_mgr_ = new TransactionManager(lock_manager_, log_manager_);
+    // Writers lock rows while logging is enabled, snapshot readers never do.
+    log_manager_->RunFlushThread();
+    Transaction *txn = txn_mgr_->Begin();
+    table_ = new TableHeap(bpm_, lock_manager_, log_manager_, txn);
+    table_->SetTableOid(0);
+    txn_mgr_->Commit(txn);
+    delete txn;
+  }
+
+  void TearDown() override {
+    log_manager_->StopFlushThread();
+    delete table_;
+    delete txn_mgr_;
+    delete lock_manager_;
+    delete log_manager_;
+    delete bpm_;
+    disk_manager_->ShutDown();
+    delete disk_manager_;
+    remove("test.db");
+    remove("test.log");
+  }
+
+  Tuple MakeTuple(int32_t value) { return Tuple{{ValueFactory::GetIntegerValue(value)}, &schema_}; }
+
+  int32_t ValueOf(const Tuple &tuple) { return tuple.GetValue(&schema_, 0).GetAs<int32_t>(); }
+
+  /** Insert the values in one committed transaction. */
+  std::vector<RID> InsertValues(const std::vector<int32_t> &values) {
+    Transaction *txn = txn_mgr_->Begin();
+    std::vector<RID> rids(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+      EXPECT_TRUE(table_->InsertTuple(MakeTuple(values[i]), &rids[i], txn));
+    }
+    txn_mgr_->Commit(txn);
+    delete txn;
+    return rids;
+  }
+
+  /** @return the values txn sees, in table order */
+  std::vector<int32_t> Scan(Transaction *txn) {
+    std::vector<int32_t> values;
+    for (auto it = table_->Begin(txn); it != table_->End(); ++it) {
+      values.push_back(ValueOf(*it));
+    }
+    return values;
+  }
+
+  Transaction *BeginSnapshot() { return txn_mgr_->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION); }
+
+  DiskManager *disk_manager_;
+  BufferPoolManagerInstance *bpm_;
+  LogManager *log_manager_;
+  LockManager *lock_manager_;
+  TransactionManager *txn_mgr_;
+  TableHeap *table_;
+  Schema schema_{std::vector<Column>{{"a", TypeId::INTEGER}}};
+};
+
+/*
+ * A snapshot sees the table as of its start: neither the writes in flight nor those committed later, while it takes
+ * no locks and the writer is never blocked by it.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, SnapshotReadsTest) {
+  std::vector<RID> rids = InsertValues({0, 1, 2, 3});
+  Transaction *reader = BeginSnapshot();
+  Transaction *writer = txn_mgr_->Begin();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(10), rids[0], writer));
+  EXPECT_TRUE(table_->MarkDelete(rids[1], writer));
+  RID new_rid;
+  EXPECT_TRUE(table_->InsertTuple(MakeTuple(4), &new_rid, writer));
+
+  // The writer holds its exclusive locks, the snapshot reads around them.
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{0, 1, 2, 3}));
+  Tuple tuple;
+  EXPECT_FALSE(table_->GetTuple(new_rid, &tuple, reader));
+  EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+  EXPECT_TRUE(reader->GetIntentionSharedTableLockSet()->empty());
+  // The writer reads its own writes.
+  EXPECT_TRUE(table_->GetTuple(rids[0], &tuple, writer));
+  EXPECT_EQ(ValueOf(tuple), 10);
+  txn_mgr_->Commit(writer);
+  delete writer;
+
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{0, 1, 2, 3}));
+  EXPECT_EQ(reader->GetState(), TransactionState::GROWING);
+  Transaction *later = BeginSnapshot();
+  std::vector<int32_t> values = Scan(later);
+  EXPECT_EQ(values.size(), 4U);
+  EXPECT_EQ(values[0], 10);
+  EXPECT_EQ(values.back(), 4);
+  txn_mgr_->Commit(later);
+  delete later;
+
+  // A rolled back writer leaves nothing behind for anyone.
+  writer = txn_mgr_->Begin();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(20), rids[2], writer));
+  EXPECT_TRUE(table_->MarkDelete(rids[3], writer));
+  txn_mgr_->Abort(writer);
+  delete writer;
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{0, 1, 2, 3}));
+  txn_mgr_->Commit(reader);
+  delete reader;
+  reader = BeginSnapshot();
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{10, 2, 3, 4}));
+  txn_mgr_->Commit(reader);
+  delete reader;
+}
+
+/*
+ * Of two snapshot transactions writing the same row, the second writer is aborted: right away while the first has
+ * not committed yet, and on its write if the first committed after the second's snapshot was taken.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, WriteConflictTest) {
+  std::vector<RID> rids = InsertValues({0, 1, 2});
+  Transaction *t1 = BeginSnapshot();
+  Transaction *t2 = BeginSnapshot();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(10), rids[0], t1));
+  EXPECT_FALSE(table_->UpdateTuple(MakeTuple(20), rids[0], t2));
+  EXPECT_EQ(t2->GetState(), TransactionState::ABORTED);
+  txn_mgr_->Abort(t2);
+  delete t2;
+
+  Transaction *t3 = BeginSnapshot();
+  txn_mgr_->Commit(t1);
+  EXPECT_GT(t1->GetCommitTs(), t3->GetReadTs());
+  delete t1;
+  EXPECT_FALSE(table_->MarkDelete(rids[0], t3));
+  EXPECT_EQ(t3->GetState(), TransactionState::ABORTED);
+  txn_mgr_->Abort(t3);
+  delete t3;
+
+  // Disjoint rows do not conflict, and a snapshot taken after the commit may write the row.
+  Transaction *t4 = BeginSnapshot();
+  Transaction *t5 = BeginSnapshot();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(11), rids[0], t4));
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(21), rids[1], t5));
+  EXPECT_TRUE(table_->MarkDelete(rids[2], t5));
+  txn_mgr_->Commit(t4);
+  txn_mgr_->Commit(t5);
+  delete t4;
+  delete t5;
+  Transaction *reader = BeginSnapshot();
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{11, 21}));
+  txn_mgr_->Commit(reader);
+  delete reader;
+}
+
+/*
+ * Replaced versions are kept while a snapshot older than their replacement runs, and dropped once it finishes.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, GarbageCollectionTest) {
+  const int num_updates = 5;
+  std::vector<RID> rids = InsertValues({0, 1});
+  EXPECT_EQ(table_->GetVersionCount(), 0U);
+
+  Transaction *reader = BeginSnapshot();
+  for (int i = 1; i <= num_updates; i++) {
+    Transaction *writer = txn_mgr_->Begin();
+    EXPECT_TRUE(table_->UpdateTuple(MakeTuple(i), rids[0], writer));
+    txn_mgr_->Commit(writer);
+    delete writer;
+  }
+  EXPECT_EQ(table_->GetVersionCount(), static_cast<size_t>(num_updates));
+  EXPECT_EQ(txn_mgr_->GetWatermark(), reader->GetReadTs());
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{0, 1}));
+
+  // A newer snapshot only holds on to the versions replaced after it began.
+  Transaction *newer = BeginSnapshot();
+  txn_mgr_->Commit(reader);
+  delete reader;
+  EXPECT_EQ(table_->GetVersionCount(), 0U);
+  Transaction *writer = txn_mgr_->Begin();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(100), rids[0], writer));
+  EXPECT_TRUE(table_->MarkDelete(rids[1], writer));
+  txn_mgr_->Commit(writer);
+  delete writer;
+  EXPECT_EQ(table_->GetVersionCount(), 2U);
+  EXPECT_EQ(Scan(newer), (std::vector<int32_t>{num_updates, 1}));
+  txn_mgr_->Commit(newer);
+  delete newer;
+  EXPECT_EQ(table_->GetVersionCount(), 0U);
+  EXPECT_EQ(txn_mgr_->GetWatermark(), txn_mgr_->GetLastCommitTs());
+}
+
+/*
+ * Snapshots that find no free slot are kept in the overflow set, and hold garbage collection back all the same.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, SnapshotSlotOverflowTest) {
+  TransactionManager txn_mgr(lock_manager_, log_manager_, 1);
+  auto update = [&](const RID &rid, int32_t value) {
+    Transaction *writer = txn_mgr.Begin();
+    EXPECT_TRUE(table_->UpdateTuple(MakeTuple(value), rid, writer));
+    txn_mgr.Commit(writer);
+    delete writer;
+  };
+  Transaction *txn = txn_mgr.Begin();
+  RID rid;
+  EXPECT_TRUE(table_->InsertTuple(MakeTuple(0), &rid, txn));
+  txn_mgr.Commit(txn);
+  delete txn;
+
+  Transaction *in_slot = txn_mgr.Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  update(rid, 1);
+  Transaction *overflow = txn_mgr.BeginReadOnly();
+  EXPECT_GT(overflow->GetReadTs(), in_slot->GetReadTs());
+  update(rid, 2);
+  EXPECT_EQ(txn_mgr.GetWatermark(), in_slot->GetReadTs());
+  EXPECT_EQ(table_->GetVersionCount(), 2U);
+
+  // Only the version the overflowing snapshot reads stays.
+  txn_mgr.Commit(in_slot);
+  delete in_slot;
+  EXPECT_EQ(txn_mgr.GetWatermark(), overflow->GetReadTs());
+  EXPECT_EQ(table_->GetVersionCount(), 1U);
+  EXPECT_EQ(Scan(overflow), (std::vector<int32_t>{1}));
+  txn_mgr.Commit(overflow);
+  delete overflow;
+  EXPECT_EQ(txn_mgr.GetWatermark(), txn_mgr.GetLastCommitTs());
+}
+
+/*
+ * A read-only transaction reads a snapshot and holds back garbage collection like any snapshot, but logs nothing,
+ * does not show up among the running transactions, and is aborted by anything but a read.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, ReadOnlyTransactionTest) {
+  std::vector<RID> rids = InsertValues({0, 1});
+  lsn_t next_lsn = log_manager_->GetNextLSN();
+  size_t running = TransactionManager::GetRunningTransactionCount();
+  Transaction *reader = txn_mgr_->BeginReadOnly();
+  EXPECT_TRUE(reader->IsReadOnly());
+  EXPECT_EQ(TransactionManager::GetRunningTransactionCount(), running);
+  EXPECT_TRUE(txn_mgr_->GetActiveTransactionTable().empty());
+
+  Transaction *writer = txn_mgr_->Begin();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(10), rids[0], writer));
+  txn_mgr_->Commit(writer);
+  delete writer;
+  EXPECT_EQ(table_->GetVersionCount(), 1U);
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{0, 1}));
+  Tuple tuple;
+  EXPECT_TRUE(table_->GetTuple(rids[0], &tuple, reader));
+  EXPECT_EQ(ValueOf(tuple), 0);
+  next_lsn = log_manager_->GetNextLSN();
+  EXPECT_TRUE(txn_mgr_->Commit(reader));
+  EXPECT_EQ(reader->GetState(), TransactionState::COMMITTED);
+  delete reader;
+  EXPECT_EQ(log_manager_->GetNextLSN(), next_lsn);
+  // Its commit leaves the versions to the next writing commit, or whoever collects them.
+  EXPECT_EQ(table_->GetVersionCount(), 1U);
+  EXPECT_EQ(txn_mgr_->GarbageCollect(), 1U);
+  EXPECT_EQ(table_->GetVersionCount(), 0U);
+
+  // Writes and lock requests abort it before they touch anything.
+  reader = txn_mgr_->BeginReadOnly();
+  EXPECT_FALSE(table_->UpdateTuple(MakeTuple(20), rids[1], reader));
+  EXPECT_EQ(reader->GetState(), TransactionState::ABORTED);
+  txn_mgr_->Abort(reader);
+  delete reader;
+  reader = txn_mgr_->BeginReadOnly();
+  RID rid;
+  EXPECT_FALSE(table_->InsertTuple(MakeTuple(2), &rid, reader));
+  txn_mgr_->Abort(reader);
+  delete reader;
+  reader = txn_mgr_->BeginReadOnly();
+  EXPECT_FALSE(lock_manager_->LockShared(reader, rids[1]));
+  EXPECT_EQ(reader->GetState(), TransactionState::ABORTED);
+  txn_mgr_->Abort(reader);
+  delete reader;
+  reader = txn_mgr_->BeginReadOnly();
+  EXPECT_FALSE(lock_manager_->LockTable(reader, LockManager::LockMode::INTENTION_SHARED, 0));
+  EXPECT_TRUE(reader->GetIntentionSharedTableLockSet()->empty());
+  // Its sets are its own, whatever a caller adds after the abort stays with it.
+  Transaction *other_reader = txn_mgr_->BeginReadOnly();
+  reader->GetIndexWriteSet()->emplace_back(rids[1], 0, WType::DELETE, Tuple{}, 0, nullptr);
+  EXPECT_TRUE(other_reader->GetIndexWriteSet()->empty());
+  txn_mgr_->Abort(reader);
+  txn_mgr_->Commit(other_reader);
+  delete reader;
+  delete other_reader;
+
+  reader = txn_mgr_->BeginReadOnly();
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{10, 1}));
+  txn_mgr_->Commit(reader);
+  delete reader;
+}
+
+/*
+ * Transfers between accounts keep the total; every snapshot scan must see it while the transfers run.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, ConcurrentTransfersTest) {
+  const int num_accounts = 10;
+  const int balance = 100;
+  const int num_writers = 3;
+  const int transfers_per_writer = 100;
+  std::vector<RID> rids = InsertValues(std::vector<int32_t>(num_accounts, balance));
+
+  std::atomic<int> aborts{0};
+  std::atomic<int> finished{0};
+  std::vector<std::thread> writers;
+  for (int w = 0; w < num_writers; w++) {
+    writers.emplace_back([&, w] {
+      std::mt19937 gen(w);
+      std::uniform_int_distribution<int> account(0, num_accounts - 1);
+      for (int i = 0; i < transfers_per_writer;) {
+        int from = account(gen);
+        int to = (from + 1 + account(gen) % (num_accounts - 1)) % num_accounts;
+        Transaction *txn = BeginSnapshot();
+        Tuple a;
+        Tuple b;
+        bool ok = table_->GetTuple(rids[from], &a, txn) && table_->GetTuple(rids[to], &b, txn) &&
+                  table_->UpdateTuple(MakeTuple(ValueOf(a) - 1), rids[from], txn) &&
+                  table_->UpdateTuple(MakeTuple(ValueOf(b) + 1), rids[to], txn);
+        if (ok && txn->GetState() != TransactionState::ABORTED) {
+          txn_mgr_->Commit(txn);
+          i++;
+        } else {
+          txn_mgr_->Abort(txn);
+          aborts++;
+        }
+        delete txn;
+      }
+      finished++;
+    });
+  }
+  int scans = 0;
+  do {
+    Transaction *reader = BeginSnapshot();
+    int total = 0;
+    for (int32_t value : Scan(reader)) {
+      total += value;
+    }
+    EXPECT_EQ(total, num_accounts * balance);
+    txn_mgr_->Commit(reader);
+    delete reader;
+    scans++;
+  } while (finished < num_writers);
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  LOG_INFO("%d scans, %d aborted transfers", scans, aborts.load());
+  EXPECT_EQ(table_->GetVersionCount(), 0U);
+}
+
+/*
+ * An optimistic transaction reads without locks and keeps its writes to itself until it commits, when it is aborted
+ * if anything it read has changed since.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, OptimisticValidationTest) {
+  std::vector<RID> rids = InsertValues({0, 1, 2});
+  Transaction *t1 = txn_mgr_->Begin();
+  t1->SetOptimistic(true);
+  Tuple tuple;
+  EXPECT_TRUE(table_->GetTuple(rids[0], &tuple, t1));
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(10), rids[0], t1));
+  EXPECT_TRUE(table_->GetTuple(rids[0], &tuple, t1));
+  EXPECT_EQ(ValueOf(tuple), 10);
+  EXPECT_TRUE(t1->GetSharedLockSet()->empty());
+  EXPECT_TRUE(t1->GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(t1->GetIntentionExclusiveTableLockSet()->empty());
+
+  // Nobody else sees the buffered update, t2 reads what t1 read.
+  Transaction *t2 = txn_mgr_->Begin();
+  t2->SetOptimistic(true);
+  EXPECT_EQ(Scan(t2), (std::vector<int32_t>{0, 1, 2}));
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(11), rids[1], t2));
+  EXPECT_TRUE(txn_mgr_->Commit(t1));
+  EXPECT_EQ(t1->GetState(), TransactionState::COMMITTED);
+  delete t1;
+  EXPECT_FALSE(txn_mgr_->Commit(t2));
+  EXPECT_EQ(t2->GetState(), TransactionState::ABORTED);
+  delete t2;
+
+  // A row someone else is writing fails validation as well.
+  Transaction *t3 = txn_mgr_->Begin();
+  t3->SetOptimistic(true);
+  EXPECT_TRUE(table_->GetTuple(rids[2], &tuple, t3));
+  Transaction *writer = txn_mgr_->Begin();
+  EXPECT_TRUE(table_->UpdateTuple(MakeTuple(12), rids[2], writer));
+  EXPECT_TRUE(table_->GetTuple(rids[2], &tuple, t3));
+  EXPECT_EQ(ValueOf(tuple), 2);
+  EXPECT_FALSE(txn_mgr_->Commit(t3));
+  delete t3;
+  txn_mgr_->Commit(writer);
+  delete writer;
+
+  // Deletes are buffered too, and a transaction without conflicts commits.
+  Transaction *t4 = txn_mgr_->Begin();
+  t4->SetOptimistic(true);
+  EXPECT_TRUE(table_->MarkDelete(rids[1], t4));
+  EXPECT_FALSE(table_->GetTuple(rids[1], &tuple, t4));
+  EXPECT_FALSE(table_->UpdateTuple(MakeTuple(13), rids[1], t4));
+  EXPECT_EQ(Scan(t4), (std::vector<int32_t>{10, 12}));
+  EXPECT_TRUE(txn_mgr_->Commit(t4));
+  delete t4;
+  Transaction *reader = BeginSnapshot();
+  EXPECT_EQ(Scan(reader), (std::vector<int32_t>{10, 12}));
+  txn_mgr_->Commit(reader);
+  delete reader;
+}
+
+/*
+ * Short read-modify-write transactions, run once under two-phase locking and once optimistically, on uniformly
+ * distributed keys and on Zipf distributed ones that make a few rows hot. Every transaction reads four rows and
+ * increments two of them; aborted ones are retried.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, OptimisticVersusLockingBenchmark) {
+  const int num_rows = 200;
+  const int num_threads = 4;
+  const int txns_per_thread = 300;
+  const int reads_per_txn = 4;
+  const int writes_per_txn = 2;
+  std::vector<RID> rids = InsertValues(std::vector<int32_t>(num_rows, 0));
+  txn_mgr_->SetAsyncCommit(true);
+
+  // Zipf with theta 0.99 by inverting its cumulative distribution.
+  std::vector<double> zipf_cdf(num_rows);
+  double sum = 0;
+  for (int i = 0; i < num_rows; i++) {
+    sum += 1.0 / std::pow(i + 1, 0.99);
+    zipf_cdf[i] = sum;
+  }
+  for (double &p : zipf_cdf) {
+    p /= sum;
+  }
+
+  int64_t expected_total = 0;
+  for (bool zipf : {false, true}) {
+    for (bool optimistic : {false, true}) {
+      std::atomic<int> aborts{0};
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+          std::mt19937 gen(t);
+          std::uniform_int_distribution<int> uniform(0, num_rows - 1);
+          std::uniform_real_distribution<double> unit(0, 1);
+          auto next_key = [&] {
+            if (!zipf) {
+              return uniform(gen);
+            }
+            return static_cast<int>(std::lower_bound(zipf_cdf.begin(), zipf_cdf.end(), unit(gen)) - zipf_cdf.begin());
+          };
+          for (int i = 0; i < txns_per_thread;) {
+            std::vector<int> keys;
+            while (keys.size() < static_cast<size_t>(reads_per_txn)) {
+              int key = std::min(next_key(), num_rows - 1);
+              if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+                keys.push_back(key);
+              }
+            }
+            Transaction *txn = txn_mgr_->Begin();
+            txn->SetOptimistic(optimistic);
+            std::vector<Tuple> tuples(reads_per_txn);
+            bool ok = true;
+            for (int k = 0; ok && k < reads_per_txn; k++) {
+              ok = table_->GetTuple(rids[keys[k]], &tuples[k], txn);
+            }
+            for (int k = 0; ok && k < writes_per_txn; k++) {
+              ok = table_->UpdateTuple(MakeTuple(ValueOf(tuples[k]) + 1), rids[keys[k]], txn);
+            }
+            if (ok && txn->GetState() != TransactionState::ABORTED) {
+              // An optimistic transaction that fails validation is aborted by Commit.
+              if (txn_mgr_->Commit(txn)) {
+                i++;
+              } else {
+                aborts++;
+              }
+            } else {
+              txn_mgr_->Abort(txn);
+              aborts++;
+            }
+            delete txn;
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      LOG_INFO("%s keys, %s: %d txns in %.1fms, %.0f txns/s, %d aborts", zipf ? "zipf" : "uniform",
+               optimistic ? "OCC" : "2PL", num_threads * txns_per_thread, elapsed.count(),
+               num_threads * txns_per_thread / elapsed.count() * 1000, aborts.load());
+
+      expected_total += num_threads * txns_per_thread * writes_per_txn;
+      Transaction *reader = BeginSnapshot();
+      int64_t total = 0;
+      for (int32_t value : Scan(reader)) {
+        total += value;
+      }
+      EXPECT_EQ(total, expected_total);
+      txn_mgr_->Commit(reader);
+      delete reader;
+    }
+  }
+}
+
+/*
+ * Short read transactions, begun once as snapshot transactions and once read-only. Both read the same snapshot of
+ * four rows; the read-only ones skip the allocations, the log records and the bookkeeping of the others.
+ */
+// NOLINTNEXTLINE
+TEST_F(MvccTest, ReadOnlyVersusSnapshotBenchmark) {
+  const int num_rows = 100;
+  const int num_threads = 4;
+  const int txns_per_thread = 2000;
+  const int reads_per_txn = 4;
+  std::vector<RID> rids = InsertValues(std::vector<int32_t>(num_rows, 1));
+
+  for (bool read_only : {false, true}) {
+    lsn_t next_lsn = log_manager_->GetNextLSN();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t] {
+        std::mt19937 gen(t);
+        std::uniform_int_distribution<int> uniform(0, num_rows - 1);
+        for (int i = 0; i < txns_per_thread; i++) {
+          Transaction *txn = read_only ? txn_mgr_->BeginReadOnly() : BeginSnapshot();
+          int32_t sum = 0;
+          Tuple tuple;
+          for (int k = 0; k < reads_per_txn; k++) {
+            EXPECT_TRUE(table_->GetTuple(rids[uniform(gen)], &tuple, txn));
+            sum += ValueOf(tuple);
+          }
+          EXPECT_EQ(sum, reads_per_txn);
+          EXPECT_TRUE(txn_mgr_->Commit(txn));
+          delete txn;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    LOG_INFO("%s: %d txns in %.1fms, %.0f txns/s, %d log records", read_only ? "read-only" : "snapshot",
+             num_threads * txns_per_thread, elapsed.count(), num_threads * txns_per_thread / elapsed.count() * 1000,
+             static_cast<int>(log_manager_->GetNextLSN() - next_lsn));
+    if (read_only) {
+      EXPECT_EQ(log_manager_->GetNextLSN(), next_lsn);
+    }
+  }
+}
+
+}  // namespace bustub
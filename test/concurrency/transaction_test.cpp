@@ -15,6 +15,7 @@
 #include <memory>
 #include <random>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -253,4 +254,54 @@ TEST_F(TransactionTest, DISABLED_DirtyReadsTest) {
   delete txn2;
 }
 
+/*
+ * Finished transactions leave the registry, from however many threads they run, and the oldest running transaction is
+ * the one that began first.
+ */
+// NOLINTNEXTLINE
+TEST(TransactionRegistryTest, FinishedTransactionsAreForgottenTest) {
+  const int num_threads = 4;
+  const int txns_per_thread = 1000;
+  LockManager lock_manager;
+  TransactionManager txn_mgr(&lock_manager);
+  size_t running = TransactionManager::GetRunningTransactionCount();
+
+  Transaction *oldest = txn_mgr.Begin();
+  Transaction *middle = txn_mgr.Begin();
+  Transaction *youngest = txn_mgr.Begin();
+  EXPECT_EQ(TransactionManager::GetRunningTransactionCount(), running + 3);
+  EXPECT_EQ(TransactionManager::GetOldestActiveTransaction(), oldest->GetTransactionId());
+  EXPECT_EQ(TransactionManager::GetTransaction(middle->GetTransactionId()), middle);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < txns_per_thread; i++) {
+        Transaction *txn = txn_mgr.Begin();
+        EXPECT_EQ(TransactionManager::GetTransaction(txn->GetTransactionId()), txn);
+        if ((i + t) % 2 == 0) {
+          txn_mgr.Commit(txn);
+        } else {
+          txn_mgr.Abort(txn);
+        }
+        delete txn;
+      }
+    });
+  }
+  txn_mgr.Commit(oldest);
+  delete oldest;
+  EXPECT_EQ(TransactionManager::GetOldestActiveTransaction(), middle->GetTransactionId());
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(TransactionManager::GetRunningTransactionCount(), running + 2);
+
+  txn_mgr.Abort(middle);
+  delete middle;
+  EXPECT_EQ(TransactionManager::GetOldestActiveTransaction(), youngest->GetTransactionId());
+  txn_mgr.Commit(youngest);
+  delete youngest;
+  EXPECT_EQ(TransactionManager::GetRunningTransactionCount(), running);
+}
+
 }  // namespace bustub
@@ -0,0 +1,186 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// checkpoint_manager_test.cpp
+//
+// Identification: test/recovery/checkpoint_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "common/config.h"
+#include "common/logger.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/checkpoint_manager.h"
+
+namespace bustub {
+
+class CheckpointManagerTest : public ::testing::Test {
+ protected:
+  static constexpr size_t POOL_SIZE = 64;
+  static constexpr int NUM_DIRTY_PAGES = 48;
+
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+    disk_manager_ = new DiskManager("test.db");
+    log_manager_ = new LogManager(disk_manager_);
+    bpm_ = new BufferPoolManagerInstance(POOL_SIZE, disk_manager_, log_manager_);
+    transaction_manager_ = new TransactionManager(nullptr, log_manager_);
+    checkpoint_manager_ = new CheckpointManager(transaction_manager_, log_manager_, bpm_, disk_manager_);
+    log_manager_->RunFlushThread();
+  }
+
+  void TearDown() override {
+    delete checkpoint_manager_;
+    log_manager_->StopFlushThread();
+    delete transaction_manager_;
+    delete bpm_;
+    delete log_manager_;
+    disk_manager_->ShutDown();
+    delete disk_manager_;
+    remove("test.db");
+    remove("test.log");
+  }
+
+  /** Create pages and leave them dirty in the buffer pool. */
+  void DirtyPages(int count) {
+    for (int i = 0; i < count; i++) {
+      page_id_t page_id;
+      Page *page = bpm_->NewPage(&page_id);
+      ASSERT_NE(page, nullptr);
+      snprintf(page->GetData() + 16, PAGE_SIZE - 16, "page %d", page_id);
+      bpm_->UnpinPage(page_id, true);
+    }
+  }
+
+  /** Re-dirty the pages created by DirtyPages. */
+  void RedirtyPages(int count) {
+    for (page_id_t page_id = 0; page_id < count; page_id++) {
+      Page *page = bpm_->FetchPage(page_id);
+      ASSERT_NE(page, nullptr);
+      page->GetData()[32]++;
+      bpm_->UnpinPage(page_id, true);
+    }
+  }
+
+  DiskManager *disk_manager_;
+  LogManager *log_manager_;
+  BufferPoolManagerInstance *bpm_;
+  TransactionManager *transaction_manager_;
+  CheckpointManager *checkpoint_manager_;
+};
+
+// NOLINTNEXTLINE
+TEST_F(CheckpointManagerTest, PacedWritesSpreadOverCompletionTarget) {
+  DirtyPages(NUM_DIRTY_PAGES);
+
+  // Without an interval the checkpoint writes everything right away.
+  auto start = std::chrono::steady_clock::now();
+  checkpoint_manager_->BeginCheckpoint();
+  auto unpaced = std::chrono::steady_clock::now() - start;
+  CheckpointStats stats = checkpoint_manager_->GetStats();
+  EXPECT_EQ(stats.checkpoints_, 1U);
+  EXPECT_FALSE(stats.in_progress_);
+  EXPECT_EQ(stats.pages_to_write_, static_cast<size_t>(NUM_DIRTY_PAGES));
+  EXPECT_EQ(stats.pages_written_, static_cast<size_t>(NUM_DIRTY_PAGES));
+  EXPECT_LT(unpaced, std::chrono::milliseconds(150));
+
+  // Paced, the writes take about half of the 400ms interval.
+  RedirtyPages(NUM_DIRTY_PAGES);
+  checkpoint_manager_->SetCheckpointInterval(std::chrono::milliseconds(400));
+  checkpoint_manager_->SetCompletionTarget(0.5);
+  start = std::chrono::steady_clock::now();
+  checkpoint_manager_->BeginCheckpoint();
+  auto paced = std::chrono::steady_clock::now() - start;
+  stats = checkpoint_manager_->GetStats();
+  EXPECT_EQ(stats.checkpoints_, 2U);
+  EXPECT_EQ(stats.pages_written_, static_cast<size_t>(NUM_DIRTY_PAGES));
+  EXPECT_GE(paced, std::chrono::milliseconds(180));
+  LOG_INFO("unpaced=%.2fms paced=%.2fms", std::chrono::duration<double, std::milli>(unpaced).count(),
+           std::chrono::duration<double, std::milli>(paced).count());
+
+  // Every page made it to disk and the buffer pool is clean again.
+  std::vector<char> disk_data(PAGE_SIZE);
+  for (page_id_t page_id = 0; page_id < NUM_DIRTY_PAGES; page_id++) {
+    Page *page = bpm_->FetchPage(page_id);
+    disk_manager_->ReadPage(page_id, disk_data.data());
+    EXPECT_EQ(memcmp(disk_data.data(), page->GetData(), PAGE_SIZE), 0);
+    EXPECT_FALSE(page->IsDirty());
+    bpm_->UnpinPage(page_id, false);
+  }
+  std::unordered_map<page_id_t, lsn_t> dirty_page_table;
+  bpm_->GetDirtyPageTable(&dirty_page_table);
+  EXPECT_TRUE(dirty_page_table.empty());
+}
+
+// NOLINTNEXTLINE
+TEST_F(CheckpointManagerTest, CheckpointThreadRunsPeriodically) {
+  DirtyPages(NUM_DIRTY_PAGES);
+  checkpoint_manager_->SetCheckpointInterval(std::chrono::milliseconds(100));
+  checkpoint_manager_->RunCheckpointThread();
+  std::this_thread::sleep_for(std::chrono::milliseconds(450));
+  checkpoint_manager_->StopCheckpointThread();
+
+  CheckpointStats stats = checkpoint_manager_->GetStats();
+  EXPECT_GE(stats.checkpoints_, 2U);
+  EXPECT_FALSE(stats.in_progress_);
+  EXPECT_NE(disk_manager_->GetCheckpointLSN(), INVALID_LSN);
+}
+
+/*
+ * Foreground page reads compete with the checkpoint for the disk. Compare their latency while an unpaced and a paced
+ * checkpoint write back the same number of pages.
+ */
+// NOLINTNEXTLINE
+TEST_F(CheckpointManagerTest, ForegroundReadLatencyBenchmark) {
+  DirtyPages(NUM_DIRTY_PAGES);
+  checkpoint_manager_->BeginCheckpoint();
+
+  for (auto interval : {std::chrono::milliseconds(0), std::chrono::milliseconds(400)}) {
+    RedirtyPages(NUM_DIRTY_PAGES);
+    checkpoint_manager_->SetCheckpointInterval(interval);
+    uint64_t throttled_before = checkpoint_manager_->GetStats().throttled_writes_;
+
+    std::atomic<bool> done{false};
+    std::vector<double> latencies;
+    std::thread reader([&] {
+      std::vector<char> data(PAGE_SIZE);
+      for (page_id_t page_id = 0; !done || latencies.empty(); page_id = (page_id + 1) % NUM_DIRTY_PAGES) {
+        auto start = std::chrono::steady_clock::now();
+        disk_manager_->ReadPage(page_id, data.data());
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+    auto start = std::chrono::steady_clock::now();
+    checkpoint_manager_->BeginCheckpoint();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    done = true;
+    reader.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    CheckpointStats stats = checkpoint_manager_->GetStats();
+    LOG_INFO("interval=%dms checkpoint=%.2fms reads=%zu read p50=%.1fus p99=%.1fus max=%.1fus throttled=%d",
+             static_cast<int>(interval.count()), elapsed.count(), latencies.size(), latencies[latencies.size() / 2],
+             latencies[latencies.size() * 99 / 100], latencies.back(),
+             static_cast<int>(stats.throttled_writes_ - throttled_before));
+    EXPECT_EQ(stats.pages_written_, static_cast<size_t>(NUM_DIRTY_PAGES));
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,264 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// group_commit_test.cpp
+//
+// Identification: test/recovery/group_commit_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "common/bustub_instance.h"
+#include "common/config.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "logging/common.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+#include "storage/table/table_heap.h"
+
+namespace bustub {
+
+/**
+ * Commit latency target of the throughput benchmark. It is far above what group commit needs, so that a loaded host
+ * does not fail it, and far below the periodic flush timeout, which a commit that missed its forced flush waits for.
+ */
+static constexpr auto COMMIT_P99_TARGET = std::chrono::milliseconds(500);
+
+class GroupCommitTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+    // Make the timeout large enough that only forced flushes can satisfy a commit in time.
+    saved_log_timeout_ = log_timeout;
+    log_timeout = std::chrono::seconds(15);
+  }
+
+  void TearDown() override {
+    log_timeout = saved_log_timeout_;
+    remove("test.db");
+    remove("test.log");
+  }
+
+  std::chrono::duration<int64_t> saved_log_timeout_;
+};
+
+// NOLINTNEXTLINE
+TEST_F(GroupCommitTest, CommitWaitsOnlyForItsRecord) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  RID rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, txn));
+
+  auto start = std::chrono::steady_clock::now();
+  bustub_instance->transaction_manager_->Commit(txn);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  // A commit that waited for the periodic flush would take the whole timeout.
+  EXPECT_LT(elapsed, log_timeout);
+  EXPECT_GE(bustub_instance->log_manager_->GetPersistentLSN(), txn->GetPrevLSN());
+
+  delete txn;
+  delete test_table;
+  delete bustub_instance;
+}
+
+// NOLINTNEXTLINE
+TEST_F(GroupCommitTest, AsyncCommitIsDurableWithinLag) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->SetAsyncCommitLag(std::chrono::milliseconds(20));
+  bustub_instance->transaction_manager_->SetAsyncCommit(true);
+  bustub_instance->log_manager_->RunFlushThread();
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  ASSERT_TRUE(txn->IsAsyncCommit());
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  RID rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  lsn_t commit_lsn = txn->GetPrevLSN();
+
+  // The 15s log timeout cannot be what flushes the record, only the commit lag can.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_GE(bustub_instance->log_manager_->GetPersistentLSN(), commit_lsn);
+
+  // A transaction can still opt back into synchronous commit.
+  Transaction *sync_txn = bustub_instance->transaction_manager_->Begin();
+  sync_txn->SetAsyncCommit(false);
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, sync_txn));
+  bustub_instance->transaction_manager_->Commit(sync_txn);
+  EXPECT_GE(bustub_instance->log_manager_->GetPersistentLSN(), sync_txn->GetPrevLSN());
+
+  // Callers that need durability of an asynchronous commit wait on its LSN explicitly.
+  Transaction *async_txn = bustub_instance->transaction_manager_->Begin();
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, async_txn));
+  bustub_instance->transaction_manager_->Commit(async_txn);
+  bustub_instance->log_manager_->WaitUntilPersistent(async_txn->GetPrevLSN());
+  EXPECT_GE(bustub_instance->log_manager_->GetPersistentLSN(), async_txn->GetPrevLSN());
+
+  delete txn;
+  delete sync_txn;
+  delete async_txn;
+  delete test_table;
+  delete bustub_instance;
+}
+
+// NOLINTNEXTLINE
+TEST_F(GroupCommitTest, CommitThroughputBenchmark) {
+  const int txns_per_thread = 200;
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+
+  for (auto [async_commit, num_threads] : std::vector<std::pair<bool, int>>{
+           {false, 1}, {false, 4}, {false, 16}, {true, 1}, {true, 4}, {true, 16}}) {
+    remove("test.db");
+    remove("test.log");
+    auto *bustub_instance = new BustubInstance("test.db");
+    bustub_instance->transaction_manager_->SetAsyncCommit(async_commit);
+    bustub_instance->log_manager_->RunFlushThread();
+
+    Transaction *txn = bustub_instance->transaction_manager_->Begin();
+    auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                     bustub_instance->log_manager_, txn);
+    bustub_instance->transaction_manager_->Commit(txn);
+    delete txn;
+    int flushes_before = bustub_instance->disk_manager_->GetNumFlushes();
+
+    std::vector<std::vector<double>> latencies(num_threads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int tid = 0; tid < num_threads; tid++) {
+      threads.emplace_back([&, tid] {
+        for (int i = 0; i < txns_per_thread; i++) {
+          Transaction *txn = bustub_instance->transaction_manager_->Begin();
+          RID rid;
+          EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, txn));
+          auto commit_start = std::chrono::steady_clock::now();
+          bustub_instance->transaction_manager_->Commit(txn);
+          std::chrono::duration<double, std::milli> commit_time = std::chrono::steady_clock::now() - commit_start;
+          latencies[tid].push_back(commit_time.count());
+          delete txn;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> all;
+    for (auto &thread_latencies : latencies) {
+      all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    int commits = num_threads * txns_per_thread;
+    int flushes = bustub_instance->disk_manager_->GetNumFlushes() - flushes_before;
+    double p99 = all[static_cast<size_t>(all.size() * 0.99)];
+    LOG_INFO("async=%d threads=%d commits/s=%.0f p50=%.3fms p99=%.3fms commits/flush=%.2f", async_commit, num_threads,
+             commits / elapsed.count(), all[all.size() / 2], p99, static_cast<double>(commits) / std::max(flushes, 1));
+
+    // Commits never flush more than once each, and asynchronous ones share the flushes of the durability lag.
+    std::chrono::duration<double, std::milli> target = COMMIT_P99_TARGET;
+    EXPECT_LT(p99, target.count());
+    EXPECT_LE(flushes, commits);
+    if (async_commit) {
+      EXPECT_LT(flushes, commits);
+    }
+
+    delete test_table;
+    delete bustub_instance;
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_F(GroupCommitTest, ConcurrentAppendScalingBenchmark) {
+  const int txns_per_thread = 500;
+  const int inserts_per_txn = 4;
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  const Tuple tuple = ConstructTuple(&schema);
+
+  for (int num_threads : {1, 2, 4, 8, 16, 32}) {
+    remove("test.db");
+    remove("test.log");
+    auto *disk_manager = new DiskManager("test.db");
+    auto *log_manager = new LogManager(disk_manager);
+    log_manager->RunFlushThread();
+
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int tid = 0; tid < num_threads; tid++) {
+      threads.emplace_back([&, tid] {
+        for (int i = 0; i < txns_per_thread; i++) {
+          txn_id_t txn_id = tid * txns_per_thread + i;
+          LogRecord begin(txn_id, INVALID_LSN, LogRecordType::BEGIN);
+          lsn_t prev_lsn = log_manager->AppendLogRecord(&begin);
+          for (int j = 0; j < inserts_per_txn; j++) {
+            LogRecord insert(txn_id, prev_lsn, LogRecordType::INSERT, RID(i, j), tuple);
+            prev_lsn = log_manager->AppendLogRecord(&insert);
+          }
+          LogRecord commit(txn_id, prev_lsn, LogRecordType::COMMIT);
+          log_manager->AppendLogRecord(&commit);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    log_manager->StopFlushThread();
+
+    int num_records = num_threads * txns_per_thread * (inserts_per_txn + 2);
+    LOG_INFO("threads=%d txns/s=%.0f records/s=%.0f", num_threads, num_threads * txns_per_thread / elapsed.count(),
+             num_records / elapsed.count());
+    EXPECT_EQ(log_manager->GetNextLSN(), num_records);
+    EXPECT_EQ(log_manager->GetPersistentLSN(), num_records - 1);
+
+    // Every record must have reached the log intact and in LSN order, with no holes between them.
+    LogRecovery log_recovery(disk_manager, nullptr);
+    std::vector<char> log_data(LOG_BUFFER_SIZE);
+    LogRecord log_record;
+    int offset = 0;
+    for (lsn_t expected_lsn = 0; expected_lsn < num_records; expected_lsn++) {
+      ASSERT_TRUE(disk_manager->ReadLog(log_data.data(), LOG_BUFFER_SIZE, offset));
+      ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data(), &log_record));
+      ASSERT_EQ(log_record.GetLSN(), expected_lsn);
+      offset += log_record.GetSize();
+    }
+    EXPECT_FALSE(disk_manager->ReadLog(log_data.data(), LOG_BUFFER_SIZE, offset));
+
+    delete log_manager;
+    disk_manager->ShutDown();
+    delete disk_manager;
+  }
+}
+
+}  // namespace bustub
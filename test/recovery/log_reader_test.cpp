@@ -0,0 +1,107 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader_test.cpp
+//
+// Identification: test/recovery/log_reader_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/config.h"
+#include "common/logger.h"
+#include "gtest/gtest.h"
+#include "logging/common.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_reader.h"
+
+namespace bustub {
+
+class LogReaderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+  }
+
+  void TearDown() override {
+    remove("test.db");
+    remove("test.log");
+    for (int i = 1; i < 100; i++) {
+      remove(("test.log." + std::to_string(i)).c_str());
+    }
+  }
+};
+
+// NOLINTNEXTLINE
+TEST_F(LogReaderTest, StreamAcrossChunksAndSegments) {
+  const int num_records = 20000;
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  Schema schema{std::vector<Column>{col1, col2}};
+
+  auto *disk_manager = new DiskManager("test.db");
+  // Small segments and the smallest chunk size put plenty of records across both kinds of boundaries.
+  disk_manager->SetLogSegmentSize(LOG_SEGMENT_HEADER_SIZE + 2 * LOG_BUFFER_SIZE);
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  std::vector<int> sizes;
+  for (int i = 0; i < num_records; i++) {
+    LogRecord insert(i % 7, INVALID_LSN, LogRecordType::INSERT, RID(i, i % 50), ConstructTuple(&schema));
+    log_manager->AppendLogRecord(&insert);
+    sizes.push_back(insert.GetSize());
+  }
+  log_manager->StopFlushThread();
+  EXPECT_GT(disk_manager->GetNumLogSegments(), 2);
+
+  std::vector<int> offsets;
+  LogRecord log_record;
+  {
+    LogReader reader(disk_manager, 0, LOG_BUFFER_SIZE);
+    auto start = std::chrono::steady_clock::now();
+    for (lsn_t lsn = 0; lsn < num_records; lsn++) {
+      ASSERT_TRUE(reader.Next(&log_record));
+      ASSERT_EQ(log_record.GetLSN(), lsn);
+      ASSERT_EQ(log_record.GetSize(), sizes[lsn]);
+      ASSERT_EQ(log_record.GetInsertRID(), RID(lsn, lsn % 50));
+      offsets.push_back(reader.GetRecordOffset());
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_FALSE(reader.Next(&log_record));
+    EXPECT_FALSE(reader.Next(&log_record));
+    LOG_INFO("decoded %d records in %.2fms", num_records, elapsed.count());
+  }
+
+  // Walk backwards like undo does, and jump around at random.
+  LogReader reader(disk_manager, 0, 2 * LOG_BUFFER_SIZE);
+  for (lsn_t lsn = num_records - 1; lsn >= 0; lsn -= 13) {
+    reader.Seek(offsets[lsn]);
+    ASSERT_TRUE(reader.Next(&log_record));
+    ASSERT_EQ(log_record.GetLSN(), lsn);
+  }
+  std::mt19937 generator(15445);
+  for (int i = 0; i < 1000; i++) {
+    lsn_t lsn = generator() % num_records;
+    reader.Seek(offsets[lsn]);
+    ASSERT_TRUE(reader.Next(&log_record));
+    ASSERT_EQ(log_record.GetLSN(), lsn);
+    if (lsn + 1 < num_records) {
+      ASSERT_TRUE(reader.Next(&log_record));
+      ASSERT_EQ(log_record.GetLSN(), lsn + 1);
+    }
+  }
+
+  delete log_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+}
+
+}  // namespace bustub
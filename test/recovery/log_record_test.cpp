@@ -0,0 +1,203 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_record_test.cpp
+//
+// Identification: test/recovery/log_record_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common/bustub_instance.h"
+#include "common/config.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "logging/common.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+#include "storage/table/table_heap.h"
+
+namespace bustub {
+
+class LogRecordTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    remove("test.db");
+    remove("test.log");
+  }
+
+  void TearDown() override {
+    remove("test.db");
+    remove("test.log");
+  }
+};
+
+static Tuple MakeRow(Schema *schema, int32_t id, int32_t counter) {
+  std::vector<Value> values{Value(TypeId::INTEGER, id), Value(TypeId::INTEGER, counter),
+                            Value(TypeId::VARCHAR, std::string(32, static_cast<char>('a' + id % 26))),
+                            Value(TypeId::BIGINT, static_cast<int64_t>(id) * 1000)};
+  return Tuple(values, schema);
+}
+
+// NOLINTNEXTLINE
+TEST_F(LogRecordTest, EncodeDecodeRoundTrip) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+
+  Column col_a{"a", TypeId::INTEGER};
+  Column col_b{"b", TypeId::INTEGER};
+  Column col_c{"c", TypeId::VARCHAR, 40};
+  Column col_d{"d", TypeId::BIGINT};
+  Schema schema{std::vector<Column>{col_a, col_b, col_c, col_d}};
+  Tuple old_tuple = MakeRow(&schema, 7, 1);
+  Tuple new_tuple = MakeRow(&schema, 7, 1000000);
+
+  // Push the LSNs and ids past the one-byte varint range so the multi-byte paths are exercised as well.
+  txn_id_t txn_id = 300;
+  for (int i = 0; i < 200; i++) {
+    LogRecord filler(txn_id, INVALID_LSN, LogRecordType::BEGIN);
+    log_manager->AppendLogRecord(&filler);
+  }
+  LogRecord begin(txn_id, INVALID_LSN, LogRecordType::BEGIN);
+  lsn_t begin_lsn = log_manager->AppendLogRecord(&begin);
+  LogRecord new_page(txn_id, begin_lsn, LogRecordType::NEWPAGE, INVALID_PAGE_ID, 130);
+  lsn_t new_page_lsn = log_manager->AppendLogRecord(&new_page);
+  LogRecord insert(txn_id, new_page_lsn, LogRecordType::INSERT, RID(130, 200), old_tuple);
+  lsn_t insert_lsn = log_manager->AppendLogRecord(&insert);
+  LogRecord update(txn_id, insert_lsn, LogRecordType::UPDATE, RID(130, 200), old_tuple, new_tuple);
+  lsn_t update_lsn = log_manager->AppendLogRecord(&update);
+  LogRecord mark_delete(txn_id, update_lsn, LogRecordType::MARKDELETE, RID(130, 200), new_tuple);
+  lsn_t mark_delete_lsn = log_manager->AppendLogRecord(&mark_delete);
+  LogRecord commit(txn_id, mark_delete_lsn, LogRecordType::COMMIT);
+  log_manager->AppendLogRecord(&commit);
+  log_manager->StopFlushThread();
+
+  // An unchanged-length update should only log the bytes that differ.
+  EXPECT_LT(update.GetSize(), insert.GetSize() + 8);
+
+  LogRecovery log_recovery(disk_manager, nullptr);
+  std::vector<char> log_data(LOG_BUFFER_SIZE);
+  ASSERT_TRUE(disk_manager->ReadLog(log_data.data(), LOG_BUFFER_SIZE, 0));
+  LogRecord log_record;
+  int offset = 0;
+  for (int i = 0; i < 200; i++) {
+    ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+    offset += log_record.GetSize();
+  }
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::BEGIN);
+  EXPECT_EQ(log_record.GetLSN(), begin_lsn);
+  EXPECT_EQ(log_record.GetTxnId(), txn_id);
+  EXPECT_EQ(log_record.GetPrevLSN(), INVALID_LSN);
+  offset += log_record.GetSize();
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::NEWPAGE);
+  EXPECT_EQ(log_record.GetPrevLSN(), begin_lsn);
+  EXPECT_EQ(log_record.GetNewPageRecord(), INVALID_PAGE_ID);
+  EXPECT_EQ(log_record.GetNewPageId(), 130);
+  offset += log_record.GetSize();
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::INSERT);
+  EXPECT_EQ(log_record.GetInsertRID(), RID(130, 200));
+  EXPECT_EQ(log_record.GetInsertTuple().ToString(&schema), old_tuple.ToString(&schema));
+  offset += log_record.GetSize();
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::UPDATE);
+  EXPECT_EQ(log_record.GetLSN(), update_lsn);
+  EXPECT_EQ(log_record.GetPrevLSN(), insert_lsn);
+  EXPECT_EQ(log_record.GetSize(), update.GetSize());
+  EXPECT_EQ(log_record.GetUpdateRID(), RID(130, 200));
+  EXPECT_EQ(log_record.GetOriginalTuple().ToString(&schema), old_tuple.ToString(&schema));
+  EXPECT_EQ(log_record.GetUpdateTuple().ToString(&schema), new_tuple.ToString(&schema));
+  offset += log_record.GetSize();
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::MARKDELETE);
+  EXPECT_EQ(log_record.GetDeleteRID(), RID(130, 200));
+  offset += log_record.GetSize();
+
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_EQ(log_record.GetLogRecordType(), LogRecordType::COMMIT);
+  EXPECT_EQ(log_record.GetPrevLSN(), mark_delete_lsn);
+  offset += log_record.GetSize();
+
+  // The zero-filled tail is not a record, and neither is a truncated one.
+  EXPECT_FALSE(log_recovery.DeserializeLogRecord(log_data.data() + offset, &log_record));
+  EXPECT_FALSE(log_recovery.DeserializeLogRecord(log_data.data() + offset - commit.GetSize(), &log_record,
+                                                 commit.GetSize() - 1));
+
+  delete log_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST_F(LogRecordTest, UpdateHeavyLogVolumeBenchmark) {
+  const int num_rows = 100;
+  const int num_txns = 500;
+  const int updates_per_txn = 8;
+
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->transaction_manager_->SetAsyncCommit(true);
+  bustub_instance->log_manager_->RunFlushThread();
+
+  Column col_a{"a", TypeId::INTEGER};
+  Column col_b{"b", TypeId::INTEGER};
+  Column col_c{"c", TypeId::VARCHAR, 40};
+  Column col_d{"d", TypeId::BIGINT};
+  Schema schema{std::vector<Column>{col_a, col_b, col_c, col_d}};
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  std::vector<RID> rids(num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    ASSERT_TRUE(test_table->InsertTuple(MakeRow(&schema, i, 0), &rids[i], txn));
+  }
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  bustub_instance->log_manager_->WaitUntilPersistent(bustub_instance->log_manager_->GetNextLSN() - 1);
+  std::ifstream load_log("test.log", std::ios::binary | std::ios::ate);
+  int64_t load_bytes = load_log.tellg();
+
+  // The legacy layout used a 20 byte header, an 8 byte RID and both tuples in full with 4 byte length prefixes.
+  int64_t legacy_bytes = 0;
+  for (int t = 0; t < num_txns; t++) {
+    txn = bustub_instance->transaction_manager_->Begin();
+    legacy_bytes += 20;
+    for (int u = 0; u < updates_per_txn; u++) {
+      int row = (t * updates_per_txn + u) % num_rows;
+      Tuple new_tuple = MakeRow(&schema, row, t + 1);
+      ASSERT_TRUE(test_table->UpdateTuple(new_tuple, rids[row], txn));
+      legacy_bytes += 20 + 8 + 2 * (4 + new_tuple.GetLength());
+    }
+    bustub_instance->transaction_manager_->Commit(txn);
+    legacy_bytes += 20;
+    delete txn;
+  }
+  bustub_instance->log_manager_->WaitUntilPersistent(bustub_instance->log_manager_->GetNextLSN() - 1);
+  std::ifstream log("test.log", std::ios::binary | std::ios::ate);
+  int64_t compact_bytes = static_cast<int64_t>(log.tellg()) - load_bytes;
+
+  LOG_INFO("update-heavy: log bytes/txn compact=%.1f legacy=%.1f (%.1f%% of legacy)",
+           static_cast<double>(compact_bytes) / num_txns, static_cast<double>(legacy_bytes) / num_txns,
+           100.0 * compact_bytes / legacy_bytes);
+  EXPECT_LT(compact_bytes, legacy_bytes / 2);
+
+  delete test_table;
+  delete bustub_instance;
+}
+
+}  // namespace bustub
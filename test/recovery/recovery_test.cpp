@@ -10,6 +10,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <chrono>  // NOLINT
+#include <filesystem>
 #include <string>
 #include <vector>
 
@@ -17,12 +19,17 @@
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction_manager.h"
+#include "container/hash/extendible_hash_table.h"
 #include "gtest/gtest.h"
 #include "logging/common.h"
+#include "recovery/log_reader.h"
 #include "recovery/log_recovery.h"
+#include "storage/index/b_plus_tree.h"
+#include "storage/page/header_page.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/table_iterator.h"
 #include "storage/table/tuple.h"
+#include "test_util.h"  // NOLINT
 
 namespace bustub {
 
@@ -39,6 +46,9 @@ class RecoveryTest : public ::testing::Test {
     LOG_INFO("Tearing down the system..");
     remove("test.db");
     remove("test.log");
+    for (int i = 1; i < 10; i++) {
+      remove(("test.log." + std::to_string(i)).c_str());
+    }
   };
 };
 
@@ -314,4 +324,390 @@ TEST_F(RecoveryTest, DISABLED_CheckpointTest) {
   LOG_INFO("Shutdown System");
   delete bustub_instance;
 }
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, CheckpointTruncationTest) {
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  RID before_checkpoint_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &before_checkpoint_rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // Continue the log in a new segment, so the records above are in a segment of their own.
+  lsn_t checkpoint_lsn = bustub_instance->log_manager_->GetNextLSN();
+  bustub_instance->log_manager_->WaitUntilPersistent(checkpoint_lsn - 1);
+  bustub_instance->disk_manager_->StartLogSegment(checkpoint_lsn);
+  EXPECT_EQ(bustub_instance->disk_manager_->GetNumLogSegments(), 2);
+
+  LOG_INFO("Checkpoint truncates the log");
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  EXPECT_EQ(bustub_instance->disk_manager_->GetNumLogSegments(), 1);
+  EXPECT_EQ(bustub_instance->disk_manager_->GetLogStartLSN(), checkpoint_lsn);
+  EXPECT_GT(bustub_instance->disk_manager_->GetCheckpointLSN(), checkpoint_lsn);
+  int checkpoint_offset = bustub_instance->disk_manager_->GetLogStartOffset();
+  EXPECT_GT(checkpoint_offset, 0);
+
+  txn = bustub_instance->transaction_manager_->Begin();
+  RID committed_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &committed_rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  txn = bustub_instance->transaction_manager_->Begin();
+  RID loser_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &loser_rid, txn));
+  bustub_instance->log_manager_->WaitUntilPersistent(txn->GetPrevLSN());
+  delete txn;
+  delete test_table;
+
+  LOG_INFO("System crash before the loser commits");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+
+  // The records before the checkpoint are gone, recovery only sees the checkpoint's segment.
+  char buf[16];
+  EXPECT_FALSE(bustub_instance->disk_manager_->ReadLog(buf, sizeof(buf), 0));
+  EXPECT_EQ(bustub_instance->disk_manager_->GetLogStartOffset(), checkpoint_offset);
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple tuple;
+  EXPECT_TRUE(test_table->GetTuple(before_checkpoint_rid, &tuple, txn));
+  EXPECT_TRUE(test_table->GetTuple(committed_rid, &tuple, txn));
+  EXPECT_FALSE(test_table->GetTuple(loser_rid, &tuple, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+
+  delete txn;
+  delete test_table;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, FuzzyCheckpointTest) {
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  RID old_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &old_rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  lsn_t next_lsn = bustub_instance->log_manager_->GetNextLSN();
+  bustub_instance->log_manager_->WaitUntilPersistent(next_lsn - 1);
+  bustub_instance->disk_manager_->StartLogSegment(next_lsn);
+
+  // Both transactions are still running during the checkpoint. A blocking checkpoint would wait for them forever.
+  Transaction *loser = bustub_instance->transaction_manager_->Begin();
+  lsn_t loser_begin_lsn = loser->GetPrevLSN();
+  RID loser_rid_1;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &loser_rid_1, loser));
+  Transaction *winner = bustub_instance->transaction_manager_->Begin();
+  RID winner_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &winner_rid, winner));
+
+  LOG_INFO("Checkpoint with active transactions");
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  // The loser may have to be undone, so its BEGIN record must survive truncation.
+  EXPECT_EQ(bustub_instance->disk_manager_->GetNumLogSegments(), 1);
+  EXPECT_LE(bustub_instance->disk_manager_->GetLogStartLSN(), loser_begin_lsn);
+
+  // The checkpoint logged both transactions and the pages that were pinned while it ran.
+  lsn_t checkpoint_lsn = bustub_instance->disk_manager_->GetCheckpointLSN();
+  ASSERT_NE(checkpoint_lsn, INVALID_LSN);
+  LogReader reader(bustub_instance->disk_manager_, bustub_instance->disk_manager_->GetLogStartOffset());
+  LogRecord log_record;
+  while (reader.Next(&log_record) && log_record.GetLSN() != checkpoint_lsn) {
+  }
+  ASSERT_EQ(log_record.GetLogRecordType(), LogRecordType::CHECKPOINT_END);
+  EXPECT_EQ(log_record.GetActiveTransactionTable().size(), 2U);
+
+  RID loser_rid_2;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &loser_rid_2, loser));
+  bustub_instance->transaction_manager_->Commit(winner);
+  txn = bustub_instance->transaction_manager_->Begin();
+  RID new_rid;
+  ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &new_rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  bustub_instance->log_manager_->WaitUntilPersistent(loser->GetPrevLSN());
+  delete txn;
+  delete winner;
+  delete loser;
+  delete test_table;
+
+  LOG_INFO("System crash before the loser commits");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple tuple;
+  EXPECT_TRUE(test_table->GetTuple(old_rid, &tuple, txn));
+  EXPECT_TRUE(test_table->GetTuple(winner_rid, &tuple, txn));
+  EXPECT_TRUE(test_table->GetTuple(new_rid, &tuple, txn));
+  EXPECT_FALSE(test_table->GetTuple(loser_rid_1, &tuple, txn));
+  EXPECT_FALSE(test_table->GetTuple(loser_rid_2, &tuple, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+
+  delete txn;
+  delete test_table;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, ParallelRedoTest) {
+  const int num_txns = 40;
+  const int inserts_per_txn = 100;
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+
+  // Inserts, in-place updates and deletes spread over many more pages than the buffer pool holds.
+  for (int t = 0; t < num_txns; t++) {
+    txn = bustub_instance->transaction_manager_->Begin();
+    std::vector<RID> rids(inserts_per_txn);
+    for (auto &rid : rids) {
+      ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, txn));
+    }
+    for (int i = 0; i < inserts_per_txn; i += 3) {
+      Tuple tuple;
+      ASSERT_TRUE(test_table->GetTuple(rids[i], &tuple, txn));
+      std::vector<Value> values{tuple.GetValue(&schema, 0), Value(TypeId::SMALLINT, static_cast<int16_t>(t))};
+      test_table->UpdateTuple(Tuple(values, &schema), rids[i], txn);
+    }
+    for (int i = 1; i < inserts_per_txn; i += 7) {
+      ASSERT_TRUE(test_table->MarkDelete(rids[i], txn));
+    }
+    bustub_instance->transaction_manager_->Commit(txn);
+    delete txn;
+  }
+  delete test_table;
+
+  LOG_INFO("System crash");
+  delete bustub_instance;
+  std::filesystem::copy_file("test.db", "test.db.crash", std::filesystem::copy_options::overwrite_existing);
+  std::filesystem::copy_file("test.log", "test.log.crash", std::filesystem::copy_options::overwrite_existing);
+
+  // Recover the same crash image serially and in parallel, both must produce the same table.
+  std::vector<std::vector<std::string>> contents;
+  for (int redo_threads : {0, 1, 4}) {
+    std::filesystem::copy_file("test.db.crash", "test.db", std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::copy_file("test.log.crash", "test.log", std::filesystem::copy_options::overwrite_existing);
+    bustub_instance = new BustubInstance("test.db");
+    auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+    log_recovery->SetRedoThreads(redo_threads);
+    auto start = std::chrono::steady_clock::now();
+    log_recovery->Redo();
+    std::chrono::duration<double, std::milli> redo_time = std::chrono::steady_clock::now() - start;
+    log_recovery->Undo();
+    LOG_INFO("redo threads=%d redo time=%.2fms", redo_threads, redo_time.count());
+
+    txn = bustub_instance->transaction_manager_->Begin();
+    test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                               bustub_instance->log_manager_, first_page_id);
+    std::vector<std::string> content;
+    for (auto it = test_table->Begin(txn); it != test_table->End(); ++it) {
+      content.push_back(it->GetRid().ToString() + it->ToString(&schema));
+    }
+    bustub_instance->transaction_manager_->Commit(txn);
+    contents.push_back(std::move(content));
+
+    delete txn;
+    delete test_table;
+    delete log_recovery;
+    delete bustub_instance;
+  }
+  EXPECT_EQ(contents[0].size(), num_txns * (inserts_per_txn - (inserts_per_txn + 5) / 7));
+  EXPECT_EQ(contents[0], contents[1]);
+  EXPECT_EQ(contents[0], contents[2]);
+
+  remove("test.db.crash");
+  remove("test.log.crash");
+}
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, HashIndexRecoveryTest) {
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>(
+      "index", bustub_instance->buffer_pool_manager_, IntComparator(), HashFunction<int>(), bustub_instance->log_manager_);
+
+  // Enough keys to split the buckets a few times, remove them all again so the buckets merge, and keep a few.
+  Transaction *winner = bustub_instance->transaction_manager_->Begin();
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_TRUE(ht->Insert(winner, i, i));
+  }
+  uint32_t global_depth = ht->GetGlobalDepth();
+  EXPECT_GT(global_depth, 1U);
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_TRUE(ht->Remove(winner, i, i));
+  }
+  EXPECT_LT(ht->GetGlobalDepth(), global_depth);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(ht->Insert(winner, i, i));
+  }
+  bustub_instance->transaction_manager_->Commit(winner);
+
+  // The loser splits buckets further, which moves the winner's entries around, and removes some of them.
+  Transaction *loser = bustub_instance->transaction_manager_->Begin();
+  for (int i = 1000; i < 5000; i++) {
+    ASSERT_TRUE(ht->Insert(loser, i, i));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(ht->Remove(loser, i, i));
+  }
+  EXPECT_GT(ht->GetGlobalDepth(), global_depth);
+  bustub_instance->log_manager_->WaitUntilPersistent(loser->GetPrevLSN());
+  page_id_t directory_page_id = ht->GetDirectoryPageId();
+  delete winner;
+  delete loser;
+  delete ht;
+
+  LOG_INFO("System crash before the loser commits");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  // The index is recovered in place instead of being rebuilt from the table.
+  ht = new ExtendibleHashTable<int, int, IntComparator>("index", bustub_instance->buffer_pool_manager_, IntComparator(),
+                                                        HashFunction<int>(), nullptr, directory_page_id);
+  ht->VerifyIntegrity();
+  for (int i = 0; i < 5000; i++) {
+    std::vector<int> result;
+    ht->GetValue(nullptr, i, &result);
+    if (i < 1000) {
+      ASSERT_EQ(result.size(), 1U) << "lost key " << i;
+      EXPECT_EQ(result[0], i);
+    } else {
+      EXPECT_TRUE(result.empty()) << "unexpected key " << i;
+    }
+  }
+
+  delete ht;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, BPlusTreeIndexRecoveryTest) {
+  using Tree = BPlusTree<GenericKey<8>, RID, GenericComparator<8>>;
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  // The default max sizes, as many entries as fit into a page.
+  const int leaf_max_size = (PAGE_SIZE - LEAF_PAGE_HEADER_SIZE) / sizeof(std::pair<GenericKey<8>, RID>);
+  const int internal_max_size = (PAGE_SIZE - INTERNAL_PAGE_HEADER_SIZE) / sizeof(std::pair<GenericKey<8>, page_id_t>);
+  auto key_of = [](int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  };
+
+  BustubInstance *bustub_instance = new BustubInstance("test.db");
+  page_id_t header_page_id;
+  bustub_instance->buffer_pool_manager_->NewPage(&header_page_id);
+  ASSERT_EQ(header_page_id, HEADER_PAGE_ID);
+  bustub_instance->buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+  bustub_instance->log_manager_->RunFlushThread();
+  auto *tree = new Tree("index", bustub_instance->buffer_pool_manager_, comparator, leaf_max_size, internal_max_size,
+                        bustub_instance->log_manager_);
+
+  // Enough keys to split the root leaf, remove most of them again so the leaves merge back into one.
+  Transaction *winner = bustub_instance->transaction_manager_->Begin();
+  for (int64_t key = 0; key < 1000; key++) {
+    ASSERT_TRUE(tree->Insert(key_of(key), RID(key), winner));
+  }
+  for (int64_t key = 200; key < 1000; key++) {
+    tree->Remove(key_of(key), winner);
+  }
+  bustub_instance->transaction_manager_->Commit(winner);
+
+  // The loser removes some of the winner's keys and splits the leaf again. The buffer pool hands out page ids from
+  // the start again after a restart, so undo must not split: it puts back fewer keys than the winner left.
+  Transaction *loser = bustub_instance->transaction_manager_->Begin();
+  for (int64_t key = 0; key < 50; key++) {
+    tree->Remove(key_of(key), loser);
+  }
+  for (int64_t key = 1000; key < 3000; key++) {
+    ASSERT_TRUE(tree->Insert(key_of(key), RID(key), loser));
+  }
+  bustub_instance->log_manager_->WaitUntilPersistent(loser->GetPrevLSN());
+  delete winner;
+  delete loser;
+  delete tree;
+
+  LOG_INFO("System crash before the loser commits");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+
+  // The index is recovered in place instead of being rebuilt from the table, from the root redo put in the header.
+  auto *header_page = static_cast<HeaderPage *>(bustub_instance->buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  page_id_t root_page_id;
+  ASSERT_TRUE(header_page->GetRootId("index", &root_page_id));
+  bustub_instance->buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  tree = new Tree("index", bustub_instance->buffer_pool_manager_, comparator, leaf_max_size, internal_max_size, nullptr,
+                  root_page_id);
+  log_recovery->RegisterIndex("index", [tree](LogRecord *log_record) { tree->UndoLogRecord(log_record); });
+  log_recovery->Undo();
+
+  for (int64_t key = 0; key < 3000; key++) {
+    std::vector<RID> result;
+    tree->GetValue(key_of(key), &result);
+    if (key < 200) {
+      ASSERT_EQ(result.size(), 1U) << "lost key " << key;
+      EXPECT_EQ(result[0].GetSlotNum(), key);
+    } else {
+      EXPECT_TRUE(result.empty()) << "unexpected key " << key;
+    }
+  }
+  int64_t expected = 0;
+  for (auto it = tree->Begin(); !it.IsEnd(); ++it) {
+    EXPECT_EQ((*it).second.GetSlotNum(), expected++);
+  }
+  EXPECT_EQ(expected, 200);
+
+  delete tree;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
 }  // namespace bustub
@@ -0,0 +1,220 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// standby_manager_test.cpp
+//
+// Identification: test/recovery/standby_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/bustub_instance.h"
+#include "common/config.h"
+#include "common/logger.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "logging/common.h"
+#include "recovery/log_recovery.h"
+#include "recovery/standby_manager.h"
+#include "storage/table/table_heap.h"
+#include "storage/table/table_iterator.h"
+
+namespace bustub {
+
+class StandbyManagerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    RemoveFiles();
+    std::filesystem::create_directory("standby");
+    primary_ = new BustubInstance("test.db");
+    standby_ = new BustubInstance("standby/test.db");
+    standby_manager_ = new StandbyManager("test.db", standby_->disk_manager_, standby_->buffer_pool_manager_,
+                                          standby_->log_manager_);
+    primary_->log_manager_->RunFlushThread();
+  }
+
+  void TearDown() override {
+    table_.reset();
+    delete primary_;
+    delete standby_manager_;
+    delete standby_;
+    RemoveFiles();
+  }
+
+  void RemoveFiles() {
+    remove("test.db");
+    remove("test.log");
+    std::filesystem::remove_all("standby");
+  }
+
+  /** Create a table on the primary. */
+  void CreateTable() {
+    Transaction *txn = primary_->transaction_manager_->Begin();
+    table_ = std::make_unique<TableHeap>(primary_->buffer_pool_manager_, primary_->lock_manager_,
+                                         primary_->log_manager_, txn);
+    first_page_id_ = table_->GetFirstPageId();
+    primary_->transaction_manager_->Commit(txn);
+    delete txn;
+  }
+
+  /** Insert count tuples into the table on the primary in one transaction, committing it if commit is set. */
+  std::vector<RID> InsertTuples(int count, bool commit = true) {
+    Transaction *txn = primary_->transaction_manager_->Begin();
+    std::vector<RID> rids(count);
+    for (auto &rid : rids) {
+      EXPECT_TRUE(table_->InsertTuple(ConstructTuple(&schema_), &rid, txn));
+    }
+    if (commit) {
+      primary_->transaction_manager_->Commit(txn);
+      delete txn;
+    } else {
+      loser_ = txn;
+    }
+    return rids;
+  }
+
+  /** Wait until the standby has redone everything the primary made persistent. */
+  void WaitForStandby() {
+    lsn_t persistent_lsn = primary_->log_manager_->GetPersistentLSN();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (standby_manager_->GetStats().applied_lsn_ < persistent_lsn && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_GE(standby_manager_->GetStats().applied_lsn_, persistent_lsn);
+  }
+
+  /** Read the whole table through the standby's buffer pool, the way a read-only query does. */
+  std::vector<std::string> ScanStandby() {
+    TableHeap table(standby_->buffer_pool_manager_, standby_->lock_manager_, nullptr, first_page_id_);
+    return Scan(&table, standby_->lock_manager_);
+  }
+
+  std::vector<std::string> ScanPrimary() { return Scan(table_.get(), primary_->lock_manager_); }
+
+  std::vector<std::string> Scan(TableHeap *table, LockManager *lock_manager) {
+    Transaction txn(0);
+    std::vector<std::string> content;
+    for (auto it = table->Begin(&txn); it != table->End(); ++it) {
+      content.push_back(it->GetRid().ToString() + it->ToString(&schema_));
+    }
+    std::vector<RID> locked(txn.GetSharedLockSet()->begin(), txn.GetSharedLockSet()->end());
+    for (const RID &rid : locked) {
+      lock_manager->Unlock(&txn, rid);
+    }
+    return content;
+  }
+
+  BustubInstance *primary_;
+  BustubInstance *standby_;
+  StandbyManager *standby_manager_;
+  std::unique_ptr<TableHeap> table_;
+  page_id_t first_page_id_{INVALID_PAGE_ID};
+  Transaction *loser_{nullptr};
+  Schema schema_{std::vector<Column>{{"a", TypeId::VARCHAR, 20}, {"b", TypeId::SMALLINT}}};
+};
+
+// NOLINTNEXTLINE
+TEST_F(StandbyManagerTest, ContinuousRedoServesReadOnlyQueries) {
+  const int num_txns = 30;
+  const int inserts_per_txn = 50;
+  CreateTable();
+  standby_manager_->SetReplayInterval(std::chrono::milliseconds(2));
+  standby_manager_->RunReplayThread();
+  WaitForStandby();
+
+  // Queries run on the standby while it applies the primary's inserts; with inserts only, nothing ever disappears.
+  std::atomic<bool> done{false};
+  size_t scans = 0;
+  size_t last_size = 0;
+  std::thread reader([&] {
+    while (!done) {
+      size_t size = ScanStandby().size();
+      EXPECT_GE(size, last_size);
+      last_size = size;
+      scans++;
+    }
+  });
+  for (int i = 0; i < num_txns; i++) {
+    InsertTuples(inserts_per_txn);
+  }
+  WaitForStandby();
+  done = true;
+  reader.join();
+
+  std::vector<std::string> content = ScanStandby();
+  EXPECT_EQ(content.size(), static_cast<size_t>(num_txns * inserts_per_txn));
+  EXPECT_EQ(content, ScanPrimary());
+  StandbyStats stats = standby_manager_->GetStats();
+  LOG_INFO("shipped %d records, %d bytes, %d scans on the standby", static_cast<int>(stats.records_shipped_),
+           static_cast<int>(stats.bytes_shipped_), static_cast<int>(scans));
+  EXPECT_FALSE(stats.promoted_);
+}
+
+/*
+ * After a crash of the primary, promoting the standby applies only the records it had not seen yet and rolls back the
+ * transaction that was in flight. Full recovery of the primary's own files has to replay the whole log.
+ */
+// NOLINTNEXTLINE
+TEST_F(StandbyManagerTest, PromoteReplaysOnlyTheTail) {
+  const int num_txns = 40;
+  const int inserts_per_txn = 50;
+  CreateTable();
+  standby_manager_->RunReplayThread();
+  for (int i = 0; i < num_txns; i++) {
+    InsertTuples(inserts_per_txn);
+  }
+  WaitForStandby();
+  standby_manager_->StopReplayThread();
+
+  std::vector<RID> last_committed = InsertTuples(5);
+  std::vector<std::string> committed_content = ScanPrimary();
+  std::vector<RID> uncommitted = InsertTuples(5, false);
+  primary_->log_manager_->WaitUntilPersistent(primary_->log_manager_->GetNextLSN() - 1);
+
+  LOG_INFO("Primary crash");
+  delete loser_;
+  table_.reset();
+  delete primary_;
+  primary_ = nullptr;
+
+  standby_manager_->Promote();
+  StandbyStats stats = standby_manager_->GetStats();
+  EXPECT_TRUE(stats.promoted_);
+  // BEGIN, inserts and COMMIT of the last transaction and the loser, and maybe a new table page.
+  EXPECT_GE(stats.promotion_records_, 5U + 2 + 5 + 1);
+  EXPECT_LE(stats.promotion_records_, 5U + 2 + 5 + 1 + 2);
+  EXPECT_EQ(standby_->log_manager_->GetNextLSN(), stats.applied_lsn_ + 1);
+  std::vector<std::string> content = ScanStandby();
+  EXPECT_EQ(content, committed_content);
+  TableHeap standby_table(standby_->buffer_pool_manager_, standby_->lock_manager_, nullptr, first_page_id_);
+  Transaction txn(0);
+  Tuple tuple;
+  EXPECT_TRUE(standby_table.GetTuple(last_committed[0], &tuple, &txn));
+  EXPECT_FALSE(standby_table.GetTuple(uncommitted[0], &tuple, &txn));
+
+  // The same failover by recovering the crashed primary's files.
+  auto *recovered = new BustubInstance("test.db");
+  auto *log_recovery = new LogRecovery(recovered->disk_manager_, recovered->buffer_pool_manager_);
+  auto start = std::chrono::steady_clock::now();
+  log_recovery->Redo();
+  log_recovery->Undo();
+  std::chrono::duration<double, std::milli> recovery_time = std::chrono::steady_clock::now() - start;
+  LOG_INFO("promotion replayed %d of %d records in %dms, full recovery took %.2fms",
+           static_cast<int>(stats.promotion_records_), static_cast<int>(stats.records_shipped_),
+           static_cast<int>(stats.promotion_duration_.count()), recovery_time.count());
+  delete log_recovery;
+  primary_ = recovered;
+}
+
+}  // namespace bustub
@@ -10,12 +10,17 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdio>
 #include <functional>
+#include <mutex>  // NOLINT
+#include <random>
+#include <shared_mutex>
 #include <thread>  // NOLINT
 
 #include "buffer/buffer_pool_manager_instance.h"
+#include "common/logger.h"
 #include "gtest/gtest.h"
 #include "storage/index/b_plus_tree.h"
 #include "test_util.h"  // NOLINT
@@ -100,7 +105,7 @@ void DeleteHelperSplit(BPlusTree<GenericKey<8>, RID, GenericComparator<8>> *tree
   delete transaction;
 }
 
-TEST(BPlusTreeConcurrentTest, DISABLED_InsertTest1) {
+TEST(BPlusTreeConcurrentTest, InsertTest1) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
@@ -152,7 +157,7 @@ TEST(BPlusTreeConcurrentTest, DISABLED_InsertTest1) {
   remove("test.log");
 }
 
-TEST(BPlusTreeConcurrentTest, DISABLED_InsertTest2) {
+TEST(BPlusTreeConcurrentTest, InsertTest2) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
@@ -203,7 +208,7 @@ TEST(BPlusTreeConcurrentTest, DISABLED_InsertTest2) {
   remove("test.log");
 }
 
-TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest1) {
+TEST(BPlusTreeConcurrentTest, DeleteTest1) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
@@ -245,7 +250,7 @@ TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest1) {
   remove("test.log");
 }
 
-TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest2) {
+TEST(BPlusTreeConcurrentTest, DeleteTest2) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
@@ -288,7 +293,7 @@ TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest2) {
   remove("test.log");
 }
 
-TEST(BPlusTreeConcurrentTest, DISABLED_MixTest) {
+TEST(BPlusTreeConcurrentTest, MixTest) {
   // create KeyComparator and index schema
   auto key_schema = ParseCreateStatement("a bigint");
   GenericComparator<8> comparator(key_schema.get());
@@ -333,4 +338,167 @@ TEST(BPlusTreeConcurrentTest, DISABLED_MixTest) {
   remove("test.log");
 }
 
+/*
+ * With pages of a few entries nearly every insert and remove splits or merges. Each thread inserts keys of its own and
+ * removes every other one again, checking what it finds on the way, while the others reshape the tree around it and a
+ * reader keeps scanning it.
+ */
+TEST(BPlusTreeConcurrentTest, SplitAndMergeStressTest) {
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManagerInstance(100, disk_manager);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator, 3, 4);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(&page_id);
+  (void)header_page;
+
+  const int num_threads = 4;
+  const int64_t keys_per_thread = 500;
+  std::atomic<int> writers_left{num_threads};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t] {
+      GenericKey<8> index_key;
+      std::vector<RID> rids;
+      for (int64_t i = 0; i < keys_per_thread; i++) {
+        int64_t key = i * num_threads + t;
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(tree.Insert(index_key, RID(key)));
+        EXPECT_FALSE(tree.Insert(index_key, RID(key)));
+      }
+      for (int64_t i = 0; i < keys_per_thread; i += 2) {
+        index_key.SetFromInteger(i * num_threads + t);
+        tree.Remove(index_key);
+      }
+      for (int64_t i = 0; i < keys_per_thread; i++) {
+        int64_t key = i * num_threads + t;
+        index_key.SetFromInteger(key);
+        rids.clear();
+        EXPECT_EQ(tree.GetValue(index_key, &rids), i % 2 == 1);
+        if (i % 2 == 1) {
+          EXPECT_EQ(rids[0].GetSlotNum(), key);
+        }
+      }
+      writers_left--;
+    });
+  }
+  threads.emplace_back([&] {
+    while (writers_left > 0) {
+      int64_t previous = -1;
+      for (auto iterator = tree.Begin(); iterator != tree.End(); ++iterator) {
+        int64_t key = (*iterator).second.GetSlotNum();
+        EXPECT_LT(previous, key);
+        previous = key;
+      }
+    }
+  });
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  int64_t previous = -1;
+  int64_t size = 0;
+  for (auto iterator = tree.Begin(); iterator != tree.End(); ++iterator) {
+    int64_t key = (*iterator).second.GetSlotNum();
+    EXPECT_EQ(key / num_threads % 2, 1);
+    EXPECT_LT(previous, key);
+    previous = key;
+    size++;
+  }
+  EXPECT_EQ(size, keys_per_thread / 2 * num_threads);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * Throughput of 80% lookups, 10% inserts and 10% removes of random keys on a tree of about 20000 keys, once with latch
+ * crabbing and once with every call serialized on one reader-writer latch around the tree, as it used to be.
+ */
+TEST(BPlusTreeConcurrentTest, MixedReadWriteScalingBenchmark) {
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManagerInstance(500, disk_manager);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(&page_id);
+  (void)header_page;
+
+  // Every other key is in the tree, and inserts and removes hit the whole range, so the size stays where it is.
+  const int64_t key_range = 40000;
+  const int ops_per_thread = 10000;
+  std::vector<int64_t> keys;
+  for (int64_t key = 0; key < key_range; key += 2) {
+    keys.push_back(key);
+  }
+  InsertHelper(&tree, keys);
+
+  std::shared_mutex tree_latch;
+  for (bool coarse : {true, false}) {
+    for (int num_threads : {1, 2, 4, 8}) {
+      auto task = [&](int thread) {
+        std::mt19937 gen(thread);
+        std::uniform_int_distribution<int64_t> key_dist(0, key_range - 1);
+        std::uniform_int_distribution<int> op_dist(0, 9);
+        GenericKey<8> index_key;
+        std::vector<RID> rids;
+        for (int i = 0; i < ops_per_thread; i++) {
+          int64_t key = key_dist(gen);
+          int op = op_dist(gen);
+          index_key.SetFromInteger(key);
+          if (op < 8) {
+            rids.clear();
+            std::shared_lock lock(tree_latch, std::defer_lock);
+            if (coarse) {
+              lock.lock();
+            }
+            tree.GetValue(index_key, &rids);
+          } else {
+            std::unique_lock lock(tree_latch, std::defer_lock);
+            if (coarse) {
+              lock.lock();
+            }
+            if (op == 8) {
+              tree.Insert(index_key, RID(key));
+            } else {
+              tree.Remove(index_key);
+            }
+          }
+        }
+      };
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(task, i);
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      LOG_INFO("%s threads=%d %.0f ops/s", coarse ? "tree latch" : "crabbing", num_threads,
+               static_cast<double>(num_threads) * ops_per_thread / elapsed.count());
+    }
+  }
+
+  int64_t previous = -1;
+  for (auto iterator = tree.Begin(); iterator != tree.End(); ++iterator) {
+    int64_t key = (*iterator).second.GetSlotNum();
+    EXPECT_LT(previous, key);
+    previous = key;
+  }
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
 }  // namespace bustub
@@ -10,11 +10,21 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <chrono>  // NOLINT
 #include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "buffer/buffer_pool_manager_instance.h"
+#include "common/bustub_instance.h"
 #include "common/exception.h"
+#include "common/logger.h"
 #include "gtest/gtest.h"
+#include "logging/common.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/table/table_heap.h"
 
 namespace bustub {
 
@@ -24,12 +34,17 @@ class DiskManagerTest : public ::testing::Test {
   void SetUp() override {
     remove("test.db");
     remove("test.log");
+    remove("test.dwb");
   }
 
   // This function is called after every test.
   void TearDown() override {
     remove("test.db");
     remove("test.log");
+    remove("test.dwb");
+    for (int i = 1; i < 10; i++) {
+      remove(("test.log." + std::to_string(i)).c_str());
+    }
   };
 };
 
@@ -72,7 +87,197 @@ TEST_F(DiskManagerTest, ReadWriteLogTest) {
   dm.ShutDown();
 }
 
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, LogSegmentTest) {
+  const int chunk_size = LOG_BUFFER_SIZE / 2;
+  std::vector<char> chunks[2] = {std::vector<char>(chunk_size), std::vector<char>(chunk_size)};
+  std::vector<char> buf(chunk_size);
+  std::string db_file("test.db");
+  auto *dm = new DiskManager(db_file);
+  // Room for exactly two chunks per segment.
+  dm->SetLogSegmentSize(LOG_SEGMENT_HEADER_SIZE + 2 * chunk_size);
+
+  // Alternate buffers like the log manager does, tagging every chunk with its index.
+  for (int i = 0; i < 5; i++) {
+    std::memset(chunks[i % 2].data(), 'a' + i, chunk_size);
+    dm->WriteLog(chunks[i % 2].data(), chunk_size, i * 100);
+  }
+  EXPECT_EQ(dm->GetNumLogSegments(), 3);
+  EXPECT_EQ(dm->GetLogStartOffset(), 0);
+
+  // Offsets are logical and continue across segments.
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(dm->ReadLog(buf.data(), chunk_size, i * chunk_size));
+    EXPECT_EQ(buf[0], 'a' + i);
+    EXPECT_EQ(buf[chunk_size - 1], 'a' + i);
+  }
+  // A read stops at the end of its segment.
+  ASSERT_TRUE(dm->ReadLog(buf.data(), chunk_size, chunk_size + chunk_size / 2));
+  EXPECT_EQ(buf[0], 'b');
+  EXPECT_EQ(buf[chunk_size - 1], 0);
+  EXPECT_FALSE(dm->ReadLog(buf.data(), chunk_size, 5 * chunk_size));
+  dm->ShutDown();
+  delete dm;
+
+  // Reopening finds all segments again, then truncation drops everything before the new segment.
+  dm = new DiskManager(db_file);
+  EXPECT_EQ(dm->GetNumLogSegments(), 3);
+  ASSERT_TRUE(dm->ReadLog(buf.data(), chunk_size, 3 * chunk_size));
+  EXPECT_EQ(buf[0], 'd');
+  int start_offset = dm->StartLogSegment(500);
+  EXPECT_EQ(start_offset, 5 * chunk_size);
+  dm->RemoveLogSegmentsBefore(start_offset);
+  EXPECT_EQ(dm->GetNumLogSegments(), 1);
+  EXPECT_EQ(dm->GetLogStartOffset(), start_offset);
+  EXPECT_EQ(dm->GetLogStartLSN(), 500);
+  EXPECT_FALSE(dm->ReadLog(buf.data(), chunk_size, 0));
+
+  std::memset(chunks[1].data(), 'f', chunk_size);
+  dm->WriteLog(chunks[1].data(), chunk_size, 500);
+  dm->ShutDown();
+  delete dm;
+
+  dm = new DiskManager(db_file);
+  EXPECT_EQ(dm->GetNumLogSegments(), 1);
+  EXPECT_EQ(dm->GetLogStartLSN(), 500);
+  ASSERT_TRUE(dm->ReadLog(buf.data(), chunk_size, start_offset));
+  EXPECT_EQ(buf[0], 'f');
+  dm->ShutDown();
+  delete dm;
+}
+
 // NOLINTNEXTLINE
 TEST_F(DiskManagerTest, ThrowBadFileTest) { EXPECT_THROW(DiskManager("dev/null\\/foo/bar/baz/test.db"), Exception); }
 
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, DoubleWriteRepairTest) {
+  std::vector<std::vector<char>> pages(4, std::vector<char>(PAGE_SIZE));
+  std::vector<std::pair<page_id_t, const char *>> batch;
+  for (page_id_t page_id = 0; page_id < 4; page_id++) {
+    snprintf(pages[page_id].data(), PAGE_SIZE, "page %d", page_id);
+    memset(pages[page_id].data() + PAGE_SIZE / 2, 'a' + page_id, PAGE_SIZE / 2);
+    batch.emplace_back(page_id, pages[page_id].data());
+  }
+  auto *dm = new DiskManager("test.db");
+  dm->SetDoubleWrite(true);
+  dm->WritePages(batch);
+  EXPECT_EQ(dm->GetNumWrites(), 4);
+  EXPECT_EQ(dm->GetNumDoubleWrites(), 4);
+  dm->ShutDown();
+  delete dm;
+
+  // Crash in the middle of the in-place write of page 2: only its first half made it.
+  std::vector<char> torn(PAGE_SIZE / 2, 'x');
+  std::fstream db_io("test.db", std::ios::binary | std::ios::in | std::ios::out);
+  db_io.seekp(2 * PAGE_SIZE + PAGE_SIZE / 2);
+  db_io.write(torn.data(), torn.size());
+  db_io.close();
+
+  dm = new DiskManager("test.db");
+  EXPECT_EQ(dm->RepairTornPages(), 4);
+  std::vector<char> buf(PAGE_SIZE);
+  for (page_id_t page_id = 0; page_id < 4; page_id++) {
+    dm->ReadPage(page_id, buf.data());
+    EXPECT_EQ(memcmp(buf.data(), pages[page_id].data(), PAGE_SIZE), 0);
+  }
+  // The batch is used up.
+  EXPECT_EQ(dm->RepairTornPages(), 0);
+
+  // A batch torn on its way into the double-write file is ignored, its pages were never written in place.
+  dm->SetDoubleWrite(true);
+  dm->WritePage(1, pages[3].data());
+  dm->ShutDown();
+  delete dm;
+  std::fstream double_write_io("test.dwb", std::ios::binary | std::ios::in | std::ios::out);
+  double_write_io.seekp(DOUBLE_WRITE_HEADER_SIZE + sizeof(page_id_t) + PAGE_SIZE / 2);
+  double_write_io.write(torn.data(), torn.size());
+  double_write_io.close();
+  dm = new DiskManager("test.db");
+  EXPECT_EQ(dm->RepairTornPages(), 0);
+  dm->ReadPage(1, buf.data());
+  EXPECT_EQ(memcmp(buf.data(), pages[3].data(), PAGE_SIZE), 0);
+  dm->ShutDown();
+  delete dm;
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, DoubleWriteFailureTest) {
+  auto *dm = new DiskManager("test.db");
+  dm->SetDoubleWrite(true);
+  auto *bpm = new BufferPoolManagerInstance(1, dm);
+  page_id_t page_id;
+  Page *page = bpm->NewPage(&page_id);
+  snprintf(page->GetData(), PAGE_SIZE, "hello");
+  bpm->UnpinPage(page_id, true);
+
+  // The double-write file cannot be synced any more, so nothing is written in place and the page stays dirty.
+  remove("test.dwb");
+  EXPECT_FALSE(dm->WritePage(page_id, page->GetData()));
+  bpm->FlushAllPages();
+  EXPECT_TRUE(page->IsDirty());
+  EXPECT_FALSE(bpm->FlushPage(page_id));
+  EXPECT_TRUE(page->IsDirty());
+  page_id_t other_page_id;
+  EXPECT_EQ(bpm->NewPage(&other_page_id), nullptr);
+  EXPECT_EQ(dm->GetNumWrites(), 0);
+
+  dm->SetDoubleWrite(false);
+  dm->SetDoubleWrite(true);
+  EXPECT_TRUE(bpm->FlushPage(page_id));
+  EXPECT_FALSE(page->IsDirty());
+  std::vector<char> buf(PAGE_SIZE);
+  dm->ReadPage(page_id, buf.data());
+  EXPECT_STREQ(buf.data(), "hello");
+
+  delete bpm;
+  dm->ShutDown();
+  delete dm;
+}
+
+/*
+ * The insert workload of the group commit benchmark, with and without the double-write buffer. With BUFFER_POOL_SIZE
+ * frames most pages are written by evictions, one page at a time, and each of those syncs both the double-write file
+ * and the db file. Only the final flush is written in batches.
+ */
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, DoubleWriteAmplificationBenchmark) {
+  const int num_tuples = 5000;
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::SMALLINT};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+
+  for (bool double_write : {false, true}) {
+    remove("test.db");
+    remove("test.log");
+    remove("test.dwb");
+    auto *bustub_instance = new BustubInstance("test.db");
+    bustub_instance->disk_manager_->SetDoubleWrite(double_write);
+    bustub_instance->log_manager_->RunFlushThread();
+
+    auto start = std::chrono::steady_clock::now();
+    Transaction *txn = bustub_instance->transaction_manager_->Begin();
+    auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                     bustub_instance->log_manager_, txn);
+    for (int i = 0; i < num_tuples; i++) {
+      RID rid;
+      ASSERT_TRUE(test_table->InsertTuple(ConstructTuple(&schema), &rid, txn));
+    }
+    bustub_instance->transaction_manager_->Commit(txn);
+    bustub_instance->buffer_pool_manager_->FlushAllPages();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    int writes = bustub_instance->disk_manager_->GetNumWrites();
+    int double_writes = bustub_instance->disk_manager_->GetNumDoubleWrites();
+    LOG_INFO("double_write=%d inserts=%d time=%.2fms page writes=%d double writes=%d write amplification=%.2f",
+             double_write, num_tuples, elapsed.count(), writes, double_writes,
+             static_cast<double>(writes + double_writes) / writes);
+    EXPECT_EQ(double_writes, double_write ? writes : 0);
+
+    delete txn;
+    delete test_table;
+    delete bustub_instance;
+  }
+}
+
 }  // namespace bustub